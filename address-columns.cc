@@ -0,0 +1,153 @@
+/**
+ * @file address-columns.cc
+ * @brief Struct-of-arrays decoding of WINDIVERT_ADDRESS batches
+ */
+
+#include <cstring>
+#include "address-columns.h"
+
+/**
+ * @brief Bytes per packet of each column
+ */
+static const uint8_t kColumnWidth[ADDR_COL_COUNT] = {
+	8, 8, 8,    // timestamp, endpointId, parentEndpointId
+	4, 4, 4,    // ifIdx, subIfIdx, processId
+	16, 16,     // localAddr, remoteAddr
+	2, 2, 2,    // localPort, remotePort, priority
+	1, 1, 1, 1  // layer, event, flags, protocol
+};
+
+/**
+ * @brief Returns true if a column exists for a kind
+ */
+static bool HasColumn(AddressKind kind, int column)
+{
+	switch (column)
+	{
+		case ADDR_COL_TIMESTAMP:
+		case ADDR_COL_PROCESS_ID:
+		case ADDR_COL_LAYER:
+		case ADDR_COL_EVENT:
+		case ADDR_COL_FLAGS:
+			return true;
+		case ADDR_COL_IF_IDX:
+		case ADDR_COL_SUB_IF_IDX:
+			return kind == ADDR_KIND_NETWORK;
+		case ADDR_COL_PRIORITY:
+			return kind == ADDR_KIND_REFLECT;
+		default:
+			return kind == ADDR_KIND_FLOW;
+	}
+}
+
+AddressColumnsLayout::AddressColumnsLayout(uint32_t count, AddressKind kind) : count(count), kind(kind)
+{
+	size_t offset = ADDR_COLUMNS_HEADER_BYTES;
+	for (int column = 0; column < ADDR_COL_COUNT; column++)
+	{
+		if (!HasColumn(kind, column))
+		{
+			offsets[column] = 0;
+			continue;
+		}
+		offsets[column] = offset;
+		offset = (offset + static_cast<size_t>(count) * kColumnWidth[column] + 7) & ~static_cast<size_t>(7);
+	}
+	byteLength = offset;
+}
+
+AddressKind AddressKindForLayer(WINDIVERT_LAYER layer)
+{
+	switch (layer)
+	{
+		case WINDIVERT_LAYER_FLOW:
+		case WINDIVERT_LAYER_SOCKET:
+			return ADDR_KIND_FLOW;
+		case WINDIVERT_LAYER_REFLECT:
+			return ADDR_KIND_REFLECT;
+		default:
+			return ADDR_KIND_NETWORK;
+	}
+}
+
+/**
+ * @brief Returns a typed pointer to a column
+ */
+template <typename T>
+static T *Column(uint8_t *out, const AddressColumnsLayout &layout, int column)
+{
+	return reinterpret_cast<T *>(out + layout.offsets[column]);
+}
+
+void DecodeAddressColumns(const WINDIVERT_ADDRESS *addrs, const AddressColumnsLayout &layout, uint8_t *out)
+{
+	uint32_t *header = reinterpret_cast<uint32_t *>(out);
+	header[0] = layout.count;
+	header[1] = static_cast<uint32_t>(layout.kind);
+	header[2] = 0;
+	header[3] = 0;
+
+	int64_t *timestamp = Column<int64_t>(out, layout, ADDR_COL_TIMESTAMP);
+	uint8_t *layer = Column<uint8_t>(out, layout, ADDR_COL_LAYER);
+	uint8_t *event = Column<uint8_t>(out, layout, ADDR_COL_EVENT);
+	uint8_t *flags = Column<uint8_t>(out, layout, ADDR_COL_FLAGS);
+	for (uint32_t i = 0; i < layout.count; i++)
+	{
+		const WINDIVERT_ADDRESS &addr = addrs[i];
+		timestamp[i] = addr.Timestamp;
+		layer[i] = static_cast<uint8_t>(addr.Layer);
+		event[i] = static_cast<uint8_t>(addr.Event);
+		flags[i] = static_cast<uint8_t>(
+			(addr.Sniffed ? ADDR_FLAG_SNIFFED : 0) | (addr.Outbound ? ADDR_FLAG_OUTBOUND : 0) |
+			(addr.Loopback ? ADDR_FLAG_LOOPBACK : 0) | (addr.Impostor ? ADDR_FLAG_IMPOSTOR : 0) |
+			(addr.IPv6 ? ADDR_FLAG_IPV6 : 0) | (addr.IPChecksum ? ADDR_FLAG_IP_CHECKSUM : 0) |
+			(addr.TCPChecksum ? ADDR_FLAG_TCP_CHECKSUM : 0) | (addr.UDPChecksum ? ADDR_FLAG_UDP_CHECKSUM : 0));
+	}
+
+	if (layout.kind == ADDR_KIND_NETWORK)
+	{
+		uint32_t *ifIdx = Column<uint32_t>(out, layout, ADDR_COL_IF_IDX);
+		uint32_t *subIfIdx = Column<uint32_t>(out, layout, ADDR_COL_SUB_IF_IDX);
+		uint32_t *processId = Column<uint32_t>(out, layout, ADDR_COL_PROCESS_ID);
+		for (uint32_t i = 0; i < layout.count; i++)
+		{
+			ifIdx[i] = addrs[i].Network.IfIdx;
+			subIfIdx[i] = addrs[i].Network.SubIfIdx;
+			processId[i] = 0;
+		}
+	}
+	else if (layout.kind == ADDR_KIND_FLOW)
+	{
+		// WINDIVERT_DATA_SOCKET has the same layout as WINDIVERT_DATA_FLOW.
+		uint64_t *endpointId = Column<uint64_t>(out, layout, ADDR_COL_ENDPOINT_ID);
+		uint64_t *parentEndpointId = Column<uint64_t>(out, layout, ADDR_COL_PARENT_ENDPOINT_ID);
+		uint32_t *processId = Column<uint32_t>(out, layout, ADDR_COL_PROCESS_ID);
+		uint32_t *localAddr = Column<uint32_t>(out, layout, ADDR_COL_LOCAL_ADDR);
+		uint32_t *remoteAddr = Column<uint32_t>(out, layout, ADDR_COL_REMOTE_ADDR);
+		uint16_t *localPort = Column<uint16_t>(out, layout, ADDR_COL_LOCAL_PORT);
+		uint16_t *remotePort = Column<uint16_t>(out, layout, ADDR_COL_REMOTE_PORT);
+		uint8_t *protocol = Column<uint8_t>(out, layout, ADDR_COL_PROTOCOL);
+		for (uint32_t i = 0; i < layout.count; i++)
+		{
+			const WINDIVERT_DATA_FLOW &flow = addrs[i].Flow;
+			endpointId[i] = flow.EndpointId;
+			parentEndpointId[i] = flow.ParentEndpointId;
+			processId[i] = flow.ProcessId;
+			std::memcpy(localAddr + i * 4, flow.LocalAddr, sizeof(flow.LocalAddr));
+			std::memcpy(remoteAddr + i * 4, flow.RemoteAddr, sizeof(flow.RemoteAddr));
+			localPort[i] = flow.LocalPort;
+			remotePort[i] = flow.RemotePort;
+			protocol[i] = flow.Protocol;
+		}
+	}
+	else
+	{
+		uint32_t *processId = Column<uint32_t>(out, layout, ADDR_COL_PROCESS_ID);
+		int16_t *priority = Column<int16_t>(out, layout, ADDR_COL_PRIORITY);
+		for (uint32_t i = 0; i < layout.count; i++)
+		{
+			processId[i] = addrs[i].Reflect.ProcessId;
+			priority[i] = addrs[i].Reflect.Priority;
+		}
+	}
+}
@@ -0,0 +1,88 @@
+/**
+ * @file address-columns.h
+ * @brief Struct-of-arrays decoding of WINDIVERT_ADDRESS batches
+ *
+ * A batch of addresses is decoded into one buffer holding a small header followed by
+ * one column per field. Each column starts on an 8 byte boundary so JavaScript can view
+ * it with the matching typed array. Which columns exist depends on the layer kind; the
+ * layout must match addressColumnsLayout in decoders.js.
+ */
+
+#ifndef ADDRESS_COLUMNS_H_
+#define ADDRESS_COLUMNS_H_
+
+#include <cstdint>
+#include <cstddef>
+#include "windivert.h"
+
+#define ADDR_COLUMNS_HEADER_BYTES 16   ///< Uint32 count, Uint32 kind, reserved
+
+#define ADDR_FLAG_SNIFFED       0x01
+#define ADDR_FLAG_OUTBOUND      0x02
+#define ADDR_FLAG_LOOPBACK      0x04
+#define ADDR_FLAG_IMPOSTOR      0x08
+#define ADDR_FLAG_IPV6          0x10
+#define ADDR_FLAG_IP_CHECKSUM   0x20
+#define ADDR_FLAG_TCP_CHECKSUM  0x40
+#define ADDR_FLAG_UDP_CHECKSUM  0x80
+
+/**
+ * @enum AddressKind
+ * @brief Which union member of WINDIVERT_ADDRESS a batch carries
+ */
+enum AddressKind {
+	ADDR_KIND_NETWORK = 0,   ///< NETWORK and NETWORK_FORWARD layers
+	ADDR_KIND_FLOW = 1,      ///< FLOW and SOCKET layers
+	ADDR_KIND_REFLECT = 2    ///< REFLECT layer
+};
+
+/**
+ * @enum AddressColumn
+ * @brief Column identifiers, in layout order
+ */
+enum AddressColumn {
+	ADDR_COL_TIMESTAMP = 0,          ///< BigInt64, all kinds
+	ADDR_COL_ENDPOINT_ID,            ///< BigUint64, flow
+	ADDR_COL_PARENT_ENDPOINT_ID,     ///< BigUint64, flow
+	ADDR_COL_IF_IDX,                 ///< Uint32, network
+	ADDR_COL_SUB_IF_IDX,             ///< Uint32, network
+	ADDR_COL_PROCESS_ID,             ///< Uint32, all kinds; for network filled from a joined FlowIndex
+	ADDR_COL_LOCAL_ADDR,             ///< 4 x Uint32 per packet, flow
+	ADDR_COL_REMOTE_ADDR,            ///< 4 x Uint32 per packet, flow
+	ADDR_COL_LOCAL_PORT,             ///< Uint16, flow
+	ADDR_COL_REMOTE_PORT,            ///< Uint16, flow
+	ADDR_COL_PRIORITY,               ///< Int16, reflect
+	ADDR_COL_LAYER,                  ///< Uint8, all kinds
+	ADDR_COL_EVENT,                  ///< Uint8, all kinds
+	ADDR_COL_FLAGS,                  ///< Uint8 ADDR_FLAG_* bits, all kinds
+	ADDR_COL_PROTOCOL,               ///< Uint8, flow
+	ADDR_COL_COUNT
+};
+
+/**
+ * @struct AddressColumnsLayout
+ * @brief Byte offsets of the columns of one decoded batch, 0 for absent columns
+ */
+struct AddressColumnsLayout {
+	uint32_t count;                      ///< Addresses in the batch
+	AddressKind kind;                    ///< Layer kind
+	size_t offsets[ADDR_COL_COUNT];      ///< Column offsets
+	size_t byteLength;                   ///< Total buffer size
+
+	AddressColumnsLayout(uint32_t count, AddressKind kind);
+};
+
+/**
+ * @brief Maps a WINDIVERT_LAYER to the address kind of its batches
+ */
+AddressKind AddressKindForLayer(WINDIVERT_LAYER layer);
+
+/**
+ * @brief Decodes a batch of addresses into columns
+ * @param addrs Addresses to decode
+ * @param layout Layout created for the batch, layout.count addresses are read
+ * @param out Buffer of layout.byteLength bytes, 8 byte aligned
+ */
+void DecodeAddressColumns(const WINDIVERT_ADDRESS *addrs, const AddressColumnsLayout &layout, uint8_t *out);
+
+#endif
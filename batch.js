@@ -0,0 +1,174 @@
+/**
+ * @module batch
+ * @description Batched packet reception: PacketBatch views plus async iterator and Readable stream consumers
+ */
+
+const { Readable } = require('stream');
+const { AddressColumns } = require('./decoders.js');
+
+/**
+ * @constant {number} ADDRESS_SIZE
+ * @description Size in bytes of one WINDIVERT_ADDRESS entry in a batch address buffer
+ */
+const ADDRESS_SIZE = 80;
+
+/**
+ * Class wrapping one batch returned by the native batched receiver.
+ * Packets are stored back to back in a single buffer; packet(i) and addr(i) return views, not copies.
+ */
+class PacketBatch {
+	/**
+	 * Creates a new PacketBatch
+	 * @param {Buffer} data - Concatenated packet data
+	 * @param {Buffer} addrs - Concatenated WINDIVERT_ADDRESS entries
+	 * @param {Uint32Array} offsets - Packet boundaries into data (count + 1 entries)
+	 * @param {ArrayBuffer} [columns] - Addresses decoded natively into columns
+	 */
+	constructor(data, addrs, offsets, columns) {
+		this.data = data;
+		this.addrs = addrs;
+		this.offsets = offsets;
+		this.count = offsets.length - 1;
+		this.columnsBuffer = columns;
+		this.addressColumns = null;
+	}
+
+	/**
+	 * Struct-of-arrays view of the batch's addresses, created on first use
+	 * @returns {AddressColumns|null} null if the receiver did not decode the addresses
+	 */
+	get columns() {
+		if (this.addressColumns === null && this.columnsBuffer) {
+			this.addressColumns = new AddressColumns(this.columnsBuffer);
+		}
+		return this.addressColumns;
+	}
+
+	/**
+	 * Returns a view of the packet at the given index
+	 * @param {number} index - Packet index
+	 * @returns {Buffer} Packet data
+	 */
+	packet(index) {
+		return this.data.subarray(this.offsets[index], this.offsets[index + 1]);
+	}
+
+	/**
+	 * Returns a view of the address at the given index
+	 * @param {number} index - Packet index
+	 * @returns {Buffer} WINDIVERT_ADDRESS data
+	 */
+	addr(index) {
+		return this.addrs.subarray(index * ADDRESS_SIZE, (index + 1) * ADDRESS_SIZE);
+	}
+
+	/**
+	 * Iterates over the packets of the batch
+	 * @yields {{packet: Buffer, addr: Buffer}}
+	 */
+	*[Symbol.iterator]() {
+		for (let i = 0; i < this.count; i++) {
+			yield { packet: this.packet(i), addr: this.addr(i) };
+		}
+	}
+}
+
+/**
+ * @function packets
+ * @description Starts batched reception on a handle and returns an async iterator of PacketBatch objects.
+ * At most highWaterMark batches are read from the driver ahead of the consumer; when the consumer
+ * stops pulling or breaks out of the loop, the native receiver stops reading and packets stay
+ * queued in the driver.
+ * @param {Object} handle - Opened WinDivert handle
+ * @param {Object} [options]
+ * @param {number} [options.batchSize=64] - Maximum packets per batch (1-255)
+ * @param {number} [options.highWaterMark=4] - Maximum batches received but not yet consumed
+ * @returns {AsyncIterableIterator<PacketBatch>}
+ */
+function packets(handle, { batchSize = 64, highWaterMark = 4 } = {}) {
+	const queue = [];
+	let waiting = null;
+	let ended = false;
+	let returned = false;
+
+	handle.recvBatch((data, addrs, offsets, columns) => {
+		if (data === null) {
+			ended = true;
+		} else if (!returned) {
+			queue.push(new PacketBatch(data, addrs, offsets, columns));
+		}
+		if (waiting) {
+			const resolve = waiting;
+			waiting = null;
+			resolve(next());
+		}
+	}, batchSize, highWaterMark);
+
+	function next() {
+		if (queue.length > 0) {
+			// The consumed batch frees a slot, let the receiver read one more.
+			handle.credit(1);
+			return { value: queue.shift(), done: false };
+		}
+		if (ended || returned) {
+			return { value: undefined, done: true };
+		}
+		return null;
+	}
+
+	return {
+		next() {
+			const result = next();
+			if (result) {
+				return Promise.resolve(result);
+			}
+			return new Promise((resolve) => {
+				waiting = resolve;
+			});
+		},
+		return() {
+			if (!returned) {
+				// Take back the unused credits so the receiver stops reading and packets stay in the driver.
+				handle.credit(-highWaterMark);
+			}
+			returned = true;
+			queue.length = 0;
+			if (waiting) {
+				const resolve = waiting;
+				waiting = null;
+				resolve({ value: undefined, done: true });
+			}
+			return Promise.resolve({ value: undefined, done: true });
+		},
+		[Symbol.asyncIterator]() {
+			return this;
+		}
+	};
+}
+
+/**
+ * @function createPacketStream
+ * @description Starts batched reception on a handle and returns an object mode Readable of PacketBatch objects.
+ * Each _read() grants one native read credit, so the stream's highWaterMark bounds how far
+ * reception runs ahead of the consumer and stream.pipeline backpressure reaches the driver queue.
+ * @param {Object} handle - Opened WinDivert handle
+ * @param {Object} [options]
+ * @param {number} [options.batchSize=64] - Maximum packets per batch (1-255)
+ * @param {number} [options.highWaterMark=4] - Readable highWaterMark, in batches
+ * @returns {Readable}
+ */
+function createPacketStream(handle, { batchSize = 64, highWaterMark = 4 } = {}) {
+	const stream = new Readable({
+		objectMode: true,
+		highWaterMark,
+		read() {
+			handle.credit(1);
+		}
+	});
+	handle.recvBatch((data, addrs, offsets, columns) => {
+		stream.push(data === null ? null : new PacketBatch(data, addrs, offsets, columns));
+	}, batchSize, 0);
+	return stream;
+}
+
+module.exports = { ADDRESS_SIZE, PacketBatch, packets, createPacketStream };
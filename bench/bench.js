@@ -0,0 +1,221 @@
+/**
+ * @module bench/bench
+ * @description JavaScript microbenchmarks of the binding's hot paths, runnable without the driver.
+ *
+ * Usage: node bench/bench.js [--time=ms] [--filter=regex] [--out=file.json]
+ * A table goes to stderr; JSON results go to stdout, or to --out when given.
+ */
+
+const fs = require('fs');
+const os = require('os');
+const { HeaderReader, AddressColumns, ADDRESS_FLAGS } = require('../decoders.js');
+const { ADDRESS_SIZE, PacketBatch } = require('../batch.js');
+const { buildMix } = require('./synthetic.js');
+
+const MIX_SIZE = 4096;
+const BATCH_SIZE = 64;
+
+const args = Object.fromEntries(process.argv.slice(2).map((arg) => {
+	const [key, value = 'true'] = arg.replace(/^--/, '').split('=');
+	return [key, value];
+}));
+const minTime = Number(args.time || 500);
+const filter = args.filter ? new RegExp(args.filter) : null;
+
+const mix = buildMix(MIX_SIZE, 1024, 1);
+const addrs = Buffer.alloc(MIX_SIZE * ADDRESS_SIZE);
+for (let i = 0; i < MIX_SIZE; i++) {
+	addrs[i * ADDRESS_SIZE + 10] = (i & 1) ? ADDRESS_FLAGS.OUTBOUND : 0;
+}
+
+/**
+ * Concatenates packets into the layout delivered by recvBatch
+ * @returns {{data: Buffer, addrs: Buffer, offsets: Uint32Array}}
+ */
+function makeBatch(start, count) {
+	const packets = [];
+	const offsets = new Uint32Array(count + 1);
+	for (let i = 0; i < count; i++) {
+		const packet = mix[(start + i) % MIX_SIZE];
+		packets.push(packet);
+		offsets[i + 1] = offsets[i] + packet.length;
+	}
+	return {
+		data: Buffer.concat(packets),
+		addrs: addrs.subarray(0, count * ADDRESS_SIZE),
+		offsets
+	};
+}
+
+/**
+ * Builds a NETWORK kind columns buffer as the native decoder would
+ */
+function makeColumns(count) {
+	const header = 16;
+	const align = (n) => (n + 7) & ~7;
+	let offset = header;
+	const timestamp = offset; offset = align(offset + count * 8);
+	const ifIdx = offset; offset = align(offset + count * 4);
+	offset = align(offset + count * 4); // subIfIdx
+	offset = align(offset + count * 4); // processId
+	offset = align(offset + count); // layer
+	offset = align(offset + count); // event
+	const flags = offset; offset = align(offset + count);
+	const buffer = new ArrayBuffer(offset);
+	new Uint32Array(buffer, 0, 2).set([count, 0]);
+	new BigInt64Array(buffer, timestamp, count).fill(1n);
+	new Uint32Array(buffer, ifIdx, count).fill(7);
+	const flagView = new Uint8Array(buffer, flags, count);
+	for (let i = 0; i < count; i++) {
+		flagView[i] = (i & 1) ? ADDRESS_FLAGS.OUTBOUND : 0;
+	}
+	return buffer;
+}
+
+const benchmarks = [];
+
+/**
+ * Registers a benchmark
+ * @param {string} name - Benchmark name
+ * @param {number} items - Packets processed per call of fn
+ * @param {Function} fn - Body, called repeatedly with an increasing counter
+ */
+function bench(name, items, fn) {
+	benchmarks.push({ name, items, fn });
+}
+
+let sink = 0;
+
+bench('HeaderReader.parse', 1, (i) => {
+	const reader = new HeaderReader();
+	reader.setPacketBuffer(mix[i % MIX_SIZE]);
+	sink += reader.WinDivertHelperParsePacket().Protocol;
+});
+
+const sharedReader = new HeaderReader();
+bench('HeaderReader.parse/reused', 1, (i) => {
+	sharedReader.setPacketBuffer(mix[i % MIX_SIZE]);
+	sink += sharedReader.WinDivertHelperParsePacket().Protocol;
+});
+
+sharedReader.setAddressBuffer(addrs);
+bench('HeaderReader.readAddressData', 1, (i) => {
+	sink += sharedReader.readAddressData((i % MIX_SIZE) * ADDRESS_SIZE) ? 1 : 0;
+});
+
+const columnsBuffer = makeColumns(BATCH_SIZE);
+bench('AddressColumns.scan', BATCH_SIZE, () => {
+	const columns = new AddressColumns(columnsBuffer);
+	let outbound = 0;
+	for (let j = 0; j < columns.count; j++) {
+		outbound += columns.flags[j] & ADDRESS_FLAGS.OUTBOUND;
+	}
+	sink += outbound;
+});
+
+// Per-packet dispatch: what ReceivePackets delivers, one copied packet and address per callback.
+const onPacket = (packet, addr) => {
+	sink += packet.length + addr[10];
+};
+bench('dispatch/per-packet', 1, (i) => {
+	const packet = mix[i % MIX_SIZE];
+	onPacket(Buffer.from(packet), Buffer.from(addrs.subarray(0, ADDRESS_SIZE)));
+});
+
+// Per-batch dispatch: one callback per batch, packets are views into a single buffer.
+const batches = Array.from({ length: 16 }, (_, i) => makeBatch(i * BATCH_SIZE, BATCH_SIZE));
+bench('dispatch/per-batch', BATCH_SIZE, (i) => {
+	const { data, addrs: batchAddrs, offsets } = batches[i % batches.length];
+	const batch = new PacketBatch(Buffer.from(data), Buffer.from(batchAddrs), offsets.slice());
+	for (let j = 0; j < batch.count; j++) {
+		onPacket(batch.packet(j), batch.addr(j));
+	}
+});
+
+bench('buffer/alloc', 1, (i) => {
+	const packet = mix[i % MIX_SIZE];
+	const copy = Buffer.alloc(packet.length);
+	packet.copy(copy);
+	sink += copy[0];
+});
+
+bench('buffer/allocUnsafe', 1, (i) => {
+	const packet = mix[i % MIX_SIZE];
+	const copy = Buffer.allocUnsafe(packet.length);
+	packet.copy(copy);
+	sink += copy[0];
+});
+
+const slab = Buffer.allocUnsafe(1 << 20);
+let slabOffset = 0;
+bench('buffer/pooled', 1, (i) => {
+	const packet = mix[i % MIX_SIZE];
+	if (slabOffset + packet.length > slab.length) {
+		slabOffset = 0;
+	}
+	const copy = slab.subarray(slabOffset, slabOffset + packet.length);
+	slabOffset += (packet.length + 7) & ~7;
+	packet.copy(copy);
+	sink += copy[0];
+});
+
+/**
+ * Runs one benchmark for at least minTime milliseconds after a warmup
+ * @returns {Object} Result record
+ */
+function run({ name, items, fn }) {
+	let counter = 0;
+	const warmupEnd = Date.now() + Math.min(100, minTime / 4);
+	while (Date.now() < warmupEnd) {
+		fn(counter++);
+	}
+	let calls = 0;
+	let chunk = 64;
+	const start = process.hrtime.bigint();
+	let elapsed = 0;
+	while (elapsed < minTime * 1e6) {
+		for (let j = 0; j < chunk; j++) {
+			fn(counter++);
+		}
+		calls += chunk;
+		chunk = Math.min(chunk * 2, 65536);
+		elapsed = Number(process.hrtime.bigint() - start);
+	}
+	const packets = calls * items;
+	return {
+		name,
+		iterations: calls,
+		items: packets,
+		ns_per_item: elapsed / packets,
+		items_per_second: packets / (elapsed / 1e9)
+	};
+}
+
+const results = [];
+for (const benchmark of benchmarks) {
+	if (filter && !filter.test(benchmark.name)) {
+		continue;
+	}
+	const result = run(benchmark);
+	results.push(result);
+	process.stderr.write(`${result.name.padEnd(32)} ${result.ns_per_item.toFixed(1).padStart(10)} ns/item ${(result.items_per_second / 1e6).toFixed(2).padStart(10)} M items/s\n`);
+}
+
+const report = JSON.stringify({
+	context: {
+		date: new Date().toISOString(),
+		node: process.version,
+		v8: process.versions.v8,
+		platform: `${os.platform()} ${os.arch()}`,
+		cpu: os.cpus()[0] ? os.cpus()[0].model : 'unknown',
+		min_time_ms: minTime
+	},
+	benchmarks: results,
+	sink
+}, null, 2);
+
+if (args.out) {
+	fs.writeFileSync(args.out, report + '\n');
+} else {
+	process.stdout.write(report + '\n');
+}
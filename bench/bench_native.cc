@@ -0,0 +1,256 @@
+/**
+ * @file bench_native.cc
+ * @brief Microbenchmarks of the binding's native hot paths
+ *
+ * Covers packet parsing, flow keys, checksums, the cost of handing packets to another
+ * thread one by one versus in batches (the pattern behind ThreadSafeFunction dispatch),
+ * and per-packet buffer allocation versus pooling.
+ */
+
+#include <benchmark/benchmark.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include "packet.h"
+#include "checksum.h"
+#include "flow-table.h"
+#include "synthetic.h"
+
+#define BENCH_MIX_SIZE   4096
+#define BENCH_FLOWS      1024
+
+static const std::vector<std::vector<uint8_t>> &Mix()
+{
+	static const std::vector<std::vector<uint8_t>> mix = BuildSyntheticMix(BENCH_MIX_SIZE, BENCH_FLOWS, 1);
+	return mix;
+}
+
+static void BM_ParsePacket(benchmark::State &state)
+{
+	const auto &mix = Mix();
+	size_t i = 0;
+	PacketInfo info;
+	for (auto _ : state)
+	{
+		const auto &packet = mix[i++ % mix.size()];
+		benchmark::DoNotOptimize(ParsePacket(packet.data(), static_cast<uint32_t>(packet.size()), &info));
+		benchmark::DoNotOptimize(info);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ParsePacket);
+
+static void BM_FlowKeyHash(benchmark::State &state)
+{
+	const auto &mix = Mix();
+	size_t i = 0;
+	PacketInfo info;
+	FlowKey key;
+	for (auto _ : state)
+	{
+		const auto &packet = mix[i++ % mix.size()];
+		ParsePacket(packet.data(), static_cast<uint32_t>(packet.size()), &info);
+		FlowKeyFromPacket(packet.data(), info, true, &key);
+		benchmark::DoNotOptimize(FlowHash(key));
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FlowKeyHash);
+
+static void BM_FlowTableLookup(benchmark::State &state)
+{
+	const auto &mix = Mix();
+	std::vector<FlowKey> keys(mix.size());
+	FlowTable<uint32_t> table;
+	for (size_t i = 0; i < mix.size(); i++)
+	{
+		PacketInfo info;
+		ParsePacket(mix[i].data(), static_cast<uint32_t>(mix[i].size()), &info);
+		FlowKeyFromPacket(mix[i].data(), info, true, &keys[i]);
+		table.Insert(keys[i], static_cast<uint32_t>(i));
+	}
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(table.Find(keys[i++ % keys.size()]));
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FlowTableLookup);
+
+static void BM_CalcChecksums(benchmark::State &state)
+{
+	SyntheticSpec spec;
+	spec.payload = static_cast<uint32_t>(state.range(0));
+	std::vector<uint8_t> packet = BuildSyntheticPacket(spec);
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(CalcPacketChecksums(packet.data(), static_cast<uint32_t>(packet.size())));
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations());
+	state.SetBytesProcessed(state.iterations() * packet.size());
+}
+BENCHMARK(BM_CalcChecksums)->Arg(0)->Arg(64)->Arg(512)->Arg(1400);
+
+/**
+ * @class HandoffQueue
+ * @brief Mutex and condition variable queue, the same handoff a ThreadSafeFunction performs
+ * between the receive thread and the event loop
+ */
+template <typename T>
+class HandoffQueue {
+	public:
+		void Push(T item)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				items_.push_back(std::move(item));
+			}
+			cond_.notify_one();
+		}
+
+		bool Pop(T *item)
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			cond_.wait(lock, [this] { return !items_.empty() || closed_; });
+			if (items_.empty())
+			{
+				return false;
+			}
+			*item = std::move(items_.front());
+			items_.pop_front();
+			return true;
+		}
+
+		void Close()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				closed_ = true;
+			}
+			cond_.notify_all();
+		}
+
+	private:
+		std::mutex mutex_;
+		std::condition_variable cond_;
+		std::deque<T> items_;
+		bool closed_ = false;
+};
+
+/**
+ * @brief Hands packets to a consumer thread; range(0) packets per handoff, 1 is per-packet dispatch
+ */
+static void BM_Dispatch(benchmark::State &state)
+{
+	const auto &mix = Mix();
+	const size_t batch = static_cast<size_t>(state.range(0));
+	HandoffQueue<std::vector<const std::vector<uint8_t> *>> queue;
+	std::atomic<size_t> consumed(0);
+	std::thread consumer([&queue, &consumed]
+	{
+		std::vector<const std::vector<uint8_t> *> item;
+		while (queue.Pop(&item))
+		{
+			size_t bytes = 0;
+			for (const auto *packet : item)
+			{
+				bytes += packet->size();
+			}
+			benchmark::DoNotOptimize(bytes);
+			consumed.fetch_add(item.size(), std::memory_order_relaxed);
+		}
+	});
+
+	size_t i = 0;
+	size_t produced = 0;
+	for (auto _ : state)
+	{
+		std::vector<const std::vector<uint8_t> *> item;
+		item.reserve(batch);
+		for (size_t j = 0; j < batch; j++)
+		{
+			item.push_back(&mix[i++ % mix.size()]);
+		}
+		queue.Push(std::move(item));
+		produced += batch;
+	}
+	queue.Close();
+	consumer.join();
+	state.SetItemsProcessed(static_cast<int64_t>(produced));
+	state.counters["consumed"] = static_cast<double>(consumed.load());
+}
+BENCHMARK(BM_Dispatch)->Arg(1)->Arg(16)->Arg(64)->Arg(255)->UseRealTime();
+
+/**
+ * @brief Copies each packet into a freshly allocated buffer, as Napi::Buffer::Copy does
+ */
+static void BM_AllocPerPacket(benchmark::State &state)
+{
+	const auto &mix = Mix();
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		const auto &packet = mix[i++ % mix.size()];
+		char *copy = new char[packet.size()];
+		std::memcpy(copy, packet.data(), packet.size());
+		benchmark::DoNotOptimize(copy);
+		delete[] copy;
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_AllocPerPacket);
+
+/**
+ * @brief Copies each packet into a recycled MTU sized buffer from a free list
+ */
+static void BM_PooledBuffers(benchmark::State &state)
+{
+	const auto &mix = Mix();
+	std::vector<std::unique_ptr<char[]>> pool;
+	for (int j = 0; j < 64; j++)
+	{
+		pool.emplace_back(new char[65575]);
+	}
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		const auto &packet = mix[i++ % mix.size()];
+		std::unique_ptr<char[]> buffer = std::move(pool.back());
+		pool.pop_back();
+		std::memcpy(buffer.get(), packet.data(), packet.size());
+		benchmark::DoNotOptimize(buffer.get());
+		pool.push_back(std::move(buffer));
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PooledBuffers);
+
+/**
+ * @brief Copies packets back to back into one batch buffer, as the batched receiver delivers them
+ */
+static void BM_BatchStaging(benchmark::State &state)
+{
+	const auto &mix = Mix();
+	std::vector<uint8_t> staging;
+	staging.reserve(256 * 1024);
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		staging.clear();
+		for (int j = 0; j < 64; j++)
+		{
+			const auto &packet = mix[i++ % mix.size()];
+			staging.insert(staging.end(), packet.begin(), packet.end());
+		}
+		benchmark::DoNotOptimize(staging.data());
+	}
+	state.SetItemsProcessed(state.iterations() * 64);
+}
+BENCHMARK(BM_BatchStaging);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,177 @@
+/**
+ * @file synthetic.h
+ * @brief Synthetic IPv4/IPv6 packets for the benchmarks and the mock driver
+ *
+ * Packets have valid lengths and checksums so they exercise the same parse paths as
+ * captured traffic. Generation is deterministic for a given seed.
+ */
+
+#ifndef BENCH_SYNTHETIC_H_
+#define BENCH_SYNTHETIC_H_
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "packet.h"
+#include "checksum.h"
+
+/**
+ * @struct SyntheticSpec
+ * @brief Shape of one synthetic packet
+ */
+struct SyntheticSpec {
+	uint8_t version = 4;                 ///< 4 or 6
+	uint8_t protocol = PACKET_PROTO_TCP; ///< TCP, UDP, ICMP or ICMPv6
+	uint32_t payload = 0;                ///< Payload bytes
+	uint32_t flow = 0;                   ///< Flow number, varies addresses and ports
+	bool outbound = true;                ///< Source is the local endpoint
+};
+
+/**
+ * @brief Builds one packet with valid lengths and checksums
+ * @return Packet data
+ */
+inline std::vector<uint8_t> BuildSyntheticPacket(const SyntheticSpec &spec)
+{
+	const uint32_t ipLength = spec.version == 6 ? PACKET_IPV6_HDR_LEN : PACKET_IPV4_HDR_MIN;
+	uint32_t transportLength = PACKET_ICMP_HDR_LEN;
+	if (spec.protocol == PACKET_PROTO_TCP)
+	{
+		transportLength = PACKET_TCP_HDR_MIN;
+	}
+	else if (spec.protocol == PACKET_PROTO_UDP)
+	{
+		transportLength = PACKET_UDP_HDR_LEN;
+	}
+	const uint32_t length = ipLength + transportLength + spec.payload;
+	std::vector<uint8_t> packet(length, 0);
+	uint8_t *p = packet.data();
+
+	// Local endpoint 10.0.x.y / fd00::x:y, remote 93.184.x.y / 2606:2800::x:y.
+	uint8_t local[16] = {0}, remote[16] = {0};
+	if (spec.version == 6)
+	{
+		local[0] = 0xFD;
+		remote[0] = 0x26; remote[1] = 0x06; remote[2] = 0x28;
+		WriteBE32(local + 12, spec.flow);
+		WriteBE32(remote + 12, spec.flow >> 8);
+	}
+	else
+	{
+		local[0] = 10; local[2] = static_cast<uint8_t>(spec.flow >> 8); local[3] = static_cast<uint8_t>(spec.flow);
+		remote[0] = 93; remote[1] = 184; remote[2] = static_cast<uint8_t>(spec.flow >> 16); remote[3] = 34;
+	}
+	const uint8_t *src = spec.outbound ? local : remote;
+	const uint8_t *dst = spec.outbound ? remote : local;
+
+	if (spec.version == 6)
+	{
+		p[0] = 0x60;
+		WriteBE16(p + 4, static_cast<uint16_t>(length - PACKET_IPV6_HDR_LEN));
+		p[6] = spec.protocol;
+		p[7] = 64;
+		std::memcpy(p + 8, src, 16);
+		std::memcpy(p + 24, dst, 16);
+	}
+	else
+	{
+		p[0] = 0x45;
+		WriteBE16(p + 2, static_cast<uint16_t>(length));
+		WriteBE16(p + 4, static_cast<uint16_t>(spec.flow));
+		WriteBE16(p + 6, 0x4000);
+		p[8] = 64;
+		p[9] = spec.protocol;
+		std::memcpy(p + 12, src, 4);
+		std::memcpy(p + 16, dst, 4);
+	}
+
+	uint8_t *t = p + ipLength;
+	const uint16_t localPort = static_cast<uint16_t>(49152 + (spec.flow % 16384));
+	const uint16_t remotePort = spec.protocol == PACKET_PROTO_UDP ? 53 : 443;
+	if (spec.protocol == PACKET_PROTO_TCP || spec.protocol == PACKET_PROTO_UDP)
+	{
+		WriteBE16(t, spec.outbound ? localPort : remotePort);
+		WriteBE16(t + 2, spec.outbound ? remotePort : localPort);
+	}
+	if (spec.protocol == PACKET_PROTO_TCP)
+	{
+		WriteBE32(t + 4, 0x01000000u + spec.flow);
+		WriteBE32(t + 8, 0x02000000u + spec.flow);
+		t[12] = 5 << 4;
+		t[13] = PACKET_TCP_ACK | (spec.payload > 0 ? PACKET_TCP_PSH : 0);
+		WriteBE16(t + 14, 64240);
+	}
+	else if (spec.protocol == PACKET_PROTO_UDP)
+	{
+		WriteBE16(t + 4, static_cast<uint16_t>(transportLength + spec.payload));
+	}
+	else
+	{
+		t[0] = spec.version == 6 ? 128 : 8; // echo request
+		WriteBE16(t + 4, static_cast<uint16_t>(spec.flow));
+	}
+	for (uint32_t i = 0; i < spec.payload; i++)
+	{
+		t[transportLength + i] = static_cast<uint8_t>('a' + (i + spec.flow) % 26);
+	}
+	CalcPacketChecksums(p, length);
+	return packet;
+}
+
+/**
+ * @struct SyntheticMixSpec
+ * @brief Composition of a synthetic traffic mix, percentages are of all packets
+ */
+struct SyntheticMixSpec {
+	uint32_t flows = 1024;          ///< Distinct flows
+	uint32_t ipv6Percent = 20;      ///< IPv6 packets
+	uint32_t udpPercent = 15;       ///< UDP packets
+	uint32_t icmpPercent = 5;       ///< ICMP/ICMPv6 packets, the rest is TCP
+	uint32_t emptyPercent = 40;     ///< Packets without payload (pure ACKs)
+	uint32_t largePercent = 20;     ///< Near-MTU packets, the rest carries 64-575 bytes
+	uint32_t seed = 1;              ///< Random seed
+};
+
+/**
+ * @brief Builds a traffic mix; the defaults are 80% TCP, 15% UDP, 5% ICMP, 20% IPv6,
+ * mostly small packets with a tail of full sized segments
+ * @param count Number of packets
+ * @param mix Mix composition
+ */
+inline std::vector<std::vector<uint8_t>> BuildSyntheticMix(size_t count, const SyntheticMixSpec &mix)
+{
+	std::mt19937 rng(mix.seed);
+	std::vector<std::vector<uint8_t>> packets;
+	packets.reserve(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		SyntheticSpec spec;
+		const uint32_t kind = rng() % 100;
+		spec.version = (rng() % 100 < mix.ipv6Percent) ? 6 : 4;
+		spec.protocol = kind < mix.icmpPercent ? (spec.version == 6 ? PACKET_PROTO_ICMPV6 : PACKET_PROTO_ICMP) :
+						kind < mix.icmpPercent + mix.udpPercent ? PACKET_PROTO_UDP : PACKET_PROTO_TCP;
+		const uint32_t size = rng() % 100;
+		spec.payload = size < mix.emptyPercent ? 0 : size < 100 - mix.largePercent ? 64 + rng() % 512 : 1200 + rng() % 200;
+		spec.flow = mix.flows > 0 ? rng() % mix.flows : 0;
+		spec.outbound = (rng() & 1) != 0;
+		packets.push_back(BuildSyntheticPacket(spec));
+	}
+	return packets;
+}
+
+/**
+ * @brief Builds the default traffic mix
+ * @param count Number of packets
+ * @param flows Number of distinct flows
+ * @param seed Random seed
+ */
+inline std::vector<std::vector<uint8_t>> BuildSyntheticMix(size_t count, uint32_t flows, uint32_t seed)
+{
+	SyntheticMixSpec mix;
+	mix.flows = flows;
+	mix.seed = seed;
+	return BuildSyntheticMix(count, mix);
+}
+
+#endif
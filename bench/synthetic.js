@@ -0,0 +1,109 @@
+/**
+ * @module bench/synthetic
+ * @description Synthetic packets for the JavaScript benchmarks, same shapes as synthetic.h.
+ * Checksums are left zero; nothing on the JavaScript side validates them.
+ */
+
+const PROTO = Object.freeze({ ICMP: 1, TCP: 6, UDP: 17, ICMPV6: 58 });
+
+/**
+ * Deterministic xorshift32 generator
+ * @param {number} seed - Non-zero seed
+ * @returns {Function} Returns the next unsigned 32-bit value
+ */
+function rng(seed) {
+	let x = seed >>> 0 || 1;
+	return () => {
+		x ^= x << 13;
+		x ^= x >>> 17;
+		x ^= x << 5;
+		return x >>> 0;
+	};
+}
+
+/**
+ * Builds one packet
+ * @param {Object} spec - { version, protocol, payload, flow, outbound }
+ * @returns {Buffer}
+ */
+function buildPacket({ version = 4, protocol = PROTO.TCP, payload = 0, flow = 0, outbound = true } = {}) {
+	const ipLength = version === 6 ? 40 : 20;
+	const transportLength = protocol === PROTO.TCP ? 20 : protocol === PROTO.UDP ? 8 : 8;
+	const length = ipLength + transportLength + payload;
+	const p = Buffer.alloc(length);
+	const local = Buffer.alloc(16);
+	const remote = Buffer.alloc(16);
+	if (version === 6) {
+		local[0] = 0xfd;
+		remote.writeUInt32BE(0x26062800, 0);
+		local.writeUInt32BE(flow >>> 0, 12);
+		remote.writeUInt32BE(flow >>> 8, 12);
+	} else {
+		local.set([10, 0, (flow >>> 8) & 0xff, flow & 0xff]);
+		remote.set([93, 184, (flow >>> 16) & 0xff, 34]);
+	}
+	const src = outbound ? local : remote;
+	const dst = outbound ? remote : local;
+	if (version === 6) {
+		p[0] = 0x60;
+		p.writeUInt16BE(length - 40, 4);
+		p[6] = protocol;
+		p[7] = 64;
+		src.copy(p, 8, 0, 16);
+		dst.copy(p, 24, 0, 16);
+	} else {
+		p[0] = 0x45;
+		p.writeUInt16BE(length, 2);
+		p.writeUInt16BE(flow & 0xffff, 4);
+		p.writeUInt16BE(0x4000, 6);
+		p[8] = 64;
+		p[9] = protocol;
+		src.copy(p, 12, 0, 4);
+		dst.copy(p, 16, 0, 4);
+	}
+	const t = ipLength;
+	const localPort = 49152 + (flow % 16384);
+	const remotePort = protocol === PROTO.UDP ? 53 : 443;
+	if (protocol === PROTO.TCP || protocol === PROTO.UDP) {
+		p.writeUInt16BE(outbound ? localPort : remotePort, t);
+		p.writeUInt16BE(outbound ? remotePort : localPort, t + 2);
+	}
+	if (protocol === PROTO.TCP) {
+		p.writeUInt32BE((0x01000000 + flow) >>> 0, t + 4);
+		p.writeUInt32BE((0x02000000 + flow) >>> 0, t + 8);
+		p[t + 12] = 5 << 4;
+		p[t + 13] = 0x10 | (payload > 0 ? 0x08 : 0);
+		p.writeUInt16BE(64240, t + 14);
+	} else if (protocol === PROTO.UDP) {
+		p.writeUInt16BE(transportLength + payload, t + 4);
+	} else {
+		p[t] = version === 6 ? 128 : 8;
+	}
+	for (let i = 0; i < payload; i++) {
+		p[t + transportLength + i] = 97 + ((i + flow) % 26);
+	}
+	return p;
+}
+
+/**
+ * Builds the traffic mix of BuildSyntheticMix: 80% TCP, 15% UDP, 5% ICMP, 20% IPv6
+ * @param {number} count - Number of packets
+ * @param {number} flows - Number of distinct flows
+ * @param {number} seed - Random seed
+ * @returns {Buffer[]}
+ */
+function buildMix(count, flows, seed) {
+	const next = rng(seed);
+	const packets = [];
+	for (let i = 0; i < count; i++) {
+		const kind = next() % 100;
+		const version = next() % 5 === 0 ? 6 : 4;
+		const protocol = kind < 80 ? PROTO.TCP : kind < 95 ? PROTO.UDP : (version === 6 ? PROTO.ICMPV6 : PROTO.ICMP);
+		const size = next() % 100;
+		const payload = size < 40 ? 0 : size < 80 ? 64 + next() % 512 : 1200 + next() % 200;
+		packets.push(buildPacket({ version, protocol, payload, flow: flows > 0 ? next() % flows : 0, outbound: (next() & 1) !== 0 }));
+	}
+	return packets;
+}
+
+module.exports = { PROTO, rng, buildPacket, buildMix };
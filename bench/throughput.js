@@ -0,0 +1,137 @@
+/**
+ * @module bench/throughput
+ * @description End-to-end throughput harness of the binding against the mock driver.
+ * Requires the addon built on Linux (node-gyp rebuild), where binding.gyp links mock/ in place
+ * of WinDivert. Every delivery mode receives the same synthetic traffic at each offered rate and
+ * passes every packet unmodified; the mock measures latency from arrival to reinjection.
+ *
+ * Usage: node bench/throughput.js [--rates=50000,200000,0] [--count=200000] [--queue=4096]
+ *                                 [--modes=per-packet,batched,native-verdict] [--out=file.json]
+ * A rate of 0 offers packets as fast as the queue drains. A table goes to stderr; JSON results
+ * go to stdout, or to --out when given.
+ */
+
+const fs = require('fs');
+const os = require('os');
+const wd = require('bindings')('windivert');
+const { addReceiveListener } = require('../windivert.js');
+
+if (typeof wd.mockConfigure !== 'function') {
+	console.error('The addon was not built against the mock driver (binding.gyp OS!="win" target).');
+	process.exit(1);
+}
+
+const args = Object.fromEntries(process.argv.slice(2).map((arg) => {
+	const [key, value = 'true'] = arg.replace(/^--/, '').split('=');
+	return [key, value];
+}));
+const rates = (args.rates || '50000,200000,0').split(',').map(Number);
+const count = Number(args.count || 200000);
+const queueLength = Number(args.queue || 4096);
+const IDLE_TIMEOUT_MS = 2000;
+
+/**
+ * Delivery modes, each starts reception on an opened handle and returns a stop function
+ */
+const MODES = {
+	'per-packet': (handle) => {
+		addReceiveListener(handle, () => undefined, { verdictRing: false });
+	},
+	'batched': (handle) => {
+		(async () => {
+			for await (const batch of handle.packets({ batchSize: 255 })) {
+				for (let i = 0; i < batch.count; i++) {
+					handle.send({ packet: batch.packet(i), addr: batch.addr(i) });
+				}
+			}
+		})().catch(() => {});
+	},
+	'native-verdict': (handle) => {
+		addReceiveListener(handle, () => undefined);
+	}
+};
+const modes = (args.modes || Object.keys(MODES).join(',')).split(',');
+
+/**
+ * Resolves once every offered packet was dropped or reinjected, or progress stalls
+ */
+function settle() {
+	return new Promise((resolve) => {
+		let last = -1;
+		let idleSince = Date.now();
+		const timer = setInterval(() => {
+			const stats = wd.mockStats();
+			const done = stats.queueDrops + stats.reinjected;
+			if (stats.offered >= count && done >= stats.offered) {
+				clearInterval(timer);
+				resolve(stats);
+				return;
+			}
+			if (done !== last) {
+				last = done;
+				idleSince = Date.now();
+			} else if (Date.now() - idleSince > IDLE_TIMEOUT_MS) {
+				clearInterval(timer);
+				resolve(stats);
+			}
+		}, 20);
+	});
+}
+
+async function run(mode, rate) {
+	wd.mockConfigure({ rate, count, queueLength });
+	const handle = new wd.WinDivert('true', 0, 0);
+	handle.open();
+	MODES[mode](handle);
+	const stats = await settle();
+	handle.close();
+	return {
+		mode,
+		offeredRate: rate,
+		offered: stats.offered,
+		reinjected: stats.reinjected,
+		pps: stats.lastSend > 0 ? Math.round(stats.reinjected / stats.lastSend) : 0,
+		dropRate: stats.offered > 0 ? stats.queueDrops / stats.offered : 0,
+		lost: stats.offered - stats.queueDrops - stats.reinjected,
+		p50Us: stats.p50 / 1e3,
+		p99Us: stats.p99 / 1e3,
+		p999Us: stats.p999 / 1e3,
+		maxUs: stats.maxLatency / 1e3
+	};
+}
+
+async function main() {
+	const results = [];
+	for (const rate of rates) {
+		for (const mode of modes) {
+			if (!MODES[mode]) {
+				throw new Error(`Unknown mode ${mode}`);
+			}
+			const result = await run(mode, rate);
+			results.push(result);
+			console.error(
+				`${mode.padEnd(15)} ${String(rate || 'max').padStart(8)} offered/s  ` +
+				`${String(result.pps).padStart(9)} pps  drop ${(result.dropRate * 100).toFixed(2).padStart(6)}%  ` +
+				`p50 ${result.p50Us.toFixed(1).padStart(8)}us  p99 ${result.p99Us.toFixed(1).padStart(8)}us  ` +
+				`p999 ${result.p999Us.toFixed(1).padStart(8)}us`
+			);
+		}
+	}
+	const report = JSON.stringify({
+		node: process.version,
+		cpu: os.cpus()[0] ? os.cpus()[0].model : 'unknown',
+		count,
+		queueLength,
+		results
+	}, null, 2);
+	if (args.out) {
+		fs.writeFileSync(args.out, report);
+	} else {
+		process.stdout.write(report + '\n');
+	}
+}
+
+main().catch((error) => {
+	console.error(error);
+	process.exit(1);
+});
@@ -3,10 +3,10 @@
       {  
          'conditions':[  
             [  
-               'target_arch=="ia32"',
+               'OS=="win" and target_arch=="ia32"',
                {  
                   'target_name':'windivert',
-                  'sources':['windivert.cc'],
+                  'sources':['windivert.cc', 'packet.cc', 'checksum.cc', 'address-columns.cc', 'node-flow-index.cc', 'process-cache.cc', 'packet-match.cc', 'node-stage.cc', 'nat.cc', 'node-nat.cc', 'packet-scheduler.cc', 'shaper.cc', 'node-shaper.cc', 'policer.cc', 'node-policer.cc', 'sampler.cc', 'node-sampler.cc', 'flow-cache.cc', 'node-flow-cache.cc', 'http.cc', 'http-rewriter.cc', 'node-http-rewriter.cc', 'seq-tracker.cc', 'node-seq-tracker.cc', 'fake-injector.cc', 'node-fake-injector.cc', 'hop-estimator.cc', 'node-hop-estimator.cc', 'fragmenter.cc', 'node-fragmenter.cc', 'disorder.cc', 'node-disorder.cc', 'tcp-option-rewriter.cc', 'node-tcp-option-rewriter.cc', 'reject.cc', 'node-compiled-filter.cc', 'pipeline.cc', 'node-pipeline.cc', 'packet-sink.cc'],
                   'libraries':[  
                      "../bin/x64/windivert.lib"
                   ],
@@ -33,11 +33,49 @@
                }
             ],
             [  
-               'target_arch=="x64"',
+               'OS=="win" and target_arch=="x64"',
                {  
                   'target_name':'windivert',
                   'sources':[  
-                     'windivert.cc'
+                     'windivert.cc',
+                     'packet.cc',
+                     'checksum.cc',
+                     'address-columns.cc',
+                     'node-flow-index.cc',
+                     'process-cache.cc',
+                     'packet-match.cc',
+                     'node-stage.cc',
+                     'nat.cc',
+                     'node-nat.cc',
+                     'packet-scheduler.cc',
+                     'shaper.cc',
+                     'node-shaper.cc',
+                     'policer.cc',
+                     'node-policer.cc',
+                     'sampler.cc',
+                     'node-sampler.cc',
+                     'flow-cache.cc',
+                     'node-flow-cache.cc',
+                     'http.cc',
+                     'http-rewriter.cc',
+                     'node-http-rewriter.cc',
+                     'seq-tracker.cc',
+                     'node-seq-tracker.cc',
+                     'fake-injector.cc',
+                     'node-fake-injector.cc',
+                     'hop-estimator.cc',
+                     'node-hop-estimator.cc',
+                     'fragmenter.cc',
+                     'node-fragmenter.cc',
+                     'disorder.cc',
+                     'node-disorder.cc',
+                     'tcp-option-rewriter.cc',
+                     'node-tcp-option-rewriter.cc',
+                     'reject.cc',
+                     'node-compiled-filter.cc',
+                     'pipeline.cc',
+                     'node-pipeline.cc',
+                     'packet-sink.cc'
                   ],
                   'libraries':[
 						"../bin/x64/windivert.lib"
@@ -58,6 +96,65 @@
 				],
 				'defines': [ 'NAPI_DISABLE_CPP_EXCEPTIONS' ]
                }
+            ],
+            [  
+               'OS!="win"',
+               {  
+                  'target_name':'windivert',
+                  'sources':[  
+                     'windivert.cc',
+                     'packet.cc',
+                     'checksum.cc',
+                     'address-columns.cc',
+                     'node-flow-index.cc',
+                     'process-cache.cc',
+                     'packet-match.cc',
+                     'node-stage.cc',
+                     'nat.cc',
+                     'node-nat.cc',
+                     'packet-scheduler.cc',
+                     'shaper.cc',
+                     'node-shaper.cc',
+                     'policer.cc',
+                     'node-policer.cc',
+                     'sampler.cc',
+                     'node-sampler.cc',
+                     'flow-cache.cc',
+                     'node-flow-cache.cc',
+                     'http.cc',
+                     'http-rewriter.cc',
+                     'node-http-rewriter.cc',
+                     'seq-tracker.cc',
+                     'node-seq-tracker.cc',
+                     'fake-injector.cc',
+                     'node-fake-injector.cc',
+                     'hop-estimator.cc',
+                     'node-hop-estimator.cc',
+                     'fragmenter.cc',
+                     'node-fragmenter.cc',
+                     'disorder.cc',
+                     'node-disorder.cc',
+                     'tcp-option-rewriter.cc',
+                     'node-tcp-option-rewriter.cc',
+                     'reject.cc',
+                     'node-compiled-filter.cc',
+                     'pipeline.cc',
+                     'node-pipeline.cc',
+                     'packet-sink.cc',
+                     'mock/mock-windivert.cc',
+                     'mock/mock-win32.cc',
+                     'mock/mock-binding.cc'
+                  ],
+				"cflags!": [ "-fno-exceptions" ],
+				"cflags_cc!": [ "-fno-exceptions" ],
+				"cflags_cc": [ "-std=c++17" ],
+				"include_dirs": [
+				"mock",
+				"bench",
+				"<!@(node -p \"require('node-addon-api').include\")"
+				],
+				'defines': [ 'NAPI_DISABLE_CPP_EXCEPTIONS', 'WINDIVERT_MOCK' ]
+               }
             ]
          ]
       }
@@ -0,0 +1,111 @@
+/**
+ * @file checksum.cc
+ * @brief Portable Internet checksum helpers
+ */
+
+#include "checksum.h"
+#include "packet.h"
+
+uint32_t ChecksumAdd(uint32_t sum, const uint8_t *data, size_t length)
+{
+	uint64_t acc = sum;
+	size_t i = 0;
+	for (; i + 4 <= length; i += 4)
+	{
+		acc += ReadBE32(data + i);
+	}
+	for (; i + 2 <= length; i += 2)
+	{
+		acc += ReadBE16(data + i);
+	}
+	if (i < length)
+	{
+		acc += static_cast<uint32_t>(data[i]) << 8;
+	}
+	while (acc >> 32)
+	{
+		acc = (acc & 0xFFFFFFFFULL) + (acc >> 32);
+	}
+	return static_cast<uint32_t>(acc);
+}
+
+uint16_t ChecksumFold(uint32_t sum)
+{
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	return static_cast<uint16_t>(~sum);
+}
+
+uint32_t ChecksumDelta(uint32_t delta, const uint8_t *before, const uint8_t *after, size_t length)
+{
+	for (size_t i = 0; i + 2 <= length; i += 2)
+	{
+		delta += static_cast<uint16_t>(~ReadBE16(before + i)) + static_cast<uint32_t>(ReadBE16(after + i));
+	}
+	return (delta & 0xFFFF) + (delta >> 16);
+}
+
+void ChecksumUpdate(uint8_t *field, uint32_t delta)
+{
+	// HC' = ~(~HC + ~m + m'), which never yields the ambiguous 0x0000 of RFC 1141.
+	WriteBE16(field, ChecksumFold(static_cast<uint16_t>(~ReadBE16(field)) + delta));
+}
+
+/**
+ * @brief Sum of the IPv4 or IPv6 pseudo header
+ */
+static uint32_t PseudoHeaderSum(const uint8_t *data, const PacketInfo &info, uint32_t transportLength)
+{
+	uint32_t sum = info.version == 6 ? ChecksumAdd(0, data + 8, 32) : ChecksumAdd(0, data + 12, 8);
+	return sum + info.protocol + transportLength;
+}
+
+bool CalcPacketChecksums(uint8_t *data, uint32_t length)
+{
+	PacketInfo info;
+	if (!ParsePacket(data, length, &info))
+	{
+		return false;
+	}
+	if (info.version == 4)
+	{
+		WriteBE16(data + 10, 0);
+		WriteBE16(data + 10, ChecksumFold(ChecksumAdd(0, data, info.transportOffset)));
+	}
+	if (info.fragment || info.transportLength == 0)
+	{
+		return true;
+	}
+
+	uint8_t *transport = data + info.transportOffset;
+	const uint32_t transportLength = info.length - info.transportOffset;
+	size_t checksumOffset;
+	bool pseudo = true;
+	switch (info.protocol)
+	{
+		case PACKET_PROTO_TCP:
+			checksumOffset = 16;
+			break;
+		case PACKET_PROTO_UDP:
+			checksumOffset = 6;
+			break;
+		case PACKET_PROTO_ICMP:
+			checksumOffset = 2;
+			pseudo = false;
+			break;
+		case PACKET_PROTO_ICMPV6:
+			checksumOffset = 2;
+			break;
+		default:
+			return true;
+	}
+	WriteBE16(transport + checksumOffset, 0);
+	uint32_t sum = pseudo ? PseudoHeaderSum(data, info, transportLength) : 0;
+	uint16_t checksum = ChecksumFold(ChecksumAdd(sum, transport, transportLength));
+	if (checksum == 0 && info.protocol == PACKET_PROTO_UDP)
+	{
+		checksum = 0xFFFF;
+	}
+	WriteBE16(transport + checksumOffset, checksum);
+	return true;
+}
@@ -0,0 +1,54 @@
+/**
+ * @file checksum.h
+ * @brief Portable Internet checksum helpers
+ *
+ * Equivalent of WinDivertHelperCalcChecksums for code that must also run without the
+ * WinDivert DLL, such as the mock driver and the benchmarks.
+ */
+
+#ifndef CHECKSUM_H_
+#define CHECKSUM_H_
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief Adds 16-bit big-endian words of a buffer to a running one's complement sum
+ * @param sum Running sum
+ * @param data Data to add
+ * @param length Data length, an odd trailing byte is padded with zero
+ * @return New running sum, not folded
+ */
+uint32_t ChecksumAdd(uint32_t sum, const uint8_t *data, size_t length);
+
+/**
+ * @brief Folds a running sum into the final 16-bit checksum
+ */
+uint16_t ChecksumFold(uint32_t sum);
+
+/**
+ * @brief Accumulates the change of a header field for an incremental update (RFC 1624)
+ * @param delta Running delta, 0 to start
+ * @param before Field bytes before the change
+ * @param after Field bytes after the change
+ * @param length Field length, even
+ * @return New running delta
+ */
+uint32_t ChecksumDelta(uint32_t delta, const uint8_t *before, const uint8_t *after, size_t length);
+
+/**
+ * @brief Applies an accumulated delta to a big-endian checksum field in place
+ * @param field Checksum field
+ * @param delta Delta from ChecksumDelta
+ */
+void ChecksumUpdate(uint8_t *field, uint32_t delta);
+
+/**
+ * @brief Recalculates the IPv4 header checksum and the TCP, UDP, ICMP or ICMPv6 checksum
+ * @param data Packet data
+ * @param length Packet length
+ * @return false if the packet could not be parsed; fragments only get their IPv4 header checksum
+ */
+bool CalcPacketChecksums(uint8_t *data, uint32_t length);
+
+#endif
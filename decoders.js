@@ -37,8 +37,8 @@ class HeaderReader {
       throw new TypeError('packetBuffer must be a Buffer or Uint8Array');
     }
     this.packetBuffer = packetBuffer;
-    this.packetDataView = new DataView(packetBuffer.buffer);
-    this.packetLength = packetBuffer.buffer.byteLength||packetBuffer.length;
+    this.packetDataView = new DataView(packetBuffer.buffer, packetBuffer.byteOffset, packetBuffer.byteLength);
+    this.packetLength = packetBuffer.byteLength;
   }
 
   /**
@@ -51,7 +51,7 @@ class HeaderReader {
       throw new TypeError('packetBuffer must be a Buffer or Uint8Array');
     }
     this.addressBuffer = addressBuffer;
-    this.addressDataView = new DataView(addressBuffer.buffer);
+    this.addressDataView = new DataView(addressBuffer.buffer, addressBuffer.byteOffset, addressBuffer.byteLength);
   }
 
   /**
@@ -1039,4 +1039,92 @@ class HeaderReader {
   }
 }
 
-module.exports = { HeaderReader, BYTESWAP16 };
\ No newline at end of file
+/**
+ * @constant {Object} ADDRESS_FLAGS
+ * @description Bits of the AddressColumns flags column
+ */
+const ADDRESS_FLAGS = Object.freeze({
+  SNIFFED: 0x01,
+  OUTBOUND: 0x02,
+  LOOPBACK: 0x04,
+  IMPOSTOR: 0x08,
+  IPV6: 0x10,
+  IP_CHECKSUM: 0x20,
+  TCP_CHECKSUM: 0x40,
+  UDP_CHECKSUM: 0x80
+});
+
+/**
+ * @constant {Object} ADDRESS_KIND
+ * @description Which layer data an AddressColumns buffer carries
+ */
+const ADDRESS_KIND = Object.freeze({
+  NETWORK: 0,
+  FLOW: 1,
+  REFLECT: 2
+});
+
+/**
+ * Columns in layout order: [name, typed array, elements per address, kinds]. Must match address-columns.h.
+ * @private
+ */
+const ADDRESS_COLUMNS = [
+  ['timestamp', BigInt64Array, 1, [0, 1, 2]],
+  ['endpointId', BigUint64Array, 1, [1]],
+  ['parentEndpointId', BigUint64Array, 1, [1]],
+  ['ifIdx', Uint32Array, 1, [0]],
+  ['subIfIdx', Uint32Array, 1, [0]],
+  ['processId', Uint32Array, 1, [0, 1, 2]],
+  ['localAddr', Uint32Array, 4, [1]],
+  ['remoteAddr', Uint32Array, 4, [1]],
+  ['localPort', Uint16Array, 1, [1]],
+  ['remotePort', Uint16Array, 1, [1]],
+  ['priority', Int16Array, 1, [2]],
+  ['layer', Uint8Array, 1, [0, 1, 2]],
+  ['event', Uint8Array, 1, [0, 1, 2]],
+  ['flags', Uint8Array, 1, [0, 1, 2]],
+  ['protocol', Uint8Array, 1, [1]]
+];
+
+const ADDRESS_COLUMNS_HEADER_BYTES = 16;
+
+/**
+ * Struct-of-arrays view of a batch of decoded WINDIVERT_ADDRESS entries.
+ * Each field is a typed array indexed by packet, so a whole batch can be filtered with plain loops:
+ * `for (let i = 0; i < cols.count; i++) if (cols.flags[i] & ADDRESS_FLAGS.OUTBOUND) ...`.
+ * Fields that do not exist for the batch's layer are undefined.
+ */
+class AddressColumns {
+  /**
+   * Creates views over a buffer produced by the native decoder
+   * @param {ArrayBuffer} buffer - Decoded columns, see address-columns.h
+   */
+  constructor(buffer) {
+    const header = new Uint32Array(buffer, 0, 2);
+    this.buffer = buffer;
+    this.count = header[0];
+    this.kind = header[1];
+
+    let offset = ADDRESS_COLUMNS_HEADER_BYTES;
+    for (const [name, Type, width, kinds] of ADDRESS_COLUMNS) {
+      if (!kinds.includes(this.kind)) {
+        continue;
+      }
+      const length = this.count * width;
+      this[name] = new Type(buffer, offset, length);
+      offset = (offset + length * Type.BYTES_PER_ELEMENT + 7) & ~7;
+    }
+  }
+
+  /**
+   * Returns true if a flag bit is set for a packet
+   * @param {number} index - Packet index
+   * @param {number} flag - One of ADDRESS_FLAGS
+   * @returns {boolean}
+   */
+  has(index, flag) {
+    return (this.flags[index] & flag) !== 0;
+  }
+}
+
+module.exports = { HeaderReader, BYTESWAP16, AddressColumns, ADDRESS_FLAGS, ADDRESS_KIND };
\ No newline at end of file
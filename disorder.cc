@@ -0,0 +1,140 @@
+/**
+ * @file disorder.cc
+ * @brief Stage splitting TCP segments and sending the pieces out of order
+ */
+
+#include <cstring>
+#include "checksum.h"
+#include "disorder.h"
+
+bool PlanDisorder(const PacketInfo &info, const DisorderConfig &config, DisorderPlan *plan)
+{
+	plan->count = 1;
+	plan->bounds[0] = 0;
+	for (size_t i = 0; i < config.offsets.size() && plan->count <= DISORDER_MAX_SPLITS; i++)
+	{
+		const UINT32 offset = config.offsets[i];
+		if (offset > plan->bounds[plan->count - 1] && offset < info.payloadLength)
+		{
+			plan->bounds[plan->count++] = offset;
+		}
+	}
+	plan->bounds[plan->count] = info.payloadLength;
+	if (plan->count < 2)
+	{
+		return false;
+	}
+
+	UINT32 sent = 0;
+	for (size_t i = 0; i < config.order.size(); i++)
+	{
+		if (config.order[i] < plan->count)
+		{
+			plan->order[sent++] = config.order[i];
+		}
+	}
+	if (sent != plan->count)
+	{
+		// No permutation, or one for fewer pieces: send them last to first.
+		for (UINT32 i = 0; i < plan->count; i++)
+		{
+			plan->order[i] = plan->count - 1 - i;
+		}
+	}
+	return true;
+}
+
+UINT32 DisorderPieceLength(const PacketInfo &info, const DisorderPlan &plan, UINT32 index)
+{
+	return info.payloadOffset + plan.bounds[index + 1] - plan.bounds[index];
+}
+
+void BuildDisorderPiece(const UINT8 *data, const PacketInfo &info, const DisorderPlan &plan, UINT32 index, UINT8 *out)
+{
+	const UINT32 start = plan.bounds[index];
+	const UINT32 length = plan.bounds[index + 1] - start;
+	std::memcpy(out, data, info.payloadOffset);
+	std::memcpy(out + info.payloadOffset, data + info.payloadOffset + start, length);
+	UINT8 *tcp = out + info.transportOffset;
+	WriteBE32(tcp + 4, ReadBE32(tcp + 4) + start);
+	if (index + 1 < plan.count)
+	{
+		tcp[13] = static_cast<UINT8>(tcp[13] & ~PACKET_TCP_FIN);
+	}
+	SetPacketLength(out, info.payloadOffset + length);
+	CalcPacketChecksums(out, info.payloadOffset + length);
+}
+
+DisorderStage::DisorderStage(const DisorderConfig &config, size_t maxBytes)
+	: config_(config), scheduler_(std::make_shared<PacketScheduler>(maxBytes, SCHEDULER_DEFAULT_RESOLUTION)),
+	  matched_(0), split_(0), pieces_(0), delayed_(0), skipped_(0)
+{
+}
+
+StageVerdict DisorderStage::Process(PacketContext &ctx)
+{
+	if (!ctx.parsed || ctx.info.fragment || ctx.info.protocol != PACKET_PROTO_TCP ||
+		ctx.info.transportLength < PACKET_TCP_HDR_MIN || ctx.info.payloadLength == 0 ||
+		!MatchPacket(this->config_.match, ctx.data, ctx.info, *ctx.addr) ||
+		!MatchPayload(this->config_.payload, ctx.data + ctx.info.payloadOffset, ctx.info.payloadLength))
+	{
+		return STAGE_CONTINUE;
+	}
+	this->matched_.fetch_add(1, std::memory_order_relaxed);
+	DisorderPlan plan;
+	if (!ctx.reinject || ctx.send == nullptr || !PlanDisorder(ctx.info, this->config_, &plan))
+	{
+		this->skipped_.fetch_add(1, std::memory_order_relaxed);
+		return STAGE_CONTINUE;
+	}
+
+	WINDIVERT_ADDRESS addr = *ctx.addr;
+	addr.IPChecksum = 1;
+	addr.TCPChecksum = 1;
+	const UINT64 now = PacketScheduler::Now();
+	UINT64 delay = 0;
+	std::vector<UINT8> held;
+	for (UINT32 i = 0; i < plan.count; i++)
+	{
+		const UINT32 index = plan.order[i];
+		const UINT32 length = DisorderPieceLength(ctx.info, plan, index);
+		if (i > 0 && i - 1 < this->config_.delays.size())
+		{
+			delay += this->config_.delays[i - 1];
+		}
+		if (delay == 0)
+		{
+			BuildDisorderPiece(ctx.data, ctx.info, plan, index, ctx.send->Reserve(length, addr));
+			continue;
+		}
+		held.resize(length);
+		BuildDisorderPiece(ctx.data, ctx.info, plan, index, held.data());
+		if (this->scheduler_->Schedule(ctx.handle, held.data(), length, addr, now + delay))
+		{
+			this->delayed_.fetch_add(1, std::memory_order_relaxed);
+		}
+		else
+		{
+			// Losing a piece would stall the stream, so it goes out early instead.
+			ctx.send->Add(held.data(), length, addr);
+		}
+	}
+	this->split_.fetch_add(1, std::memory_order_relaxed);
+	this->pieces_.fetch_add(plan.count, std::memory_order_relaxed);
+	return STAGE_HOLD;
+}
+
+void DisorderStage::Detach(HANDLE handle)
+{
+	this->scheduler_->Detach(handle);
+}
+
+void DisorderStage::GetStats(DisorderStats *stats, SchedulerStats *scheduler)
+{
+	stats->matched = this->matched_.load(std::memory_order_relaxed);
+	stats->split = this->split_.load(std::memory_order_relaxed);
+	stats->pieces = this->pieces_.load(std::memory_order_relaxed);
+	stats->delayed = this->delayed_.load(std::memory_order_relaxed);
+	stats->skipped = this->skipped_.load(std::memory_order_relaxed);
+	this->scheduler_->GetStats(scheduler);
+}
@@ -0,0 +1,136 @@
+/**
+ * @file disorder.h
+ * @brief Stage splitting TCP segments and sending the pieces out of order
+ *
+ * A DPI box that inspects segments in arrival order, or gives up on a stream whose
+ * first bytes arrive late, misses a ClientHello or HTTP request whose pieces come in a
+ * different order, while the server's stack reorders them by sequence number. The pieces
+ * are built straight into the receive thread's send batch in the configured permutation,
+ * so they leave in one WinDivertSendEx call; pieces given a delay are held by the stage's
+ * PacketScheduler instead.
+ */
+
+#ifndef DISORDER_H_
+#define DISORDER_H_
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "windivert.h"
+#include "packet.h"
+#include "packet-match.h"
+#include "packet-stage.h"
+#include "packet-scheduler.h"
+#include "fake-injector.h"
+
+#define DISORDER_MAX_SPLITS 15       ///< Split points per segment, so at most 16 pieces
+#define DISORDER_MAX_DELAY  60000    ///< Longest delay between two pieces in milliseconds, far inside the wheel range
+
+/**
+ * @struct DisorderConfig
+ * @brief Segments the stage splits and how the pieces are sent
+ */
+struct DisorderConfig {
+	PacketMatch match;                ///< Segments considered
+	FakeMatch payload;                ///< Kind of payload required, FAKE_MATCH_ANY for every segment with payload
+	std::vector<UINT32> offsets;      ///< Split points in the payload, ascending
+	std::vector<UINT8> order;         ///< Permutation of the pieces, by offset, in send order
+	std::vector<UINT64> delays;       ///< Microseconds between consecutive sends, missing entries are 0
+};
+
+/**
+ * @struct DisorderPlan
+ * @brief Pieces of one segment
+ */
+struct DisorderPlan {
+	UINT32 count;                                 ///< Pieces
+	UINT32 bounds[DISORDER_MAX_SPLITS + 2];       ///< Start of each piece in the payload, then its length
+	UINT32 order[DISORDER_MAX_SPLITS + 1];        ///< Pieces in send order
+};
+
+/**
+ * @struct DisorderStats
+ * @brief Counters since the stage was created
+ */
+struct DisorderStats {
+	UINT64 matched;           ///< Segments selected by match and payload
+	UINT64 split;             ///< Segments sent as pieces
+	UINT64 pieces;            ///< Pieces sent or held
+	UINT64 delayed;           ///< Pieces handed to the scheduler; those it refuses are sent right away
+	UINT64 skipped;           ///< Matched but too short to split, or the handle cannot send
+};
+
+/**
+ * @brief Lays out the pieces of a TCP segment
+ * @param info Headers of the segment
+ * @param config Split points and permutation; split points past the payload are ignored
+ *               and the permutation keeps the remaining pieces in their relative order
+ * @param plan Receives the layout
+ * @return false if no split point falls inside the payload
+ */
+bool PlanDisorder(const PacketInfo &info, const DisorderConfig &config, DisorderPlan *plan);
+
+/**
+ * @brief Returns the length of a piece
+ * @param info Headers of the segment
+ * @param plan Its layout
+ * @param index Piece, by offset
+ */
+UINT32 DisorderPieceLength(const PacketInfo &info, const DisorderPlan &plan, UINT32 index);
+
+/**
+ * @brief Builds a piece as a TCP segment of its own
+ * @param data Segment the plan was made for
+ * @param info Its headers
+ * @param plan Its layout
+ * @param index Piece, by offset
+ * @param out Receives DisorderPieceLength bytes, checksums included
+ *
+ * The sequence number is advanced to the piece and FIN is kept only on the last piece.
+ */
+void BuildDisorderPiece(const UINT8 *data, const PacketInfo &info, const DisorderPlan &plan, UINT32 index, UINT8 *out);
+
+/**
+ * @class DisorderStage
+ * @brief PacketStage sending matching segments as reordered pieces
+ */
+class DisorderStage : public PacketStage {
+	public:
+		/**
+		 * @param config Split settings
+		 * @param maxBytes Cap on bytes held for delayed pieces
+		 */
+		DisorderStage(const DisorderConfig &config, size_t maxBytes);
+
+		/**
+		 * @brief Sends or holds the pieces of a matching segment
+		 * @return STAGE_HOLD if split, STAGE_CONTINUE otherwise
+		 */
+		StageVerdict Process(PacketContext &ctx) override;
+
+		/**
+		 * @brief Sends the pieces still held for a closing handle
+		 */
+		void Detach(HANDLE handle) override;
+
+		/**
+		 * @brief Settings the stage was created with
+		 */
+		const DisorderConfig &Config() const
+		{
+			return config_;
+		}
+
+		void GetStats(DisorderStats *stats, SchedulerStats *scheduler);
+
+	private:
+		DisorderConfig config_;
+		std::shared_ptr<PacketScheduler> scheduler_;    ///< Holds delayed pieces
+		std::atomic<UINT64> matched_;
+		std::atomic<UINT64> split_;
+		std::atomic<UINT64> pieces_;
+		std::atomic<UINT64> delayed_;
+		std::atomic<UINT64> skipped_;
+};
+
+#endif
@@ -1,4 +1,9 @@
 var wd = require("../windivert.js");
+var os = require("os");
+var path = require("path");
+
+// Compiled filters survive restarts, so the generated filter strings are only compiled once.
+const filterCache = new wd.FilterCache({ path: path.join(os.tmpdir(), "goodbyedpi-filters.json") });
 class Filter {
     static #instance;
     #ipIdTemplate
@@ -254,6 +259,8 @@ class GoodbyeDPI {
     #passiveWindivert;
     #quicWindivert;
     #activeWindivert;
+    #flowCache;
+    #httpRewriter;
     #patcher;
     #timeout;
 
@@ -292,7 +299,7 @@ class GoodbyeDPI {
     async #initializeWindivert() {
         // Initialize passive windivert
         this.#passiveWindivert = await wd.createWindivert(
-            this.#filter.passiveFilter,
+            filterCache.get(this.#filter.passiveFilter, wd.LAYERS.NETWORK),
             wd.LAYERS.NETWORK,
             wd.FLAGS.DROP
         );
@@ -300,7 +307,7 @@ class GoodbyeDPI {
 
         // Initialize QUIC windivert
         this.#quicWindivert = await wd.createWindivert(
-            this.#filter.quicBlockPassiveFilter,
+            filterCache.get(this.#filter.quicBlockPassiveFilter, wd.LAYERS.NETWORK),
             wd.LAYERS.NETWORK,
             wd.FLAGS.DROP
         );
@@ -308,11 +315,19 @@ class GoodbyeDPI {
 
         // Initialize active windivert
         this.#activeWindivert = await wd.createWindivert(
-            this.#filter.filter,
+            filterCache.get(this.#filter.filter, wd.LAYERS.NETWORK),
             wd.LAYERS.NETWORK,
             wd.FLAGS.DEFAULT
         );
         this.#activeWindivert.open();
+        // Plain HTTP requests get "hoSt:" and a mixed case host name natively. Both keep the
+        // payload size, as the filter only sees some of the server's packets to shift.
+        this.#httpRewriter = new wd.HttpRewriter({ hostName: "hoSt", mixCase: true });
+        this.#activeWindivert.attachStage(this.#httpRewriter);
+        // Flows whose ClientHello was split are passed natively from then on.
+        this.#flowCache = new wd.FlowCache();
+        this.#activeWindivert.attachStage(this.#flowCache);
+        filterCache.save();
     }
 
     /**
@@ -336,7 +351,9 @@ class GoodbyeDPI {
         this.#patcher.setPacketBuffer(packet);
 
         if (this.#shouldFragmentPacket()) {
-            return this.#patcher.createFragmentPacket(this.#activeWindivert, 2);
+            const result = this.#patcher.createFragmentPacket(this.#activeWindivert, 2);
+            this.#flowCache.set(packet, addr, "pass");
+            return result;
         }
     }
 
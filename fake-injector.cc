@@ -0,0 +1,156 @@
+/**
+ * @file fake-injector.cc
+ * @brief Stage sending decoy copies of TCP segments ahead of the real ones
+ */
+
+#include <algorithm>
+#include <cstring>
+#include "checksum.h"
+#include "http.h"
+#include "fake-injector.h"
+
+#define TCP_OPT_MD5SIG 19
+
+UINT32 FakePacketLength(const PacketInfo &info, const FakeConfig &config)
+{
+	UINT32 header = info.transportLength;
+	if (config.md5sig)
+	{
+		header += FAKE_MD5SIG_OPTION_LEN;
+		if (header > 60)
+		{
+			return 0;
+		}
+	}
+	const UINT32 payload = config.payload.empty() ? info.payloadLength : static_cast<UINT32>(config.payload.size());
+	const UINT32 length = info.transportOffset + header + payload;
+	const UINT32 ipLength = info.version == 6 ? length - PACKET_IPV6_HDR_LEN : length;
+	return ipLength > 0xFFFF ? 0 : length;
+}
+
+void BuildFakePacket(const UINT8 *data, const PacketInfo &info, const FakeConfig &config, UINT8 ttl, UINT8 *out)
+{
+	const UINT32 length = FakePacketLength(info, config);
+	std::memcpy(out, data, info.transportOffset + info.transportLength);
+	UINT8 *tcp = out + info.transportOffset;
+	UINT32 header = info.transportLength;
+	if (config.md5sig)
+	{
+		UINT8 *option = tcp + header;
+		option[0] = PACKET_TCP_OPT_NOP;
+		option[1] = PACKET_TCP_OPT_NOP;
+		option[2] = TCP_OPT_MD5SIG;
+		option[3] = FAKE_MD5SIG_OPTION_LEN - 2;
+		std::memset(option + 4, 0, FAKE_MD5SIG_OPTION_LEN - 4);
+		header += FAKE_MD5SIG_OPTION_LEN;
+		tcp[12] = static_cast<UINT8>(((header / 4) << 4) | (tcp[12] & 0x0F));
+	}
+	UINT8 *payload = tcp + header;
+	if (config.payload.empty())
+	{
+		std::memset(payload, 0, info.payloadLength);
+	}
+	else
+	{
+		std::memcpy(payload, config.payload.data(), config.payload.size());
+	}
+
+	SetPacketLength(out, length);
+	if (ttl != 0)
+	{
+		out[info.version == 6 ? 7 : 8] = ttl;
+	}
+	if (config.badSeq)
+	{
+		WriteBE32(tcp + 4, ReadBE32(tcp + 4) + static_cast<UINT32>(config.seqOffset));
+		WriteBE32(tcp + 8, ReadBE32(tcp + 8) + static_cast<UINT32>(config.seqOffset));
+	}
+	CalcPacketChecksums(out, length);
+	if (config.badChecksum)
+	{
+		WriteBE16(tcp + 16, static_cast<UINT16>(ReadBE16(tcp + 16) ^ 0x5A5A));
+	}
+}
+
+bool MatchPayload(FakeMatch match, const UINT8 *payload, UINT32 length)
+{
+	switch (match)
+	{
+		case FAKE_MATCH_TLS:
+			// Handshake record of TLS 1.0 to 1.3 whose first message is a ClientHello.
+			return length > 5 && payload[0] == 0x16 && payload[1] == 0x03 && payload[5] == 0x01;
+		case FAKE_MATCH_HTTP:
+		{
+			HttpRequest request;
+			return ParseHttpRequest(payload, length, &request);
+		}
+		default:
+			return true;
+	}
+}
+
+FakeInjectorStage::FakeInjectorStage(const FakeConfig &config, std::shared_ptr<HopEstimatorStage> hops)
+	: config_(config), hops_(std::move(hops)), matched_(0), fakes_(0), skipped_(0), autoTtl_(0)
+{
+}
+
+UINT8 FakeInjectorStage::FakeTtl(const UINT8 *data, const PacketInfo &info)
+{
+	if (this->config_.autoTtl && this->hops_)
+	{
+		const bool ipv6 = info.version == 6;
+		FlowKey key;
+		HopEntry entry;
+		HostKey(data + (ipv6 ? 24 : 16), ipv6, &key);
+		if (this->hops_->Lookup(key, &entry))
+		{
+			const int ttl = static_cast<int>(entry.hops) - this->config_.autoTtlDelta;
+			this->autoTtl_.fetch_add(1, std::memory_order_relaxed);
+			return static_cast<UINT8>(std::min<int>(std::max<int>(ttl, this->config_.autoTtlMin), this->config_.autoTtlMax));
+		}
+	}
+	return this->config_.hasTtl ? this->config_.ttl : 0;
+}
+
+StageVerdict FakeInjectorStage::Process(PacketContext &ctx)
+{
+	if (!ctx.parsed || ctx.info.fragment || ctx.info.protocol != PACKET_PROTO_TCP || !ctx.addr->Outbound ||
+		ctx.info.transportLength < PACKET_TCP_HDR_MIN || ctx.info.payloadLength == 0)
+	{
+		return STAGE_CONTINUE;
+	}
+	const UINT16 port = ReadBE16(ctx.data + ctx.info.transportOffset + 2);
+	if (std::find(this->config_.ports.begin(), this->config_.ports.end(), port) == this->config_.ports.end() ||
+		!MatchPayload(this->config_.match, ctx.data + ctx.info.payloadOffset, ctx.info.payloadLength))
+	{
+		return STAGE_CONTINUE;
+	}
+	this->matched_.fetch_add(1, std::memory_order_relaxed);
+	const UINT32 length = FakePacketLength(ctx.info, this->config_);
+	const UINT8 ttl = FakeTtl(ctx.data, ctx.info);
+	const bool corrupt = ttl != 0 || this->config_.badChecksum || this->config_.badSeq || this->config_.md5sig;
+	if (!ctx.reinject || ctx.send == nullptr || length == 0 || !corrupt)
+	{
+		this->skipped_.fetch_add(1, std::memory_order_relaxed);
+		return STAGE_CONTINUE;
+	}
+
+	WINDIVERT_ADDRESS addr = *ctx.addr;
+	addr.IPChecksum = 1;
+	addr.TCPChecksum = 1;
+	for (UINT32 i = 0; i < this->config_.repeat; i++)
+	{
+		BuildFakePacket(ctx.data, ctx.info, this->config_, ttl, ctx.send->Reserve(length, addr));
+	}
+	ctx.send->Add(ctx.data, ctx.length, *ctx.addr);
+	this->fakes_.fetch_add(this->config_.repeat, std::memory_order_relaxed);
+	return STAGE_HOLD;
+}
+
+void FakeInjectorStage::GetStats(FakeInjectorStats *stats)
+{
+	stats->matched = this->matched_.load(std::memory_order_relaxed);
+	stats->fakes = this->fakes_.load(std::memory_order_relaxed);
+	stats->skipped = this->skipped_.load(std::memory_order_relaxed);
+	stats->autoTtl = this->autoTtl_.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,142 @@
+/**
+ * @file fake-injector.h
+ * @brief Stage sending decoy copies of TCP segments ahead of the real ones
+ *
+ * A DPI box that reassembles the stream can be desynchronised by a fake segment that it
+ * accepts but the server discards: one whose TTL expires before the server, whose
+ * checksum is wrong, whose sequence number is outside the window, or which carries a
+ * TCP MD5 signature option the server does not expect. The fake is derived from the
+ * headers of the real segment and both are added to the receive thread's send batch,
+ * fakes first, so they leave in the same WinDivertSendEx call. The TTL of the fakes can
+ * follow the hop distance a HopEstimatorStage learned for the server.
+ */
+
+#ifndef FAKE_INJECTOR_H_
+#define FAKE_INJECTOR_H_
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "windivert.h"
+#include "packet.h"
+#include "packet-stage.h"
+#include "hop-estimator.h"
+
+#define FAKE_MD5SIG_OPTION_LEN  20       ///< NOP, NOP and the 18 byte TCP MD5 signature option
+#define FAKE_DEFAULT_SEQ_OFFSET (-10000) ///< Moves a badSeq fake behind the receive window
+#define FAKE_MAX_REPEAT         8
+
+/**
+ * @enum FakeMatch
+ * @brief Segments that get fakes
+ */
+enum FakeMatch {
+	FAKE_MATCH_TLS = 0,       ///< First segment of a TLS ClientHello
+	FAKE_MATCH_HTTP = 1,      ///< First segment of an HTTP/1.x request
+	FAKE_MATCH_ANY = 2        ///< Every segment with payload
+};
+
+/**
+ * @struct FakeConfig
+ * @brief How fakes are derived from a real segment
+ */
+struct FakeConfig {
+	bool hasTtl;
+	UINT8 ttl;                ///< IPv4 TTL or IPv6 hop limit of the fake
+	bool autoTtl;             ///< Derive the TTL from the server's hop distance when it is known
+	UINT8 autoTtlDelta;       ///< The fake gets the hop distance minus this
+	UINT8 autoTtlMin;         ///< Bounds of the derived TTL
+	UINT8 autoTtlMax;
+	bool badChecksum;         ///< Send the fake with a wrong TCP checksum
+	bool badSeq;              ///< Move the sequence and acknowledgement numbers by seqOffset
+	INT32 seqOffset;
+	bool md5sig;              ///< Add a TCP MD5 signature option
+	UINT32 repeat;            ///< Fakes sent before each real segment
+	std::vector<UINT8> payload;   ///< Fake payload; empty for a zeroed payload of the real length
+	FakeMatch match;
+	std::vector<UINT16> ports;    ///< Remote ports of matched segments
+};
+
+/**
+ * @struct FakeInjectorStats
+ * @brief Counters since the stage was created
+ */
+struct FakeInjectorStats {
+	UINT64 matched;           ///< Real segments that matched
+	UINT64 fakes;             ///< Fakes sent
+	UINT64 skipped;           ///< Matched segments sent without fakes: not reinjectable, too large, or
+	                          ///< autoTtl alone and the server's distance unknown
+	UINT64 autoTtl;           ///< Segments whose fakes got a TTL from the hop estimator
+};
+
+/**
+ * @brief Returns the length of the fake of a TCP segment
+ * @param info Headers of the real segment
+ * @param config Fake settings
+ * @return Fake length, 0 if the fake would be too large or the options do not fit
+ */
+UINT32 FakePacketLength(const PacketInfo &info, const FakeConfig &config);
+
+/**
+ * @brief Builds the fake of a TCP segment
+ * @param data Real segment
+ * @param info Its headers
+ * @param config Fake settings
+ * @param ttl TTL or hop limit of the fake, 0 to keep the real one
+ * @param out Receives FakePacketLength bytes, checksums included
+ */
+void BuildFakePacket(const UINT8 *data, const PacketInfo &info, const FakeConfig &config, UINT8 ttl, UINT8 *out);
+
+/**
+ * @brief Tests whether a TCP payload is of a kind
+ * @param match Kind of payload
+ * @param payload Transport payload
+ * @param length Its length
+ */
+bool MatchPayload(FakeMatch match, const UINT8 *payload, UINT32 length);
+
+/**
+ * @class FakeInjectorStage
+ * @brief PacketStage sending fakes ahead of matching outbound segments
+ */
+class FakeInjectorStage : public PacketStage {
+	public:
+		/**
+		 * @param config Fake settings
+		 * @param hops Estimator read for autoTtl, may be empty
+		 */
+		FakeInjectorStage(const FakeConfig &config, std::shared_ptr<HopEstimatorStage> hops);
+
+		/**
+		 * @brief Adds fakes and the segment to the send batch if it matches
+		 * @return STAGE_HOLD if sent, STAGE_CONTINUE otherwise
+		 */
+		StageVerdict Process(PacketContext &ctx) override;
+
+		/**
+		 * @brief Returns the TTL of the fakes of a segment, 0 to keep the real one
+		 * @param data Real outbound segment
+		 * @param info Its headers
+		 */
+		UINT8 FakeTtl(const UINT8 *data, const PacketInfo &info);
+
+		/**
+		 * @brief Settings the stage was created with
+		 */
+		const FakeConfig &Config() const
+		{
+			return config_;
+		}
+
+		void GetStats(FakeInjectorStats *stats);
+
+	private:
+		FakeConfig config_;
+		std::shared_ptr<HopEstimatorStage> hops_;
+		std::atomic<UINT64> matched_;
+		std::atomic<UINT64> fakes_;
+		std::atomic<UINT64> skipped_;
+		std::atomic<UINT64> autoTtl_;
+};
+
+#endif
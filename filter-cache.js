@@ -0,0 +1,102 @@
+/**
+ * @module filter-cache
+ * @description Compiles WinDivert filters once and keeps the compiled objects across handles and restarts.
+ * Filters generated at startup (for example by chaining replace() over a template) are compiled the
+ * first time they are asked for; later requests for the same layer and filter return the same
+ * CompiledFilter. A cache file stores the compiled objects; entries are validated on load and
+ * recompiled on demand if the WinDivert library no longer accepts them.
+ */
+
+const fs = require('fs');
+const { CompiledFilter } = require('bindings')('windivert');
+
+const CACHE_VERSION = 1;
+
+class FilterCache {
+	/**
+	 * @param {Object} [options]
+	 * @param {string} [options.path] - Cache file, loaded now if it exists and written by save()
+	 */
+	constructor({ path } = {}) {
+		this.path = path;
+		this.entries = new Map();
+		this.hits = 0;
+		this.misses = 0;
+		if (path && fs.existsSync(path)) {
+			this.load(path);
+		}
+	}
+
+	/**
+	 * Returns the compiled form of a filter, compiling it on the first request
+	 * @param {string} filter - Filter string
+	 * @param {number} [layer=0] - WinDivert layer
+	 * @returns {CompiledFilter}
+	 * @throws {SyntaxError} With position and filterError if the filter does not compile
+	 */
+	get(filter, layer = 0) {
+		const key = `${layer}:${filter}`;
+		let compiled = this.entries.get(key);
+		if (compiled) {
+			this.hits++;
+			return compiled;
+		}
+		this.misses++;
+		compiled = new CompiledFilter(filter, layer);
+		this.entries.set(key, compiled);
+		return compiled;
+	}
+
+	/**
+	 * Adds the entries of a cache file; entries the library rejects are skipped
+	 * @param {string} [path=this.path]
+	 * @returns {number} Number of entries loaded
+	 */
+	load(path = this.path) {
+		let data;
+		try {
+			data = JSON.parse(fs.readFileSync(path, 'utf8'));
+		} catch (error) {
+			return 0;
+		}
+		if (!data || data.version !== CACHE_VERSION || !Array.isArray(data.entries)) {
+			return 0;
+		}
+		let loaded = 0;
+		for (const { source, layer, object } of data.entries) {
+			try {
+				this.entries.set(`${layer}:${source}`, new CompiledFilter(object, layer));
+				loaded++;
+			} catch (error) {
+				// Written by another WinDivert version; the filter is compiled again when asked for.
+			}
+		}
+		return loaded;
+	}
+
+	/**
+	 * Writes every cached filter to a cache file
+	 * @param {string} [path=this.path]
+	 */
+	save(path = this.path) {
+		const entries = [];
+		for (const [key, compiled] of this.entries) {
+			const source = key.slice(key.indexOf(':') + 1);
+			entries.push({ source, layer: compiled.layer, object: compiled.object });
+		}
+		fs.writeFileSync(path, JSON.stringify({ version: CACHE_VERSION, entries }));
+	}
+
+	/**
+	 * Number of cached filters
+	 */
+	get size() {
+		return this.entries.size;
+	}
+
+	clear() {
+		this.entries.clear();
+	}
+}
+
+module.exports = { FilterCache };
@@ -0,0 +1,307 @@
+/**
+ * @module filter-narrower
+ * @description Keeps flows that were decided as "pass" out of a handle altogether.
+ * A FlowCache still costs a kernel to user transition per packet; a flow excluded from the driver
+ * filter costs nothing, because packets no handle matches never leave the network stack. The
+ * narrower collects passed flows, and on a timer regenerates the handle's filter as
+ * `(base) and not (flow or flow ...)` and swaps it in with replaceFilter(), so queued packets are
+ * neither lost nor reordered.
+ */
+
+const { CompiledFilter } = require('bindings')('windivert');
+
+const PROTOCOL_TCP = 6;
+const PROTOCOL_UDP = 17;
+const ADDR_OUTBOUND_OFFSET = 10;
+const ADDR_OUTBOUND = 0x02;
+
+/**
+ * Formats 4 or 16 address bytes for a filter expression
+ * @param {Uint8Array} bytes
+ * @returns {string}
+ */
+function formatAddress(bytes) {
+	if (bytes.length === 4) {
+		return bytes.join('.');
+	}
+	const groups = [];
+	for (let i = 0; i < 16; i += 2) {
+		groups.push(((bytes[i] << 8) | bytes[i + 1]).toString(16));
+	}
+	return groups.join(':');
+}
+
+/**
+ * Extracts the direction independent 5-tuple of a TCP or UDP packet
+ * @param {Uint8Array} packet - Packet starting with the IP header
+ * @param {Uint8Array} addr - WINDIVERT_ADDRESS of the packet
+ * @returns {{protocol: number, localAddr: string, localPort: number, remoteAddr: string, remotePort: number}|null}
+ */
+function flowOf(packet, addr) {
+	const version = packet[0] >> 4;
+	let protocol, src, dst, transport;
+	if (version === 4) {
+		const fragment = ((packet[6] & 0x1F) << 8) | packet[7];
+		if (fragment !== 0) {
+			return null;
+		}
+		protocol = packet[9];
+		src = packet.subarray(12, 16);
+		dst = packet.subarray(16, 20);
+		transport = (packet[0] & 0x0F) * 4;
+	} else if (version === 6) {
+		protocol = packet[6];
+		src = packet.subarray(8, 24);
+		dst = packet.subarray(24, 40);
+		transport = 40;
+	} else {
+		return null;
+	}
+	if ((protocol !== PROTOCOL_TCP && protocol !== PROTOCOL_UDP) || packet.length < transport + 4) {
+		return null;
+	}
+	const srcPort = (packet[transport] << 8) | packet[transport + 1];
+	const dstPort = (packet[transport + 2] << 8) | packet[transport + 3];
+	const outbound = (addr[ADDR_OUTBOUND_OFFSET] & ADDR_OUTBOUND) !== 0;
+	return {
+		protocol,
+		localAddr: formatAddress(outbound ? src : dst),
+		localPort: outbound ? srcPort : dstPort,
+		remoteAddr: formatAddress(outbound ? dst : src),
+		remotePort: outbound ? dstPort : srcPort
+	};
+}
+
+/**
+ * Returns the map key of a flow
+ */
+function flowKey(flow) {
+	return `${flow.protocol}/${flow.localAddr}/${flow.localPort}/${flow.remoteAddr}/${flow.remotePort}`;
+}
+
+/**
+ * Returns the filter clause matching both directions of a flow
+ * Only NETWORK layer fields are used: localAddr and friends exist on the FLOW and SOCKET layers only.
+ * The clause does not test outbound, as loopback packets are outbound in both directions.
+ * @param {{protocol: number, localAddr: string, localPort: number, remoteAddr: string, remotePort: number}} flow
+ * @returns {string}
+ */
+function flowClause(flow) {
+	const ip = flow.localAddr.includes(':') ? 'ipv6' : 'ip';
+	const transport = flow.protocol === PROTOCOL_TCP ? 'tcp' : 'udp';
+	const direction = (srcAddr, srcPort, dstAddr, dstPort) =>
+		`(${ip}.SrcAddr == ${srcAddr} and ${ip}.DstAddr == ${dstAddr}` +
+		` and ${transport}.SrcPort == ${srcPort} and ${transport}.DstPort == ${dstPort})`;
+	return `(${direction(flow.localAddr, flow.localPort, flow.remoteAddr, flow.remotePort)}` +
+		` or ${direction(flow.remoteAddr, flow.remotePort, flow.localAddr, flow.localPort)})`;
+}
+
+/**
+ * Tests whether a CompiledFilter error means the filter is too big for the driver
+ * @param {Error} error
+ * @returns {boolean}
+ */
+function isSizeError(error) {
+	return typeof error.filterError === 'string' && /\btoo\b/i.test(error.filterError);
+}
+
+class FilterNarrower {
+	/**
+	 * @param {WinDivert} handle - Opened handle whose filter is narrowed
+	 * @param {string} filter - Base filter the handle was opened with
+	 * @param {Object} [options]
+	 * @param {number} [options.layer=0] - Layer of the handle
+	 * @param {FlowCache} [options.cache] - Cache attached to the handle, used to measure the packet rate
+	 * @param {number} [options.interval=5000] - Milliseconds between filter updates
+	 * @param {number} [options.minAge=2000] - Milliseconds a flow must have been passed before it is excluded
+	 * @param {number} [options.maxAge=600000] - Milliseconds after which a flow is let back in, so ended flows are forgotten
+	 * @param {number} [options.maxFlows=32] - Flows excluded at once; the oldest are preferred
+	 * @param {number} [options.maxLength=8192] - Longest filter string generated
+	 */
+	constructor(handle, filter, { layer = 0, cache, interval = 5000, minAge = 2000, maxAge = 600000, maxFlows = 32, maxLength = 8192 } = {}) {
+		this.handle = handle;
+		this.filter = filter;
+		this.layer = layer;
+		this.cache = cache;
+		this.interval = interval;
+		this.minAge = minAge;
+		this.maxAge = maxAge;
+		this.maxFlows = maxFlows;
+		this.maxLength = maxLength;
+		this.flows = new Map();
+		this.excluded = [];
+		this.timer = null;
+		this.updating = null;
+		this.swaps = 0;
+		this.failures = 0;
+		this.lastSwap = null;
+		this.lastError = null;
+		this.sample = null;
+		this.packetRate = 0;
+		this.baselineRate = 0;
+	}
+
+	/**
+	 * Records a flow decided as "pass"; only passed flows may bypass the handle
+	 * @param {Uint8Array|Object} packet - Packet of the flow, or a tuple as returned by flowOf
+	 * @param {Uint8Array} [addr] - Address of the packet
+	 * @returns {boolean} false if the packet is not TCP or UDP
+	 */
+	add(packet, addr) {
+		const flow = addr === undefined ? packet : flowOf(packet, addr);
+		if (!flow) {
+			return false;
+		}
+		const key = flowKey(flow);
+		if (!this.flows.has(key)) {
+			this.flows.set(key, { flow, since: Date.now() });
+		}
+		return true;
+	}
+
+	/**
+	 * Forgets a flow, for example on a FLOW_DELETED event; it is let back in on the next update
+	 * @returns {boolean} false if the flow was not recorded
+	 */
+	remove(packet, addr) {
+		const flow = addr === undefined ? packet : flowOf(packet, addr);
+		return flow ? this.flows.delete(flowKey(flow)) : false;
+	}
+
+	/**
+	 * Starts updating the filter every interval
+	 * @returns {FilterNarrower} this
+	 */
+	start() {
+		if (!this.timer) {
+			// Failures are counted and kept in lastError by update().
+			this.timer = setInterval(() => this.update().catch(() => {}), this.interval);
+			this.timer.unref();
+		}
+		return this;
+	}
+
+	stop() {
+		clearInterval(this.timer);
+		this.timer = null;
+	}
+
+	/**
+	 * Regenerates the filter and swaps it in if the excluded set changed; calls are serialised
+	 * @returns {Promise<boolean>} true if the filter was replaced
+	 * @throws {Error} If the filter does not compile for another reason than its size, or the swap fails
+	 */
+	update() {
+		if (!this.updating) {
+			this.updating = this.#update().catch((error) => {
+				this.failures++;
+				this.lastError = error;
+				throw error;
+			}).finally(() => {
+				this.updating = null;
+			});
+		}
+		return this.updating;
+	}
+
+	async #update() {
+		const now = Date.now();
+		this.#measure(now);
+		for (const [key, entry] of this.flows) {
+			if (now - entry.since >= this.maxAge) {
+				this.flows.delete(key);
+			}
+		}
+		// Map order is insertion order, so the longest lived flows come first.
+		const eligible = [];
+		for (const entry of this.flows.values()) {
+			if (now - entry.since >= this.minAge && eligible.length < this.maxFlows) {
+				eligible.push(entry.flow);
+			}
+		}
+		const next = eligible.map(flowKey);
+		if (next.length === this.excluded.length && next.every((key, i) => key === this.excluded[i])) {
+			return false;
+		}
+
+		let count = eligible.length;
+		let compiled;
+		while (true) {
+			const filter = this.#build(eligible.slice(0, count));
+			if (count === 0 || filter.length <= this.maxLength) {
+				try {
+					compiled = new CompiledFilter(filter, this.layer);
+					break;
+				} catch (error) {
+					// Only a filter too big for the driver is retried with fewer flows.
+					if (count === 0 || !isSizeError(error)) {
+						throw error;
+					}
+				}
+			}
+			count = count >> 1;
+		}
+		if (count === this.excluded.length && next.slice(0, count).every((key, i) => key === this.excluded[i])) {
+			return false;
+		}
+
+		const baseline = this.packetRate;
+		try {
+			this.lastSwap = await this.handle.replaceFilter(compiled);
+		} catch (error) {
+			this.stop();
+			throw error;
+		}
+		this.excluded = next.slice(0, count);
+		this.swaps++;
+		this.baselineRate = baseline;
+		return true;
+	}
+
+	/**
+	 * Builds the base filter with the given flows excluded
+	 */
+	#build(flows) {
+		if (flows.length === 0) {
+			return this.filter;
+		}
+		return `(${this.filter}) and not (${flows.map(flowClause).join(' or ')})`;
+	}
+
+	/**
+	 * Updates the packet rate from the FlowCache lookups since the last update
+	 */
+	#measure(now) {
+		if (!this.cache) {
+			return;
+		}
+		const { lookups } = this.cache.stats();
+		if (this.sample && now > this.sample.time) {
+			this.packetRate = (lookups - this.sample.lookups) * 1000 / (now - this.sample.time);
+		}
+		this.sample = { time: now, lookups };
+	}
+
+	/**
+	 * Returns the state of the narrower
+	 * @returns {{flows: number, excluded: number, swaps: number, failures: number, lastError: string|null,
+	 *            packetRate: number, baselineRate: number, reduction: number, lastSwap: Object|null}}
+	 * packetRate is the TCP and UDP packets per second crossing into user space during the last
+	 * interval, baselineRate the rate before the last swap and reduction the share removed since.
+	 */
+	stats() {
+		return {
+			flows: this.flows.size,
+			excluded: this.excluded.length,
+			swaps: this.swaps,
+			failures: this.failures,
+			lastError: this.lastError ? this.lastError.message : null,
+			packetRate: this.packetRate,
+			baselineRate: this.baselineRate,
+			reduction: this.baselineRate > 0 ? Math.max(0, 1 - this.packetRate / this.baselineRate) : 0,
+			lastSwap: this.lastSwap
+		};
+	}
+}
+
+module.exports = { FilterNarrower, flowOf, flowClause };
@@ -0,0 +1,180 @@
+/**
+ * @file flow-cache.cc
+ * @brief Per-flow verdict cache that keeps decided flows out of JavaScript
+ */
+
+#include <cstring>
+#include "checksum.h"
+#include "flow-cache.h"
+
+FlowCacheStage::FlowCacheStage(size_t maxFlows, UINT64 idleTimeout)
+	: idleTimeout_(idleTimeout), rewrites_(std::make_shared<const std::vector<FlowRewrite>>()), table_(maxFlows),
+	  lastSweep_(0), lookups_(0), hits_(0), passed_(0), dropped_(0), rejected_(0), rewritten_(0), closed_(0), expired_(0), full_(0)
+{
+}
+
+void FlowCacheStage::SetRewrites(std::vector<FlowRewrite> rewrites)
+{
+	std::atomic_store(&this->rewrites_, std::shared_ptr<const std::vector<FlowRewrite>>(
+		std::make_shared<const std::vector<FlowRewrite>>(std::move(rewrites))));
+}
+
+bool FlowCacheStage::Set(const FlowKey &key, const FlowCacheEntry &entry)
+{
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	if (this->table_.Insert(key, entry) == nullptr)
+	{
+		this->full_++;
+		return false;
+	}
+	return true;
+}
+
+bool FlowCacheStage::Delete(const FlowKey &key)
+{
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	return this->table_.Erase(key);
+}
+
+void FlowCacheStage::Clear()
+{
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	this->table_.Clear();
+}
+
+StageVerdict FlowCacheStage::Process(PacketContext &ctx)
+{
+	FlowKey key;
+	if (!ctx.parsed || ctx.info.fragment || !FlowKeyFromPacket(ctx.data, ctx.info, ctx.addr->Outbound != 0, &key))
+	{
+		return STAGE_CONTINUE;
+	}
+	this->lookups_.fetch_add(1, std::memory_order_relaxed);
+	const bool closing = ctx.info.protocol == PACKET_PROTO_TCP &&
+						 (ctx.data[ctx.info.transportOffset + 13] & (PACKET_TCP_FIN | PACKET_TCP_RST)) != 0;
+
+	FlowCacheEntry entry;
+	{
+		std::lock_guard<std::mutex> lock(this->mutex_);
+		FlowCacheEntry *cached = this->table_.Find(key);
+		if (cached == nullptr)
+		{
+			return STAGE_CONTINUE;
+		}
+		entry = *cached;
+		if (closing)
+		{
+			// The verdict still applies to the FIN or RST itself.
+			this->table_.Erase(key);
+			this->closed_++;
+		}
+		else
+		{
+			cached->lastSeen = ctx.now;
+		}
+	}
+	this->hits_.fetch_add(1, std::memory_order_relaxed);
+
+	switch (entry.verdict)
+	{
+		case FLOW_DROP:
+			this->dropped_.fetch_add(1, std::memory_order_relaxed);
+			return STAGE_DROP;
+		case FLOW_REJECT:
+			this->rejected_.fetch_add(1, std::memory_order_relaxed);
+			return STAGE_REJECT;
+		case FLOW_REWRITE:
+		{
+			std::shared_ptr<const std::vector<FlowRewrite>> rewrites = std::atomic_load(&this->rewrites_);
+			if (entry.rewrite < rewrites->size())
+			{
+				Rewrite(ctx, (*rewrites)[entry.rewrite]);
+				this->rewritten_.fetch_add(1, std::memory_order_relaxed);
+				return STAGE_PASS;
+			}
+			// A rewrite removed by SetRewrites leaves the flow passing unchanged.
+			this->passed_.fetch_add(1, std::memory_order_relaxed);
+			return STAGE_PASS;
+		}
+		default:
+			this->passed_.fetch_add(1, std::memory_order_relaxed);
+			return STAGE_PASS;
+	}
+}
+
+void FlowCacheStage::Rewrite(PacketContext &ctx, const FlowRewrite &rewrite)
+{
+	UINT8 *data = ctx.data;
+	if (ctx.info.version == 4)
+	{
+		// TOS shares a checksum word with version and IHL, TTL with the protocol.
+		UINT8 before[10];
+		std::memcpy(before, data, sizeof(before));
+		if (rewrite.hasTos)
+		{
+			data[1] = rewrite.tos;
+		}
+		if (rewrite.hasTtl)
+		{
+			data[8] = rewrite.ttl;
+		}
+		if (ctx.addr->IPChecksum)
+		{
+			ChecksumUpdate(data + 10, ChecksumDelta(0, before, data, sizeof(before)));
+		}
+	}
+	else
+	{
+		if (rewrite.hasTos)
+		{
+			data[0] = static_cast<UINT8>((data[0] & 0xF0) | (rewrite.tos >> 4));
+			data[1] = static_cast<UINT8>((data[1] & 0x0F) | (rewrite.tos << 4));
+		}
+		if (rewrite.hasTtl)
+		{
+			data[7] = rewrite.ttl;
+		}
+	}
+
+	if (rewrite.hasWindow && ctx.info.protocol == PACKET_PROTO_TCP && ctx.info.transportLength >= PACKET_TCP_HDR_MIN)
+	{
+		UINT8 *transport = data + ctx.info.transportOffset;
+		UINT8 window[2];
+		WriteBE16(window, rewrite.window);
+		if (ctx.addr->TCPChecksum)
+		{
+			ChecksumUpdate(transport + 16, ChecksumDelta(0, transport + 14, window, 2));
+		}
+		std::memcpy(transport + 14, window, 2);
+	}
+}
+
+void FlowCacheStage::Tick(UINT64 now)
+{
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	if (now - this->lastSweep_ < FLOW_CACHE_SWEEP_INTERVAL)
+	{
+		return;
+	}
+	this->lastSweep_ = now;
+	const UINT64 idle = this->idleTimeout_;
+	this->expired_ += this->table_.EraseIf([now, idle](const FlowKey &, const FlowCacheEntry &entry)
+	{
+		return now > entry.lastSeen && now - entry.lastSeen > idle;
+	});
+}
+
+void FlowCacheStage::GetStats(FlowCacheStats *stats)
+{
+	stats->lookups = this->lookups_.load(std::memory_order_relaxed);
+	stats->hits = this->hits_.load(std::memory_order_relaxed);
+	stats->passed = this->passed_.load(std::memory_order_relaxed);
+	stats->dropped = this->dropped_.load(std::memory_order_relaxed);
+	stats->rejected = this->rejected_.load(std::memory_order_relaxed);
+	stats->rewritten = this->rewritten_.load(std::memory_order_relaxed);
+	stats->closed = this->closed_.load(std::memory_order_relaxed);
+	stats->expired = this->expired_.load(std::memory_order_relaxed);
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	stats->full = this->full_;
+	stats->flows = this->table_.Size();
+}
@@ -0,0 +1,147 @@
+/**
+ * @file flow-cache.h
+ * @brief Per-flow verdict cache that keeps decided flows out of JavaScript
+ *
+ * JavaScript decides a flow once, typically on its first interesting packet, and stores
+ * the verdict for the flow's 5-tuple. Later packets of the flow in either direction are
+ * passed, dropped, rejected or rewritten by the receive thread. Entries are removed when a FIN or
+ * RST is seen, when the flow is idle for too long, or when JavaScript deletes them.
+ */
+
+#ifndef FLOW_CACHE_H_
+#define FLOW_CACHE_H_
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "windivert.h"
+#include "packet.h"
+#include "flow-table.h"
+#include "packet-stage.h"
+
+#define FLOW_CACHE_DEFAULT_MAX_FLOWS (1 << 16)
+#define FLOW_CACHE_DEFAULT_IDLE      120000   ///< Idle milliseconds before an entry is forgotten
+#define FLOW_CACHE_SWEEP_INTERVAL    1000     ///< Milliseconds between expiry sweeps
+
+/**
+ * @enum FlowVerdict
+ * @brief What happens to cached flows
+ */
+enum FlowVerdict {
+	FLOW_PASS = 0,        ///< Reinject unchanged
+	FLOW_DROP = 1,        ///< Discard
+	FLOW_REWRITE = 2,     ///< Apply a FlowRewrite, then reinject
+	FLOW_REJECT = 3       ///< Discard and answer with a TCP RST or ICMP unreachable
+};
+
+/**
+ * @struct FlowRewrite
+ * @brief Header fields a rewrite verdict sets; checksums are fixed incrementally
+ */
+struct FlowRewrite {
+	bool hasTtl;
+	UINT8 ttl;            ///< IPv4 TTL or IPv6 hop limit
+	bool hasTos;
+	UINT8 tos;            ///< IPv4 TOS or IPv6 traffic class
+	bool hasWindow;
+	UINT16 window;        ///< TCP window, raw value before scaling
+};
+
+/**
+ * @struct FlowCacheEntry
+ * @brief Verdict of one flow
+ */
+struct FlowCacheEntry {
+	FlowVerdict verdict;
+	UINT32 rewrite;       ///< Index into the rewrites for FLOW_REWRITE
+	UINT64 lastSeen;      ///< GetTickCount64 of the last packet or of the set call
+};
+
+/**
+ * @struct FlowCacheStats
+ * @brief Counters since the cache was created
+ */
+struct FlowCacheStats {
+	UINT64 lookups;       ///< TCP and UDP packets looked up
+	UINT64 hits;          ///< Packets handled from the cache
+	UINT64 passed;
+	UINT64 dropped;
+	UINT64 rejected;
+	UINT64 rewritten;
+	UINT64 closed;        ///< Entries removed on FIN or RST
+	UINT64 expired;       ///< Entries removed by the idle timeout
+	UINT64 full;          ///< Set calls refused because the table was full
+	UINT64 flows;         ///< Entries in the cache
+};
+
+/**
+ * @class FlowCacheStage
+ * @brief PacketStage applying cached flow verdicts
+ */
+class FlowCacheStage : public PacketStage {
+	public:
+		/**
+		 * @param maxFlows Entries the cache holds; further set calls fail
+		 * @param idleTimeout Idle milliseconds before an entry is forgotten
+		 */
+		FlowCacheStage(size_t maxFlows, UINT64 idleTimeout);
+
+		/**
+		 * @brief Replaces the rewrites FLOW_REWRITE entries refer to by index
+		 */
+		void SetRewrites(std::vector<FlowRewrite> rewrites);
+
+		/**
+		 * @brief Stores the verdict of a flow, replacing an earlier one
+		 * @return false if the table is full
+		 */
+		bool Set(const FlowKey &key, const FlowCacheEntry &entry);
+
+		/**
+		 * @brief Removes a flow
+		 * @return false if the flow was not cached
+		 */
+		bool Delete(const FlowKey &key);
+
+		/**
+		 * @brief Forgets all flows
+		 */
+		void Clear();
+
+		/**
+		 * @brief Applies the cached verdict of the packet's flow
+		 * @return STAGE_PASS, STAGE_DROP or STAGE_REJECT on a hit, STAGE_CONTINUE on a miss
+		 */
+		StageVerdict Process(PacketContext &ctx) override;
+
+		/**
+		 * @brief Expires idle flows at most once per FLOW_CACHE_SWEEP_INTERVAL
+		 */
+		void Tick(UINT64 now) override;
+
+		void GetStats(FlowCacheStats *stats);
+
+	private:
+		/**
+		 * @brief Sets the header fields of a rewrite and fixes the checksums
+		 */
+		static void Rewrite(PacketContext &ctx, const FlowRewrite &rewrite);
+
+		UINT64 idleTimeout_;
+		std::shared_ptr<const std::vector<FlowRewrite>> rewrites_;   ///< Accessed with std::atomic_load/store
+		std::mutex mutex_;                 ///< Guards table_ and lastSweep_
+		FlowTable<FlowCacheEntry> table_;
+		UINT64 lastSweep_;
+		std::atomic<UINT64> lookups_;
+		std::atomic<UINT64> hits_;
+		std::atomic<UINT64> passed_;
+		std::atomic<UINT64> dropped_;
+		std::atomic<UINT64> rejected_;
+		std::atomic<UINT64> rewritten_;
+		std::atomic<UINT64> closed_;
+		std::atomic<UINT64> expired_;
+		std::atomic<UINT64> full_;
+};
+
+#endif
@@ -0,0 +1,192 @@
+/**
+ * @file flow-index.h
+ * @brief Flow to process attribution shared between handles
+ *
+ * FLOW and SOCKET layer handles feed their events into a FlowIndex from the receive
+ * thread; NETWORK layer handles joined to the same index look packets up by flow key.
+ * Sockets that are only bound or listening are stored under a port key with zero
+ * addresses and remote port, which is used when no exact 5-tuple entry exists.
+ */
+
+#ifndef FLOW_INDEX_H_
+#define FLOW_INDEX_H_
+
+#include <cstdint>
+#include <shared_mutex>
+#include <mutex>
+#include "packet.h"
+#include "flow-table.h"
+
+/**
+ * @struct FlowEntry
+ * @brief What is known about the endpoint owning a flow
+ */
+struct FlowEntry {
+	uint64_t endpointId;         ///< WinDivert endpoint ID
+	uint64_t parentEndpointId;   ///< WinDivert parent endpoint ID
+	uint32_t processId;          ///< Owning process
+};
+
+/**
+ * @enum FlowChangeKind
+ * @brief What a FlowChange does to the index
+ */
+enum FlowChangeKind {
+	FLOW_CHANGE_ADD,            ///< Record a flow or connected socket
+	FLOW_CHANGE_ADD_PORT,       ///< Record a bound or listening socket under its port key
+	FLOW_CHANGE_REMOVE,         ///< Forget a flow
+	FLOW_CHANGE_REMOVE_PORT     ///< Forget the port key of a closed bound socket
+};
+
+/**
+ * @struct FlowChange
+ * @brief One update of a batch applied with FlowIndex::Apply
+ */
+struct FlowChange {
+	FlowKey key;
+	FlowEntry entry;            ///< Unused by removals
+	FlowChangeKind kind;
+};
+
+/**
+ * @class FlowIndex
+ * @brief Thread safe FlowTable of FlowEntry, many readers and one writer at a time
+ */
+class FlowIndex {
+	public:
+		explicit FlowIndex(size_t maxSize) : table_(maxSize)
+		{
+		}
+
+		/**
+		 * @brief Records an established flow or connected socket
+		 * @return false if the index is full
+		 */
+		bool Add(const FlowKey &key, const FlowEntry &entry)
+		{
+			std::unique_lock<std::shared_mutex> lock(mutex_);
+			return table_.Insert(key, entry) != nullptr;
+		}
+
+		/**
+		 * @brief Records a bound or listening socket under its port key
+		 */
+		bool AddPort(const FlowKey &key, const FlowEntry &entry)
+		{
+			return Add(PortKey(key), entry);
+		}
+
+		/**
+		 * @brief Forgets a flow, and the port key of a closed bound socket
+		 */
+		void Remove(const FlowKey &key, bool port)
+		{
+			std::unique_lock<std::shared_mutex> lock(mutex_);
+			table_.Erase(port ? PortKey(key) : key);
+		}
+
+		/**
+		 * @brief Applies a batch of changes in order under one writer lock
+		 * @return false if the index filled up
+		 */
+		bool Apply(const FlowChange *changes, size_t count)
+		{
+			bool full = false;
+			std::unique_lock<std::shared_mutex> lock(mutex_);
+			for (size_t i = 0; i < count; i++)
+			{
+				const FlowChange &change = changes[i];
+				switch (change.kind)
+				{
+					case FLOW_CHANGE_ADD:
+						full |= table_.Insert(change.key, change.entry) == nullptr;
+						break;
+					case FLOW_CHANGE_ADD_PORT:
+						full |= table_.Insert(PortKey(change.key), change.entry) == nullptr;
+						break;
+					case FLOW_CHANGE_REMOVE:
+						table_.Erase(change.key);
+						break;
+					case FLOW_CHANGE_REMOVE_PORT:
+						table_.Erase(PortKey(change.key));
+						break;
+				}
+			}
+			return !full;
+		}
+
+		/**
+		 * @brief Finds the entry of a flow, falling back to its local port
+		 * @return false if neither the flow nor its port is known
+		 */
+		bool Lookup(const FlowKey &key, FlowEntry *entry)
+		{
+			std::shared_lock<std::shared_mutex> lock(mutex_);
+			const FlowEntry *found = table_.Find(key);
+			if (found == nullptr)
+			{
+				found = table_.Find(PortKey(key));
+			}
+			if (found == nullptr)
+			{
+				return false;
+			}
+			*entry = *found;
+			return true;
+		}
+
+		/**
+		 * @brief Looks up the processes of many flows under one lock
+		 * @param keys Flow keys, entries with protocol 0 are skipped
+		 * @param count Number of keys
+		 * @param processIds Receives the process ID of each key, 0 if unknown
+		 */
+		void LookupProcesses(const FlowKey *keys, size_t count, uint32_t *processIds)
+		{
+			std::shared_lock<std::shared_mutex> lock(mutex_);
+			for (size_t i = 0; i < count; i++)
+			{
+				processIds[i] = 0;
+				if (keys[i].protocol == 0)
+				{
+					continue;
+				}
+				const FlowEntry *found = table_.Find(keys[i]);
+				if (found == nullptr)
+				{
+					found = table_.Find(PortKey(keys[i]));
+				}
+				if (found != nullptr)
+				{
+					processIds[i] = found->processId;
+				}
+			}
+		}
+
+		size_t Size()
+		{
+			std::shared_lock<std::shared_mutex> lock(mutex_);
+			return table_.Size();
+		}
+
+		void Clear()
+		{
+			std::unique_lock<std::shared_mutex> lock(mutex_);
+			table_.Clear();
+		}
+
+	private:
+		static FlowKey PortKey(const FlowKey &key)
+		{
+			FlowKey port;
+			std::memset(&port, 0, sizeof(FlowKey));
+			port.localPort = key.localPort;
+			port.protocol = key.protocol;
+			return port;
+		}
+
+		std::shared_mutex mutex_;       ///< Guards table_
+		FlowTable<FlowEntry> table_;    ///< Flow and port keys
+};
+
+#endif
@@ -0,0 +1,225 @@
+/**
+ * @file flow-table.h
+ * @brief Open addressing hash table keyed by FlowKey
+ *
+ * Linear probing over a power of two slot array with backward shift deletion, so there
+ * are no tombstones and lookups never degrade after churn. The table grows until it
+ * reaches its maximum size; beyond that Insert fails and callers decide what to evict.
+ * Not thread safe; owners add their own locking.
+ */
+
+#ifndef FLOW_TABLE_H_
+#define FLOW_TABLE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "packet.h"
+
+#define FLOW_TABLE_MIN_CAPACITY 64
+
+template <typename V>
+class FlowTable {
+	public:
+		/**
+		 * @brief Creates an empty table
+		 * @param maxSize Maximum number of entries
+		 */
+		explicit FlowTable(size_t maxSize = 1 << 20) : maxSize_(maxSize), size_(0)
+		{
+			slots_.resize(FLOW_TABLE_MIN_CAPACITY);
+		}
+
+		/**
+		 * @brief Returns the value stored for a key
+		 * @return Pointer valid until the next insert or erase, or nullptr
+		 */
+		V *Find(const FlowKey &key)
+		{
+			const size_t mask = slots_.size() - 1;
+			for (size_t i = FlowHash(key) & mask;; i = (i + 1) & mask)
+			{
+				Slot &slot = slots_[i];
+				if (!slot.used)
+				{
+					return nullptr;
+				}
+				if (slot.key == key)
+				{
+					return &slot.value;
+				}
+			}
+		}
+
+		/**
+		 * @brief Inserts or replaces the value for a key
+		 * @return Pointer to the stored value, or nullptr if the table is full
+		 */
+		V *Insert(const FlowKey &key, const V &value)
+		{
+			V *existing = Find(key);
+			if (existing != nullptr)
+			{
+				*existing = value;
+				return existing;
+			}
+			if (size_ >= maxSize_)
+			{
+				return nullptr;
+			}
+			if ((size_ + 1) * 4 > slots_.size() * 3)
+			{
+				Rehash(slots_.size() * 2);
+			}
+			const size_t mask = slots_.size() - 1;
+			size_t i = FlowHash(key) & mask;
+			while (slots_[i].used)
+			{
+				i = (i + 1) & mask;
+			}
+			slots_[i].used = true;
+			slots_[i].key = key;
+			slots_[i].value = value;
+			size_++;
+			return &slots_[i].value;
+		}
+
+		/**
+		 * @brief Removes a key
+		 * @return false if the key was not present
+		 */
+		bool Erase(const FlowKey &key)
+		{
+			const size_t mask = slots_.size() - 1;
+			size_t i = FlowHash(key) & mask;
+			while (true)
+			{
+				if (!slots_[i].used)
+				{
+					return false;
+				}
+				if (slots_[i].key == key)
+				{
+					break;
+				}
+				i = (i + 1) & mask;
+			}
+			EraseSlot(i);
+			return true;
+		}
+
+		/**
+		 * @brief Removes every entry for which pred(key, value) returns true
+		 * @return Number of removed entries
+		 */
+		template <typename F>
+		size_t EraseIf(F pred)
+		{
+			size_t removed = 0;
+			for (size_t i = 0; i < slots_.size();)
+			{
+				// A backward shift may move a later entry into slot i, so re-check it.
+				if (slots_[i].used && pred(slots_[i].key, slots_[i].value))
+				{
+					EraseSlot(i);
+					removed++;
+				}
+				else
+				{
+					i++;
+				}
+			}
+			return removed;
+		}
+
+		/**
+		 * @brief Calls fn(key, value) for every entry
+		 */
+		template <typename F>
+		void ForEach(F fn)
+		{
+			for (Slot &slot : slots_)
+			{
+				if (slot.used)
+				{
+					fn(slot.key, slot.value);
+				}
+			}
+		}
+
+		void Clear()
+		{
+			slots_.assign(FLOW_TABLE_MIN_CAPACITY, Slot());
+			size_ = 0;
+		}
+
+		size_t Size() const
+		{
+			return size_;
+		}
+
+		size_t MaxSize() const
+		{
+			return maxSize_;
+		}
+
+	private:
+		struct Slot {
+			bool used = false;
+			FlowKey key;
+			V value;
+		};
+
+		/**
+		 * @brief Empties a slot and shifts the following probe chain back
+		 */
+		void EraseSlot(size_t hole)
+		{
+			const size_t mask = slots_.size() - 1;
+			size_t i = hole;
+			while (true)
+			{
+				i = (i + 1) & mask;
+				if (!slots_[i].used)
+				{
+					break;
+				}
+				const size_t home = FlowHash(slots_[i].key) & mask;
+				// Move the entry back unless its home lies cyclically in (hole, i].
+				if (((i - home) & mask) >= ((i - hole) & mask))
+				{
+					slots_[hole] = slots_[i];
+					hole = i;
+				}
+			}
+			slots_[hole].used = false;
+			size_--;
+		}
+
+		void Rehash(size_t capacity)
+		{
+			std::vector<Slot> old;
+			old.swap(slots_);
+			slots_.resize(capacity);
+			const size_t mask = capacity - 1;
+			for (Slot &slot : old)
+			{
+				if (!slot.used)
+				{
+					continue;
+				}
+				size_t i = FlowHash(slot.key) & mask;
+				while (slots_[i].used)
+				{
+					i = (i + 1) & mask;
+				}
+				slots_[i] = slot;
+			}
+		}
+
+		std::vector<Slot> slots_;    ///< Power of two slot array
+		size_t maxSize_;             ///< Entry limit
+		size_t size_;                ///< Entries in use
+};
+
+#endif
@@ -0,0 +1,255 @@
+/**
+ * @file fragmenter.cc
+ * @brief Stage splitting packets into IPv4 or IPv6 fragments
+ */
+
+#include <cstring>
+#include <random>
+#include "checksum.h"
+#include "fragmenter.h"
+
+#define IPV6_NEXT_HOPOPTS  0
+#define IPV6_NEXT_ROUTING  43
+#define IPV6_NEXT_FRAGMENT 44
+#define IPV6_NEXT_DSTOPTS  60
+
+/**
+ * @brief Copies the IPv4 options whose copied flag is set, as later fragments carry them.
+ * @param options Options of the unfragmented packet
+ * @param length Their length
+ * @param out Receives the options padded to 4 bytes, or nullptr to only measure them
+ * @return Padded length
+ */
+static UINT32 CopyIPv4Options(const UINT8 *options, UINT32 length, UINT8 *out)
+{
+	UINT32 copied = 0;
+	UINT32 i = 0;
+	while (i < length && options[i] != 0)
+	{
+		if (options[i] == 1)
+		{
+			i++;
+			continue;
+		}
+		if (i + 1 >= length || options[i + 1] < 2 || i + options[i + 1] > length)
+		{
+			break;
+		}
+		const UINT32 optionLength = options[i + 1];
+		if ((options[i] & 0x80) != 0)
+		{
+			if (out != nullptr)
+			{
+				std::memcpy(out + copied, options + i, optionLength);
+			}
+			copied += optionLength;
+		}
+		i += optionLength;
+	}
+	const UINT32 padded = (copied + 3) & ~3u;
+	if (out != nullptr)
+	{
+		std::memset(out + copied, 0, padded - copied);
+	}
+	return padded;
+}
+
+/**
+ * @brief Finds the end of the IPv6 headers that precede a Fragment header.
+ * @param data Packet data
+ * @param length Packet length
+ * @param nextHeader Receives the offset of the Next Header field to chain the Fragment header from
+ * @return Length of the unfragmentable part
+ *
+ * Hop-by-Hop Options, Routing and Destination Options followed by Routing are processed
+ * by the routers on the way and stay in every fragment.
+ */
+static UINT32 IPv6Unfragmentable(const UINT8 *data, UINT32 length, UINT32 *nextHeader)
+{
+	UINT32 end = PACKET_IPV6_HDR_LEN;
+	UINT32 offset = PACKET_IPV6_HDR_LEN;
+	UINT8 protocol = data[6];
+	*nextHeader = 6;
+	while (offset + 2 <= length)
+	{
+		const UINT8 *hdr = data + offset;
+		const UINT32 headerLength = (hdr[1] + 1) * 8;
+		if (offset + headerLength > length)
+		{
+			break;
+		}
+		if (protocol == IPV6_NEXT_HOPOPTS || protocol == IPV6_NEXT_ROUTING)
+		{
+			*nextHeader = offset;
+			end = offset + headerLength;
+		}
+		else if (protocol != IPV6_NEXT_DSTOPTS || hdr[0] != IPV6_NEXT_ROUTING)
+		{
+			break;
+		}
+		protocol = hdr[0];
+		offset += headerLength;
+	}
+	return end;
+}
+
+bool PlanFragments(const UINT8 *data, const PacketInfo &info, const UINT32 *offsets, size_t count, FragmentPlan *plan)
+{
+	if (info.fragment)
+	{
+		return false;
+	}
+	std::memset(plan, 0, sizeof(FragmentPlan));
+	plan->version = info.version;
+	if (info.version == 4)
+	{
+		plan->headerLength = info.transportOffset;
+		plan->tailHeaderLength = PACKET_IPV4_HDR_MIN +
+			CopyIPv4Options(data + PACKET_IPV4_HDR_MIN, plan->headerLength - PACKET_IPV4_HDR_MIN, nullptr);
+	}
+	else
+	{
+		plan->headerLength = IPv6Unfragmentable(data, info.length, &plan->nextHeader);
+		plan->tailHeaderLength = plan->headerLength;
+	}
+
+	const UINT32 payload = info.length - plan->headerLength;
+	plan->count = 1;
+	for (size_t i = 0; i < count && plan->count <= FRAGMENTER_MAX_SPLITS; i++)
+	{
+		const UINT32 offset = offsets[i];
+		if (offset % 8 == 0 && offset > plan->bounds[plan->count - 1] && offset < payload)
+		{
+			plan->bounds[plan->count++] = offset;
+		}
+	}
+	plan->bounds[plan->count] = payload;
+	return plan->count > 1;
+}
+
+UINT32 FragmentLength(const FragmentPlan &plan, UINT32 index)
+{
+	const UINT32 header = plan.version == 4 ? (index == 0 ? plan.headerLength : plan.tailHeaderLength)
+											: plan.headerLength + FRAGMENTER_IPV6_FRAG_LEN;
+	return header + plan.bounds[index + 1] - plan.bounds[index];
+}
+
+void BuildFragment(const UINT8 *data, const FragmentPlan &plan, UINT32 index, UINT32 id, UINT8 *out)
+{
+	const UINT32 start = plan.bounds[index];
+	const UINT32 length = plan.bounds[index + 1] - start;
+	const bool more = index + 1 < plan.count;
+	UINT32 header;
+	if (plan.version == 4)
+	{
+		if (index == 0)
+		{
+			header = plan.headerLength;
+			std::memcpy(out, data, header);
+		}
+		else
+		{
+			header = plan.tailHeaderLength;
+			std::memcpy(out, data, PACKET_IPV4_HDR_MIN);
+			CopyIPv4Options(data + PACKET_IPV4_HDR_MIN, plan.headerLength - PACKET_IPV4_HDR_MIN, out + PACKET_IPV4_HDR_MIN);
+			out[0] = static_cast<UINT8>(0x40 | (header / 4));
+		}
+		// DF is cleared, the fragments must be allowed to arrive as they are.
+		WriteBE16(out + 4, static_cast<UINT16>(id));
+		WriteBE16(out + 6, static_cast<UINT16>((more ? 0x2000 : 0) | (start / 8)));
+	}
+	else
+	{
+		std::memcpy(out, data, plan.headerLength);
+		UINT8 *fragment = out + plan.headerLength;
+		fragment[0] = data[plan.nextHeader];
+		fragment[1] = 0;
+		WriteBE16(fragment + 2, static_cast<UINT16>(start | (more ? 1 : 0)));
+		WriteBE32(fragment + 4, id);
+		out[plan.nextHeader] = IPV6_NEXT_FRAGMENT;
+		header = plan.headerLength + FRAGMENTER_IPV6_FRAG_LEN;
+	}
+	std::memcpy(out + header, data + plan.headerLength + start, length);
+	SetPacketLength(out, header + length);
+	CalcPacketChecksums(out, header + length);
+}
+
+void FragmentSendOrder(FragmentOrder order, UINT32 count, UINT32 *indices)
+{
+	for (UINT32 i = 0; i < count; i++)
+	{
+		switch (order)
+		{
+			case FRAGMENT_REVERSED:
+				indices[i] = count - 1 - i;
+				break;
+			case FRAGMENT_FIRST_LAST:
+				indices[i] = (i + 1) % count;
+				break;
+			default:
+				indices[i] = i;
+				break;
+		}
+	}
+}
+
+FragmenterStage::FragmenterStage(const FragmentConfig &config)
+	: config_(config), nextId_(std::random_device()()), matched_(0), fragmented_(0), fragments_(0), skipped_(0)
+{
+}
+
+UINT32 FragmenterStage::Identification(const UINT8 *data, const PacketInfo &info)
+{
+	if (info.version == 4)
+	{
+		return ReadBE16(data + 4);
+	}
+	return this->nextId_.fetch_add(1, std::memory_order_relaxed);
+}
+
+StageVerdict FragmenterStage::Process(PacketContext &ctx)
+{
+	if (!ctx.parsed || ctx.info.fragment || !MatchPacket(this->config_.match, ctx.data, ctx.info, *ctx.addr))
+	{
+		return STAGE_CONTINUE;
+	}
+	if (this->config_.payload != FAKE_MATCH_ANY &&
+		(ctx.info.protocol != PACKET_PROTO_TCP || ctx.info.payloadLength == 0 ||
+		 !MatchPayload(this->config_.payload, ctx.data + ctx.info.payloadOffset, ctx.info.payloadLength)))
+	{
+		return STAGE_CONTINUE;
+	}
+	this->matched_.fetch_add(1, std::memory_order_relaxed);
+	FragmentPlan plan;
+	if (!ctx.reinject || ctx.send == nullptr ||
+		!PlanFragments(ctx.data, ctx.info, this->config_.offsets.data(), this->config_.offsets.size(), &plan))
+	{
+		this->skipped_.fetch_add(1, std::memory_order_relaxed);
+		return STAGE_CONTINUE;
+	}
+
+	// A checksum left to offloading could no longer be filled in once the segment is split.
+	CalcPacketChecksums(ctx.data, ctx.info.length);
+	WINDIVERT_ADDRESS addr = *ctx.addr;
+	addr.IPChecksum = 1;
+	addr.TCPChecksum = 1;
+	addr.UDPChecksum = 1;
+	UINT32 order[FRAGMENTER_MAX_SPLITS + 1];
+	FragmentSendOrder(this->config_.order, plan.count, order);
+	const UINT32 id = Identification(ctx.data, ctx.info);
+	for (UINT32 i = 0; i < plan.count; i++)
+	{
+		BuildFragment(ctx.data, plan, order[i], id, ctx.send->Reserve(FragmentLength(plan, order[i]), addr));
+	}
+	this->fragmented_.fetch_add(1, std::memory_order_relaxed);
+	this->fragments_.fetch_add(plan.count, std::memory_order_relaxed);
+	return STAGE_HOLD;
+}
+
+void FragmenterStage::GetStats(FragmenterStats *stats)
+{
+	stats->matched = this->matched_.load(std::memory_order_relaxed);
+	stats->fragmented = this->fragmented_.load(std::memory_order_relaxed);
+	stats->fragments = this->fragments_.load(std::memory_order_relaxed);
+	stats->skipped = this->skipped_.load(std::memory_order_relaxed);
+}
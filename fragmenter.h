@@ -0,0 +1,149 @@
+/**
+ * @file fragmenter.h
+ * @brief Stage splitting packets into IPv4 or IPv6 fragments
+ *
+ * A DPI box that does not reassemble IP fragments cannot see a TLS ClientHello or HTTP
+ * request cut across them, while the server's stack reassembles them before TCP sees the
+ * segment, so no sequence numbers need to be tracked. Fragments are built straight into
+ * the receive thread's send batch, in order or deliberately reordered, and leave in the
+ * same WinDivertSendEx call.
+ */
+
+#ifndef FRAGMENTER_H_
+#define FRAGMENTER_H_
+
+#include <atomic>
+#include <vector>
+#include "windivert.h"
+#include "packet.h"
+#include "packet-match.h"
+#include "packet-stage.h"
+#include "fake-injector.h"
+
+#define FRAGMENTER_MAX_SPLITS 15        ///< Split points per packet, so at most 16 fragments
+#define FRAGMENTER_IPV6_FRAG_LEN 8      ///< Length of the IPv6 Fragment header
+
+/**
+ * @enum FragmentOrder
+ * @brief Order the fragments of a packet are sent in
+ */
+enum FragmentOrder {
+	FRAGMENT_ORDERED = 0,     ///< By offset
+	FRAGMENT_REVERSED = 1,    ///< Last fragment first
+	FRAGMENT_FIRST_LAST = 2   ///< By offset, but the fragment with the transport header last
+};
+
+/**
+ * @struct FragmentConfig
+ * @brief Packets the stage splits and how
+ */
+struct FragmentConfig {
+	PacketMatch match;                ///< Packets considered
+	FakeMatch payload;                ///< Kind of TCP payload required, FAKE_MATCH_ANY for every packet
+	FragmentOrder order;
+	std::vector<UINT32> offsets;      ///< Split points in the fragmentable part, ascending multiples of 8
+};
+
+/**
+ * @struct FragmentPlan
+ * @brief Layout of the fragments of one packet
+ */
+struct FragmentPlan {
+	UINT8 version;
+	UINT32 headerLength;      ///< IPv4 header, or IPv6 header and the extension headers that stay unfragmented
+	UINT32 tailHeaderLength;  ///< IPv4 header of the later fragments, which keep only the copied options
+	UINT32 nextHeader;        ///< IPv6 Next Header field the Fragment header is chained from
+	UINT32 count;             ///< Fragments
+	UINT32 bounds[FRAGMENTER_MAX_SPLITS + 2]; ///< Start of each fragment in the fragmentable part, then its length
+};
+
+/**
+ * @struct FragmenterStats
+ * @brief Counters since the stage was created
+ */
+struct FragmenterStats {
+	UINT64 matched;           ///< Packets selected by match and payload
+	UINT64 fragmented;        ///< Packets sent as fragments
+	UINT64 fragments;         ///< Fragments sent
+	UINT64 skipped;           ///< Matched but too short to split, or the handle cannot send
+};
+
+/**
+ * @brief Lays out the fragments of a packet
+ * @param data Unfragmented packet
+ * @param info Its headers
+ * @param offsets Split points in the fragmentable part, ascending; those not a positive
+ *                multiple of 8 inside the packet are ignored
+ * @param count Number of split points, at most FRAGMENTER_MAX_SPLITS
+ * @param plan Receives the layout
+ * @return false if the packet is already a fragment or no split point applies
+ */
+bool PlanFragments(const UINT8 *data, const PacketInfo &info, const UINT32 *offsets, size_t count, FragmentPlan *plan);
+
+/**
+ * @brief Returns the length of a fragment
+ * @param plan Layout from PlanFragments
+ * @param index Fragment, by offset
+ */
+UINT32 FragmentLength(const FragmentPlan &plan, UINT32 index);
+
+/**
+ * @brief Builds a fragment
+ * @param data Packet the plan was made for, with a valid transport checksum
+ * @param plan Its layout
+ * @param index Fragment, by offset
+ * @param id IPv4 Identification (16 bits) or IPv6 Fragment header Identification
+ * @param out Receives FragmentLength bytes, IPv4 header checksum included
+ */
+void BuildFragment(const UINT8 *data, const FragmentPlan &plan, UINT32 index, UINT32 id, UINT8 *out);
+
+/**
+ * @brief Returns the fragments of a plan in send order
+ * @param order Send order
+ * @param count Fragments
+ * @param indices Receives count fragment indices
+ */
+void FragmentSendOrder(FragmentOrder order, UINT32 count, UINT32 *indices);
+
+/**
+ * @class FragmenterStage
+ * @brief PacketStage sending matching packets as IP fragments
+ */
+class FragmenterStage : public PacketStage {
+	public:
+		explicit FragmenterStage(const FragmentConfig &config);
+
+		/**
+		 * @brief Adds the fragments of a matching packet to the send batch
+		 * @return STAGE_HOLD if sent, STAGE_CONTINUE otherwise
+		 */
+		StageVerdict Process(PacketContext &ctx) override;
+
+		/**
+		 * @brief Returns the identification the fragments of a packet get
+		 *
+		 * IPv4 fragments keep the packet's own Identification; IPv6 ones take the next value
+		 * of a counter started at a random value.
+		 */
+		UINT32 Identification(const UINT8 *data, const PacketInfo &info);
+
+		/**
+		 * @brief Settings the stage was created with
+		 */
+		const FragmentConfig &Config() const
+		{
+			return config_;
+		}
+
+		void GetStats(FragmenterStats *stats);
+
+	private:
+		FragmentConfig config_;
+		std::atomic<UINT32> nextId_;
+		std::atomic<UINT64> matched_;
+		std::atomic<UINT64> fragmented_;
+		std::atomic<UINT64> fragments_;
+		std::atomic<UINT64> skipped_;
+};
+
+#endif
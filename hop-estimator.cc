@@ -0,0 +1,144 @@
+/**
+ * @file hop-estimator.cc
+ * @brief Hop distance of remote hosts, learned from the TTL of their SYN-ACKs
+ */
+
+#include "hop-estimator.h"
+
+#define HOP_NONE 0xFFFFFFFFu
+
+void EstimateHops(UINT8 ttl, HopEntry *entry)
+{
+	entry->ttl = ttl;
+	entry->initialTtl = ttl <= 64 ? 64 : (ttl <= 128 ? 128 : 255);
+	entry->hops = static_cast<UINT8>(entry->initialTtl - ttl);
+}
+
+HopEstimatorStage::HopEstimatorStage(size_t maxHosts)
+	: index_(maxHosts), maxHosts_(maxHosts == 0 ? 1 : maxHosts), head_(HOP_NONE), tail_(HOP_NONE), evicted_(0),
+	  observed_(0), lookups_(0), hits_(0)
+{
+}
+
+void HopEstimatorStage::Unlink(UINT32 index)
+{
+	Slot &slot = this->slots_[index];
+	if (slot.prev != HOP_NONE)
+	{
+		this->slots_[slot.prev].next = slot.next;
+	}
+	else
+	{
+		this->head_ = slot.next;
+	}
+	if (slot.next != HOP_NONE)
+	{
+		this->slots_[slot.next].prev = slot.prev;
+	}
+	else
+	{
+		this->tail_ = slot.prev;
+	}
+}
+
+void HopEstimatorStage::PushFront(UINT32 index)
+{
+	Slot &slot = this->slots_[index];
+	slot.prev = HOP_NONE;
+	slot.next = this->head_;
+	if (this->head_ != HOP_NONE)
+	{
+		this->slots_[this->head_].prev = index;
+	}
+	this->head_ = index;
+	if (this->tail_ == HOP_NONE)
+	{
+		this->tail_ = index;
+	}
+}
+
+StageVerdict HopEstimatorStage::Process(PacketContext &ctx)
+{
+	if (!ctx.parsed || ctx.addr->Outbound || ctx.info.fragment || ctx.info.protocol != PACKET_PROTO_TCP ||
+		ctx.info.transportLength < PACKET_TCP_HDR_MIN)
+	{
+		return STAGE_CONTINUE;
+	}
+	const UINT8 flags = ctx.data[ctx.info.transportOffset + 13];
+	if ((flags & (PACKET_TCP_SYN | PACKET_TCP_ACK | PACKET_TCP_RST)) != (PACKET_TCP_SYN | PACKET_TCP_ACK))
+	{
+		return STAGE_CONTINUE;
+	}
+	const bool ipv6 = ctx.info.version == 6;
+	FlowKey key;
+	HostKey(ctx.data + (ipv6 ? 8 : 12), ipv6, &key);
+	Observe(key, ctx.data[ipv6 ? 7 : 8], ctx.now);
+	return STAGE_CONTINUE;
+}
+
+void HopEstimatorStage::Observe(const FlowKey &key, UINT8 ttl, UINT64 now)
+{
+	this->observed_.fetch_add(1, std::memory_order_relaxed);
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	UINT32 *found = this->index_.Find(key);
+	UINT32 index;
+	if (found != nullptr)
+	{
+		index = *found;
+		Unlink(index);
+	}
+	else if (this->slots_.size() < this->maxHosts_)
+	{
+		index = static_cast<UINT32>(this->slots_.size());
+		this->slots_.emplace_back();
+		this->slots_[index].key = key;
+		this->index_.Insert(key, index);
+	}
+	else
+	{
+		index = this->tail_;
+		Unlink(index);
+		this->index_.Erase(this->slots_[index].key);
+		this->slots_[index].key = key;
+		this->index_.Insert(key, index);
+		this->evicted_++;
+	}
+	EstimateHops(ttl, &this->slots_[index].entry);
+	this->slots_[index].entry.seen = now;
+	PushFront(index);
+}
+
+bool HopEstimatorStage::Lookup(const FlowKey &key, HopEntry *entry)
+{
+	this->lookups_.fetch_add(1, std::memory_order_relaxed);
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	UINT32 *found = this->index_.Find(key);
+	if (found == nullptr)
+	{
+		return false;
+	}
+	*entry = this->slots_[*found].entry;
+	Unlink(*found);
+	PushFront(*found);
+	this->hits_.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+void HopEstimatorStage::Clear()
+{
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	this->index_.Clear();
+	this->slots_.clear();
+	this->head_ = HOP_NONE;
+	this->tail_ = HOP_NONE;
+}
+
+void HopEstimatorStage::GetStats(HopEstimatorStats *stats)
+{
+	stats->observed = this->observed_.load(std::memory_order_relaxed);
+	stats->lookups = this->lookups_.load(std::memory_order_relaxed);
+	stats->hits = this->hits_.load(std::memory_order_relaxed);
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	stats->evicted = this->evicted_;
+	stats->hosts = this->slots_.size();
+}
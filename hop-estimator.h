@@ -0,0 +1,128 @@
+/**
+ * @file hop-estimator.h
+ * @brief Hop distance of remote hosts, learned from the TTL of their SYN-ACKs
+ *
+ * Hosts start packets with a TTL or hop limit of 64, 128 or 255. The smallest of these
+ * that is not below the value a SYN-ACK arrives with is taken as the initial one, and the
+ * difference is the number of routers in between. Distances are kept per remote address
+ * in a fixed size least recently used cache, so lookups are O(1) and memory is bounded.
+ */
+
+#ifndef HOP_ESTIMATOR_H_
+#define HOP_ESTIMATOR_H_
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "windivert.h"
+#include "packet.h"
+#include "flow-table.h"
+#include "packet-stage.h"
+
+#define HOP_ESTIMATOR_DEFAULT_MAX_HOSTS 4096
+
+/**
+ * @struct HopEntry
+ * @brief What is known about one remote host
+ */
+struct HopEntry {
+	UINT8 hops;               ///< Routers between the host and this machine
+	UINT8 initialTtl;         ///< Inferred initial TTL or hop limit, 64, 128 or 255
+	UINT8 ttl;                ///< TTL or hop limit of the last SYN-ACK
+	UINT64 seen;              ///< GetTickCount64 of the last SYN-ACK
+};
+
+/**
+ * @struct HopEstimatorStats
+ * @brief Counters since the estimator was created
+ */
+struct HopEstimatorStats {
+	UINT64 observed;          ///< SYN-ACKs seen
+	UINT64 lookups;
+	UINT64 hits;
+	UINT64 evicted;           ///< Hosts dropped to make room
+	UINT64 hosts;             ///< Hosts in the cache
+};
+
+/**
+ * @brief Infers the hop distance of a TTL or hop limit
+ * @param ttl Value a packet arrived with
+ * @param entry Receives hops and initialTtl
+ */
+void EstimateHops(UINT8 ttl, HopEntry *entry);
+
+/**
+ * @class HopEstimatorStage
+ * @brief PacketStage learning hop distances from inbound SYN-ACKs
+ *
+ * Other stages share the object and call Lookup on their own receive threads.
+ */
+class HopEstimatorStage : public PacketStage {
+	public:
+		/**
+		 * @param maxHosts Hosts kept; the least recently used one is replaced when full
+		 */
+		explicit HopEstimatorStage(size_t maxHosts);
+
+		/**
+		 * @brief Records the TTL of inbound SYN-ACKs
+		 * @return STAGE_CONTINUE
+		 */
+		StageVerdict Process(PacketContext &ctx) override;
+
+		/**
+		 * @brief Records a TTL or hop limit seen from a host
+		 * @param key Host key from HostKey
+		 */
+		void Observe(const FlowKey &key, UINT8 ttl, UINT64 now);
+
+		/**
+		 * @brief Returns what is known about a host and marks it as recently used
+		 * @param key Host key from HostKey
+		 * @param entry Receives the entry
+		 * @return false if the host was not seen
+		 */
+		bool Lookup(const FlowKey &key, HopEntry *entry);
+
+		/**
+		 * @brief Forgets all hosts
+		 */
+		void Clear();
+
+		void GetStats(HopEstimatorStats *stats);
+
+	private:
+		/**
+		 * @struct Slot
+		 * @brief Cache entry linked into the recency list by index
+		 */
+		struct Slot {
+			FlowKey key;
+			HopEntry entry;
+			UINT32 prev;
+			UINT32 next;
+		};
+
+		/**
+		 * @brief Unlinks a slot from the recency list
+		 */
+		void Unlink(UINT32 index);
+
+		/**
+		 * @brief Links a slot in as the most recently used
+		 */
+		void PushFront(UINT32 index);
+
+		std::mutex mutex_;                ///< Guards everything below but the atomics
+		FlowTable<UINT32> index_;         ///< Host key to slot
+		std::vector<Slot> slots_;         ///< Grows up to maxHosts_, then slots are reused
+		size_t maxHosts_;
+		UINT32 head_;                     ///< Most recently used slot
+		UINT32 tail_;                     ///< Least recently used slot
+		UINT64 evicted_;
+		std::atomic<UINT64> observed_;
+		std::atomic<UINT64> lookups_;
+		std::atomic<UINT64> hits_;
+};
+
+#endif
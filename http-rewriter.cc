@@ -0,0 +1,176 @@
+/**
+ * @file http-rewriter.cc
+ * @brief Stage rewriting the Host header of outbound HTTP/1.x requests
+ */
+
+#include <algorithm>
+#include <cstring>
+#include "checksum.h"
+#include "http-rewriter.h"
+
+#define HTTP_REWRITER_MAX_EDITS 5
+
+HttpRewriterStage::HttpRewriterStage(const HttpRewriteConfig &config, std::shared_ptr<SeqTrackerStage> tracker, bool shiftPackets)
+	: config_(config), tracker_(std::move(tracker)), shiftPackets_(shiftPackets), requests_(0), rewritten_(0),
+	  resized_(0), skipped_(0)
+{
+}
+
+size_t HttpRewriterStage::BuildEdits(const UINT8 *payload, const HttpRequest &request, UINT8 *scratch, PayloadEdit *edits)
+{
+	static const UINT8 space[] = {' '};
+	static const UINT8 dot[] = {'.'};
+	if (request.host < 0)
+	{
+		return 0;
+	}
+	const HttpField &host = request.headers[request.host];
+	const UINT8 *value = payload + host.valueOffset;
+
+	// The host name ends at the port separator, or after the brackets of an IPv6 literal.
+	UINT32 nameLength = 0;
+	const bool literal = host.valueLength > 0 && value[0] == '[';
+	while (nameLength < host.valueLength && value[nameLength] != (literal ? ']' : ':'))
+	{
+		nameLength++;
+	}
+
+	size_t count = 0;
+	if (this->config_.methodSpace)
+	{
+		edits[count++] = {request.methodLength, 0, space, 1};
+	}
+	if (this->config_.hasHostName && host.nameLength == 4)
+	{
+		edits[count++] = {host.nameOffset, 4, reinterpret_cast<const UINT8 *>(this->config_.hostName), 4};
+	}
+	if (this->config_.removeSpace && host.valueOffset > host.colon + 1)
+	{
+		edits[count++] = {host.colon + 1, host.valueOffset - host.colon - 1, nullptr, 0};
+	}
+	if (this->config_.mixCase && !literal && nameLength > 0 && nameLength <= HTTP_REWRITER_MAX_HOST)
+	{
+		bool upper = false;
+		for (UINT32 i = 0; i < nameLength; i++)
+		{
+			UINT8 c = value[i];
+			const UINT8 lower = c >= 'A' && c <= 'Z' ? static_cast<UINT8>(c + ('a' - 'A')) : c;
+			if (lower >= 'a' && lower <= 'z')
+			{
+				c = upper ? static_cast<UINT8>(lower - ('a' - 'A')) : lower;
+				upper = !upper;
+			}
+			scratch[i] = c;
+		}
+		edits[count++] = {host.valueOffset, nameLength, scratch, nameLength};
+	}
+	if (this->config_.addDot && !literal && nameLength > 0 && value[nameLength - 1] != '.')
+	{
+		edits[count++] = {host.valueOffset + nameLength, 0, dot, 1};
+	}
+	return count;
+}
+
+StageVerdict HttpRewriterStage::Process(PacketContext &ctx)
+{
+	if (!ctx.parsed || ctx.info.fragment || ctx.info.protocol != PACKET_PROTO_TCP ||
+		ctx.info.transportLength < PACKET_TCP_HDR_MIN)
+	{
+		return STAGE_CONTINUE;
+	}
+	UINT8 *tcp = ctx.data + ctx.info.transportOffset;
+	const bool outbound = ctx.addr->Outbound != 0;
+	FlowKey key;
+	bool keyed = false;
+	if (this->shiftPackets_)
+	{
+		this->tracker_->Shift(ctx, &key, &keyed);
+	}
+
+	if (!outbound || ctx.info.payloadLength == 0 ||
+		std::find(this->config_.ports.begin(), this->config_.ports.end(), ReadBE16(tcp + 2)) == this->config_.ports.end())
+	{
+		return STAGE_CONTINUE;
+	}
+	UINT8 *payload = ctx.data + ctx.info.payloadOffset;
+	HttpRequest request;
+	if (!ParseHttpRequest(payload, ctx.info.payloadLength, &request))
+	{
+		return STAGE_CONTINUE;
+	}
+	this->requests_.fetch_add(1, std::memory_order_relaxed);
+
+	UINT8 scratch[HTTP_REWRITER_MAX_HOST];
+	PayloadEdit edits[HTTP_REWRITER_MAX_EDITS];
+	const size_t count = BuildEdits(payload, request, scratch, edits);
+	INT32 growth = 0;
+	bool inPlace = true;
+	for (size_t i = 0; i < count; i++)
+	{
+		growth += static_cast<INT32>(edits[i].insertLength) - static_cast<INT32>(edits[i].remove);
+		inPlace = inPlace && edits[i].insertLength == edits[i].remove;
+	}
+	if (count == 0)
+	{
+		this->skipped_.fetch_add(1, std::memory_order_relaxed);
+		return STAGE_CONTINUE;
+	}
+
+	if (inPlace)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			std::memcpy(payload + edits[i].offset, edits[i].insert, edits[i].insertLength);
+		}
+		if (ctx.addr->TCPChecksum)
+		{
+			CalcPacketChecksums(ctx.data, ctx.info.length);
+			ctx.addr->IPChecksum = 1;
+		}
+		this->rewritten_.fetch_add(1, std::memory_order_relaxed);
+		return STAGE_PASS;
+	}
+
+	const UINT32 length = ctx.info.length + static_cast<UINT32>(growth);
+	const UINT32 ipLength = ctx.info.version == 6 ? length - PACKET_IPV6_HDR_LEN : length;
+	if (!ctx.reinject || ctx.send == nullptr || ipLength > 0xFFFF)
+	{
+		this->skipped_.fetch_add(1, std::memory_order_relaxed);
+		return STAGE_CONTINUE;
+	}
+	if (!keyed && growth != 0)
+	{
+		keyed = FlowKeyFromPacket(ctx.data, ctx.info, outbound, &key);
+	}
+	if (growth != 0 && (!keyed || !this->tracker_->Record(key, ReadBE32(tcp + 4), ctx.info.payloadLength, growth, true, ctx.now)))
+	{
+		this->skipped_.fetch_add(1, std::memory_order_relaxed);
+		return STAGE_CONTINUE;
+	}
+
+	// Edits that move bytes are built in the send batch, as the receive buffer cannot grow.
+	ctx.addr->IPChecksum = 1;
+	ctx.addr->TCPChecksum = 1;
+	UINT8 *out = ctx.send->Reserve(length, *ctx.addr);
+	EditPayload(ctx.data, ctx.info, edits, count, out);
+	CalcPacketChecksums(out, length);
+	this->resized_.fetch_add(1, std::memory_order_relaxed);
+	return STAGE_HOLD;
+}
+
+void HttpRewriterStage::Tick(UINT64 now)
+{
+	if (this->shiftPackets_)
+	{
+		this->tracker_->Tick(now);
+	}
+}
+
+void HttpRewriterStage::GetStats(HttpRewriterStats *stats)
+{
+	stats->requests = this->requests_.load(std::memory_order_relaxed);
+	stats->rewritten = this->rewritten_.load(std::memory_order_relaxed);
+	stats->resized = this->resized_.load(std::memory_order_relaxed);
+	stats->skipped = this->skipped_.load(std::memory_order_relaxed);
+	this->tracker_->GetStats(&stats->tracker);
+}
@@ -0,0 +1,105 @@
+/**
+ * @file http-rewriter.h
+ * @brief Stage rewriting the Host header of outbound HTTP/1.x requests
+ *
+ * Middleboxes that look for "Host: name" are often satisfied by a head a server still
+ * accepts: the header name spelled "hoSt", no space after the colon, a mixed case or
+ * dot terminated host name, or an extra space after the method. Rewrites that only
+ * replace bytes are applied in place. Rewrites that move bytes are built into the send
+ * batch. When the payload size changed, the change is recorded in a SeqTrackerStage,
+ * which shifts the rest of the flow so both ends keep agreeing on the stream.
+ */
+
+#ifndef HTTP_REWRITER_H_
+#define HTTP_REWRITER_H_
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "windivert.h"
+#include "packet.h"
+#include "http.h"
+#include "packet-stage.h"
+#include "seq-tracker.h"
+
+#define HTTP_REWRITER_MAX_HOST 255      ///< Longest host name whose case is mixed
+
+/**
+ * @struct HttpRewriteConfig
+ * @brief Rewrites applied to the head of every matching request
+ */
+struct HttpRewriteConfig {
+	bool hasHostName;
+	char hostName[4];         ///< Spelling of "Host", compared case insensitively with it
+	bool removeSpace;         ///< Remove the white space after "Host:"
+	bool mixCase;             ///< Alternate the case of the host name letters
+	bool addDot;              ///< Append a dot to the host name, before any port
+	bool methodSpace;         ///< Add a space after the method
+	std::vector<UINT16> ports;   ///< Remote ports of rewritten requests
+};
+
+/**
+ * @struct HttpRewriterStats
+ * @brief Counters since the stage was created
+ */
+struct HttpRewriterStats {
+	UINT64 requests;          ///< Outbound segments that started with a request line
+	UINT64 rewritten;         ///< Requests rewritten in place
+	UINT64 resized;           ///< Requests rebuilt in the send batch
+	UINT64 skipped;           ///< Requests left alone: no Host header, too large, not reinjectable or untracked
+	SeqTrackerStats tracker;  ///< Counters of the tracker the size changes are recorded in
+};
+
+/**
+ * @class HttpRewriterStage
+ * @brief PacketStage applying an HttpRewriteConfig
+ */
+class HttpRewriterStage : public PacketStage {
+	public:
+		/**
+		 * @param config Rewrites and ports
+		 * @param tracker Tracker size changes are recorded in
+		 * @param shiftPackets Shift packets through tracker in Process; false if the tracker is
+		 *                     attached as a stage of its own, ahead of this one
+		 */
+		HttpRewriterStage(const HttpRewriteConfig &config, std::shared_ptr<SeqTrackerStage> tracker, bool shiftPackets);
+
+		/**
+		 * @brief Rewrites requests and shifts the packets of resized flows
+		 * @return STAGE_PASS if rewritten in place, STAGE_HOLD if an edited copy was added
+		 *         to the send batch, STAGE_CONTINUE otherwise
+		 */
+		StageVerdict Process(PacketContext &ctx) override;
+
+		/**
+		 * @brief Expires idle flows of the tracker if this stage shifts packets
+		 */
+		void Tick(UINT64 now) override;
+
+		/**
+		 * @brief Tracker the size changes are recorded in
+		 */
+		const std::shared_ptr<SeqTrackerStage> &Tracker() const
+		{
+			return tracker_;
+		}
+
+		void GetStats(HttpRewriterStats *stats);
+
+	private:
+		/**
+		 * @brief Lists the edits of the configured rewrites
+		 * @return Number of edits, 0 if the request cannot be rewritten
+		 */
+		size_t BuildEdits(const UINT8 *payload, const HttpRequest &request, UINT8 *scratch, PayloadEdit *edits);
+
+		HttpRewriteConfig config_;
+		std::shared_ptr<SeqTrackerStage> tracker_;
+		bool shiftPackets_;
+		std::atomic<UINT64> requests_;
+		std::atomic<UINT64> rewritten_;
+		std::atomic<UINT64> resized_;
+		std::atomic<UINT64> skipped_;
+};
+
+#endif
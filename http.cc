@@ -0,0 +1,173 @@
+/**
+ * @file http.cc
+ * @brief HTTP/1.x request head parser for the first segment of a request
+ */
+
+#include "http.h"
+
+/**
+ * @brief Returns true for RFC 9110 token characters
+ */
+static bool IsToken(uint8_t c)
+{
+	if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+	{
+		return true;
+	}
+	switch (c)
+	{
+		case '!': case '#': case '$': case '%': case '&': case '\'': case '*': case '+':
+		case '-': case '.': case '^': case '_': case '`': case '|': case '~':
+			return true;
+		default:
+			return false;
+	}
+}
+
+/**
+ * @brief Compares a header name with a lower case name, ignoring case
+ */
+static bool NameEquals(const uint8_t *name, uint32_t length, const char *lower)
+{
+	uint32_t i = 0;
+	for (; i < length && lower[i] != '\0'; i++)
+	{
+		uint8_t c = name[i];
+		if (c >= 'A' && c <= 'Z')
+		{
+			c = static_cast<uint8_t>(c + ('a' - 'A'));
+		}
+		if (c != static_cast<uint8_t>(lower[i]))
+		{
+			return false;
+		}
+	}
+	return i == length && lower[i] == '\0';
+}
+
+/**
+ * @brief Finds the end of the line starting at offset
+ * @return Offset of the '\n', or length if the line is incomplete
+ */
+static uint32_t LineEnd(const uint8_t *payload, uint32_t length, uint32_t offset)
+{
+	while (offset < length && payload[offset] != '\n')
+	{
+		offset++;
+	}
+	return offset;
+}
+
+bool ParseHttpRequest(const uint8_t *payload, uint32_t length, HttpRequest *request)
+{
+	request->host = -1;
+	request->headerCount = 0;
+	request->headerEnd = 0;
+
+	// Request line: method SP+ target SP+ "HTTP/1." digit CRLF; extra spaces are tolerated
+	// because a rewritten request may carry them.
+	uint32_t i = 0;
+	while (i < length && i <= HTTP_MAX_METHOD && payload[i] >= 'A' && payload[i] <= 'Z')
+	{
+		i++;
+	}
+	if (i == 0 || i > HTTP_MAX_METHOD || i >= length || payload[i] != ' ')
+	{
+		return false;
+	}
+	request->methodLength = i;
+	while (i < length && payload[i] == ' ')
+	{
+		i++;
+	}
+	request->targetOffset = i;
+	while (i < length && payload[i] > ' ' && payload[i] < 0x7F)
+	{
+		i++;
+	}
+	request->targetLength = i - request->targetOffset;
+	if (request->targetLength == 0 || i >= length || payload[i] != ' ')
+	{
+		return false;
+	}
+	while (i < length && payload[i] == ' ')
+	{
+		i++;
+	}
+	request->versionOffset = i;
+	static const char version[] = "HTTP/1.";
+	for (uint32_t k = 0; k < sizeof(version) - 1; k++, i++)
+	{
+		if (i >= length || payload[i] != static_cast<uint8_t>(version[k]))
+		{
+			return false;
+		}
+	}
+	if (i >= length || payload[i] < '0' || payload[i] > '9')
+	{
+		return false;
+	}
+	request->versionMinor = static_cast<uint8_t>(payload[i] - '0');
+	i++;
+	if (i < length && payload[i] == '\r')
+	{
+		i++;
+	}
+	if (i >= length || payload[i] != '\n')
+	{
+		return false;
+	}
+	i++;
+
+	// Header lines: token ":" OWS value OWS CRLF, up to the empty line.
+	while (i < length)
+	{
+		const uint32_t end = LineEnd(payload, length, i);
+		if (end >= length)
+		{
+			break;
+		}
+		const uint32_t content = end > i && payload[end - 1] == '\r' ? end - 1 : end;
+		if (content == i)
+		{
+			request->headerEnd = end + 1;
+			break;
+		}
+		uint32_t colon = i;
+		while (colon < content && IsToken(payload[colon]))
+		{
+			colon++;
+		}
+		if (colon == i || colon >= content || payload[colon] != ':')
+		{
+			// Malformed header or obsolete line folding; the head cannot be rewritten safely.
+			break;
+		}
+		if (request->headerCount < HTTP_MAX_HEADERS)
+		{
+			HttpField &field = request->headers[request->headerCount];
+			field.nameOffset = i;
+			field.nameLength = colon - i;
+			field.colon = colon;
+			uint32_t value = colon + 1;
+			while (value < content && (payload[value] == ' ' || payload[value] == '\t'))
+			{
+				value++;
+			}
+			uint32_t valueEnd = content;
+			while (valueEnd > value && (payload[valueEnd - 1] == ' ' || payload[valueEnd - 1] == '\t'))
+			{
+				valueEnd--;
+			}
+			field.valueOffset = value;
+			field.valueLength = valueEnd - value;
+			if (request->host < 0 && NameEquals(payload + i, field.nameLength, "host"))
+			{
+				request->host = static_cast<int32_t>(request->headerCount);
+			}
+			request->headerCount++;
+		}
+		i = end + 1;
+	}
+	return true;
+}
@@ -0,0 +1,54 @@
+/**
+ * @file http.h
+ * @brief HTTP/1.x request head parser for the first segment of a request
+ *
+ * The parser never copies: it reports offsets into the payload so that callers can
+ * rewrite the request line and the Host header in place or through EditPayload.
+ */
+
+#ifndef HTTP_H_
+#define HTTP_H_
+
+#include <cstdint>
+
+#define HTTP_MAX_HEADERS    32
+#define HTTP_MAX_METHOD     16
+
+/**
+ * @struct HttpField
+ * @brief Offsets of one header line, relative to the payload
+ */
+struct HttpField {
+	uint32_t nameOffset;
+	uint32_t nameLength;
+	uint32_t colon;             ///< Offset of the ':' after the name
+	uint32_t valueOffset;       ///< First value byte after optional white space
+	uint32_t valueLength;       ///< Value length without trailing white space
+};
+
+/**
+ * @struct HttpRequest
+ * @brief Request line and header offsets, relative to the payload
+ */
+struct HttpRequest {
+	uint32_t methodLength;      ///< The method starts at offset 0
+	uint32_t targetOffset;
+	uint32_t targetLength;
+	uint32_t versionOffset;     ///< Offset of "HTTP/1.x"
+	uint8_t versionMinor;
+	int32_t host;               ///< Index of the Host header in headers, -1 if not seen
+	uint32_t headerCount;       ///< Complete header lines parsed, at most HTTP_MAX_HEADERS
+	HttpField headers[HTTP_MAX_HEADERS];
+	uint32_t headerEnd;         ///< Offset after the empty line, 0 if the head continues past the segment
+};
+
+/**
+ * @brief Parses the request line and the complete header lines of a segment
+ * @param payload TCP payload starting with the request line
+ * @param length Payload length
+ * @param request Receives the offsets
+ * @return false if the payload does not start with a complete HTTP/1.x request line
+ */
+bool ParseHttpRequest(const uint8_t *payload, uint32_t length, HttpRequest *request);
+
+#endif
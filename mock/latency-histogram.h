@@ -0,0 +1,111 @@
+/**
+ * @file latency-histogram.h
+ * @brief Log-linear latency histogram
+ *
+ * Values are bucketed by their highest set bit and the next LATENCY_SUB_BITS bits,
+ * which bounds the relative error of a reported percentile to about 3%.
+ */
+
+#ifndef LATENCY_HISTOGRAM_H_
+#define LATENCY_HISTOGRAM_H_
+
+#include <cstdint>
+#include <cstring>
+
+#define LATENCY_SUB_BITS    4
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS     (64 * LATENCY_SUB_BUCKETS)
+
+class LatencyHistogram {
+	public:
+		LatencyHistogram()
+		{
+			Reset();
+		}
+
+		void Reset()
+		{
+			std::memset(counts_, 0, sizeof(counts_));
+			total_ = 0;
+			max_ = 0;
+		}
+
+		/**
+		 * @brief Records one value
+		 */
+		void Record(uint64_t value)
+		{
+			counts_[Bucket(value)]++;
+			total_++;
+			if (value > max_)
+			{
+				max_ = value;
+			}
+		}
+
+		/**
+		 * @brief Returns the value at a percentile
+		 * @param percentile 0-100
+		 * @return Upper bound of the bucket holding the percentile, 0 if empty
+		 */
+		uint64_t Percentile(double percentile) const
+		{
+			if (total_ == 0)
+			{
+				return 0;
+			}
+			uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(total_) + 0.5);
+			rank = rank < 1 ? 1 : rank > total_ ? total_ : rank;
+			uint64_t seen = 0;
+			for (int i = 0; i < LATENCY_BUCKETS; i++)
+			{
+				seen += counts_[i];
+				if (seen >= rank)
+				{
+					const uint64_t upper = UpperBound(i);
+					return upper < max_ ? upper : max_;
+				}
+			}
+			return max_;
+		}
+
+		uint64_t Count() const
+		{
+			return total_;
+		}
+
+		uint64_t Max() const
+		{
+			return max_;
+		}
+
+	private:
+		static int Bucket(uint64_t value)
+		{
+			if (value < LATENCY_SUB_BUCKETS)
+			{
+				return static_cast<int>(value);
+			}
+			const int msb = 63 - __builtin_clzll(value);
+			const int sub = static_cast<int>((value >> (msb - LATENCY_SUB_BITS)) & (LATENCY_SUB_BUCKETS - 1));
+			return (msb - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS + sub;
+		}
+
+		static uint64_t UpperBound(int bucket)
+		{
+			if (bucket < LATENCY_SUB_BUCKETS)
+			{
+				return static_cast<uint64_t>(bucket);
+			}
+			const int msb = bucket / LATENCY_SUB_BUCKETS + LATENCY_SUB_BITS - 1;
+			const uint64_t sub = static_cast<uint64_t>(bucket % LATENCY_SUB_BUCKETS);
+			const int shift = msb - LATENCY_SUB_BITS;
+			return (((static_cast<uint64_t>(LATENCY_SUB_BUCKETS) | sub) + 1) << shift) - 1;
+		}
+
+		uint64_t counts_[LATENCY_BUCKETS];   ///< Values per bucket
+		uint64_t total_;                     ///< Recorded values
+		uint64_t max_;                       ///< Largest recorded value
+};
+
+#endif
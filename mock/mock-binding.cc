@@ -0,0 +1,83 @@
+/**
+ * @file mock-binding.cc
+ * @brief Node.js controls of the mock driver, only built with WINDIVERT_MOCK
+ */
+
+#include <napi.h>
+#include "mock-windivert.h"
+
+/**
+ * @brief Configures the traffic of handles opened afterwards and clears statistics.
+ * @param info Contains:
+ *             - options: Object with optional rate, count, queueLength, flows, ipv6Percent,
+ *               udpPercent, icmpPercent, emptyPercent, largePercent and seed
+ * @return undefined
+ */
+static Napi::Value MockConfigureJs(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	MockConfig config;
+	if (info.Length() > 0 && !info[0].IsUndefined())
+	{
+		if (!info[0].IsObject())
+		{
+			Napi::TypeError::New(env, "Options object expected").ThrowAsJavaScriptException();
+			return env.Undefined();
+		}
+		Napi::Object options = info[0].As<Napi::Object>();
+		auto number = [&options](const char *name, double fallback) -> double
+		{
+			Napi::Value value = options.Get(name);
+			return value.IsNumber() ? value.As<Napi::Number>().DoubleValue() : fallback;
+		};
+		config.rate = static_cast<uint64_t>(number("rate", static_cast<double>(config.rate)));
+		config.count = static_cast<uint64_t>(number("count", static_cast<double>(config.count)));
+		config.queueLength = static_cast<uint32_t>(number("queueLength", config.queueLength));
+		config.mix.flows = static_cast<uint32_t>(number("flows", config.mix.flows));
+		config.mix.ipv6Percent = static_cast<uint32_t>(number("ipv6Percent", config.mix.ipv6Percent));
+		config.mix.udpPercent = static_cast<uint32_t>(number("udpPercent", config.mix.udpPercent));
+		config.mix.icmpPercent = static_cast<uint32_t>(number("icmpPercent", config.mix.icmpPercent));
+		config.mix.emptyPercent = static_cast<uint32_t>(number("emptyPercent", config.mix.emptyPercent));
+		config.mix.largePercent = static_cast<uint32_t>(number("largePercent", config.mix.largePercent));
+		config.mix.seed = static_cast<uint32_t>(number("seed", config.mix.seed));
+	}
+	if (config.queueLength == 0 || config.mix.flows == 0)
+	{
+		Napi::RangeError::New(env, "queueLength and flows must be positive").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	MockConfigure(config);
+	MockReset();
+	return env.Undefined();
+}
+
+/**
+ * @brief Returns the mock driver statistics.
+ * @return Object with counters and latency percentiles in nanoseconds
+ */
+static Napi::Value MockStatsJs(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	MockStats stats;
+	MockGetStats(&stats);
+	Napi::Object result = Napi::Object::New(env);
+	result.Set("offered", Napi::Number::New(env, static_cast<double>(stats.offered)));
+	result.Set("queueDrops", Napi::Number::New(env, static_cast<double>(stats.queueDrops)));
+	result.Set("received", Napi::Number::New(env, static_cast<double>(stats.received)));
+	result.Set("reinjected", Napi::Number::New(env, static_cast<double>(stats.reinjected)));
+	result.Set("injected", Napi::Number::New(env, static_cast<double>(stats.injected)));
+	result.Set("queued", Napi::Number::New(env, static_cast<double>(stats.queued)));
+	result.Set("elapsed", Napi::Number::New(env, stats.elapsed));
+	result.Set("lastSend", Napi::Number::New(env, stats.lastSend));
+	result.Set("p50", Napi::Number::New(env, static_cast<double>(stats.p50)));
+	result.Set("p99", Napi::Number::New(env, static_cast<double>(stats.p99)));
+	result.Set("p999", Napi::Number::New(env, static_cast<double>(stats.p999)));
+	result.Set("maxLatency", Napi::Number::New(env, static_cast<double>(stats.maxLatency)));
+	return result;
+}
+
+void InitMock(Napi::Env env, Napi::Object exports)
+{
+	exports.Set("mockConfigure", Napi::Function::New(env, MockConfigureJs, "mockConfigure"));
+	exports.Set("mockStats", Napi::Function::New(env, MockStatsJs, "mockStats"));
+}
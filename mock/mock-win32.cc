@@ -0,0 +1,257 @@
+/**
+ * @file mock-win32.cc
+ * @brief Win32 functions used by the binding, implemented for the mock driver build
+ */
+
+#include <windows.h>
+#include <cwchar>
+
+static thread_local DWORD lastError = ERROR_SUCCESS;
+
+DWORD GetLastError()
+{
+	return lastError;
+}
+
+void SetLastError(DWORD error)
+{
+	lastError = error;
+}
+
+/**
+ * @struct MockCompletionPort
+ * @brief Queue of completion packets behind a HANDLE returned by CreateIoCompletionPort
+ */
+struct MockCompletionPort {
+	std::mutex mutex;                        ///< Guards entries
+	std::condition_variable cond;            ///< Signalled when a completion is posted
+	std::deque<OVERLAPPED_ENTRY> entries;    ///< Posted completions, oldest first
+};
+
+static std::mutex portMutex;
+static std::unordered_map<HANDLE, MockCompletionPort *> ports;
+static std::unordered_map<HANDLE, std::pair<HANDLE, ULONG_PTR>> portAssociations;
+
+static MockCompletionPort *FindPort(HANDLE port)
+{
+	std::lock_guard<std::mutex> lock(portMutex);
+	auto found = ports.find(port);
+	return found != ports.end() ? found->second : NULL;
+}
+
+BOOL CloseHandle(HANDLE handle)
+{
+	MockCompletionPort *port = NULL;
+	{
+		std::lock_guard<std::mutex> lock(portMutex);
+		auto found = ports.find(handle);
+		if (found != ports.end())
+		{
+			port = found->second;
+			ports.erase(found);
+		}
+	}
+	delete port;
+	return handle != NULL && handle != INVALID_HANDLE_VALUE;
+}
+
+HANDLE CreateIoCompletionPort(HANDLE file, HANDLE existingPort, ULONG_PTR completionKey, DWORD threads)
+{
+	HANDLE port = existingPort;
+	if (port == NULL)
+	{
+		MockCompletionPort *created = new MockCompletionPort();
+		port = created;
+		std::lock_guard<std::mutex> lock(portMutex);
+		ports[port] = created;
+	}
+	else if (FindPort(port) == NULL)
+	{
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return NULL;
+	}
+	if (file != INVALID_HANDLE_VALUE)
+	{
+		std::lock_guard<std::mutex> lock(portMutex);
+		portAssociations[file] = std::make_pair(port, completionKey);
+	}
+	return port;
+}
+
+BOOL GetQueuedCompletionStatusEx(HANDLE port, LPOVERLAPPED_ENTRY entries, ULONG count, ULONG *removed, DWORD milliseconds, BOOL alertable)
+{
+	MockCompletionPort *mock = FindPort(port);
+	if (mock == NULL || entries == NULL || count == 0 || removed == NULL)
+	{
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return FALSE;
+	}
+	std::unique_lock<std::mutex> lock(mock->mutex);
+	auto ready = [mock] { return !mock->entries.empty(); };
+	if (milliseconds == INFINITE)
+	{
+		mock->cond.wait(lock, ready);
+	}
+	else if (!mock->cond.wait_for(lock, std::chrono::milliseconds(milliseconds), ready))
+	{
+		*removed = 0;
+		SetLastError(WAIT_TIMEOUT);
+		return FALSE;
+	}
+	ULONG taken = 0;
+	while (taken < count && !mock->entries.empty())
+	{
+		entries[taken++] = mock->entries.front();
+		mock->entries.pop_front();
+	}
+	*removed = taken;
+	return TRUE;
+}
+
+BOOL PostQueuedCompletionStatus(HANDLE port, DWORD bytes, ULONG_PTR completionKey, LPOVERLAPPED overlapped)
+{
+	MockCompletionPort *mock = FindPort(port);
+	if (mock == NULL)
+	{
+		SetLastError(ERROR_INVALID_HANDLE);
+		return FALSE;
+	}
+	OVERLAPPED_ENTRY entry;
+	entry.lpCompletionKey = completionKey;
+	entry.lpOverlapped = overlapped;
+	entry.Internal = overlapped != NULL ? overlapped->Internal : 0;
+	entry.dwNumberOfBytesTransferred = bytes;
+	{
+		std::lock_guard<std::mutex> lock(mock->mutex);
+		mock->entries.push_back(entry);
+	}
+	mock->cond.notify_one();
+	return TRUE;
+}
+
+BOOL GetOverlappedResult(HANDLE file, LPOVERLAPPED overlapped, LPDWORD bytes, BOOL wait)
+{
+	// Only called for reads whose completion was already dequeued, so there is never anything to wait for.
+	if (overlapped == NULL)
+	{
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return FALSE;
+	}
+	if (bytes != NULL)
+	{
+		*bytes = static_cast<DWORD>(overlapped->InternalHigh);
+	}
+	if (overlapped->Internal != ERROR_SUCCESS)
+	{
+		SetLastError(static_cast<DWORD>(overlapped->Internal));
+		return FALSE;
+	}
+	return TRUE;
+}
+
+BOOL MockGetCompletionPort(HANDLE file, HANDLE *port, ULONG_PTR *completionKey)
+{
+	std::lock_guard<std::mutex> lock(portMutex);
+	auto found = portAssociations.find(file);
+	if (found == portAssociations.end())
+	{
+		return FALSE;
+	}
+	*port = found->second.first;
+	*completionKey = found->second.second;
+	return TRUE;
+}
+
+void MockReleaseCompletionPort(HANDLE file)
+{
+	std::lock_guard<std::mutex> lock(portMutex);
+	portAssociations.erase(file);
+}
+
+DWORD FormatMessageW(DWORD flags, const void *source, DWORD messageId, DWORD languageId, LPWSTR buffer, DWORD size, void *arguments)
+{
+	// Only the FORMAT_MESSAGE_ALLOCATE_BUFFER form used by the binding is supported.
+	if ((flags & FORMAT_MESSAGE_ALLOCATE_BUFFER) == 0 || buffer == NULL)
+	{
+		return 0;
+	}
+	std::wstring message = L"mock driver error " + std::to_wstring(messageId);
+	wchar_t *text = new wchar_t[message.size() + 1];
+	std::wcscpy(text, message.c_str());
+	*reinterpret_cast<wchar_t **>(buffer) = text;
+	return static_cast<DWORD>(message.size());
+}
+
+void *LocalFree(void *memory)
+{
+	delete[] static_cast<wchar_t *>(memory);
+	return NULL;
+}
+
+ULONGLONG GetTickCount64()
+{
+	return static_cast<ULONGLONG>(std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+HANDLE OpenProcess(DWORD access, BOOL inherit, DWORD processId)
+{
+	// The mock driver reports no processes, so image paths are never resolved.
+	SetLastError(ERROR_NOT_SUPPORTED);
+	return NULL;
+}
+
+BOOL GetProcessTimes(HANDLE process, FILETIME *creation, FILETIME *exit, FILETIME *kernel, FILETIME *user)
+{
+	SetLastError(ERROR_INVALID_HANDLE);
+	return FALSE;
+}
+
+BOOL QueryFullProcessImageNameW(HANDLE process, DWORD flags, LPWSTR name, DWORD *size)
+{
+	SetLastError(ERROR_INVALID_HANDLE);
+	return FALSE;
+}
+
+int WideCharToMultiByte(UINT codePage, DWORD flags, const WCHAR *wide, int wideLength, CHAR *multiByte, int multiByteLength, LPCSTR defaultChar, BOOL *usedDefaultChar)
+{
+	// wchar_t holds whole code points here, so each is encoded directly.
+	std::string out;
+	for (int i = 0; i < wideLength; i++)
+	{
+		const uint32_t c = static_cast<uint32_t>(wide[i]);
+		if (c < 0x80)
+		{
+			out += static_cast<char>(c);
+		}
+		else if (c < 0x800)
+		{
+			out += static_cast<char>(0xC0 | (c >> 6));
+			out += static_cast<char>(0x80 | (c & 0x3F));
+		}
+		else if (c < 0x10000)
+		{
+			out += static_cast<char>(0xE0 | (c >> 12));
+			out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (c & 0x3F));
+		}
+		else
+		{
+			out += static_cast<char>(0xF0 | (c >> 18));
+			out += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+			out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (c & 0x3F));
+		}
+	}
+	if (multiByteLength == 0)
+	{
+		return static_cast<int>(out.size());
+	}
+	if (static_cast<size_t>(multiByteLength) < out.size())
+	{
+		SetLastError(ERROR_INSUFFICIENT_BUFFER);
+		return 0;
+	}
+	std::memcpy(multiByte, out.data(), out.size());
+	return static_cast<int>(out.size());
+}
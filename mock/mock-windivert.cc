@@ -0,0 +1,727 @@
+/**
+ * @file mock-windivert.cc
+ * @brief Userspace WinDivert driver used to run the binding on Linux
+ */
+
+#include <windows.h>
+#include "windivert.h"
+#include "packet.h"
+#include "checksum.h"
+#include "mock-windivert.h"
+#include "latency-histogram.h"
+
+/**
+ * @struct MockPacket
+ * @brief Queued packet: index into the handle's pool and arrival time
+ */
+struct MockPacket {
+	uint32_t index;
+	int64_t arrival;
+};
+
+/**
+ * @struct MockRead
+ * @brief Overlapped WinDivertRecvEx waiting for packets
+ */
+struct MockRead {
+	VOID *packet;
+	UINT packetLen;
+	WINDIVERT_ADDRESS *addr;
+	UINT *addrLen;
+	LPOVERLAPPED overlapped;
+	HANDLE port;
+	ULONG_PTR key;
+};
+
+/**
+ * @class MockHandle
+ * @brief State behind one HANDLE returned by WinDivertOpen
+ */
+class MockHandle {
+	public:
+		MockHandle(WINDIVERT_LAYER layer, UINT64 flags, const MockConfig &config)
+			: layer(layer), flags(flags), config(config), shutdownRecv(false), shutdownSend(false), stop(false)
+		{
+			pool = BuildSyntheticMix(MOCK_POOL_PACKETS, config.mix);
+		}
+
+		WINDIVERT_LAYER layer;                       ///< Opened layer
+		UINT64 flags;                                ///< Opened flags
+		MockConfig config;                           ///< Traffic of this handle
+		std::vector<std::vector<uint8_t>> pool;      ///< Synthetic packets, offered round-robin
+		std::deque<MockPacket> queue;                ///< Driver queue
+		std::deque<MockRead> reads;                  ///< Pending overlapped reads, completed in order
+		std::mutex mutex;                            ///< Guards queue and the shutdown flags
+		std::condition_variable cond;                ///< Signalled on arrivals and shutdown
+		bool shutdownRecv;                           ///< WINDIVERT_SHUTDOWN_RECV was requested
+		bool shutdownSend;                           ///< WINDIVERT_SHUTDOWN_SEND was requested
+		std::atomic<bool> stop;                      ///< Stops the generator
+		std::thread generator;                       ///< Offers packets at config.rate
+};
+
+/**
+ * @brief Mock wide configuration and statistics
+ */
+static std::mutex mockMutex;
+static MockConfig mockConfig;
+static LatencyHistogram mockLatency;
+static std::atomic<uint64_t> mockOffered(0);
+static std::atomic<uint64_t> mockQueueDrops(0);
+static std::atomic<uint64_t> mockReceived(0);
+static std::atomic<uint64_t> mockReinjected(0);
+static std::atomic<uint64_t> mockInjected(0);
+static std::atomic<uint64_t> mockQueued(0);
+static std::atomic<int64_t> mockFirstOffer(0);
+static std::atomic<int64_t> mockLastSend(0);
+
+static int64_t NowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void MockConfigure(const MockConfig &config)
+{
+	std::lock_guard<std::mutex> lock(mockMutex);
+	mockConfig = config;
+}
+
+MockConfig MockGetConfig()
+{
+	std::lock_guard<std::mutex> lock(mockMutex);
+	return mockConfig;
+}
+
+void MockReset()
+{
+	std::lock_guard<std::mutex> lock(mockMutex);
+	mockLatency.Reset();
+	mockOffered = 0;
+	mockQueueDrops = 0;
+	mockReceived = 0;
+	mockReinjected = 0;
+	mockInjected = 0;
+	mockFirstOffer = 0;
+	mockLastSend = 0;
+}
+
+void MockGetStats(MockStats *stats)
+{
+	std::lock_guard<std::mutex> lock(mockMutex);
+	const int64_t first = mockFirstOffer.load();
+	const int64_t last = mockLastSend.load();
+	stats->offered = mockOffered.load();
+	stats->queueDrops = mockQueueDrops.load();
+	stats->received = mockReceived.load();
+	stats->reinjected = mockReinjected.load();
+	stats->injected = mockInjected.load();
+	stats->queued = mockQueued.load();
+	stats->elapsed = first == 0 ? 0.0 : static_cast<double>(NowNs() - first) / 1e9;
+	stats->lastSend = first == 0 || last == 0 ? 0.0 : static_cast<double>(last - first) / 1e9;
+	stats->p50 = mockLatency.Percentile(50);
+	stats->p99 = mockLatency.Percentile(99);
+	stats->p999 = mockLatency.Percentile(99.9);
+	stats->maxLatency = mockLatency.Max();
+}
+
+/**
+ * @brief Fills the address of a queued packet
+ */
+static void FillAddress(MockHandle *mock, const std::vector<uint8_t> &packet, const MockPacket &entry, WINDIVERT_ADDRESS *addr)
+{
+	std::memset(addr, 0, sizeof(WINDIVERT_ADDRESS));
+	addr->Timestamp = entry.arrival;
+	addr->Layer = mock->layer;
+	addr->Event = WINDIVERT_EVENT_NETWORK_PACKET;
+	addr->Sniffed = (mock->flags & WINDIVERT_FLAG_SNIFF) != 0;
+	addr->IPv6 = (packet[0] >> 4) == 6;
+	// Synthetic local endpoints are 10.0.0.0/8 and fd00::/8.
+	addr->Outbound = addr->IPv6 ? packet[8] == 0xFD : packet[12] == 10;
+	addr->IPChecksum = 1;
+	addr->TCPChecksum = 1;
+	addr->UDPChecksum = 1;
+	addr->Network.IfIdx = 1;
+}
+
+/**
+ * @brief Moves queued packets into a caller's buffers, called with the handle's mutex held
+ * @return Number of packets copied; 0 with *error set if none could be
+ */
+static UINT DequeuePackets(MockHandle *mock, VOID *pPacket, UINT packetLen, WINDIVERT_ADDRESS *pAddr, UINT maxPackets,
+						   UINT *length, DWORD *error)
+{
+	UINT received = 0;
+	UINT offset = 0;
+	while (!mock->queue.empty() && received < maxPackets)
+	{
+		const MockPacket entry = mock->queue.front();
+		const std::vector<uint8_t> &packet = mock->pool[entry.index];
+		if (offset + packet.size() > packetLen)
+		{
+			if (received == 0)
+			{
+				*error = ERROR_INSUFFICIENT_BUFFER;
+				return 0;
+			}
+			break;
+		}
+		mock->queue.pop_front();
+		if (pPacket != NULL)
+		{
+			std::memcpy(static_cast<uint8_t *>(pPacket) + offset, packet.data(), packet.size());
+		}
+		if (pAddr != NULL)
+		{
+			FillAddress(mock, packet, entry, &pAddr[received]);
+		}
+		offset += static_cast<UINT>(packet.size());
+		received++;
+	}
+	mockQueued -= received;
+	mockReceived += received;
+	*length = offset;
+	return received;
+}
+
+/**
+ * @brief Completes pending overlapped reads, called with the handle's mutex held.
+ * Like the driver, a read completes as soon as packets are queued, and with ERROR_NO_DATA
+ * once the handle is shut down for receive and its queue is empty.
+ */
+static void CompleteReads(MockHandle *mock)
+{
+	while (!mock->reads.empty() && (!mock->queue.empty() || mock->shutdownRecv))
+	{
+		MockRead read = mock->reads.front();
+		mock->reads.pop_front();
+		const UINT maxPackets = read.addrLen != NULL ? *read.addrLen / sizeof(WINDIVERT_ADDRESS) : 1;
+		UINT length = 0;
+		DWORD error = ERROR_NO_DATA;
+		const UINT received = DequeuePackets(mock, read.packet, read.packetLen, read.addr, maxPackets, &length, &error);
+		if (received > 0)
+		{
+			error = ERROR_SUCCESS;
+			if (read.addrLen != NULL)
+			{
+				*read.addrLen = received * sizeof(WINDIVERT_ADDRESS);
+			}
+		}
+		read.overlapped->Internal = error;
+		read.overlapped->InternalHigh = length;
+		PostQueuedCompletionStatus(read.port, length, read.key, read.overlapped);
+	}
+}
+
+/**
+ * @brief Offers packets to the queue at the configured rate.
+ * Arrivals are computed from elapsed time, so a late wakeup produces a burst instead of
+ * lowering the rate, the way packets pile up in the real driver while nobody reads.
+ */
+static void GeneratorThread(MockHandle *mock)
+{
+	const uint64_t rate = mock->config.rate;
+	const uint64_t count = mock->config.count;
+	const int64_t start = NowNs();
+	int64_t expected = 0;
+	uint64_t offered = 0;
+	uint32_t next = 0;
+	mockFirstOffer.compare_exchange_strong(expected, start);
+
+	while (!mock->stop.load() && (count == 0 || offered < count))
+	{
+		uint64_t due;
+		if (rate == 0)
+		{
+			due = offered + 64;
+		}
+		else
+		{
+			due = static_cast<uint64_t>(static_cast<double>(NowNs() - start) * static_cast<double>(rate) / 1e9);
+		}
+		if (count != 0 && due > count)
+		{
+			due = count;
+		}
+		if (due > offered)
+		{
+			std::lock_guard<std::mutex> lock(mock->mutex);
+			const int64_t now = NowNs();
+			for (; offered < due; offered++)
+			{
+				if (mock->queue.size() >= mock->config.queueLength)
+				{
+					if (rate == 0)
+					{
+						break;
+					}
+					mockOffered++;
+					mockQueueDrops++;
+					continue;
+				}
+				mock->queue.push_back(MockPacket{next, now});
+				mockOffered++;
+				mockQueued++;
+				next = (next + 1) % mock->pool.size();
+			}
+			CompleteReads(mock);
+			mock->cond.notify_one();
+		}
+		if (rate == 0)
+		{
+			// Unpaced mode only refills what the reader drained.
+			std::unique_lock<std::mutex> lock(mock->mutex);
+			mock->cond.wait_for(lock, std::chrono::microseconds(100), [mock]
+			{
+				return mock->stop.load() || mock->queue.size() < mock->config.queueLength / 2;
+			});
+		}
+		else
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+		}
+	}
+}
+
+static MockHandle *FromHandle(HANDLE handle)
+{
+	if (handle == NULL || handle == INVALID_HANDLE_VALUE)
+	{
+		SetLastError(ERROR_INVALID_HANDLE);
+		return NULL;
+	}
+	return static_cast<MockHandle *>(handle);
+}
+
+HANDLE WinDivertOpen(const char *filter, WINDIVERT_LAYER layer, INT16 priority, UINT64 flags)
+{
+	if (filter == NULL || layer > WINDIVERT_LAYER_REFLECT)
+	{
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return INVALID_HANDLE_VALUE;
+	}
+	MockHandle *mock = new MockHandle(layer, flags, MockGetConfig());
+	// Only packet layers carry traffic; send-only and drop handles never receive.
+	if ((layer == WINDIVERT_LAYER_NETWORK || layer == WINDIVERT_LAYER_NETWORK_FORWARD) &&
+		(flags & (WINDIVERT_FLAG_SEND_ONLY | WINDIVERT_FLAG_DROP)) == 0 && std::strcmp(filter, "false") != 0)
+	{
+		mock->generator = std::thread(GeneratorThread, mock);
+	}
+	return mock;
+}
+
+BOOL WinDivertRecvEx(HANDLE handle, VOID *pPacket, UINT packetLen, UINT *pRecvLen, UINT64 flags,
+					 WINDIVERT_ADDRESS *pAddr, UINT *pAddrLen, LPOVERLAPPED lpOverlapped)
+{
+	MockHandle *mock = FromHandle(handle);
+	if (mock == NULL)
+	{
+		return FALSE;
+	}
+	const UINT maxPackets = pAddrLen != NULL ? *pAddrLen / sizeof(WINDIVERT_ADDRESS) : 1;
+	if (maxPackets == 0)
+	{
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return FALSE;
+	}
+	if (lpOverlapped != NULL)
+	{
+		// Only completion port reads are supported; event based overlapped I/O is not.
+		MockRead read = {pPacket, packetLen, pAddr, pAddrLen, lpOverlapped, NULL, 0};
+		if (!MockGetCompletionPort(handle, &read.port, &read.key))
+		{
+			SetLastError(ERROR_NOT_SUPPORTED);
+			return FALSE;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mock->mutex);
+			mock->reads.push_back(read);
+			CompleteReads(mock);
+		}
+		mock->cond.notify_all();
+		SetLastError(ERROR_IO_PENDING);
+		return FALSE;
+	}
+
+	std::unique_lock<std::mutex> lock(mock->mutex);
+	mock->cond.wait(lock, [mock] { return !mock->queue.empty() || mock->shutdownRecv; });
+	if (mock->queue.empty())
+	{
+		SetLastError(ERROR_NO_DATA);
+		return FALSE;
+	}
+
+	UINT offset = 0;
+	DWORD error = ERROR_SUCCESS;
+	const UINT received = DequeuePackets(mock, pPacket, packetLen, pAddr, maxPackets, &offset, &error);
+	if (received == 0)
+	{
+		SetLastError(error);
+		return FALSE;
+	}
+	lock.unlock();
+	mock->cond.notify_all();
+
+	if (pRecvLen != NULL)
+	{
+		*pRecvLen = offset;
+	}
+	if (pAddrLen != NULL)
+	{
+		*pAddrLen = received * sizeof(WINDIVERT_ADDRESS);
+	}
+	return TRUE;
+}
+
+BOOL WinDivertRecv(HANDLE handle, VOID *pPacket, UINT packetLen, UINT *pRecvLen, WINDIVERT_ADDRESS *pAddr)
+{
+	UINT addrLen = sizeof(WINDIVERT_ADDRESS);
+	return WinDivertRecvEx(handle, pPacket, packetLen, pRecvLen, 0, pAddr, &addrLen, NULL);
+}
+
+BOOL WinDivertSendEx(HANDLE handle, const VOID *pPacket, UINT packetLen, UINT *pSendLen, UINT64 flags,
+					 const WINDIVERT_ADDRESS *pAddr, UINT addrLen, LPOVERLAPPED lpOverlapped)
+{
+	MockHandle *mock = FromHandle(handle);
+	if (mock == NULL)
+	{
+		return FALSE;
+	}
+	if (lpOverlapped != NULL)
+	{
+		SetLastError(ERROR_NOT_SUPPORTED);
+		return FALSE;
+	}
+	const UINT count = addrLen / sizeof(WINDIVERT_ADDRESS);
+	if (pPacket == NULL || pAddr == NULL || count == 0)
+	{
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return FALSE;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mock->mutex);
+		if (mock->shutdownSend)
+		{
+			SetLastError(ERROR_NO_DATA);
+			return FALSE;
+		}
+	}
+
+	const int64_t now = NowNs();
+	const uint8_t *data = static_cast<const uint8_t *>(pPacket);
+	UINT offset = 0;
+	UINT reinjected = 0;
+	std::lock_guard<std::mutex> lock(mockMutex);
+	for (UINT i = 0; i < count && offset < packetLen; i++)
+	{
+		offset += PacketLength(data + offset, packetLen - offset);
+		// Timestamps of packets built by the caller are usually 0 or copied from another packet.
+		if (pAddr[i].Timestamp > 0 && pAddr[i].Timestamp <= now)
+		{
+			mockLatency.Record(static_cast<uint64_t>(now - pAddr[i].Timestamp));
+			reinjected++;
+		}
+	}
+	mockReinjected += reinjected;
+	mockInjected += count - reinjected;
+	mockLastSend = now;
+
+	if (pSendLen != NULL)
+	{
+		*pSendLen = offset;
+	}
+	return TRUE;
+}
+
+BOOL WinDivertSend(HANDLE handle, const VOID *pPacket, UINT packetLen, UINT *pSendLen, const WINDIVERT_ADDRESS *pAddr)
+{
+	return WinDivertSendEx(handle, pPacket, packetLen, pSendLen, 0, pAddr, sizeof(WINDIVERT_ADDRESS), NULL);
+}
+
+BOOL WinDivertShutdown(HANDLE handle, WINDIVERT_SHUTDOWN how)
+{
+	MockHandle *mock = FromHandle(handle);
+	if (mock == NULL)
+	{
+		return FALSE;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mock->mutex);
+		if (how & WINDIVERT_SHUTDOWN_RECV)
+		{
+			// Like the driver, stop queueing new packets; queued ones can still be read.
+			mock->shutdownRecv = true;
+			mock->stop = true;
+			CompleteReads(mock);
+		}
+		if (how & WINDIVERT_SHUTDOWN_SEND)
+		{
+			mock->shutdownSend = true;
+		}
+	}
+	mock->cond.notify_all();
+	return TRUE;
+}
+
+BOOL WinDivertClose(HANDLE handle)
+{
+	MockHandle *mock = FromHandle(handle);
+	if (mock == NULL)
+	{
+		return FALSE;
+	}
+	WinDivertShutdown(handle, WINDIVERT_SHUTDOWN_BOTH);
+	if (mock->generator.joinable())
+	{
+		mock->generator.join();
+	}
+	mockQueued -= mock->queue.size();
+	MockReleaseCompletionPort(handle);
+	delete mock;
+	return TRUE;
+}
+
+BOOL WinDivertSetParam(HANDLE handle, WINDIVERT_PARAM param, UINT64 value)
+{
+	MockHandle *mock = FromHandle(handle);
+	if (mock == NULL)
+	{
+		return FALSE;
+	}
+	if (param == WINDIVERT_PARAM_QUEUE_LENGTH)
+	{
+		std::lock_guard<std::mutex> lock(mock->mutex);
+		mock->config.queueLength = static_cast<uint32_t>(value);
+		return TRUE;
+	}
+	return param <= WINDIVERT_PARAM_QUEUE_SIZE;
+}
+
+BOOL WinDivertGetParam(HANDLE handle, WINDIVERT_PARAM param, UINT64 *pValue)
+{
+	MockHandle *mock = FromHandle(handle);
+	if (mock == NULL || pValue == NULL)
+	{
+		return FALSE;
+	}
+	switch (param)
+	{
+		case WINDIVERT_PARAM_QUEUE_LENGTH:
+			*pValue = mock->config.queueLength;
+			return TRUE;
+		case WINDIVERT_PARAM_QUEUE_TIME:
+			*pValue = WINDIVERT_PARAM_QUEUE_TIME_DEFAULT;
+			return TRUE;
+		case WINDIVERT_PARAM_QUEUE_SIZE:
+			*pValue = WINDIVERT_PARAM_QUEUE_SIZE_DEFAULT;
+			return TRUE;
+		case WINDIVERT_PARAM_VERSION_MAJOR:
+			*pValue = 2;
+			return TRUE;
+		case WINDIVERT_PARAM_VERSION_MINOR:
+			*pValue = 2;
+			return TRUE;
+		default:
+			SetLastError(ERROR_INVALID_PARAMETER);
+			return FALSE;
+	}
+}
+
+BOOL WinDivertHelperCalcChecksums(VOID *pPacket, UINT packetLen, WINDIVERT_ADDRESS *pAddr, UINT64 flags)
+{
+	if (!CalcPacketChecksums(static_cast<uint8_t *>(pPacket), packetLen))
+	{
+		return FALSE;
+	}
+	if (pAddr != NULL)
+	{
+		pAddr->IPChecksum = 1;
+		pAddr->TCPChecksum = 1;
+		pAddr->UDPChecksum = 1;
+	}
+	return TRUE;
+}
+
+BOOL WinDivertHelperParsePacket(const VOID *pPacket, UINT packetLen, PWINDIVERT_IPHDR *ppIpHdr,
+								PWINDIVERT_IPV6HDR *ppIpv6Hdr, UINT8 *pProtocol, PWINDIVERT_ICMPHDR *ppIcmpHdr,
+								PWINDIVERT_ICMPV6HDR *ppIcmpv6Hdr, PWINDIVERT_TCPHDR *ppTcpHdr, PWINDIVERT_UDPHDR *ppUdpHdr,
+								PVOID *ppData, UINT *pDataLen, PVOID *ppNext, UINT *pNextLen)
+{
+	uint8_t *data = static_cast<uint8_t *>(const_cast<VOID *>(pPacket));
+	PacketInfo info;
+	const bool ok = pPacket != NULL && ParsePacket(data, packetLen, &info);
+	uint8_t *transport = ok && info.transportLength > 0 ? data + info.transportOffset : NULL;
+
+	if (ppIpHdr != NULL)
+	{
+		*ppIpHdr = ok && info.version == 4 ? reinterpret_cast<PWINDIVERT_IPHDR>(data) : NULL;
+	}
+	if (ppIpv6Hdr != NULL)
+	{
+		*ppIpv6Hdr = ok && info.version == 6 ? reinterpret_cast<PWINDIVERT_IPV6HDR>(data) : NULL;
+	}
+	if (pProtocol != NULL)
+	{
+		*pProtocol = ok ? info.protocol : 0;
+	}
+	if (ppIcmpHdr != NULL)
+	{
+		*ppIcmpHdr = info.protocol == PACKET_PROTO_ICMP ? reinterpret_cast<PWINDIVERT_ICMPHDR>(transport) : NULL;
+	}
+	if (ppIcmpv6Hdr != NULL)
+	{
+		*ppIcmpv6Hdr = info.protocol == PACKET_PROTO_ICMPV6 ? reinterpret_cast<PWINDIVERT_ICMPV6HDR>(transport) : NULL;
+	}
+	if (ppTcpHdr != NULL)
+	{
+		*ppTcpHdr = info.protocol == PACKET_PROTO_TCP ? reinterpret_cast<PWINDIVERT_TCPHDR>(transport) : NULL;
+	}
+	if (ppUdpHdr != NULL)
+	{
+		*ppUdpHdr = info.protocol == PACKET_PROTO_UDP ? reinterpret_cast<PWINDIVERT_UDPHDR>(transport) : NULL;
+	}
+	if (ppData != NULL)
+	{
+		*ppData = ok && info.payloadLength > 0 ? data + info.payloadOffset : NULL;
+	}
+	if (pDataLen != NULL)
+	{
+		*pDataLen = ok ? info.payloadLength : 0;
+	}
+	const UINT consumed = ok ? info.length : packetLen;
+	if (ppNext != NULL)
+	{
+		*ppNext = consumed < packetLen ? data + consumed : NULL;
+	}
+	if (pNextLen != NULL)
+	{
+		*pNextLen = packetLen - consumed;
+	}
+	return ok;
+}
+
+#define MOCK_FILTER_OBJECT_PREFIX "@WinDivMock:"
+
+/**
+ * @brief Tests whether a filter field exists only on the FLOW, SOCKET and REFLECT layers.
+ */
+static bool MockEndpointField(const std::string &field)
+{
+	static const char *const fields[] = {"protocol", "localAddr", "remoteAddr", "localPort", "remotePort",
+										  "processId", "endpointId", "parentEndpointId"};
+	for (const char *name : fields)
+	{
+		if (field == name)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Checks what the mock can check of a filter: it is not blank, its parentheses balance and
+ * on the NETWORK layers it uses no endpoint fields.
+ * The mock does not evaluate filters, every handle receives the configured traffic.
+ */
+static BOOL MockCheckFilter(const char *filter, WINDIVERT_LAYER layer, const char **errorStr, UINT *errorPos)
+{
+	const bool network = layer == WINDIVERT_LAYER_NETWORK || layer == WINDIVERT_LAYER_NETWORK_FORWARD;
+	const char *error = NULL;
+	UINT position = 0;
+	int depth = 0;
+	bool blank = true;
+	for (UINT i = 0; filter[i] != '\0' && error == NULL; i++)
+	{
+		blank = blank && std::isspace(static_cast<unsigned char>(filter[i]));
+		if (std::isalpha(static_cast<unsigned char>(filter[i])) && (i == 0 || !(std::isalnum(static_cast<unsigned char>(filter[i - 1])) || filter[i - 1] == '.' || filter[i - 1] == ':')))
+		{
+			UINT end = i;
+			while (std::isalnum(static_cast<unsigned char>(filter[end])) || filter[end] == '.' || filter[end] == '_')
+			{
+				end++;
+			}
+			if (network && MockEndpointField(std::string(filter + i, end - i)))
+			{
+				error = "Filter field is invalid for the given layer";
+				position = i;
+			}
+			i = end - 1;
+		}
+		else if (filter[i] == '(')
+		{
+			depth++;
+		}
+		else if (filter[i] == ')' && --depth < 0)
+		{
+			error = "Unexpected token";
+			position = i;
+		}
+	}
+	if (error == NULL && blank)
+	{
+		error = "Filter expression expected";
+	}
+	else if (error == NULL && depth > 0)
+	{
+		error = "Expected ')'";
+		position = static_cast<UINT>(std::strlen(filter));
+	}
+	if (errorStr != NULL)
+	{
+		*errorStr = error;
+	}
+	if (errorPos != NULL)
+	{
+		*errorPos = position;
+	}
+	return error == NULL;
+}
+
+BOOL WinDivertHelperCompileFilter(const char *filter, WINDIVERT_LAYER layer, char *object, UINT objLen,
+								  const char **errorStr, UINT *errorPos)
+{
+	if (filter == NULL || layer > WINDIVERT_LAYER_REFLECT)
+	{
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return FALSE;
+	}
+	if (!MockCheckFilter(filter, layer, errorStr, errorPos))
+	{
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return FALSE;
+	}
+	const std::string text = std::string(MOCK_FILTER_OBJECT_PREFIX) + filter;
+	if (object != NULL)
+	{
+		if (text.size() + 1 > objLen)
+		{
+			SetLastError(ERROR_INSUFFICIENT_BUFFER);
+			return FALSE;
+		}
+		std::memcpy(object, text.c_str(), text.size() + 1);
+	}
+	return TRUE;
+}
+
+BOOL WinDivertHelperFormatFilter(const char *filter, WINDIVERT_LAYER layer, char *buffer, UINT bufLen)
+{
+	if (filter == NULL || layer > WINDIVERT_LAYER_REFLECT)
+	{
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return FALSE;
+	}
+	const size_t prefix = std::strlen(MOCK_FILTER_OBJECT_PREFIX);
+	const char *text = filter[0] == '@' ? filter + prefix : filter;
+	if ((filter[0] == '@' && std::strncmp(filter, MOCK_FILTER_OBJECT_PREFIX, prefix) != 0) ||
+		!MockCheckFilter(text, layer, NULL, NULL))
+	{
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return FALSE;
+	}
+	if (std::strlen(text) + 1 > bufLen)
+	{
+		SetLastError(ERROR_INSUFFICIENT_BUFFER);
+		return FALSE;
+	}
+	std::memcpy(buffer, text, std::strlen(text) + 1);
+	return TRUE;
+}
@@ -0,0 +1,73 @@
+/**
+ * @file mock-windivert.h
+ * @brief Userspace WinDivert driver used to run the binding on Linux
+ *
+ * The mock implements the WinDivertOpen/Recv/RecvEx/Send/SendEx/Shutdown/Close contract
+ * and the helpers the binding uses. Each opened handle runs a generator thread that
+ * offers synthetic packets at a configured rate into a bounded queue, the equivalent of
+ * the driver's packet queue: packets arriving while the queue is full are dropped.
+ * Each packet's WINDIVERT_ADDRESS.Timestamp holds its arrival time in steady clock
+ * nanoseconds, and reinjection through WinDivertSend(Ex) records the time it spent in
+ * the binding, so a harness can measure throughput, latency and drop rate.
+ */
+
+#ifndef MOCK_WINDIVERT_H_
+#define MOCK_WINDIVERT_H_
+
+#include <cstdint>
+#include "synthetic.h"
+
+#define MOCK_DEFAULT_QUEUE_LENGTH 4096   ///< WINDIVERT_PARAM_QUEUE_LENGTH default
+#define MOCK_POOL_PACKETS         4096   ///< Distinct synthetic packets per handle
+
+/**
+ * @struct MockConfig
+ * @brief Traffic offered to handles opened after MockConfigure
+ */
+struct MockConfig {
+	uint64_t rate = 100000;                         ///< Arrivals per second, 0 for as fast as the queue drains
+	uint64_t count = 0;                             ///< Packets offered per handle, 0 for unlimited
+	uint32_t queueLength = MOCK_DEFAULT_QUEUE_LENGTH; ///< Queue capacity in packets
+	SyntheticMixSpec mix;                           ///< Packet mix
+};
+
+/**
+ * @struct MockStats
+ * @brief Counters accumulated over all handles since the last MockReset
+ */
+struct MockStats {
+	uint64_t offered;       ///< Packets generated
+	uint64_t queueDrops;    ///< Packets dropped because the queue was full
+	uint64_t received;      ///< Packets returned by WinDivertRecv(Ex)
+	uint64_t reinjected;    ///< Received packets sent back with WinDivertSend(Ex)
+	uint64_t injected;      ///< Sent packets that did not come from the mock
+	uint64_t queued;        ///< Packets currently queued
+	double elapsed;         ///< Seconds since the first packet was offered
+	double lastSend;        ///< Seconds from the first offer to the last reinjection
+	uint64_t p50;           ///< Latency percentiles of reinjected packets, nanoseconds
+	uint64_t p99;
+	uint64_t p999;
+	uint64_t maxLatency;
+};
+
+/**
+ * @brief Sets the traffic for handles opened afterwards
+ */
+void MockConfigure(const MockConfig &config);
+
+/**
+ * @brief Returns the current configuration
+ */
+MockConfig MockGetConfig();
+
+/**
+ * @brief Clears statistics
+ */
+void MockReset();
+
+/**
+ * @brief Reads statistics
+ */
+void MockGetStats(MockStats *stats);
+
+#endif
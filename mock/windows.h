@@ -0,0 +1,140 @@
+/**
+ * @file windows.h
+ * @brief Minimal Win32 surface for building the binding against the mock driver
+ *
+ * Only what windivert.h and the binding use is declared. The standard headers are
+ * included first because the SAL annotations below (__in, __out, ...) are plain
+ * identifiers inside libstdc++ and would break any standard header included later.
+ */
+
+#ifndef MOCK_WINDOWS_H_
+#define MOCK_WINDOWS_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <codecvt>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <locale>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+typedef void *HANDLE;
+typedef int BOOL;
+typedef unsigned int UINT;
+typedef uint32_t DWORD;
+typedef void VOID;
+typedef void *PVOID;
+typedef char CHAR;
+typedef wchar_t WCHAR;
+typedef wchar_t *LPWSTR;
+typedef const char *LPCSTR;
+typedef uint16_t WORD;
+typedef uintptr_t ULONG_PTR;
+typedef unsigned long long ULONGLONG;
+typedef unsigned long ULONG;
+typedef ULONG_PTR *PULONG_PTR;
+typedef DWORD *LPDWORD;
+typedef int8_t INT8;
+typedef uint8_t UINT8;
+typedef int16_t INT16;
+typedef uint16_t UINT16;
+typedef int32_t INT32;
+typedef uint32_t UINT32;
+typedef int64_t INT64;
+typedef uint64_t UINT64;
+
+typedef struct _OVERLAPPED {
+	ULONG_PTR Internal;
+	ULONG_PTR InternalHigh;
+	DWORD Offset;
+	DWORD OffsetHigh;
+	HANDLE hEvent;
+} OVERLAPPED, *LPOVERLAPPED;
+
+typedef struct _OVERLAPPED_ENTRY {
+	ULONG_PTR lpCompletionKey;
+	LPOVERLAPPED lpOverlapped;
+	ULONG_PTR Internal;
+	DWORD dwNumberOfBytesTransferred;
+} OVERLAPPED_ENTRY, *LPOVERLAPPED_ENTRY;
+
+typedef struct _FILETIME {
+	DWORD dwLowDateTime;
+	DWORD dwHighDateTime;
+} FILETIME;
+
+#define TRUE  1
+#define FALSE 0
+#define INVALID_HANDLE_VALUE ((HANDLE)(intptr_t)-1)
+#define INFINITE 0xFFFFFFFF
+#define MAX_PATH 260
+
+#define __in
+#define __in_opt
+#define __out
+#define __out_opt
+#define __inout
+#define __inout_opt
+#define WINDIVERTEXPORT extern
+
+#define ERROR_SUCCESS              0L
+#define ERROR_INVALID_HANDLE       6L
+#define ERROR_NOT_ENOUGH_MEMORY    8L
+#define ERROR_NOT_SUPPORTED        50L
+#define ERROR_INVALID_PARAMETER    87L
+#define ERROR_INSUFFICIENT_BUFFER  122L
+#define ERROR_NO_DATA              232L
+#define WAIT_TIMEOUT               258L
+#define ERROR_OPERATION_ABORTED    995L
+#define ERROR_IO_PENDING           997L
+
+#define FORMAT_MESSAGE_ALLOCATE_BUFFER 0x00000100
+#define FORMAT_MESSAGE_IGNORE_INSERTS  0x00000200
+#define FORMAT_MESSAGE_FROM_SYSTEM     0x00001000
+#define LANG_NEUTRAL    0x00
+#define SUBLANG_DEFAULT 0x01
+#define MAKELANGID(p, s) ((((WORD)(s)) << 10) | (WORD)(p))
+
+#define PROCESS_QUERY_LIMITED_INFORMATION 0x1000
+#define CP_UTF8 65001
+
+DWORD GetLastError();
+void SetLastError(DWORD error);
+BOOL CloseHandle(HANDLE handle);
+DWORD FormatMessageW(DWORD flags, const void *source, DWORD messageId, DWORD languageId, LPWSTR buffer, DWORD size, void *arguments);
+void *LocalFree(void *memory);
+ULONGLONG GetTickCount64();
+HANDLE OpenProcess(DWORD access, BOOL inherit, DWORD processId);
+BOOL GetProcessTimes(HANDLE process, FILETIME *creation, FILETIME *exit, FILETIME *kernel, FILETIME *user);
+BOOL QueryFullProcessImageNameW(HANDLE process, DWORD flags, LPWSTR name, DWORD *size);
+int WideCharToMultiByte(UINT codePage, DWORD flags, const WCHAR *wide, int wideLength, CHAR *multiByte, int multiByteLength, LPCSTR defaultChar, BOOL *usedDefaultChar);
+HANDLE CreateIoCompletionPort(HANDLE file, HANDLE existingPort, ULONG_PTR completionKey, DWORD threads);
+BOOL GetQueuedCompletionStatusEx(HANDLE port, LPOVERLAPPED_ENTRY entries, ULONG count, ULONG *removed, DWORD milliseconds, BOOL alertable);
+BOOL PostQueuedCompletionStatus(HANDLE port, DWORD bytes, ULONG_PTR completionKey, LPOVERLAPPED overlapped);
+BOOL GetOverlappedResult(HANDLE file, LPOVERLAPPED overlapped, LPDWORD bytes, BOOL wait);
+
+/*
+ * Not Win32: lets the mock driver find the completion port a handle was associated with.
+ * The driver completes an overlapped read by storing the error in Internal and the byte
+ * count in InternalHigh, then posting the OVERLAPPED to that port.
+ */
+BOOL MockGetCompletionPort(HANDLE file, HANDLE *port, ULONG_PTR *completionKey);
+void MockReleaseCompletionPort(HANDLE file);
+
+#endif
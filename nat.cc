@@ -0,0 +1,291 @@
+/**
+ * @file nat.cc
+ * @brief Rule based address and port translation stage with connection tracking
+ */
+
+#include "nat.h"
+#include "checksum.h"
+
+/**
+ * @brief Reads the tuple of a parsed TCP or UDP packet
+ */
+static void TupleFromPacket(const UINT8 *data, const PacketInfo &info, NatTuple *tuple)
+{
+	std::memset(tuple, 0, sizeof(NatTuple));
+	tuple->ipv6 = info.version == 6;
+	const UINT32 addrLen = tuple->ipv6 ? 16 : 4;
+	std::memcpy(tuple->src, data + (tuple->ipv6 ? 8 : 12), addrLen);
+	std::memcpy(tuple->dst, data + (tuple->ipv6 ? 24 : 16), addrLen);
+	tuple->srcPort = ReadBE16(data + info.transportOffset);
+	tuple->dstPort = ReadBE16(data + info.transportOffset + 2);
+	tuple->protocol = info.protocol;
+}
+
+/**
+ * @brief Returns the tuple of packets travelling the other way
+ */
+static NatTuple Reverse(const NatTuple &tuple)
+{
+	NatTuple reverse = tuple;
+	std::memcpy(reverse.src, tuple.dst, sizeof(tuple.dst));
+	std::memcpy(reverse.dst, tuple.src, sizeof(tuple.src));
+	reverse.srcPort = tuple.dstPort;
+	reverse.dstPort = tuple.srcPort;
+	return reverse;
+}
+
+static bool operator==(const NatTuple &a, const NatTuple &b)
+{
+	return std::memcmp(&a, &b, sizeof(NatTuple)) == 0;
+}
+
+/**
+ * @brief Table key of a directional tuple.
+ * The source takes the local slot; IPv4 is stored IPv4-mapped so families never collide.
+ */
+static FlowKey TupleKey(const NatTuple &tuple)
+{
+	FlowKey key;
+	std::memset(&key, 0, sizeof(FlowKey));
+	uint8_t *local = reinterpret_cast<uint8_t *>(key.localAddr);
+	uint8_t *remote = reinterpret_cast<uint8_t *>(key.remoteAddr);
+	if (tuple.ipv6)
+	{
+		std::memcpy(local, tuple.src, 16);
+		std::memcpy(remote, tuple.dst, 16);
+	}
+	else
+	{
+		local[10] = local[11] = remote[10] = remote[11] = 0xFF;
+		std::memcpy(local + 12, tuple.src, 4);
+		std::memcpy(remote + 12, tuple.dst, 4);
+	}
+	key.localPort = tuple.srcPort;
+	key.remotePort = tuple.dstPort;
+	key.protocol = tuple.protocol;
+	return key;
+}
+
+NatStage::NatStage(size_t maxConnections, const NatTimeouts &timeouts)
+	: rules_(std::make_shared<const std::vector<NatRule>>()), timeouts_(timeouts), table_(maxConnections * 2),
+	  lastSweep_(0), translated_(0), reversed_(0), expired_(0), full_(0), collisions_(0)
+{
+}
+
+void NatStage::SetRules(std::vector<NatRule> rules)
+{
+	std::atomic_store(&this->rules_, std::shared_ptr<const std::vector<NatRule>>(
+		std::make_shared<const std::vector<NatRule>>(std::move(rules))));
+}
+
+const NatRule *NatStage::Match(const std::vector<NatRule> &rules, const NatTuple &tuple, const WINDIVERT_ADDRESS &addr)
+{
+	for (const NatRule &rule : rules)
+	{
+		if ((rule.hasToAddr && rule.toIpv6 != tuple.ipv6) ||
+			!MatchFields(rule.match, tuple.src, tuple.dst, tuple.ipv6, tuple.protocol, tuple.srcPort, tuple.dstPort, addr))
+		{
+			continue;
+		}
+		return &rule;
+	}
+	return nullptr;
+}
+
+void NatStage::Rewrite(PacketContext &ctx, const NatTuple &to, bool flip)
+{
+	UINT8 *data = ctx.data;
+	UINT8 *transport = data + ctx.info.transportOffset;
+	const UINT32 addrLen = to.ipv6 ? 16 : 4;
+	UINT8 *src = data + (to.ipv6 ? 8 : 12);
+	UINT8 *dst = data + (to.ipv6 ? 24 : 16);
+	UINT8 ports[4];
+	WriteBE16(ports, to.srcPort);
+	WriteBE16(ports + 2, to.dstPort);
+
+	// Addresses are part of the IPv4 header and of the pseudo header, ports only of the transport header.
+	UINT32 addrDelta = ChecksumDelta(0, src, to.src, addrLen);
+	addrDelta = ChecksumDelta(addrDelta, dst, to.dst, addrLen);
+	const UINT32 transportDelta = ChecksumDelta(addrDelta, transport, ports, 4);
+
+	// A cleared checksum flag means the checksum is offloaded and computed on injection.
+	if (!to.ipv6 && ctx.addr->IPChecksum)
+	{
+		ChecksumUpdate(data + 10, addrDelta);
+	}
+	if (to.protocol == PACKET_PROTO_TCP && ctx.addr->TCPChecksum)
+	{
+		ChecksumUpdate(transport + 16, transportDelta);
+	}
+	else if (to.protocol == PACKET_PROTO_UDP && ctx.addr->UDPChecksum && ReadBE16(transport + 6) != 0)
+	{
+		ChecksumUpdate(transport + 6, transportDelta);
+		if (ReadBE16(transport + 6) == 0)
+		{
+			WriteBE16(transport + 6, 0xFFFF);
+		}
+	}
+
+	std::memcpy(src, to.src, addrLen);
+	std::memcpy(dst, to.dst, addrLen);
+	std::memcpy(transport, ports, 4);
+	if (flip)
+	{
+		ctx.addr->Outbound = ctx.addr->Outbound ? 0 : 1;
+	}
+}
+
+UINT64 NatStage::Timeout(const NatEntry &entry) const
+{
+	if (entry.closing)
+	{
+		return this->timeouts_.closing;
+	}
+	return entry.to.protocol == PACKET_PROTO_TCP ? this->timeouts_.tcp : this->timeouts_.udp;
+}
+
+StageVerdict NatStage::Process(PacketContext &ctx)
+{
+	if (!ctx.parsed || ctx.info.transportLength == 0 ||
+		(ctx.info.protocol != PACKET_PROTO_TCP && ctx.info.protocol != PACKET_PROTO_UDP))
+	{
+		return STAGE_CONTINUE;
+	}
+	NatTuple tuple;
+	TupleFromPacket(ctx.data, ctx.info, &tuple);
+	const FlowKey key = TupleKey(tuple);
+	const bool tcp = tuple.protocol == PACKET_PROTO_TCP;
+	const UINT8 tcpFlags = tcp ? ctx.data[ctx.info.transportOffset + 13] : 0;
+
+	NatTuple to;
+	bool flip;
+	bool reply = false;
+	{
+		std::lock_guard<std::mutex> lock(this->mutex_);
+		NatEntry *entry = this->table_.Find(key);
+		if (entry != nullptr)
+		{
+			to = entry->to;
+			flip = entry->flip;
+			const FlowKey partnerKey = TupleKey(Reverse(to));
+			NatEntry *partner = this->table_.Find(partnerKey);
+			reply = entry->reply;
+			if (tcpFlags & PACKET_TCP_RST)
+			{
+				this->table_.Erase(key);
+				this->table_.Erase(partnerKey);
+			}
+			else
+			{
+				entry->lastSeen = ctx.now;
+				entry->closing = entry->closing || (tcpFlags & PACKET_TCP_FIN) != 0;
+				if (partner != nullptr)
+				{
+					partner->lastSeen = ctx.now;
+					partner->closing = entry->closing;
+				}
+			}
+		}
+		else
+		{
+			std::shared_ptr<const std::vector<NatRule>> rules = std::atomic_load(&this->rules_);
+			const NatRule *rule = Match(*rules, tuple, *ctx.addr);
+			// Connections are only tracked from their first packet; a TCP mid-stream packet is left alone.
+			if (rule == nullptr || (tcp && (tcpFlags & (PACKET_TCP_SYN | PACKET_TCP_ACK)) != PACKET_TCP_SYN))
+			{
+				return STAGE_CONTINUE;
+			}
+			to = tuple;
+			if (rule->type == NAT_DNAT)
+			{
+				if (rule->hasToAddr)
+				{
+					std::memcpy(to.dst, rule->toAddr, sizeof(to.dst));
+				}
+				to.dstPort = rule->toPort != 0 ? rule->toPort : to.dstPort;
+			}
+			else
+			{
+				if (rule->hasToAddr)
+				{
+					std::memcpy(to.src, rule->toAddr, sizeof(to.src));
+				}
+				to.srcPort = rule->toPort != 0 ? rule->toPort : to.srcPort;
+			}
+			if (rule->reflect)
+			{
+				std::swap(to.src, to.dst);
+			}
+			flip = rule->reflect;
+
+			const NatTuple back = Reverse(tuple);
+			const FlowKey replyKey = TupleKey(Reverse(to));
+			const NatEntry *existing = this->table_.Find(replyKey);
+			if (existing != nullptr && !(existing->to == back))
+			{
+				this->collisions_++;
+				return STAGE_CONTINUE;
+			}
+			if (this->table_.Size() + 2 > this->table_.MaxSize())
+			{
+				this->full_++;
+				return STAGE_CONTINUE;
+			}
+			this->table_.Insert(key, NatEntry{to, ctx.now, flip, false, false});
+			this->table_.Insert(replyKey, NatEntry{back, ctx.now, flip, false, true});
+		}
+	}
+
+	Rewrite(ctx, to, flip);
+	if (reply)
+	{
+		this->reversed_++;
+	}
+	else
+	{
+		this->translated_++;
+	}
+	return STAGE_PASS;
+}
+
+void NatStage::Tick(UINT64 now)
+{
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	// Threads of other handles may have stamped a later time, so only sweep forward.
+	if (now <= this->lastSweep_ || now - this->lastSweep_ < NAT_SWEEP_INTERVAL)
+	{
+		return;
+	}
+	this->lastSweep_ = now;
+	UINT64 connections = 0;
+	this->table_.EraseIf([this, now, &connections](const FlowKey &, const NatEntry &entry)
+	{
+		if (now > entry.lastSeen && now - entry.lastSeen > this->Timeout(entry))
+		{
+			// Both directions are stamped together, so each connection counts once.
+			connections += entry.reply ? 0 : 1;
+			return true;
+		}
+		return false;
+	});
+	this->expired_ += connections;
+}
+
+void NatStage::Clear()
+{
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	this->table_.Clear();
+}
+
+void NatStage::GetStats(NatStats *stats)
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex_);
+		stats->connections = this->table_.Size() / 2;
+	}
+	stats->translated = this->translated_;
+	stats->reversed = this->reversed_;
+	stats->expired = this->expired_;
+	stats->full = this->full_;
+	stats->collisions = this->collisions_;
+}
@@ -0,0 +1,166 @@
+/**
+ * @file nat.h
+ * @brief Rule based address and port translation stage with connection tracking
+ *
+ * The first packet of a TCP or UDP connection that matches a rule is translated and two
+ * entries are tracked: the original tuple maps to the translated one, and the reverse of
+ * the translated tuple (what replies look like) maps back to the reverse of the original.
+ * Later packets in either direction are rewritten from the table without consulting the
+ * rules, so rule changes only affect new connections. Checksums are fixed incrementally.
+ *
+ * A reflect rule also swaps source and destination addresses and flips the Outbound
+ * flag, which turns an outbound connection into an inbound one to a local proxy and
+ * turns the proxy's replies back into inbound packets from the original server.
+ */
+
+#ifndef NAT_H_
+#define NAT_H_
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "windivert.h"
+#include "packet.h"
+#include "flow-table.h"
+#include "packet-match.h"
+#include "packet-stage.h"
+
+#define NAT_DEFAULT_MAX_CONNECTIONS (1 << 16)
+#define NAT_DEFAULT_TCP_TIMEOUT     300000   ///< Idle milliseconds before a TCP connection is forgotten
+#define NAT_DEFAULT_UDP_TIMEOUT     60000    ///< Idle milliseconds before a UDP association is forgotten
+#define NAT_DEFAULT_CLOSING_TIMEOUT 10000    ///< Milliseconds a TCP connection is kept after a FIN
+#define NAT_SWEEP_INTERVAL          1000     ///< Milliseconds between expiry sweeps
+
+/**
+ * @enum NatType
+ * @brief Which side of the packet a rule rewrites
+ */
+enum NatType {
+	NAT_DNAT = 0,   ///< Destination address and port
+	NAT_SNAT = 1    ///< Source address and port
+};
+
+/**
+ * @struct NatRule
+ * @brief Match and translation of a rule
+ */
+struct NatRule {
+	PacketMatch match;        ///< Connections the rule applies to, protocol is TCP, UDP or 0 for both
+	NatType type;             ///< Rewritten side
+	bool hasToAddr;           ///< Rewrite the address
+	bool toIpv6;              ///< Family of toAddr, the rule only matches this family
+	uint8_t toAddr[16];       ///< New address in network order
+	uint16_t toPort;          ///< New port, 0 keeps the port
+	bool reflect;             ///< Swap addresses and flip the direction after rewriting
+};
+
+/**
+ * @struct NatTuple
+ * @brief Directional 5-tuple, addresses in network order
+ */
+struct NatTuple {
+	uint8_t src[16];      ///< Source address, IPv4 uses the first 4 bytes
+	uint8_t dst[16];      ///< Destination address
+	uint16_t srcPort;     ///< Source port
+	uint16_t dstPort;     ///< Destination port
+	uint8_t protocol;     ///< Transport protocol
+	bool ipv6;            ///< Address family
+};
+
+/**
+ * @struct NatEntry
+ * @brief Tracked translation of one direction of a connection
+ */
+struct NatEntry {
+	NatTuple to;          ///< Tuple the packet is rewritten to
+	UINT64 lastSeen;      ///< GetTickCount64 of the last packet in either direction
+	bool flip;            ///< Flip the Outbound flag
+	bool closing;         ///< A FIN was seen
+	bool reply;           ///< Entry of the reply direction
+};
+
+/**
+ * @struct NatTimeouts
+ * @brief Connection tracking timeouts in milliseconds
+ */
+struct NatTimeouts {
+	UINT64 tcp = NAT_DEFAULT_TCP_TIMEOUT;
+	UINT64 udp = NAT_DEFAULT_UDP_TIMEOUT;
+	UINT64 closing = NAT_DEFAULT_CLOSING_TIMEOUT;
+};
+
+/**
+ * @struct NatStats
+ * @brief Counters since the stage was created
+ */
+struct NatStats {
+	UINT64 translated;    ///< Packets rewritten in the original direction
+	UINT64 reversed;      ///< Reply packets rewritten back
+	UINT64 connections;   ///< Tracked connections
+	UINT64 expired;       ///< Connections removed by timeout
+	UINT64 full;          ///< New connections left untranslated because the table was full
+	UINT64 collisions;    ///< New connections left untranslated because their reply tuple was taken
+};
+
+/**
+ * @class NatStage
+ * @brief PacketStage translating TCP and UDP connections
+ *
+ * Rules are replaced as a whole and read without locking; the connection table is
+ * guarded by a mutex since the stage may be attached to several handles.
+ */
+class NatStage : public PacketStage {
+	public:
+		NatStage(size_t maxConnections, const NatTimeouts &timeouts);
+
+		/**
+		 * @brief Replaces the rules, evaluated in order for new connections
+		 */
+		void SetRules(std::vector<NatRule> rules);
+
+		/**
+		 * @brief Translates a packet
+		 * @return STAGE_PASS if the packet was rewritten, STAGE_CONTINUE otherwise
+		 */
+		StageVerdict Process(PacketContext &ctx) override;
+
+		/**
+		 * @brief Expires idle connections at most once per NAT_SWEEP_INTERVAL
+		 */
+		void Tick(UINT64 now) override;
+
+		/**
+		 * @brief Forgets all tracked connections
+		 */
+		void Clear();
+
+		void GetStats(NatStats *stats);
+
+	private:
+		/**
+		 * @brief Returns the first rule matching a new connection, or nullptr
+		 */
+		static const NatRule *Match(const std::vector<NatRule> &rules, const NatTuple &tuple, const WINDIVERT_ADDRESS &addr);
+
+		/**
+		 * @brief Rewrites the addresses and ports of a packet and fixes its checksums
+		 */
+		static void Rewrite(PacketContext &ctx, const NatTuple &to, bool flip);
+
+		UINT64 Timeout(const NatEntry &entry) const;
+
+		std::shared_ptr<const std::vector<NatRule>> rules_;   ///< Accessed with std::atomic_load/store
+		NatTimeouts timeouts_;           ///< Idle timeouts
+		std::mutex mutex_;               ///< Guards table_ and lastSweep_
+		FlowTable<NatEntry> table_;      ///< Two entries per connection
+		UINT64 lastSweep_;               ///< Time of the last expiry sweep
+		std::atomic<UINT64> translated_;
+		std::atomic<UINT64> reversed_;
+		std::atomic<UINT64> expired_;
+		std::atomic<UINT64> full_;
+		std::atomic<UINT64> collisions_;
+};
+
+#endif
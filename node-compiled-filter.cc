@@ -0,0 +1,133 @@
+/**
+ * @file node-compiled-filter.cc
+ * @brief Node.js wrapper of filters compiled with WinDivertHelperCompileFilter
+ */
+
+#include <algorithm>
+#include <vector>
+#include "node-compiled-filter.h"
+
+Napi::FunctionReference CompiledFilterWrap::constructor;
+
+/**
+ * @brief Registers the CompiledFilter class.
+ * @param env The Node.js environment.
+ * @param exports The exports object to attach the class to.
+ * @return The modified exports object containing the CompiledFilter class.
+ */
+Napi::Object CompiledFilterWrap::Init(Napi::Env env, Napi::Object exports)
+{
+	Napi::Function func = DefineClass(env, "CompiledFilter", {InstanceAccessor("object", &CompiledFilterWrap::GetObject, nullptr), InstanceAccessor("layer", &CompiledFilterWrap::GetLayer, nullptr), InstanceAccessor("filter", &CompiledFilterWrap::GetFilter, nullptr), InstanceMethod("toJSON", &CompiledFilterWrap::toJSON)});
+
+	constructor = Napi::Persistent(func);
+	constructor.SuppressDestruct();
+
+	exports.Set("CompiledFilter", func);
+	return exports;
+}
+
+bool CompiledFilterWrap::FromValue(Napi::Value value, std::string *object, UINT32 *layer)
+{
+	if (!value.IsObject() || !value.As<Napi::Object>().InstanceOf(constructor.Value()))
+	{
+		return false;
+	}
+	CompiledFilterWrap *filter = CompiledFilterWrap::Unwrap(value.As<Napi::Object>());
+	*object = filter->object_;
+	*layer = filter->layer_;
+	return true;
+}
+
+/**
+ * @brief Compiles a filter, or validates a serialized object.
+ * @param info Contains:
+ *             - filter: Filter string, or an object string starting with '@' as returned by
+ *               the object property of an earlier CompiledFilter
+ *             - layer: (Optional) WinDivert layer, default NETWORK
+ * @throws SyntaxError with position and filterError properties if the filter does not compile.
+ * @throws Error if an object string is not valid for this driver library version.
+ */
+CompiledFilterWrap::CompiledFilterWrap(const Napi::CallbackInfo &info) : Napi::ObjectWrap<CompiledFilterWrap>(info), layer_(0)
+{
+	Napi::Env env = info.Env();
+	if (info.Length() < 1 || !info[0].IsString())
+	{
+		Napi::TypeError::New(env, "String filter expected").ThrowAsJavaScriptException();
+		return;
+	}
+	std::string source = info[0].As<Napi::String>().Utf8Value();
+	if (info.Length() > 1 && info[1].IsNumber())
+	{
+		this->layer_ = info[1].As<Napi::Number>().Uint32Value();
+	}
+	const WINDIVERT_LAYER layer = static_cast<WINDIVERT_LAYER>(this->layer_);
+
+	if (!source.empty() && source[0] == '@')
+	{
+		this->object_ = source;
+	}
+	else
+	{
+		std::vector<char> object(COMPILED_FILTER_OBJECT_MAX);
+		const char *errorStr = NULL;
+		UINT errorPos = 0;
+		if (!WinDivertHelperCompileFilter(source.c_str(), layer, object.data(), static_cast<UINT>(object.size()), &errorStr, &errorPos))
+		{
+			if (errorStr == NULL)
+			{
+				Napi::Error::New(env, "Filter compilation failed with error code: " + std::to_string(GetLastError())).ThrowAsJavaScriptException();
+				return;
+			}
+			// Show the offending part so errors in generated multi-kilobyte filters can be found.
+			const size_t position = std::min<size_t>(errorPos, source.size());
+			const size_t start = position > 20 ? position - 20 : 0;
+			std::string message = std::string(errorStr) + " at position " + std::to_string(errorPos) + ": ..." +
+								  source.substr(start, position - start) + " >>> " + source.substr(position, 20);
+			Napi::Error error = Napi::Error::New(env, message);
+			error.Set("name", Napi::String::New(env, "SyntaxError"));
+			error.Set("position", Napi::Number::New(env, errorPos));
+			error.Set("filterError", Napi::String::New(env, errorStr));
+			error.ThrowAsJavaScriptException();
+			return;
+		}
+		this->object_ = object.data();
+	}
+
+	std::vector<char> text(COMPILED_FILTER_TEXT_MAX);
+	if (!WinDivertHelperFormatFilter(this->object_.c_str(), layer, text.data(), static_cast<UINT>(text.size())))
+	{
+		Napi::Error::New(env, "Invalid compiled filter object for this layer or WinDivert version. Error code: " +
+						 std::to_string(GetLastError())).ThrowAsJavaScriptException();
+		return;
+	}
+	this->filter_ = text.data();
+}
+
+Napi::Value CompiledFilterWrap::GetObject(const Napi::CallbackInfo &info)
+{
+	return Napi::String::New(info.Env(), this->object_);
+}
+
+Napi::Value CompiledFilterWrap::GetLayer(const Napi::CallbackInfo &info)
+{
+	return Napi::Number::New(info.Env(), this->layer_);
+}
+
+Napi::Value CompiledFilterWrap::GetFilter(const Napi::CallbackInfo &info)
+{
+	return Napi::String::New(info.Env(), this->filter_);
+}
+
+/**
+ * @brief Returns the serializable form; new CompiledFilter(json.object, json.layer) restores it.
+ * @return Object with object, layer and filter.
+ */
+Napi::Value CompiledFilterWrap::toJSON(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	Napi::Object result = Napi::Object::New(env);
+	result.Set("object", Napi::String::New(env, this->object_));
+	result.Set("layer", Napi::Number::New(env, this->layer_));
+	result.Set("filter", Napi::String::New(env, this->filter_));
+	return result;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file node-compiled-filter.h
+ * @brief Node.js wrapper of filters compiled with WinDivertHelperCompileFilter
+ *
+ * A CompiledFilter is built once from a filter string, or restored from its serialized
+ * object, and can be passed to any number of WinDivert constructors in place of the
+ * string. Syntax errors are thrown when the filter is built, with the error position.
+ */
+
+#ifndef NODE_COMPILED_FILTER_H_
+#define NODE_COMPILED_FILTER_H_
+
+#define NAPI_VERSION 4
+#include <napi.h>
+#include <string>
+#include "windivert.h"
+
+#define COMPILED_FILTER_OBJECT_MAX (16 * 1024)   ///< Buffer for compiled objects
+#define COMPILED_FILTER_TEXT_MAX   (64 * 1024)   ///< Buffer for formatted filters
+
+/**
+ * @class CompiledFilterWrap
+ * @brief JavaScript CompiledFilter class
+ */
+class CompiledFilterWrap : public Napi::ObjectWrap<CompiledFilterWrap> {
+	public:
+		/**
+		 * @brief Registers the CompiledFilter class
+		 * @param env The Node.js environment
+		 * @param exports The exports object to attach the class to
+		 * @return The modified exports object
+		 */
+		static Napi::Object Init(Napi::Env env, Napi::Object exports);
+
+		/**
+		 * @brief Reads the object and layer of a CompiledFilter
+		 * @param value Value to unwrap
+		 * @param object Receives the compiled object
+		 * @param layer Receives the layer the filter was compiled for
+		 * @return false if value is not a CompiledFilter
+		 */
+		static bool FromValue(Napi::Value value, std::string *object, UINT32 *layer);
+
+		/**
+		 * @brief Constructor
+		 * @param info Contains a filter string or compiled object, and the layer
+		 */
+		CompiledFilterWrap(const Napi::CallbackInfo& info);
+
+	private:
+		/**
+		 * @brief The compiled object, a printable string accepted by WinDivertOpen
+		 */
+		Napi::Value GetObject(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief The layer the filter was compiled for
+		 */
+		Napi::Value GetLayer(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief The filter as formatted back from the object by the driver library
+		 */
+		Napi::Value GetFilter(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Returns {object, layer, filter}, what JSON.stringify stores
+		 */
+		Napi::Value toJSON(const Napi::CallbackInfo& info);
+
+		static Napi::FunctionReference constructor;   ///< Used to recognise CompiledFilter objects
+
+		std::string object_;      ///< Compiled object
+		std::string filter_;      ///< Formatted filter
+		UINT32 layer_;            ///< WINDIVERT_LAYER
+};
+
+#endif
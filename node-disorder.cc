@@ -0,0 +1,197 @@
+/**
+ * @file node-disorder.cc
+ * @brief Node.js wrapper of the out-of-order segment stage
+ */
+
+#include <string>
+#include <vector>
+#include "node-disorder.h"
+
+/**
+ * @brief Registers the Disorder class.
+ * @param env The Node.js environment.
+ * @param exports The exports object to attach the class to.
+ * @return The modified exports object containing the Disorder class.
+ */
+Napi::Object DisorderWrap::Init(Napi::Env env, Napi::Object exports)
+{
+	return Register(env, exports, "Disorder", {InstanceMethod("split", &DisorderWrap::split), InstanceMethod("stats", &DisorderWrap::stats)});
+}
+
+/**
+ * @brief Constructs a Disorder stage.
+ * @param info Contains the options object with match fields (see ParsePacketMatch) and:
+ *             - offsets: Split points in bytes of the TCP payload, ascending, required
+ *             - order: Piece indices in send order, a permutation of 0..offsets.length
+ *               (default last piece first)
+ *             - delays: Milliseconds between consecutive sends, at most DISORDER_MAX_DELAY, held by the scheduler (default none)
+ *             - payload: "tls", "http" or "any" (default), the payload a segment must start with
+ *             - maxBytes: Cap on bytes held for delayed pieces, default SCHEDULER_DEFAULT_MAX_BYTES
+ */
+DisorderWrap::DisorderWrap(const Napi::CallbackInfo &info) : StageWrap<DisorderWrap, DisorderStage>(info)
+{
+	Napi::Env env = info.Env();
+	Napi::Object options = info.Length() > 0 && info[0].IsObject() ? info[0].As<Napi::Object>() : Napi::Object::New(env);
+	DisorderConfig config;
+	std::string error = ParsePacketMatch(options, &config.match);
+	if (!error.empty())
+	{
+		Napi::TypeError::New(env, error).ThrowAsJavaScriptException();
+		return;
+	}
+
+	Napi::Value offsets = options.Get("offsets");
+	if (!offsets.IsArray() || offsets.As<Napi::Array>().Length() == 0 ||
+		offsets.As<Napi::Array>().Length() > DISORDER_MAX_SPLITS)
+	{
+		Napi::TypeError::New(env, "offsets must be an array of 1 to " + std::to_string(DISORDER_MAX_SPLITS) + " split points").ThrowAsJavaScriptException();
+		return;
+	}
+	Napi::Array array = offsets.As<Napi::Array>();
+	for (uint32_t i = 0; i < array.Length(); i++)
+	{
+		Napi::Value offset = array.Get(i);
+		const double number = offset.IsNumber() ? offset.As<Napi::Number>().DoubleValue() : -1;
+		if (!(number >= 1 && number < 65536) || static_cast<UINT32>(number) != number ||
+			(!config.offsets.empty() && number <= config.offsets.back()))
+		{
+			Napi::RangeError::New(env, "offsets must be ascending positive integers").ThrowAsJavaScriptException();
+			return;
+		}
+		config.offsets.push_back(static_cast<UINT32>(number));
+	}
+
+	const uint32_t pieces = array.Length() + 1;
+	Napi::Value order = options.Get("order");
+	if (order.IsArray())
+	{
+		Napi::Array indices = order.As<Napi::Array>();
+		std::vector<bool> used(pieces, false);
+		for (uint32_t i = 0; i < indices.Length(); i++)
+		{
+			Napi::Value index = indices.Get(i);
+			const double number = index.IsNumber() ? index.As<Napi::Number>().DoubleValue() : -1;
+			if (!(number >= 0 && number < pieces) || static_cast<UINT32>(number) != number || used[static_cast<size_t>(number)])
+			{
+				break;
+			}
+			used[static_cast<size_t>(number)] = true;
+			config.order.push_back(static_cast<UINT8>(number));
+		}
+		if (config.order.size() != pieces || indices.Length() != pieces)
+		{
+			Napi::RangeError::New(env, "order must be a permutation of 0.." + std::to_string(pieces - 1)).ThrowAsJavaScriptException();
+			return;
+		}
+	}
+	else if (!order.IsUndefined())
+	{
+		Napi::TypeError::New(env, "order must be an array").ThrowAsJavaScriptException();
+		return;
+	}
+
+	Napi::Value delays = options.Get("delays");
+	if (delays.IsArray())
+	{
+		Napi::Array values = delays.As<Napi::Array>();
+		for (uint32_t i = 0; i < values.Length(); i++)
+		{
+			Napi::Value delay = values.Get(i);
+			const double number = delay.IsNumber() ? delay.As<Napi::Number>().DoubleValue() : -1;
+			if (!(number >= 0 && number <= DISORDER_MAX_DELAY))
+			{
+				Napi::RangeError::New(env, "delays must be between 0 and " + std::to_string(DISORDER_MAX_DELAY) +
+											   " milliseconds").ThrowAsJavaScriptException();
+				return;
+			}
+			config.delays.push_back(static_cast<UINT64>(number * 1000));
+		}
+	}
+	else if (!delays.IsUndefined())
+	{
+		Napi::TypeError::New(env, "delays must be an array").ThrowAsJavaScriptException();
+		return;
+	}
+
+	Napi::Value payload = options.Get("payload");
+	const std::string payloadName = payload.IsString() ? payload.As<Napi::String>().Utf8Value() : "any";
+	if (payloadName == "tls")
+	{
+		config.payload = FAKE_MATCH_TLS;
+	}
+	else if (payloadName == "http")
+	{
+		config.payload = FAKE_MATCH_HTTP;
+	}
+	else if (payloadName == "any")
+	{
+		config.payload = FAKE_MATCH_ANY;
+	}
+	else
+	{
+		Napi::TypeError::New(env, "payload must be \"tls\", \"http\" or \"any\"").ThrowAsJavaScriptException();
+		return;
+	}
+	const size_t maxBytes = static_cast<size_t>(NumberOption(options, "maxBytes", SCHEDULER_DEFAULT_MAX_BYTES));
+	this->stage_ = std::make_shared<DisorderStage>(config, maxBytes);
+}
+
+/**
+ * @brief Returns the pieces the stage would send for a segment.
+ * @param info Contains a TCP segment; match and payload are not checked.
+ * @return Array of new Buffers in send order with checksums set, or null if no split point
+ *         falls inside the payload. Delays are not applied.
+ */
+Napi::Value DisorderWrap::split(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	if (info.Length() < 1 || !info[0].IsTypedArray())
+	{
+		Napi::TypeError::New(env, "Invalid arguments.  Expected usage: split(packet)").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	Napi::Uint8Array packet = info[0].As<Napi::Uint8Array>();
+	PacketInfo parsed;
+	DisorderPlan plan;
+	if (!ParsePacket(packet.Data(), static_cast<uint32_t>(packet.ByteLength()), &parsed) || parsed.fragment ||
+		parsed.protocol != PACKET_PROTO_TCP || parsed.transportLength < PACKET_TCP_HDR_MIN ||
+		!PlanDisorder(parsed, this->stage_->Config(), &plan))
+	{
+		return env.Null();
+	}
+	Napi::Array result = Napi::Array::New(env, plan.count);
+	for (UINT32 i = 0; i < plan.count; i++)
+	{
+		Napi::Buffer<UINT8> piece = Napi::Buffer<UINT8>::New(env, DisorderPieceLength(parsed, plan, plan.order[i]));
+		BuildDisorderPiece(packet.Data(), parsed, plan, plan.order[i], piece.Data());
+		result.Set(i, piece);
+	}
+	return result;
+}
+
+/**
+ * @brief Returns the stage counters.
+ * @param info Not used.
+ * @return Object with matched, split, pieces, delayed and skipped, and held, heldBytes, sent,
+ *         refused, flushed and failed of the scheduler.
+ */
+Napi::Value DisorderWrap::stats(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	DisorderStats stats;
+	SchedulerStats scheduler;
+	this->stage_->GetStats(&stats, &scheduler);
+	Napi::Object result = Napi::Object::New(env);
+	result.Set("matched", Napi::Number::New(env, static_cast<double>(stats.matched)));
+	result.Set("split", Napi::Number::New(env, static_cast<double>(stats.split)));
+	result.Set("pieces", Napi::Number::New(env, static_cast<double>(stats.pieces)));
+	result.Set("delayed", Napi::Number::New(env, static_cast<double>(stats.delayed)));
+	result.Set("skipped", Napi::Number::New(env, static_cast<double>(stats.skipped)));
+	result.Set("held", Napi::Number::New(env, static_cast<double>(scheduler.held)));
+	result.Set("heldBytes", Napi::Number::New(env, static_cast<double>(scheduler.heldBytes)));
+	result.Set("sent", Napi::Number::New(env, static_cast<double>(scheduler.sent)));
+	result.Set("refused", Napi::Number::New(env, static_cast<double>(scheduler.refused)));
+	result.Set("flushed", Napi::Number::New(env, static_cast<double>(scheduler.flushed)));
+	result.Set("failed", Napi::Number::New(env, static_cast<double>(scheduler.failed)));
+	return result;
+}
@@ -0,0 +1,52 @@
+/**
+ * @file node-disorder.h
+ * @brief Node.js wrapper of the out-of-order segment stage
+ *
+ * A Disorder object is attached to NETWORK layer handles with WinDivert.attachStage.
+ * Matching TCP segments are split and their pieces sent natively in the configured order.
+ */
+
+#ifndef NODE_DISORDER_H_
+#define NODE_DISORDER_H_
+
+#define NAPI_VERSION 4
+#include <napi.h>
+#include <memory>
+#include "disorder.h"
+#include "node-stage.h"
+
+/**
+ * @class DisorderWrap
+ * @brief JavaScript Disorder class
+ */
+class DisorderWrap : public StageWrap<DisorderWrap, DisorderStage> {
+	public:
+		/**
+		 * @brief Registers the Disorder class
+		 * @param env The Node.js environment
+		 * @param exports The exports object to attach the class to
+		 * @return The modified exports object
+		 */
+		static Napi::Object Init(Napi::Env env, Napi::Object exports);
+
+		/**
+		 * @brief Constructor
+		 * @param info Contains the options object
+		 */
+		DisorderWrap(const Napi::CallbackInfo& info);
+
+	private:
+		/**
+		 * @brief Returns the pieces the stage would send for a segment
+		 * @param info Contains the TCP segment
+		 * @return Array of Buffers in send order, or null if the segment cannot be split
+		 */
+		Napi::Value split(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Returns the stage and scheduler counters
+		 */
+		Napi::Value stats(const Napi::CallbackInfo& info);
+};
+
+#endif
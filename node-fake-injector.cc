@@ -0,0 +1,199 @@
+/**
+ * @file node-fake-injector.cc
+ * @brief Node.js wrapper of the fake segment injector
+ */
+
+#include <string>
+#include "node-fake-injector.h"
+
+/**
+ * @brief Registers the FakeInjector class.
+ * @param env The Node.js environment.
+ * @param exports The exports object to attach the class to.
+ * @return The modified exports object containing the FakeInjector class.
+ */
+Napi::Object FakeInjectorWrap::Init(Napi::Env env, Napi::Object exports)
+{
+	return Register(env, exports, "FakeInjector", {InstanceMethod("build", &FakeInjectorWrap::build), InstanceMethod("stats", &FakeInjectorWrap::stats)});
+}
+
+/**
+ * @brief Constructs a FakeInjector stage.
+ * @param info Contains the options object; at least one of ttl, autoTtl, badChecksum, badSeq and md5sig is required:
+ *             - ttl: TTL or hop limit of the fakes, low enough to expire between the DPI box and the server
+ *             - autoTtl: {estimator, delta, min, max}; fakes to servers the HopEstimator knows get their hop
+ *               distance minus delta (default 1), kept within min (default 3) and max (default 20)
+ *             - badChecksum: Send the fakes with a wrong TCP checksum (default false)
+ *             - badSeq: Move the fakes' sequence and acknowledgement numbers (default false)
+ *             - seqOffset: Amount badSeq moves them by (default FAKE_DEFAULT_SEQ_OFFSET)
+ *             - md5sig: Add a TCP MD5 signature option (default false)
+ *             - repeat: Fakes per real segment, 1 to FAKE_MAX_REPEAT (default 1)
+ *             - payload: Buffer sent as the fake's payload (default zeros of the real length)
+ *             - match: "tls" (default), "http" or "any"
+ *             - ports: Remote ports of matched segments (default [443], or [80] for "http")
+ */
+FakeInjectorWrap::FakeInjectorWrap(const Napi::CallbackInfo &info) : StageWrap<FakeInjectorWrap, FakeInjectorStage>(info)
+{
+	Napi::Env env = info.Env();
+	Napi::Object options = info.Length() > 0 && info[0].IsObject() ? info[0].As<Napi::Object>() : Napi::Object::New(env);
+	FakeConfig config;
+
+	Napi::Value ttl = options.Get("ttl");
+	config.hasTtl = !ttl.IsUndefined();
+	const double ttlValue = ttl.IsNumber() ? ttl.As<Napi::Number>().DoubleValue() : -1;
+	if (config.hasTtl && !(ttlValue >= 1 && ttlValue <= 255))
+	{
+		Napi::RangeError::New(env, "ttl must be between 1 and 255").ThrowAsJavaScriptException();
+		return;
+	}
+	config.ttl = static_cast<UINT8>(config.hasTtl ? ttlValue : 0);
+	std::shared_ptr<HopEstimatorStage> hops;
+	Napi::Value autoTtl = options.Get("autoTtl");
+	config.autoTtl = !autoTtl.IsUndefined();
+	if (config.autoTtl)
+	{
+		Napi::Object autoOptions = autoTtl.IsObject() ? autoTtl.As<Napi::Object>() : Napi::Object::New(env);
+		hops = HopEstimatorWrap::FromValue(autoOptions.Get("estimator"));
+		const double delta = NumberOption(autoOptions, "delta", 1);
+		const double min = NumberOption(autoOptions, "min", 3);
+		const double max = NumberOption(autoOptions, "max", 20);
+		if (!hops)
+		{
+			Napi::TypeError::New(env, "autoTtl.estimator must be a HopEstimator").ThrowAsJavaScriptException();
+			return;
+		}
+		if (delta > 255 || min < 1 || max > 255 || min > max)
+		{
+			Napi::RangeError::New(env, "autoTtl needs 1 <= min <= max <= 255 and delta <= 255").ThrowAsJavaScriptException();
+			return;
+		}
+		config.autoTtlDelta = static_cast<UINT8>(delta);
+		config.autoTtlMin = static_cast<UINT8>(min);
+		config.autoTtlMax = static_cast<UINT8>(max);
+	}
+	config.badChecksum = BooleanOption(options, "badChecksum");
+	config.badSeq = BooleanOption(options, "badSeq");
+	config.md5sig = BooleanOption(options, "md5sig");
+	Napi::Value seqOffset = options.Get("seqOffset");
+	config.seqOffset = seqOffset.IsNumber() ? seqOffset.As<Napi::Number>().Int32Value() : FAKE_DEFAULT_SEQ_OFFSET;
+	if (!config.hasTtl && !config.autoTtl && !config.badChecksum && !config.badSeq && !config.md5sig)
+	{
+		Napi::TypeError::New(env, "A fake needs ttl, autoTtl, badChecksum, badSeq or md5sig, or it reaches the server").ThrowAsJavaScriptException();
+		return;
+	}
+	const double repeat = NumberOption(options, "repeat", 1);
+	if (repeat < 1 || repeat > FAKE_MAX_REPEAT)
+	{
+		Napi::RangeError::New(env, "repeat must be between 1 and " + std::to_string(FAKE_MAX_REPEAT)).ThrowAsJavaScriptException();
+		return;
+	}
+	config.repeat = static_cast<UINT32>(repeat);
+
+	Napi::Value payload = options.Get("payload");
+	if (payload.IsTypedArray() && payload.As<Napi::TypedArray>().TypedArrayType() == napi_uint8_array)
+	{
+		Napi::Uint8Array bytes = payload.As<Napi::Uint8Array>();
+		config.payload.assign(bytes.Data(), bytes.Data() + bytes.ByteLength());
+	}
+	else if (!payload.IsUndefined())
+	{
+		Napi::TypeError::New(env, "payload must be a Buffer").ThrowAsJavaScriptException();
+		return;
+	}
+
+	Napi::Value match = options.Get("match");
+	const std::string matchName = match.IsString() ? match.As<Napi::String>().Utf8Value() : "tls";
+	if (matchName == "tls")
+	{
+		config.match = FAKE_MATCH_TLS;
+	}
+	else if (matchName == "http")
+	{
+		config.match = FAKE_MATCH_HTTP;
+	}
+	else if (matchName == "any")
+	{
+		config.match = FAKE_MATCH_ANY;
+	}
+	else
+	{
+		Napi::TypeError::New(env, "match must be \"tls\", \"http\" or \"any\"").ThrowAsJavaScriptException();
+		return;
+	}
+
+	Napi::Value ports = options.Get("ports");
+	if (ports.IsUndefined())
+	{
+		config.ports.push_back(config.match == FAKE_MATCH_HTTP ? 80 : 443);
+	}
+	else if (ports.IsArray())
+	{
+		Napi::Array array = ports.As<Napi::Array>();
+		for (uint32_t i = 0; i < array.Length(); i++)
+		{
+			Napi::Value port = array.Get(i);
+			const double number = port.IsNumber() ? port.As<Napi::Number>().DoubleValue() : -1;
+			if (!(number >= 1 && number <= 65535))
+			{
+				Napi::RangeError::New(env, "ports must be between 1 and 65535").ThrowAsJavaScriptException();
+				return;
+			}
+			config.ports.push_back(static_cast<UINT16>(number));
+		}
+	}
+	else
+	{
+		Napi::TypeError::New(env, "ports must be an array").ThrowAsJavaScriptException();
+		return;
+	}
+	this->stage_ = std::make_shared<FakeInjectorStage>(config, hops);
+}
+
+/**
+ * @brief Returns the fake the stage would send for a packet.
+ * @param info Contains the real TCP segment.
+ * @return New Buffer with checksums set as configured, or null.
+ */
+Napi::Value FakeInjectorWrap::build(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	if (info.Length() < 1 || !info[0].IsTypedArray())
+	{
+		Napi::TypeError::New(env, "Invalid arguments.  Expected usage: build(packet)").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	Napi::Uint8Array packet = info[0].As<Napi::Uint8Array>();
+	PacketInfo parsed;
+	if (!ParsePacket(packet.Data(), static_cast<uint32_t>(packet.ByteLength()), &parsed) || parsed.fragment ||
+		parsed.protocol != PACKET_PROTO_TCP || parsed.transportLength < PACKET_TCP_HDR_MIN)
+	{
+		return env.Null();
+	}
+	const FakeConfig &config = this->stage_->Config();
+	const UINT32 length = FakePacketLength(parsed, config);
+	if (length == 0)
+	{
+		return env.Null();
+	}
+	Napi::Buffer<UINT8> result = Napi::Buffer<UINT8>::New(env, length);
+	BuildFakePacket(packet.Data(), parsed, config, this->stage_->FakeTtl(packet.Data(), parsed), result.Data());
+	return result;
+}
+
+/**
+ * @brief Returns the injection counters.
+ * @param info Not used.
+ * @return Object with matched, fakes, skipped and autoTtl.
+ */
+Napi::Value FakeInjectorWrap::stats(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	FakeInjectorStats stats;
+	this->stage_->GetStats(&stats);
+	Napi::Object result = Napi::Object::New(env);
+	result.Set("matched", Napi::Number::New(env, static_cast<double>(stats.matched)));
+	result.Set("fakes", Napi::Number::New(env, static_cast<double>(stats.fakes)));
+	result.Set("skipped", Napi::Number::New(env, static_cast<double>(stats.skipped)));
+	result.Set("autoTtl", Napi::Number::New(env, static_cast<double>(stats.autoTtl)));
+	return result;
+}
@@ -0,0 +1,53 @@
+/**
+ * @file node-fake-injector.h
+ * @brief Node.js wrapper of the fake segment injector
+ *
+ * A FakeInjector object is attached to NETWORK layer handles with WinDivert.attachStage.
+ * Matching outbound segments are sent natively, preceded by their fakes.
+ */
+
+#ifndef NODE_FAKE_INJECTOR_H_
+#define NODE_FAKE_INJECTOR_H_
+
+#define NAPI_VERSION 4
+#include <napi.h>
+#include <memory>
+#include "fake-injector.h"
+#include "node-hop-estimator.h"
+#include "node-stage.h"
+
+/**
+ * @class FakeInjectorWrap
+ * @brief JavaScript FakeInjector class
+ */
+class FakeInjectorWrap : public StageWrap<FakeInjectorWrap, FakeInjectorStage> {
+	public:
+		/**
+		 * @brief Registers the FakeInjector class
+		 * @param env The Node.js environment
+		 * @param exports The exports object to attach the class to
+		 * @return The modified exports object
+		 */
+		static Napi::Object Init(Napi::Env env, Napi::Object exports);
+
+		/**
+		 * @brief Constructor
+		 * @param info Contains the options object
+		 */
+		FakeInjectorWrap(const Napi::CallbackInfo& info);
+
+	private:
+		/**
+		 * @brief Returns the fake the stage would send for a packet
+		 * @param info Contains the packet
+		 * @return Buffer, or null if the packet is not a TCP segment or the fake does not fit
+		 */
+		Napi::Value build(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Returns the injection counters
+		 */
+		Napi::Value stats(const Napi::CallbackInfo& info);
+};
+
+#endif
@@ -0,0 +1,245 @@
+/**
+ * @file node-flow-cache.cc
+ * @brief Node.js wrapper of the flow verdict cache
+ */
+
+#include <algorithm>
+#include <cstring>
+#include "node-flow-cache.h"
+
+/**
+ * @brief Registers the FlowCache class.
+ * @param env The Node.js environment.
+ * @param exports The exports object to attach the class to.
+ * @return The modified exports object containing the FlowCache class.
+ */
+Napi::Object FlowCacheWrap::Init(Napi::Env env, Napi::Object exports)
+{
+	return Register(env, exports, "FlowCache", {InstanceMethod("setRewrites", &FlowCacheWrap::setRewrites), InstanceMethod("set", &FlowCacheWrap::set), InstanceMethod("delete", &FlowCacheWrap::remove), InstanceMethod("clear", &FlowCacheWrap::clear), InstanceMethod("stats", &FlowCacheWrap::stats)});
+}
+
+/**
+ * @brief Constructs a FlowCache stage.
+ * @param info Contains an optional options object:
+ *             - maxFlows: Cached flows, default FLOW_CACHE_DEFAULT_MAX_FLOWS
+ *             - idleTimeout: Idle milliseconds before a flow is forgotten, default FLOW_CACHE_DEFAULT_IDLE
+ */
+FlowCacheWrap::FlowCacheWrap(const Napi::CallbackInfo &info) : StageWrap<FlowCacheWrap, FlowCacheStage>(info)
+{
+	size_t maxFlows = FLOW_CACHE_DEFAULT_MAX_FLOWS;
+	double idleTimeout = FLOW_CACHE_DEFAULT_IDLE;
+	if (info.Length() > 0 && info[0].IsObject())
+	{
+		Napi::Object options = info[0].As<Napi::Object>();
+		maxFlows = static_cast<size_t>(NumberOption(options, "maxFlows", static_cast<double>(maxFlows)));
+		idleTimeout = NumberOption(options, "idleTimeout", idleTimeout);
+	}
+	this->stage_ = std::make_shared<FlowCacheStage>(maxFlows, static_cast<UINT64>(idleTimeout));
+}
+
+/**
+ * @brief Reads an optional byte sized field of a rewrite.
+ * @return Error message, empty on success
+ */
+static std::string ParseField(Napi::Object object, const char *name, UINT32 max, bool *has, UINT32 *value)
+{
+	Napi::Value field = object.Get(name);
+	*has = !field.IsUndefined();
+	if (!*has)
+	{
+		return "";
+	}
+	const double number = field.IsNumber() ? field.As<Napi::Number>().DoubleValue() : -1;
+	if (!(number >= 0 && number <= max))
+	{
+		return std::string(name) + " must be between 0 and " + std::to_string(max);
+	}
+	*value = static_cast<UINT32>(number);
+	return "";
+}
+
+/**
+ * @brief Converts a rewrite object.
+ * @param object Rewrite with optional ttl (IPv4 TTL or IPv6 hop limit), tos (IPv4 TOS or IPv6
+ *               traffic class) and window (TCP window)
+ * @param rewrite Receives the rewrite
+ * @return Error message, empty on success
+ */
+static std::string ParseRewrite(Napi::Object object, FlowRewrite *rewrite)
+{
+	UINT32 ttl = 0, tos = 0, window = 0;
+	std::string error = ParseField(object, "ttl", 255, &rewrite->hasTtl, &ttl);
+	if (error.empty())
+	{
+		error = ParseField(object, "tos", 255, &rewrite->hasTos, &tos);
+	}
+	if (error.empty())
+	{
+		error = ParseField(object, "window", 65535, &rewrite->hasWindow, &window);
+	}
+	if (error.empty() && !rewrite->hasTtl && !rewrite->hasTos && !rewrite->hasWindow)
+	{
+		error = "rewrite sets none of ttl, tos and window";
+	}
+	rewrite->ttl = static_cast<UINT8>(ttl);
+	rewrite->tos = static_cast<UINT8>(tos);
+	rewrite->window = static_cast<UINT16>(window);
+	return error;
+}
+
+Napi::Value FlowCacheWrap::setRewrites(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	if (info.Length() < 1 || !info[0].IsArray())
+	{
+		Napi::TypeError::New(env, "Array of rewrites expected").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	Napi::Array array = info[0].As<Napi::Array>();
+	std::vector<FlowRewrite> rewrites(array.Length());
+	for (uint32_t i = 0; i < array.Length(); i++)
+	{
+		Napi::Value value = array.Get(i);
+		std::string error = value.IsObject() ? ParseRewrite(value.As<Napi::Object>(), &rewrites[i]) : "object expected";
+		if (!error.empty())
+		{
+			Napi::TypeError::New(env, "Invalid rewrite " + std::to_string(i) + ": " + error).ThrowAsJavaScriptException();
+			return env.Undefined();
+		}
+	}
+	this->stage_->SetRewrites(std::move(rewrites));
+	return env.Undefined();
+}
+
+/**
+ * @brief Builds the flow key of a packet passed from JavaScript.
+ * @param packet Packet as received
+ * @param addr Its WINDIVERT_ADDRESS, only the direction is used
+ * @param key Receives the flow key
+ * @param found Set to false for packets that are not TCP or UDP
+ * @return Error message, empty on success
+ */
+static std::string KeyFromArgs(Napi::Value packet, Napi::Value addr, FlowKey *key, bool *found)
+{
+	if (!packet.IsTypedArray() || packet.As<Napi::TypedArray>().TypedArrayType() != napi_uint8_array ||
+		!addr.IsTypedArray() || addr.As<Napi::TypedArray>().TypedArrayType() != napi_uint8_array)
+	{
+		return "packet and addr must be Buffers or Uint8Arrays";
+	}
+	Napi::Uint8Array packetView = packet.As<Napi::Uint8Array>();
+	Napi::Uint8Array addrView = addr.As<Napi::Uint8Array>();
+	if (addrView.ByteLength() < sizeof(WINDIVERT_ADDRESS) - 64)
+	{
+		return "Invalid addr buffer size";
+	}
+	WINDIVERT_ADDRESS address;
+	std::memset(&address, 0, sizeof(address));
+	std::memcpy(&address, addrView.Data(), std::min(addrView.ByteLength(), sizeof(address)));
+	PacketInfo parsed;
+	*found = ParsePacket(packetView.Data(), static_cast<uint32_t>(packetView.ByteLength()), &parsed) &&
+			 FlowKeyFromPacket(packetView.Data(), parsed, address.Outbound != 0, key);
+	return "";
+}
+
+/**
+ * @brief Stores the verdict for the flow of a packet.
+ * @param info Contains:
+ *             - packet: Packet of the flow, either direction
+ *             - addr: Its address buffer
+ *             - verdict: "pass", "drop", "reject" or "rewrite"
+ *             - rewrite: (Optional) Index into the rewrites for "rewrite" (default 0)
+ * @return false if the packet is not TCP or UDP, or the cache is full.
+ */
+Napi::Value FlowCacheWrap::set(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	if (info.Length() < 3 || !info[2].IsString())
+	{
+		Napi::TypeError::New(env, "Invalid arguments.  Expected usage: set(packet, addr, verdict[, rewrite])").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	FlowCacheEntry entry;
+	const std::string verdict = info[2].As<Napi::String>().Utf8Value();
+	if (verdict == "pass")
+	{
+		entry.verdict = FLOW_PASS;
+	}
+	else if (verdict == "drop")
+	{
+		entry.verdict = FLOW_DROP;
+	}
+	else if (verdict == "reject")
+	{
+		entry.verdict = FLOW_REJECT;
+	}
+	else if (verdict == "rewrite")
+	{
+		entry.verdict = FLOW_REWRITE;
+	}
+	else
+	{
+		Napi::TypeError::New(env, "verdict must be \"pass\", \"drop\", \"reject\" or \"rewrite\"").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	entry.rewrite = info.Length() > 3 && info[3].IsNumber() ? info[3].As<Napi::Number>().Uint32Value() : 0;
+	entry.lastSeen = GetTickCount64();
+
+	FlowKey key;
+	bool found = false;
+	std::string error = KeyFromArgs(info[0], info[1], &key, &found);
+	if (!error.empty())
+	{
+		Napi::TypeError::New(env, error).ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	return Napi::Boolean::New(env, found && this->stage_->Set(key, entry));
+}
+
+Napi::Value FlowCacheWrap::remove(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	if (info.Length() < 2)
+	{
+		Napi::TypeError::New(env, "Invalid arguments.  Expected usage: delete(packet, addr)").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	FlowKey key;
+	bool found = false;
+	std::string error = KeyFromArgs(info[0], info[1], &key, &found);
+	if (!error.empty())
+	{
+		Napi::TypeError::New(env, error).ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	return Napi::Boolean::New(env, found && this->stage_->Delete(key));
+}
+
+Napi::Value FlowCacheWrap::clear(const Napi::CallbackInfo &info)
+{
+	this->stage_->Clear();
+	return info.Env().Undefined();
+}
+
+/**
+ * @brief Returns the cache counters.
+ * @return Object with lookups, hits, hitRatio, passed, dropped, rejected, rewritten, closed, expired, full and flows.
+ */
+Napi::Value FlowCacheWrap::stats(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	FlowCacheStats stats;
+	this->stage_->GetStats(&stats);
+	Napi::Object result = Napi::Object::New(env);
+	result.Set("lookups", Napi::Number::New(env, static_cast<double>(stats.lookups)));
+	result.Set("hits", Napi::Number::New(env, static_cast<double>(stats.hits)));
+	result.Set("hitRatio", Napi::Number::New(env, stats.lookups == 0 ? 0 : static_cast<double>(stats.hits) / stats.lookups));
+	result.Set("passed", Napi::Number::New(env, static_cast<double>(stats.passed)));
+	result.Set("dropped", Napi::Number::New(env, static_cast<double>(stats.dropped)));
+	result.Set("rejected", Napi::Number::New(env, static_cast<double>(stats.rejected)));
+	result.Set("rewritten", Napi::Number::New(env, static_cast<double>(stats.rewritten)));
+	result.Set("closed", Napi::Number::New(env, static_cast<double>(stats.closed)));
+	result.Set("expired", Napi::Number::New(env, static_cast<double>(stats.expired)));
+	result.Set("full", Napi::Number::New(env, static_cast<double>(stats.full)));
+	result.Set("flows", Napi::Number::New(env, static_cast<double>(stats.flows)));
+	return result;
+}
@@ -0,0 +1,72 @@
+/**
+ * @file node-flow-cache.h
+ * @brief Node.js wrapper of the flow verdict cache
+ *
+ * A FlowCache object is attached to NETWORK layer handles with WinDivert.attachStage.
+ * JavaScript stores verdicts for the flows of packets it has seen; the receive thread
+ * applies them to the rest of each flow.
+ */
+
+#ifndef NODE_FLOW_CACHE_H_
+#define NODE_FLOW_CACHE_H_
+
+#define NAPI_VERSION 4
+#include <napi.h>
+#include <memory>
+#include "flow-cache.h"
+#include "node-stage.h"
+
+/**
+ * @class FlowCacheWrap
+ * @brief JavaScript FlowCache class
+ */
+class FlowCacheWrap : public StageWrap<FlowCacheWrap, FlowCacheStage> {
+	public:
+		/**
+		 * @brief Registers the FlowCache class
+		 * @param env The Node.js environment
+		 * @param exports The exports object to attach the class to
+		 * @return The modified exports object
+		 */
+		static Napi::Object Init(Napi::Env env, Napi::Object exports);
+
+		/**
+		 * @brief Constructor
+		 * @param info Contains optional maxFlows and idleTimeout
+		 */
+		FlowCacheWrap(const Napi::CallbackInfo& info);
+
+	private:
+		/**
+		 * @brief Replaces the rewrites referred to by "rewrite" verdicts
+		 * @param info Contains an array of rewrite objects
+		 * @return Undefined
+		 */
+		Napi::Value setRewrites(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Stores the verdict for the flow of a packet
+		 * @param info Contains packet, addr, verdict and the rewrite index
+		 * @return false if the packet has no flow or the cache is full
+		 */
+		Napi::Value set(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Removes the flow of a packet
+		 * @param info Contains packet and addr
+		 * @return false if the flow was not cached
+		 */
+		Napi::Value remove(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Forgets all flows
+		 */
+		Napi::Value clear(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Returns the cache counters and hit ratio
+		 */
+		Napi::Value stats(const Napi::CallbackInfo& info);
+};
+
+#endif
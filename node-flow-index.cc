@@ -0,0 +1,202 @@
+/**
+ * @file node-flow-index.cc
+ * @brief Node.js wrapper of the native flow index
+ */
+
+#include <iostream>
+#include "node-flow-index.h"
+
+Napi::FunctionReference FlowIndexWrap::constructor;
+
+/**
+ * @brief Registers the FlowIndex class.
+ * @param env The Node.js environment.
+ * @param exports The exports object to attach the class to.
+ * @return The modified exports object containing the FlowIndex class.
+ */
+Napi::Object FlowIndexWrap::Init(Napi::Env env, Napi::Object exports)
+{
+	Napi::Function func = DefineClass(env, "FlowIndex", {InstanceMethod("lookup", &FlowIndexWrap::lookup), InstanceMethod("imagePath", &FlowIndexWrap::imagePath), InstanceMethod("invalidate", &FlowIndexWrap::invalidate), InstanceMethod("size", &FlowIndexWrap::size), InstanceMethod("clear", &FlowIndexWrap::clear)});
+
+	constructor = Napi::Persistent(func);
+	constructor.SuppressDestruct();
+
+	exports.Set("FlowIndex", func);
+	return exports;
+}
+
+std::shared_ptr<FlowIndex> FlowIndexWrap::FromValue(Napi::Value value)
+{
+	if (!value.IsObject() || !value.As<Napi::Object>().InstanceOf(constructor.Value()))
+	{
+		return std::shared_ptr<FlowIndex>();
+	}
+	return FlowIndexWrap::Unwrap(value.As<Napi::Object>())->index_;
+}
+
+/**
+ * @brief Constructs a FlowIndex.
+ * @param info Contains:
+ *             - maxSize: (Optional) Maximum number of flows and ports, default FLOW_INDEX_DEFAULT_SIZE
+ */
+FlowIndexWrap::FlowIndexWrap(const Napi::CallbackInfo &info) : Napi::ObjectWrap<FlowIndexWrap>(info)
+{
+	size_t maxSize = FLOW_INDEX_DEFAULT_SIZE;
+	if (info.Length() > 0 && info[0].IsNumber())
+	{
+		maxSize = info[0].As<Napi::Number>().Uint32Value();
+	}
+	this->index_ = std::make_shared<FlowIndex>(maxSize);
+	this->processes_.reset(new ProcessCache());
+}
+
+/**
+ * @brief Attributes a packet to a process.
+ * @param info Contains:
+ *             - packet: Buffer containing the packet
+ *             - addr: Buffer containing the WINDIVERT_ADDRESS of the packet
+ * @return ProcessId owning the packet's flow, 0 if unknown.
+ */
+Napi::Value FlowIndexWrap::lookup(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	if (info.Length() < 2 || !info[0].IsBuffer() || !info[1].IsBuffer())
+	{
+		Napi::TypeError::New(env, "Packet and address buffers expected").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	Napi::Buffer<uint8_t> packet = info[0].As<Napi::Buffer<uint8_t>>();
+	Napi::Buffer<uint8_t> addrBuffer = info[1].As<Napi::Buffer<uint8_t>>();
+	if (addrBuffer.Length() < sizeof(WINDIVERT_ADDRESS))
+	{
+		Napi::RangeError::New(env, "Address buffer too small").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	WINDIVERT_ADDRESS addr;
+	std::memcpy(&addr, addrBuffer.Data(), sizeof(WINDIVERT_ADDRESS));
+
+	PacketInfo packetInfo;
+	FlowKey key;
+	FlowEntry entry;
+	if (!ParsePacket(packet.Data(), static_cast<uint32_t>(packet.Length()), &packetInfo) ||
+		!FlowKeyFromPacket(packet.Data(), packetInfo, addr.Outbound != 0, &key) ||
+		!this->index_->Lookup(key, &entry))
+	{
+		return Napi::Number::New(env, 0);
+	}
+	return Napi::Number::New(env, entry.processId);
+}
+
+/**
+ * @brief Resolves a ProcessId to its image path.
+ * @param info Contains the ProcessId.
+ * @return Image path string, or null if the process does not exist or cannot be queried.
+ */
+Napi::Value FlowIndexWrap::imagePath(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	if (info.Length() < 1 || !info[0].IsNumber())
+	{
+		Napi::TypeError::New(env, "ProcessId expected").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	std::string path;
+	if (!this->processes_->Lookup(info[0].As<Napi::Number>().Uint32Value(), &path))
+	{
+		return env.Null();
+	}
+	return Napi::String::New(env, path);
+}
+
+/**
+ * @brief Drops cached image paths.
+ * @param info Contains an optional ProcessId; all entries are dropped when omitted.
+ * @return Undefined.
+ */
+Napi::Value FlowIndexWrap::invalidate(const Napi::CallbackInfo &info)
+{
+	if (info.Length() > 0 && info[0].IsNumber())
+	{
+		this->processes_->Invalidate(info[0].As<Napi::Number>().Uint32Value());
+	}
+	else
+	{
+		this->processes_->Clear();
+	}
+	return info.Env().Undefined();
+}
+
+Napi::Value FlowIndexWrap::size(const Napi::CallbackInfo &info)
+{
+	return Napi::Number::New(info.Env(), static_cast<double>(this->index_->Size()));
+}
+
+Napi::Value FlowIndexWrap::clear(const Napi::CallbackInfo &info)
+{
+	this->index_->Clear();
+	return info.Env().Undefined();
+}
+
+/**
+ * @brief Builds the flow key of a FLOW or SOCKET layer event.
+ * Both layers share the WINDIVERT_DATA_FLOW layout and already use the FlowKey representation.
+ */
+static FlowKey FlowKeyFromEvent(const WINDIVERT_ADDRESS &addr)
+{
+	FlowKey key;
+	std::memset(&key, 0, sizeof(FlowKey));
+	std::memcpy(key.localAddr, addr.Flow.LocalAddr, sizeof(key.localAddr));
+	std::memcpy(key.remoteAddr, addr.Flow.RemoteAddr, sizeof(key.remoteAddr));
+	key.localPort = addr.Flow.LocalPort;
+	key.remotePort = addr.Flow.RemotePort;
+	key.protocol = addr.Flow.Protocol;
+	return key;
+}
+
+void ApplyFlowEvents(FlowIndex &index, const WINDIVERT_ADDRESS *addrs, size_t count)
+{
+	// A receive batch holds at most WINDIVERT_BATCH_MAX events, so it is applied under one lock.
+	FlowChange changes[WINDIVERT_BATCH_MAX];
+	size_t pending = 0;
+	bool full = false;
+	for (size_t i = 0; i < count; i++)
+	{
+		const WINDIVERT_ADDRESS &addr = addrs[i];
+		FlowChange &change = changes[pending];
+		change.key = FlowKeyFromEvent(addr);
+		change.entry = {addr.Flow.EndpointId, addr.Flow.ParentEndpointId, addr.Flow.ProcessId};
+		switch (addr.Event)
+		{
+			case WINDIVERT_EVENT_FLOW_ESTABLISHED:
+			case WINDIVERT_EVENT_SOCKET_CONNECT:
+			case WINDIVERT_EVENT_SOCKET_ACCEPT:
+				change.kind = FLOW_CHANGE_ADD;
+				break;
+			case WINDIVERT_EVENT_SOCKET_BIND:
+			case WINDIVERT_EVENT_SOCKET_LISTEN:
+				change.kind = FLOW_CHANGE_ADD_PORT;
+				break;
+			case WINDIVERT_EVENT_FLOW_DELETED:
+				change.kind = FLOW_CHANGE_REMOVE;
+				break;
+			case WINDIVERT_EVENT_SOCKET_CLOSE:
+				change.kind = change.key.remotePort == 0 ? FLOW_CHANGE_REMOVE_PORT : FLOW_CHANGE_REMOVE;
+				break;
+			default:
+				continue;
+		}
+		if (++pending == WINDIVERT_BATCH_MAX)
+		{
+			full |= !index.Apply(changes, pending);
+			pending = 0;
+		}
+	}
+	if (pending > 0)
+	{
+		full |= !index.Apply(changes, pending);
+	}
+	if (full)
+	{
+		std::cerr << "Warning: Flow index is full, new flows are not attributed." << std::endl;
+	}
+}
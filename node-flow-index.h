@@ -0,0 +1,96 @@
+/**
+ * @file node-flow-index.h
+ * @brief Node.js wrapper of the native flow index
+ *
+ * A FlowIndex object is shared by handles through WinDivert.attachFlowIndex: FLOW and
+ * SOCKET layer handles keep it up to date from their receive thread and NETWORK layer
+ * handles use it to attribute packets to processes.
+ */
+
+#ifndef NODE_FLOW_INDEX_H_
+#define NODE_FLOW_INDEX_H_
+
+#define NAPI_VERSION 4
+#include <napi.h>
+#include <memory>
+#include "windivert.h"
+#include "packet.h"
+#include "flow-index.h"
+#include "process-cache.h"
+
+#define FLOW_INDEX_DEFAULT_SIZE (1 << 20)
+
+/**
+ * @class FlowIndexWrap
+ * @brief JavaScript FlowIndex class
+ */
+class FlowIndexWrap : public Napi::ObjectWrap<FlowIndexWrap> {
+	public:
+		/**
+		 * @brief Registers the FlowIndex class
+		 * @param env The Node.js environment
+		 * @param exports The exports object to attach the class to
+		 * @return The modified exports object
+		 */
+		static Napi::Object Init(Napi::Env env, Napi::Object exports);
+
+		/**
+		 * @brief Returns the index wrapped by a FlowIndex object
+		 * @param value Value to unwrap
+		 * @return The shared index, or an empty pointer if value is not a FlowIndex
+		 */
+		static std::shared_ptr<FlowIndex> FromValue(Napi::Value value);
+
+		/**
+		 * @brief Constructor
+		 * @param info Contains the optional maximum number of entries
+		 */
+		FlowIndexWrap(const Napi::CallbackInfo& info);
+
+	private:
+		/**
+		 * @brief Attributes a packet to a process
+		 * @param info Contains packet and address buffers
+		 * @return ProcessId, 0 if the flow is unknown
+		 */
+		Napi::Value lookup(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Resolves a ProcessId to its image path through the process cache
+		 * @param info Contains the ProcessId
+		 * @return Image path, or null if the process is gone
+		 */
+		Napi::Value imagePath(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Drops cached image paths
+		 * @param info Contains an optional ProcessId, all processes when omitted
+		 * @return Undefined
+		 */
+		Napi::Value invalidate(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Number of indexed flows and ports
+		 */
+		Napi::Value size(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Forgets all flows
+		 */
+		Napi::Value clear(const Napi::CallbackInfo& info);
+
+		static Napi::FunctionReference constructor;     ///< Used to recognise FlowIndex objects
+
+		std::shared_ptr<FlowIndex> index_;              ///< Shared with attached handles
+		std::unique_ptr<ProcessCache> processes_;       ///< ProcessId to image path
+};
+
+/**
+ * @brief Applies FLOW or SOCKET layer events to an index, one writer lock per receive batch
+ * @param index Index to update
+ * @param addrs Event addresses
+ * @param count Number of events
+ */
+void ApplyFlowEvents(FlowIndex &index, const WINDIVERT_ADDRESS *addrs, size_t count);
+
+#endif
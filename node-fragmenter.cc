@@ -0,0 +1,161 @@
+/**
+ * @file node-fragmenter.cc
+ * @brief Node.js wrapper of the IP fragmentation stage
+ */
+
+#include <string>
+#include <vector>
+#include "checksum.h"
+#include "node-fragmenter.h"
+
+/**
+ * @brief Registers the Fragmenter class.
+ * @param env The Node.js environment.
+ * @param exports The exports object to attach the class to.
+ * @return The modified exports object containing the Fragmenter class.
+ */
+Napi::Object FragmenterWrap::Init(Napi::Env env, Napi::Object exports)
+{
+	return Register(env, exports, "Fragmenter", {InstanceMethod("fragment", &FragmenterWrap::fragment), InstanceMethod("stats", &FragmenterWrap::stats)});
+}
+
+/**
+ * @brief Constructs a Fragmenter stage.
+ * @param info Contains the options object with match fields (see ParsePacketMatch) and:
+ *             - offsets: Split points in bytes of the fragmentable part (the IP payload, after the
+ *               IPv6 extension headers routers read), ascending positive multiples of 8, required
+ *             - order: "ordered" (default), "reversed" or "first-last"
+ *             - payload: "tls", "http" or "any" (default), the TCP payload a packet must start
+ */
+FragmenterWrap::FragmenterWrap(const Napi::CallbackInfo &info) : StageWrap<FragmenterWrap, FragmenterStage>(info)
+{
+	Napi::Env env = info.Env();
+	Napi::Object options = info.Length() > 0 && info[0].IsObject() ? info[0].As<Napi::Object>() : Napi::Object::New(env);
+	FragmentConfig config;
+	std::string error = ParsePacketMatch(options, &config.match);
+	if (!error.empty())
+	{
+		Napi::TypeError::New(env, error).ThrowAsJavaScriptException();
+		return;
+	}
+
+	Napi::Value offsets = options.Get("offsets");
+	if (!offsets.IsArray() || offsets.As<Napi::Array>().Length() == 0 ||
+		offsets.As<Napi::Array>().Length() > FRAGMENTER_MAX_SPLITS)
+	{
+		Napi::TypeError::New(env, "offsets must be an array of 1 to " + std::to_string(FRAGMENTER_MAX_SPLITS) + " split points").ThrowAsJavaScriptException();
+		return;
+	}
+	Napi::Array array = offsets.As<Napi::Array>();
+	for (uint32_t i = 0; i < array.Length(); i++)
+	{
+		Napi::Value offset = array.Get(i);
+		const double number = offset.IsNumber() ? offset.As<Napi::Number>().DoubleValue() : -1;
+		if (!(number >= 8 && number < 65536) || static_cast<UINT32>(number) != number || static_cast<UINT32>(number) % 8 != 0 ||
+			(!config.offsets.empty() && number <= config.offsets.back()))
+		{
+			Napi::RangeError::New(env, "offsets must be ascending positive multiples of 8").ThrowAsJavaScriptException();
+			return;
+		}
+		config.offsets.push_back(static_cast<UINT32>(number));
+	}
+
+	Napi::Value order = options.Get("order");
+	const std::string orderName = order.IsString() ? order.As<Napi::String>().Utf8Value() : "ordered";
+	if (orderName == "ordered")
+	{
+		config.order = FRAGMENT_ORDERED;
+	}
+	else if (orderName == "reversed")
+	{
+		config.order = FRAGMENT_REVERSED;
+	}
+	else if (orderName == "first-last")
+	{
+		config.order = FRAGMENT_FIRST_LAST;
+	}
+	else
+	{
+		Napi::TypeError::New(env, "order must be \"ordered\", \"reversed\" or \"first-last\"").ThrowAsJavaScriptException();
+		return;
+	}
+
+	Napi::Value payload = options.Get("payload");
+	const std::string payloadName = payload.IsString() ? payload.As<Napi::String>().Utf8Value() : "any";
+	if (payloadName == "tls")
+	{
+		config.payload = FAKE_MATCH_TLS;
+	}
+	else if (payloadName == "http")
+	{
+		config.payload = FAKE_MATCH_HTTP;
+	}
+	else if (payloadName == "any")
+	{
+		config.payload = FAKE_MATCH_ANY;
+	}
+	else
+	{
+		Napi::TypeError::New(env, "payload must be \"tls\", \"http\" or \"any\"").ThrowAsJavaScriptException();
+		return;
+	}
+	this->stage_ = std::make_shared<FragmenterStage>(config);
+}
+
+/**
+ * @brief Returns the fragments the stage would send for a packet.
+ * @param info Contains an unfragmented IPv4 or IPv6 packet; match and payload are not checked.
+ * @return Array of new Buffers in send order with checksums set, or null if no split point applies.
+ */
+Napi::Value FragmenterWrap::fragment(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	if (info.Length() < 1 || !info[0].IsTypedArray())
+	{
+		Napi::TypeError::New(env, "Invalid arguments.  Expected usage: fragment(packet)").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	Napi::Uint8Array packet = info[0].As<Napi::Uint8Array>();
+	PacketInfo parsed;
+	if (!ParsePacket(packet.Data(), static_cast<uint32_t>(packet.ByteLength()), &parsed))
+	{
+		return env.Null();
+	}
+	std::vector<UINT8> copy(packet.Data(), packet.Data() + parsed.length);
+	const FragmentConfig &config = this->stage_->Config();
+	FragmentPlan plan;
+	if (!PlanFragments(copy.data(), parsed, config.offsets.data(), config.offsets.size(), &plan))
+	{
+		return env.Null();
+	}
+	CalcPacketChecksums(copy.data(), parsed.length);
+	UINT32 order[FRAGMENTER_MAX_SPLITS + 1];
+	FragmentSendOrder(config.order, plan.count, order);
+	const UINT32 id = this->stage_->Identification(copy.data(), parsed);
+	Napi::Array result = Napi::Array::New(env, plan.count);
+	for (UINT32 i = 0; i < plan.count; i++)
+	{
+		Napi::Buffer<UINT8> fragment = Napi::Buffer<UINT8>::New(env, FragmentLength(plan, order[i]));
+		BuildFragment(copy.data(), plan, order[i], id, fragment.Data());
+		result.Set(i, fragment);
+	}
+	return result;
+}
+
+/**
+ * @brief Returns the fragmentation counters.
+ * @param info Not used.
+ * @return Object with matched, fragmented, fragments and skipped.
+ */
+Napi::Value FragmenterWrap::stats(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	FragmenterStats stats;
+	this->stage_->GetStats(&stats);
+	Napi::Object result = Napi::Object::New(env);
+	result.Set("matched", Napi::Number::New(env, static_cast<double>(stats.matched)));
+	result.Set("fragmented", Napi::Number::New(env, static_cast<double>(stats.fragmented)));
+	result.Set("fragments", Napi::Number::New(env, static_cast<double>(stats.fragments)));
+	result.Set("skipped", Napi::Number::New(env, static_cast<double>(stats.skipped)));
+	return result;
+}
@@ -0,0 +1,52 @@
+/**
+ * @file node-fragmenter.h
+ * @brief Node.js wrapper of the IP fragmentation stage
+ *
+ * A Fragmenter object is attached to NETWORK layer handles with WinDivert.attachStage.
+ * Matching packets are sent natively as IP fragments.
+ */
+
+#ifndef NODE_FRAGMENTER_H_
+#define NODE_FRAGMENTER_H_
+
+#define NAPI_VERSION 4
+#include <napi.h>
+#include <memory>
+#include "fragmenter.h"
+#include "node-stage.h"
+
+/**
+ * @class FragmenterWrap
+ * @brief JavaScript Fragmenter class
+ */
+class FragmenterWrap : public StageWrap<FragmenterWrap, FragmenterStage> {
+	public:
+		/**
+		 * @brief Registers the Fragmenter class
+		 * @param env The Node.js environment
+		 * @param exports The exports object to attach the class to
+		 * @return The modified exports object
+		 */
+		static Napi::Object Init(Napi::Env env, Napi::Object exports);
+
+		/**
+		 * @brief Constructor
+		 * @param info Contains the options object
+		 */
+		FragmenterWrap(const Napi::CallbackInfo& info);
+
+	private:
+		/**
+		 * @brief Returns the fragments the stage would send for a packet
+		 * @param info Contains the packet
+		 * @return Array of Buffers in send order, or null if the packet cannot be split
+		 */
+		Napi::Value fragment(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Returns the fragmentation counters
+		 */
+		Napi::Value stats(const Napi::CallbackInfo& info);
+};
+
+#endif
@@ -0,0 +1,104 @@
+/**
+ * @file node-hop-estimator.cc
+ * @brief Node.js wrapper of the hop distance estimator
+ */
+
+#include "node-hop-estimator.h"
+
+/**
+ * @brief Registers the HopEstimator class.
+ * @param env The Node.js environment.
+ * @param exports The exports object to attach the class to.
+ * @return The modified exports object containing the HopEstimator class.
+ */
+Napi::Object HopEstimatorWrap::Init(Napi::Env env, Napi::Object exports)
+{
+	return Register(env, exports, "HopEstimator", {InstanceMethod("lookup", &HopEstimatorWrap::lookup), InstanceMethod("clear", &HopEstimatorWrap::clear), InstanceMethod("stats", &HopEstimatorWrap::stats)});
+}
+
+/**
+ * @brief Constructs a HopEstimator stage.
+ * @param info Contains an optional options object:
+ *             - maxHosts: Remote hosts remembered, default HOP_ESTIMATOR_DEFAULT_MAX_HOSTS
+ */
+HopEstimatorWrap::HopEstimatorWrap(const Napi::CallbackInfo &info) : StageWrap<HopEstimatorWrap, HopEstimatorStage>(info)
+{
+	size_t maxHosts = HOP_ESTIMATOR_DEFAULT_MAX_HOSTS;
+	if (info.Length() > 0 && info[0].IsObject())
+	{
+		Napi::Object options = info[0].As<Napi::Object>();
+		maxHosts = static_cast<size_t>(NumberOption(options, "maxHosts", static_cast<double>(maxHosts)));
+	}
+	if (maxHosts == 0 || maxHosts >= 0xFFFFFFFF)
+	{
+		Napi::RangeError::New(info.Env(), "maxHosts must be between 1 and 2^32 - 2").ThrowAsJavaScriptException();
+		return;
+	}
+	this->stage_ = std::make_shared<HopEstimatorStage>(maxHosts);
+}
+
+/**
+ * @brief Returns what is known about a remote address.
+ * @param info Contains the IPv4 or IPv6 address as a string.
+ * @return Object with hops, initialTtl, ttl and age in milliseconds, or null if no SYN-ACK was seen from it.
+ */
+Napi::Value HopEstimatorWrap::lookup(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	if (info.Length() < 1 || !info[0].IsString())
+	{
+		Napi::TypeError::New(env, "Invalid arguments.  Expected usage: lookup(address)").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	UINT8 bytes[16];
+	bool ipv6;
+	if (!ParseAddress(info[0].As<Napi::String>().Utf8Value().c_str(), bytes, &ipv6))
+	{
+		Napi::TypeError::New(env, "Invalid address").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	FlowKey key;
+	HopEntry entry;
+	HostKey(bytes, ipv6, &key);
+	if (!this->stage_->Lookup(key, &entry))
+	{
+		return env.Null();
+	}
+	const UINT64 now = GetTickCount64();
+	Napi::Object result = Napi::Object::New(env);
+	result.Set("hops", Napi::Number::New(env, entry.hops));
+	result.Set("initialTtl", Napi::Number::New(env, entry.initialTtl));
+	result.Set("ttl", Napi::Number::New(env, entry.ttl));
+	result.Set("age", Napi::Number::New(env, static_cast<double>(now > entry.seen ? now - entry.seen : 0)));
+	return result;
+}
+
+/**
+ * @brief Forgets all hosts.
+ * @param info Not used.
+ * @return undefined
+ */
+Napi::Value HopEstimatorWrap::clear(const Napi::CallbackInfo &info)
+{
+	this->stage_->Clear();
+	return info.Env().Undefined();
+}
+
+/**
+ * @brief Returns the estimator counters.
+ * @param info Not used.
+ * @return Object with observed, lookups, hits, evicted and hosts.
+ */
+Napi::Value HopEstimatorWrap::stats(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	HopEstimatorStats stats;
+	this->stage_->GetStats(&stats);
+	Napi::Object result = Napi::Object::New(env);
+	result.Set("observed", Napi::Number::New(env, static_cast<double>(stats.observed)));
+	result.Set("lookups", Napi::Number::New(env, static_cast<double>(stats.lookups)));
+	result.Set("hits", Napi::Number::New(env, static_cast<double>(stats.hits)));
+	result.Set("evicted", Napi::Number::New(env, static_cast<double>(stats.evicted)));
+	result.Set("hosts", Napi::Number::New(env, static_cast<double>(stats.hosts)));
+	return result;
+}
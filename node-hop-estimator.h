@@ -0,0 +1,58 @@
+/**
+ * @file node-hop-estimator.h
+ * @brief Node.js wrapper of the hop distance estimator
+ *
+ * A HopEstimator object is attached to NETWORK layer handles that see inbound SYN-ACKs with
+ * WinDivert.attachStage, and given to FakeInjector as autoTtl.estimator. JavaScript that
+ * rewrites TTLs itself reads the distances with lookup().
+ */
+
+#ifndef NODE_HOP_ESTIMATOR_H_
+#define NODE_HOP_ESTIMATOR_H_
+
+#define NAPI_VERSION 4
+#include <napi.h>
+#include <memory>
+#include "hop-estimator.h"
+#include "node-stage.h"
+
+/**
+ * @class HopEstimatorWrap
+ * @brief JavaScript HopEstimator class
+ */
+class HopEstimatorWrap : public StageWrap<HopEstimatorWrap, HopEstimatorStage> {
+	public:
+		/**
+		 * @brief Registers the HopEstimator class
+		 * @param env The Node.js environment
+		 * @param exports The exports object to attach the class to
+		 * @return The modified exports object
+		 */
+		static Napi::Object Init(Napi::Env env, Napi::Object exports);
+
+		/**
+		 * @brief Constructor
+		 * @param info Contains optional maxHosts
+		 */
+		HopEstimatorWrap(const Napi::CallbackInfo& info);
+
+	private:
+		/**
+		 * @brief Returns what is known about a remote address
+		 * @param info Contains the address as a string
+		 * @return Object with hops, initialTtl, ttl and age, or null if the host was not seen
+		 */
+		Napi::Value lookup(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Forgets all hosts
+		 */
+		Napi::Value clear(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Returns the estimator counters
+		 */
+		Napi::Value stats(const Napi::CallbackInfo& info);
+};
+
+#endif
@@ -0,0 +1,312 @@
+/**
+ * @file node-http-rewriter.cc
+ * @brief Node.js wrapper of the HTTP Host header rewriter
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "checksum.h"
+#include "node-http-rewriter.h"
+
+/**
+ * @brief Registers the HttpRewriter class.
+ * @param env The Node.js environment.
+ * @param exports The exports object to attach the class to.
+ * @return The modified exports object containing the HttpRewriter class.
+ */
+Napi::Object HttpRewriterWrap::Init(Napi::Env env, Napi::Object exports)
+{
+	return Register(env, exports, "HttpRewriter", {StaticMethod("parse", &HttpRewriterWrap::parse), InstanceMethod("edit", &HttpRewriterWrap::edit), InstanceMethod("stats", &HttpRewriterWrap::stats)});
+}
+
+/**
+ * @brief Constructs an HttpRewriter stage.
+ * @param info Contains the options object:
+ *             - hostName: Spelling of the Host header name, such as "hoSt"
+ *             - removeSpace: Remove the white space after "Host:" (default false)
+ *             - mixCase: Alternate the case of the host name (default false)
+ *             - addDot: Append a dot to the host name (default false)
+ *             - methodSpace: Add a space after the method (default false)
+ *             - ports: Remote ports of rewritten requests (default [80])
+ *             - tracker: SeqTracker size changes are recorded in; it must be attached ahead of the
+ *               rewriter. Without one the rewriter keeps its own and shifts packets itself.
+ *             - maxFlows: Resized flows tracked by the own tracker, default SEQ_TRACKER_DEFAULT_MAX_FLOWS
+ *             - idleTimeout: Idle milliseconds before a resized flow is forgotten, default SEQ_TRACKER_DEFAULT_IDLE
+ */
+HttpRewriterWrap::HttpRewriterWrap(const Napi::CallbackInfo &info) : StageWrap<HttpRewriterWrap, HttpRewriterStage>(info)
+{
+	Napi::Env env = info.Env();
+	Napi::Object options = info.Length() > 0 && info[0].IsObject() ? info[0].As<Napi::Object>() : Napi::Object::New(env);
+	HttpRewriteConfig config;
+	Napi::Value hostName = options.Get("hostName");
+	config.hasHostName = !hostName.IsUndefined();
+	if (config.hasHostName)
+	{
+		const std::string name = hostName.IsString() ? hostName.As<Napi::String>().Utf8Value() : "";
+		std::string lower = name;
+		std::transform(lower.begin(), lower.end(), lower.begin(), [](char c)
+		{
+			return c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c;
+		});
+		if (lower != "host")
+		{
+			Napi::TypeError::New(env, "hostName must be \"host\" in any letter case").ThrowAsJavaScriptException();
+			return;
+		}
+		std::memcpy(config.hostName, name.data(), sizeof(config.hostName));
+	}
+	config.removeSpace = BooleanOption(options, "removeSpace");
+	config.mixCase = BooleanOption(options, "mixCase");
+	config.addDot = BooleanOption(options, "addDot");
+	config.methodSpace = BooleanOption(options, "methodSpace");
+
+	Napi::Value ports = options.Get("ports");
+	if (ports.IsUndefined())
+	{
+		config.ports.push_back(80);
+	}
+	else if (ports.IsArray())
+	{
+		Napi::Array array = ports.As<Napi::Array>();
+		for (uint32_t i = 0; i < array.Length(); i++)
+		{
+			Napi::Value port = array.Get(i);
+			const double number = port.IsNumber() ? port.As<Napi::Number>().DoubleValue() : -1;
+			if (!(number >= 1 && number <= 65535))
+			{
+				Napi::RangeError::New(env, "ports must be between 1 and 65535").ThrowAsJavaScriptException();
+				return;
+			}
+			config.ports.push_back(static_cast<UINT16>(number));
+		}
+	}
+	else
+	{
+		Napi::TypeError::New(env, "ports must be an array").ThrowAsJavaScriptException();
+		return;
+	}
+	Napi::Value trackerValue = options.Get("tracker");
+	std::shared_ptr<SeqTrackerStage> tracker = SeqTrackerWrap::FromValue(trackerValue);
+	if (!tracker && !trackerValue.IsUndefined())
+	{
+		Napi::TypeError::New(env, "tracker must be a SeqTracker").ThrowAsJavaScriptException();
+		return;
+	}
+	const bool shared = static_cast<bool>(tracker);
+	if (!shared)
+	{
+		const size_t maxFlows = static_cast<size_t>(NumberOption(options, "maxFlows", SEQ_TRACKER_DEFAULT_MAX_FLOWS));
+		const double idleTimeout = NumberOption(options, "idleTimeout", SEQ_TRACKER_DEFAULT_IDLE);
+		tracker = std::make_shared<SeqTrackerStage>(maxFlows, static_cast<UINT64>(idleTimeout));
+	}
+	this->stage_ = std::make_shared<HttpRewriterStage>(config, tracker, !shared);
+}
+
+/**
+ * @brief Parses a TCP packet passed from JavaScript.
+ * @return Error message, empty on success; info.protocol is 0 if the packet is not TCP
+ */
+static std::string ParseTcpArg(Napi::Value packet, PacketInfo *info)
+{
+	if (!packet.IsTypedArray() || packet.As<Napi::TypedArray>().TypedArrayType() != napi_uint8_array)
+	{
+		return "packet must be a Buffer or Uint8Array";
+	}
+	Napi::Uint8Array view = packet.As<Napi::Uint8Array>();
+	if (!ParsePacket(view.Data(), static_cast<uint32_t>(view.ByteLength()), info) || info->fragment ||
+		info->protocol != PACKET_PROTO_TCP || info->transportLength < PACKET_TCP_HDR_MIN)
+	{
+		info->protocol = 0;
+	}
+	return "";
+}
+
+/**
+ * @brief Parses the HTTP request head of a TCP packet.
+ * @param info Contains the packet, starting with the IP header.
+ * @return null if the payload does not start with an HTTP/1.x request line, otherwise an object with
+ *         method, methodLength, targetOffset, targetLength, versionMinor, headerEnd (null while the
+ *         head continues in later segments), headers [{name, nameOffset, nameLength, valueOffset,
+ *         valueLength}] and host (the Host header entry with its value, or null). Offsets are
+ *         relative to the packet.
+ */
+Napi::Value HttpRewriterWrap::parse(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	PacketInfo parsed;
+	std::string error = info.Length() > 0 ? ParseTcpArg(info[0], &parsed) : "Expected usage: parse(packet)";
+	if (!error.empty())
+	{
+		Napi::TypeError::New(env, error).ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	HttpRequest request;
+	const UINT8 *payload = info[0].As<Napi::Uint8Array>().Data() + parsed.payloadOffset;
+	if (parsed.protocol == 0 || !ParseHttpRequest(payload, parsed.payloadLength, &request))
+	{
+		return env.Null();
+	}
+	const UINT32 base = parsed.payloadOffset;
+	Napi::Object result = Napi::Object::New(env);
+	result.Set("method", Napi::String::New(env, reinterpret_cast<const char *>(payload), request.methodLength));
+	result.Set("methodLength", Napi::Number::New(env, request.methodLength));
+	result.Set("targetOffset", Napi::Number::New(env, base + request.targetOffset));
+	result.Set("targetLength", Napi::Number::New(env, request.targetLength));
+	result.Set("versionMinor", Napi::Number::New(env, request.versionMinor));
+	result.Set("headerEnd", request.headerEnd == 0 ? env.Null() : Napi::Number::New(env, base + request.headerEnd));
+	Napi::Array headers = Napi::Array::New(env, request.headerCount);
+	for (UINT32 i = 0; i < request.headerCount; i++)
+	{
+		const HttpField &field = request.headers[i];
+		Napi::Object header = Napi::Object::New(env);
+		header.Set("name", Napi::String::New(env, reinterpret_cast<const char *>(payload + field.nameOffset), field.nameLength));
+		header.Set("nameOffset", Napi::Number::New(env, base + field.nameOffset));
+		header.Set("nameLength", Napi::Number::New(env, field.nameLength));
+		header.Set("valueOffset", Napi::Number::New(env, base + field.valueOffset));
+		header.Set("valueLength", Napi::Number::New(env, field.valueLength));
+		headers.Set(i, header);
+	}
+	result.Set("headers", headers);
+	if (request.host >= 0)
+	{
+		const HttpField &field = request.headers[request.host];
+		Napi::Object host = headers.Get(static_cast<uint32_t>(request.host)).As<Napi::Object>();
+		host.Set("value", Napi::String::New(env, reinterpret_cast<const char *>(payload + field.valueOffset), field.valueLength));
+		result.Set("host", host);
+	}
+	else
+	{
+		result.Set("host", env.Null());
+	}
+	return result;
+}
+
+/**
+ * @brief Copies a packet with payload edits and records the size change for its flow.
+ * @param info Contains:
+ *             - packet: TCP packet as received through the handle the stage is attached to
+ *             - addr: Its address buffer
+ *             - edits: Array of {offset, remove, insert}, offsets relative to the packet, inside
+ *               the payload, ascending and not overlapping; insert is a string or Buffer
+ * @return New Buffer with the IP length and checksums fixed. An outbound packet whose size changed
+ *         has its flow recorded, so the stage shifts the sequence numbers of later packets.
+ */
+Napi::Value HttpRewriterWrap::edit(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	if (info.Length() < 3 || !info[1].IsTypedArray() || !info[2].IsArray())
+	{
+		Napi::TypeError::New(env, "Invalid arguments.  Expected usage: edit(packet, addr, edits)").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	PacketInfo parsed;
+	std::string error = ParseTcpArg(info[0], &parsed);
+	if (error.empty() && parsed.protocol == 0)
+	{
+		error = "packet is not an unfragmented TCP packet";
+	}
+	Napi::Uint8Array addrView = info[1].As<Napi::Uint8Array>();
+	if (error.empty() && addrView.ByteLength() < sizeof(WINDIVERT_ADDRESS) - 64)
+	{
+		error = "Invalid addr buffer size";
+	}
+	if (!error.empty())
+	{
+		Napi::TypeError::New(env, error).ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	const UINT8 *data = info[0].As<Napi::Uint8Array>().Data();
+	WINDIVERT_ADDRESS address;
+	std::memset(&address, 0, sizeof(address));
+	std::memcpy(&address, addrView.Data(), std::min(addrView.ByteLength(), sizeof(address)));
+
+	Napi::Array array = info[2].As<Napi::Array>();
+	std::vector<PayloadEdit> edits(array.Length());
+	std::vector<std::string> inserts(array.Length());
+	INT32 growth = 0;
+	UINT32 next = parsed.payloadOffset;
+	for (uint32_t i = 0; i < array.Length(); i++)
+	{
+		Napi::Value value = array.Get(i);
+		if (!value.IsObject())
+		{
+			Napi::TypeError::New(env, "edits must be objects").ThrowAsJavaScriptException();
+			return env.Undefined();
+		}
+		Napi::Object object = value.As<Napi::Object>();
+		Napi::Value offset = object.Get("offset");
+		Napi::Value insert = object.Get("insert");
+		const double start = offset.IsNumber() ? offset.As<Napi::Number>().DoubleValue() : -1;
+		const double remove = NumberOption(object, "remove", 0);
+		if (insert.IsString())
+		{
+			inserts[i] = insert.As<Napi::String>().Utf8Value();
+		}
+		else if (insert.IsTypedArray() && insert.As<Napi::TypedArray>().TypedArrayType() == napi_uint8_array)
+		{
+			Napi::Uint8Array bytes = insert.As<Napi::Uint8Array>();
+			inserts[i].assign(reinterpret_cast<const char *>(bytes.Data()), bytes.ByteLength());
+		}
+		else if (!insert.IsUndefined())
+		{
+			Napi::TypeError::New(env, "insert must be a string or Buffer").ThrowAsJavaScriptException();
+			return env.Undefined();
+		}
+		if (!(start >= next && start + remove <= parsed.payloadOffset + parsed.payloadLength))
+		{
+			Napi::RangeError::New(env, "edit " + std::to_string(i) + " is outside the payload or overlaps the previous edit").ThrowAsJavaScriptException();
+			return env.Undefined();
+		}
+		edits[i].offset = static_cast<UINT32>(start) - parsed.payloadOffset;
+		edits[i].remove = static_cast<UINT32>(remove);
+		edits[i].insert = reinterpret_cast<const UINT8 *>(inserts[i].data());
+		edits[i].insertLength = static_cast<UINT32>(inserts[i].size());
+		growth += static_cast<INT32>(edits[i].insertLength) - static_cast<INT32>(edits[i].remove);
+		next = static_cast<UINT32>(start + remove);
+	}
+	const UINT32 length = parsed.length + static_cast<UINT32>(growth);
+	if ((parsed.version == 6 ? length - PACKET_IPV6_HDR_LEN : length) > 0xFFFF)
+	{
+		Napi::RangeError::New(env, "Edited packet is too large").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+
+	if (growth != 0 && address.Outbound)
+	{
+		FlowKey key;
+		const UINT8 *tcp = data + parsed.transportOffset;
+		if (FlowKeyFromPacket(data, parsed, true, &key) &&
+			!this->stage_->Tracker()->Record(key, ReadBE32(tcp + 4), parsed.payloadLength, growth, true, GetTickCount64()))
+		{
+			Napi::Error::New(env, "The size change of the flow could not be recorded").ThrowAsJavaScriptException();
+			return env.Undefined();
+		}
+	}
+	Napi::Buffer<UINT8> result = Napi::Buffer<UINT8>::New(env, length);
+	EditPayload(data, parsed, edits.data(), edits.size(), result.Data());
+	CalcPacketChecksums(result.Data(), length);
+	return result;
+}
+
+/**
+ * @brief Returns the rewrite counters.
+ * @param info Not used.
+ * @return Object with requests, rewritten, resized, skipped, and shifted, untracked and flows of the tracker.
+ */
+Napi::Value HttpRewriterWrap::stats(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	HttpRewriterStats stats;
+	this->stage_->GetStats(&stats);
+	Napi::Object result = Napi::Object::New(env);
+	result.Set("requests", Napi::Number::New(env, static_cast<double>(stats.requests)));
+	result.Set("rewritten", Napi::Number::New(env, static_cast<double>(stats.rewritten)));
+	result.Set("resized", Napi::Number::New(env, static_cast<double>(stats.resized)));
+	result.Set("skipped", Napi::Number::New(env, static_cast<double>(stats.skipped)));
+	result.Set("shifted", Napi::Number::New(env, static_cast<double>(stats.tracker.shifted)));
+	result.Set("untracked", Napi::Number::New(env, static_cast<double>(stats.tracker.untracked)));
+	result.Set("flows", Napi::Number::New(env, static_cast<double>(stats.tracker.flows)));
+	return result;
+}
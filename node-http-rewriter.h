@@ -0,0 +1,61 @@
+/**
+ * @file node-http-rewriter.h
+ * @brief Node.js wrapper of the HTTP Host header rewriter
+ *
+ * An HttpRewriter object is attached to NETWORK layer handles with WinDivert.attachStage.
+ * The class also exposes the native request parser, and edit() resizes a request from
+ * JavaScript while the stage keeps shifting the rest of its flow.
+ */
+
+#ifndef NODE_HTTP_REWRITER_H_
+#define NODE_HTTP_REWRITER_H_
+
+#define NAPI_VERSION 4
+#include <napi.h>
+#include <memory>
+#include "http-rewriter.h"
+#include "node-seq-tracker.h"
+#include "node-stage.h"
+
+/**
+ * @class HttpRewriterWrap
+ * @brief JavaScript HttpRewriter class
+ */
+class HttpRewriterWrap : public StageWrap<HttpRewriterWrap, HttpRewriterStage> {
+	public:
+		/**
+		 * @brief Registers the HttpRewriter class
+		 * @param env The Node.js environment
+		 * @param exports The exports object to attach the class to
+		 * @return The modified exports object
+		 */
+		static Napi::Object Init(Napi::Env env, Napi::Object exports);
+
+		/**
+		 * @brief Constructor
+		 * @param info Contains the options object
+		 */
+		HttpRewriterWrap(const Napi::CallbackInfo& info);
+
+	private:
+		/**
+		 * @brief Parses the HTTP request head of a TCP packet
+		 * @param info Contains the packet
+		 * @return Object with the method and header offsets, or null if the payload is not a request
+		 */
+		static Napi::Value parse(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Copies a packet with payload edits and records the size change for its flow
+		 * @param info Contains packet, addr and the edits
+		 * @return The edited packet with length and checksums fixed
+		 */
+		Napi::Value edit(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Returns the rewrite counters
+		 */
+		Napi::Value stats(const Napi::CallbackInfo& info);
+};
+
+#endif
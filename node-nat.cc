@@ -0,0 +1,157 @@
+/**
+ * @file node-nat.cc
+ * @brief Node.js wrapper of the NAT stage
+ */
+
+#include "node-nat.h"
+
+/**
+ * @brief Registers the Nat class.
+ * @param env The Node.js environment.
+ * @param exports The exports object to attach the class to.
+ * @return The modified exports object containing the Nat class.
+ */
+Napi::Object NatWrap::Init(Napi::Env env, Napi::Object exports)
+{
+	return Register(env, exports, "Nat", {InstanceMethod("setRules", &NatWrap::setRules), InstanceMethod("clear", &NatWrap::clear), InstanceMethod("stats", &NatWrap::stats)});
+}
+
+/**
+ * @brief Constructs a Nat stage.
+ * @param info Contains an optional options object:
+ *             - maxConnections: Tracked connections, default NAT_DEFAULT_MAX_CONNECTIONS
+ *             - tcpTimeout, udpTimeout, closingTimeout: Idle timeouts in milliseconds
+ */
+NatWrap::NatWrap(const Napi::CallbackInfo &info) : StageWrap<NatWrap, NatStage>(info)
+{
+	size_t maxConnections = NAT_DEFAULT_MAX_CONNECTIONS;
+	NatTimeouts timeouts;
+	if (info.Length() > 0 && info[0].IsObject())
+	{
+		Napi::Object options = info[0].As<Napi::Object>();
+		maxConnections = static_cast<size_t>(NumberOption(options, "maxConnections", static_cast<double>(maxConnections)));
+		timeouts.tcp = static_cast<UINT64>(NumberOption(options, "tcpTimeout", static_cast<double>(timeouts.tcp)));
+		timeouts.udp = static_cast<UINT64>(NumberOption(options, "udpTimeout", static_cast<double>(timeouts.udp)));
+		timeouts.closing = static_cast<UINT64>(NumberOption(options, "closingTimeout", static_cast<double>(timeouts.closing)));
+	}
+	this->stage_ = std::make_shared<NatStage>(maxConnections, timeouts);
+}
+
+/**
+ * @brief Converts a rule object.
+ * @param object Rule with type ('dnat' or 'snat'), match fields (see ParsePacketMatch), and
+ *               optional toAddr, toPort and reflect
+ * @param rule Receives the rule
+ * @return Error message, empty on success
+ */
+static std::string ParseRule(Napi::Object object, NatRule *rule)
+{
+	std::memset(rule, 0, sizeof(NatRule));
+	Napi::Value type = object.Get("type");
+	std::string typeName = type.IsString() ? type.As<Napi::String>().Utf8Value() : "";
+	if (typeName == "dnat")
+	{
+		rule->type = NAT_DNAT;
+	}
+	else if (typeName == "snat")
+	{
+		rule->type = NAT_SNAT;
+	}
+	else
+	{
+		return "type must be 'dnat' or 'snat'";
+	}
+
+	std::string error = ParsePacketMatch(object, &rule->match);
+	if (!error.empty())
+	{
+		return error;
+	}
+	if (rule->match.protocol != 0 && rule->match.protocol != PACKET_PROTO_TCP && rule->match.protocol != PACKET_PROTO_UDP)
+	{
+		return "protocol must be TCP or UDP";
+	}
+	rule->reflect = object.Get("reflect").ToBoolean().Value();
+
+	Napi::Value toAddr = object.Get("toAddr");
+	if (toAddr.IsString())
+	{
+		bool ipv6;
+		if (!ParseAddress(toAddr.As<Napi::String>().Utf8Value().c_str(), rule->toAddr, &ipv6))
+		{
+			return "invalid toAddr";
+		}
+		rule->hasToAddr = true;
+		rule->toIpv6 = ipv6;
+	}
+	Napi::Value toPort = object.Get("toPort");
+	if (toPort.IsNumber())
+	{
+		const uint32_t port = toPort.As<Napi::Number>().Uint32Value();
+		if (port == 0 || port > 65535)
+		{
+			return "invalid toPort";
+		}
+		rule->toPort = static_cast<uint16_t>(port);
+	}
+	if (!rule->hasToAddr && rule->toPort == 0 && !rule->reflect)
+	{
+		return "rule translates nothing";
+	}
+	return "";
+}
+
+/**
+ * @brief Replaces all rules; tracked connections keep their translation.
+ * @param info Contains an array of rule objects, evaluated in order.
+ * @return Undefined.
+ * @throws TypeError naming the first invalid rule, the previous rules stay active.
+ */
+Napi::Value NatWrap::setRules(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	if (info.Length() < 1 || !info[0].IsArray())
+	{
+		Napi::TypeError::New(env, "Array of rules expected").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	Napi::Array array = info[0].As<Napi::Array>();
+	std::vector<NatRule> rules(array.Length());
+	for (uint32_t i = 0; i < array.Length(); i++)
+	{
+		Napi::Value value = array.Get(i);
+		std::string error = value.IsObject() ? ParseRule(value.As<Napi::Object>(), &rules[i]) : "object expected";
+		if (!error.empty())
+		{
+			Napi::TypeError::New(env, "Invalid NAT rule " + std::to_string(i) + ": " + error).ThrowAsJavaScriptException();
+			return env.Undefined();
+		}
+	}
+	this->stage_->SetRules(std::move(rules));
+	return env.Undefined();
+}
+
+Napi::Value NatWrap::clear(const Napi::CallbackInfo &info)
+{
+	this->stage_->Clear();
+	return info.Env().Undefined();
+}
+
+/**
+ * @brief Returns the stage counters.
+ * @return Object with translated, reversed, connections, expired, full and collisions.
+ */
+Napi::Value NatWrap::stats(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	NatStats stats;
+	this->stage_->GetStats(&stats);
+	Napi::Object result = Napi::Object::New(env);
+	result.Set("translated", Napi::Number::New(env, static_cast<double>(stats.translated)));
+	result.Set("reversed", Napi::Number::New(env, static_cast<double>(stats.reversed)));
+	result.Set("connections", Napi::Number::New(env, static_cast<double>(stats.connections)));
+	result.Set("expired", Napi::Number::New(env, static_cast<double>(stats.expired)));
+	result.Set("full", Napi::Number::New(env, static_cast<double>(stats.full)));
+	result.Set("collisions", Napi::Number::New(env, static_cast<double>(stats.collisions)));
+	return result;
+}
@@ -0,0 +1,57 @@
+/**
+ * @file node-nat.h
+ * @brief Node.js wrapper of the NAT stage
+ *
+ * A Nat object is attached to NETWORK layer handles with WinDivert.attachStage; JavaScript
+ * only replaces its rules and reads its counters, translation happens in the receive thread.
+ */
+
+#ifndef NODE_NAT_H_
+#define NODE_NAT_H_
+
+#define NAPI_VERSION 4
+#include <napi.h>
+#include <memory>
+#include "nat.h"
+#include "node-stage.h"
+
+/**
+ * @class NatWrap
+ * @brief JavaScript Nat class
+ */
+class NatWrap : public StageWrap<NatWrap, NatStage> {
+	public:
+		/**
+		 * @brief Registers the Nat class
+		 * @param env The Node.js environment
+		 * @param exports The exports object to attach the class to
+		 * @return The modified exports object
+		 */
+		static Napi::Object Init(Napi::Env env, Napi::Object exports);
+
+		/**
+		 * @brief Constructor
+		 * @param info Contains optional maxConnections and timeouts
+		 */
+		NatWrap(const Napi::CallbackInfo& info);
+
+	private:
+		/**
+		 * @brief Replaces all rules
+		 * @param info Contains an array of rule objects
+		 * @return Undefined
+		 */
+		Napi::Value setRules(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Forgets all tracked connections
+		 */
+		Napi::Value clear(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Returns the stage counters
+		 */
+		Napi::Value stats(const Napi::CallbackInfo& info);
+};
+
+#endif
@@ -0,0 +1,401 @@
+/**
+ * @file node-pipeline.cc
+ * @brief Node.js wrapper of the multi-handle pipeline
+ */
+
+#include "node-pipeline.h"
+#include "node-compiled-filter.h"
+#include "send-batch.h"
+
+/**
+ * @brief Registers the Pipeline class.
+ * @param env The Node.js environment.
+ * @param exports The exports object to attach the class to.
+ * @return The modified exports object containing the Pipeline class.
+ */
+Napi::Object PipelineWrap::Init(Napi::Env env, Napi::Object exports)
+{
+	Napi::Function func = DefineClass(env, "Pipeline", {InstanceMethod("add", &PipelineWrap::add), InstanceMethod("recv", &PipelineWrap::recv), InstanceMethod("credit", &PipelineWrap::credit), InstanceMethod("send", &PipelineWrap::send), InstanceMethod("sendBatch", &PipelineWrap::sendBatch), InstanceMethod("stats", &PipelineWrap::stats), InstanceMethod("close", &PipelineWrap::close)});
+
+	Napi::FunctionReference constructor = Napi::Persistent(func);
+	constructor.SuppressDestruct();
+
+	exports.Set("Pipeline", func);
+	return exports;
+}
+
+/**
+ * @brief Constructs an empty pipeline.
+ * @param info Contains an optional options object:
+ *             - batchSize: Packets per read, 1..WINDIVERT_BATCH_MAX (default 64)
+ *             - depth: Reads kept posted per handle, 1..PIPELINE_MAX_DEPTH (default 2)
+ */
+PipelineWrap::PipelineWrap(const Napi::CallbackInfo &info) : Napi::ObjectWrap<PipelineWrap>(info), closed_(false)
+{
+	Napi::Env env = info.Env();
+	UINT32 batchSize = PIPELINE_DEFAULT_BATCH;
+	UINT32 depth = PIPELINE_DEFAULT_DEPTH;
+	if (info.Length() > 0 && info[0].IsObject())
+	{
+		Napi::Object options = info[0].As<Napi::Object>();
+		if (options.Get("batchSize").IsNumber())
+		{
+			batchSize = options.Get("batchSize").As<Napi::Number>().Uint32Value();
+		}
+		if (options.Get("depth").IsNumber())
+		{
+			depth = options.Get("depth").As<Napi::Number>().Uint32Value();
+		}
+	}
+	if (batchSize < 1 || batchSize > WINDIVERT_BATCH_MAX)
+	{
+		Napi::RangeError::New(env, "batchSize must be between 1 and " + std::to_string(WINDIVERT_BATCH_MAX)).ThrowAsJavaScriptException();
+		return;
+	}
+	if (depth < 1 || depth > PIPELINE_MAX_DEPTH)
+	{
+		Napi::RangeError::New(env, "depth must be between 1 and " + std::to_string(PIPELINE_MAX_DEPTH)).ThrowAsJavaScriptException();
+		return;
+	}
+	this->pipeline_.reset(new Pipeline(batchSize, depth));
+}
+
+PipelineWrap::~PipelineWrap()
+{
+	if (this->pipeline_)
+	{
+		this->pipeline_->Close();
+	}
+}
+
+/**
+ * @brief Opens a handle and adds it to the pipeline.
+ * @param info Contains:
+ *             - filter: String containing the WinDivert filter expression, or a CompiledFilter
+ *             - layer: (Optional) The WinDivert layer, must match a CompiledFilter's layer
+ *             - flags: (Optional) WinDivert flags; DROP and SEND_ONLY handles are owned but never read
+ *             - priority: (Optional) Handle priority (default 0)
+ * @return Id that tags the handle's packets and selects it in send and sendBatch.
+ * @throws Error if the pipeline is started or full, or the handle cannot be opened.
+ */
+Napi::Value PipelineWrap::add(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	if (this->closed_)
+	{
+		Napi::Error::New(env, "Pipeline closed").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	HandleInfo handle = {std::string(), 0, 0, 0};
+	UINT32 compiledLayer = 0;
+	const bool compiled = info.Length() > 0 && CompiledFilterWrap::FromValue(info[0], &handle.filter, &compiledLayer);
+	if (!compiled && (info.Length() < 1 || !info[0].IsString()))
+	{
+		Napi::TypeError::New(env, "String filter or CompiledFilter expected").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	if (!compiled)
+	{
+		handle.filter = info[0].As<Napi::String>().Utf8Value();
+	}
+	handle.layer = compiledLayer;
+	if (info.Length() > 1 && info[1].IsNumber())
+	{
+		handle.layer = info[1].As<Napi::Number>().Uint32Value();
+		if (compiled && handle.layer != compiledLayer)
+		{
+			Napi::TypeError::New(env, "CompiledFilter was compiled for layer " + std::to_string(compiledLayer)).ThrowAsJavaScriptException();
+			return env.Undefined();
+		}
+	}
+	if (info.Length() > 2 && info[2].IsNumber())
+	{
+		handle.flags = info[2].As<Napi::Number>().Uint32Value();
+	}
+	if (info.Length() > 3 && info[3].IsNumber())
+	{
+		const int priority = info[3].As<Napi::Number>().Int32Value();
+		if (priority < WINDIVERT_PRIORITY_LOWEST || priority > WINDIVERT_PRIORITY_HIGHEST)
+		{
+			Napi::RangeError::New(env, "Priority must be between " + std::to_string(WINDIVERT_PRIORITY_LOWEST) +
+										   " and " + std::to_string(WINDIVERT_PRIORITY_HIGHEST)).ThrowAsJavaScriptException();
+			return env.Undefined();
+		}
+		handle.priority = static_cast<INT16>(priority);
+	}
+	if (this->pipeline_->Size() >= PIPELINE_MAX_HANDLES)
+	{
+		Napi::Error::New(env, "A pipeline holds at most " + std::to_string(PIPELINE_MAX_HANDLES) + " handles").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+
+	HANDLE opened = WinDivertOpen(handle.filter.c_str(), (WINDIVERT_LAYER)handle.layer, handle.priority, handle.flags);
+	if (opened == INVALID_HANDLE_VALUE)
+	{
+		std::string errorMsg = "Error opening filter: [" + std::to_string(GetLastError()) + "]";
+		Napi::Error::New(env, errorMsg).ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	const int id = this->pipeline_->Add(opened, handle.flags);
+	if (id < 0)
+	{
+		WinDivertClose(opened);
+		CloseHandle(opened);
+		Napi::Error::New(env, "Handles must be added before recv is called").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	this->handles_.push_back(handle);
+	return Napi::Number::New(env, id);
+}
+
+/**
+ * @brief Starts reading every receiving handle on one completion port thread.
+ * @param info Contains:
+ *             - callback: Called as (data, addrs, offsets, handles) per batch and once with null at end of stream;
+ *               handles is a Uint8Array with the id of each packet's handle
+ *             - credits: (Optional) Batches that may be delivered before credit() is called (default 0)
+ * @return Undefined.
+ * @throws Error if recv was already called or no added handle receives.
+ */
+Napi::Value PipelineWrap::recv(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	if (this->closed_)
+	{
+		Napi::Error::New(env, "Pipeline closed").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	if (info.Length() < 1 || !info[0].IsFunction())
+	{
+		Napi::TypeError::New(env, "Function expected as argument").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	if (this->tsfn_)
+	{
+		Napi::Error::New(env, "Receive already started on this pipeline").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	int credits = 0;
+	if (info.Length() > 1 && info[1].IsNumber())
+	{
+		credits = info[1].As<Napi::Number>().Int32Value();
+	}
+
+	this->tsfn_ = Napi::ThreadSafeFunction::New(env, info[0].As<Napi::Function>(), "Pipeline Callback", 0, 1);
+	Napi::ThreadSafeFunction tsfn = this->tsfn_;
+	auto deliver = [tsfn](PipelineBatch *batch) mutable
+	{
+		if (batch == nullptr)
+		{
+			// Signal end of stream so iterators and streams can finish.
+			tsfn.BlockingCall([](Napi::Env env, Napi::Function jsCallback)
+			{
+				jsCallback.Call({env.Null()});
+			});
+			tsfn.Release();
+			return true;
+		}
+		auto callback = [](Napi::Env env, Napi::Function jsCallback, PipelineBatch *batch)
+		{
+			Napi::Buffer<char> dataBuffer = Napi::Buffer<char>::Copy(env, batch->data.data(), batch->data.size());
+			Napi::Buffer<char> addrBuffer = Napi::Buffer<char>::Copy(
+				env, reinterpret_cast<const char *>(batch->addrs.data()), batch->addrs.size() * sizeof(WINDIVERT_ADDRESS));
+			Napi::Uint32Array offsets = Napi::Uint32Array::New(env, batch->offsets.size());
+			std::copy(batch->offsets.begin(), batch->offsets.end(), offsets.Data());
+			Napi::Uint8Array handles = Napi::Uint8Array::New(env, batch->handles.size());
+			std::copy(batch->handles.begin(), batch->handles.end(), handles.Data());
+			delete batch;
+
+			jsCallback.Call({dataBuffer, addrBuffer, offsets, handles});
+		};
+		napi_status status = tsfn.BlockingCall(batch, callback);
+		if (status != napi_ok)
+		{
+			delete batch;
+			std::cerr << "Warning: Failed to call JavaScript callback. NAPI status: " << status << std::endl;
+			return false;
+		}
+		return true;
+	};
+	if (credits > 0)
+	{
+		this->pipeline_->Credit(credits);
+	}
+	if (!this->pipeline_->Start(deliver))
+	{
+		this->tsfn_.Release();
+		Napi::Error::New(env, "No handle of the pipeline can be read").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	return env.Undefined();
+}
+
+/**
+ * @brief Grants read credits to the completion thread.
+ * @param info Contains the number of batches the consumer can accept (default 1).
+ * @return Number of credits now available.
+ */
+Napi::Value PipelineWrap::credit(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	int count = 1;
+	if (info.Length() > 0)
+	{
+		if (!info[0].IsNumber())
+		{
+			Napi::TypeError::New(env, "Number expected as argument").ThrowAsJavaScriptException();
+			return env.Undefined();
+		}
+		count = info[0].As<Napi::Number>().Int32Value();
+	}
+	return Napi::Number::New(env, this->pipeline_->Credit(std::max(count, 0)));
+}
+
+/**
+ * @brief Sends a packet through one of the handles.
+ * @param info Contains the handle id and an object with packet and addr buffers.
+ * @return Boolean indicating success.
+ * @throws Error if the id is unknown or the send fails.
+ */
+Napi::Value PipelineWrap::send(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsObject())
+	{
+		Napi::TypeError::New(env, "Handle id and object expected").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	HANDLE handle = this->pipeline_->Handle(info[0].As<Napi::Number>().Uint32Value());
+	if (handle == INVALID_HANDLE_VALUE)
+	{
+		Napi::Error::New(env, "Unknown or closed handle id").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	Napi::Object packetData = info[1].As<Napi::Object>();
+	Napi::Buffer<char> packet = packetData.Get("packet").As<Napi::Buffer<char>>();
+	Napi::Buffer<char> addrBuffer = packetData.Get("addr").As<Napi::Buffer<char>>();
+	if (addrBuffer.Length() < (sizeof(WINDIVERT_ADDRESS) - 64))
+	{
+		Napi::TypeError::New(env, "Invalid addr buffer size").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	UINT sendLen;
+	BOOL sent = WinDivertSend(handle, packet.Data(), packet.Length(), &sendLen,
+							  reinterpret_cast<const WINDIVERT_ADDRESS *>(addrBuffer.Data()));
+	if (sent != 1)
+	{
+		std::string errorMsg = "Packet send failed with error code: " + std::to_string(GetLastError());
+		Napi::Error::New(env, errorMsg).ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	return Napi::Boolean::New(env, sent);
+}
+
+/**
+ * @brief Sends packets stored back to back with one WinDivertSendEx per handle and batch.
+ * @param info Contains:
+ *             - handles: Uint8Array with the handle id of each packet
+ *             - data: Buffer with the packets
+ *             - addrs: Buffer with one WINDIVERT_ADDRESS per packet
+ *             - offsets: Uint32Array with the packet boundaries (count + 1 entries)
+ * @return Number of packets accepted by the driver.
+ * @throws RangeError if the arrays do not describe the same packets or the offsets do not
+ *         ascend within data.
+ */
+Napi::Value PipelineWrap::sendBatch(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	if (info.Length() < 4 || !info[0].IsTypedArray() || !info[1].IsBuffer() || !info[2].IsBuffer() || !info[3].IsTypedArray())
+	{
+		Napi::TypeError::New(env, "handles, data, addrs and offsets expected").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	Napi::Uint8Array handles = info[0].As<Napi::Uint8Array>();
+	Napi::Buffer<char> data = info[1].As<Napi::Buffer<char>>();
+	Napi::Buffer<char> addrs = info[2].As<Napi::Buffer<char>>();
+	Napi::Uint32Array offsets = info[3].As<Napi::Uint32Array>();
+	const size_t count = handles.ElementLength();
+	bool valid = offsets.ElementLength() == count + 1 && addrs.Length() >= count * sizeof(WINDIVERT_ADDRESS) &&
+				 offsets[count] <= data.Length();
+	// Offsets must ascend, so every packet lies inside data.
+	for (size_t i = 0; valid && i < count; i++)
+	{
+		valid = offsets[i] <= offsets[i + 1];
+	}
+	if (!valid)
+	{
+		Napi::RangeError::New(env, "handles, addrs and offsets do not match").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+
+	const WINDIVERT_ADDRESS *addr = reinterpret_cast<const WINDIVERT_ADDRESS *>(addrs.Data());
+	std::vector<std::unique_ptr<SendBatch>> batches(this->pipeline_->Size());
+	for (size_t i = 0; i < count; i++)
+	{
+		const UINT32 id = handles[i];
+		if (id >= batches.size() || this->pipeline_->Handle(id) == INVALID_HANDLE_VALUE)
+		{
+			continue;
+		}
+		if (!batches[id])
+		{
+			batches[id].reset(new SendBatch(this->pipeline_->Handle(id)));
+		}
+		batches[id]->Add(data.Data() + offsets[i], offsets[i + 1] - offsets[i], addr[i]);
+	}
+	UINT64 sent = 0;
+	for (const std::unique_ptr<SendBatch> &batch : batches)
+	{
+		if (batch)
+		{
+			batch->Flush();
+			sent += batch->Sent();
+		}
+	}
+	return Napi::Number::New(env, static_cast<double>(sent));
+}
+
+/**
+ * @brief Returns the pipeline counters.
+ * @return Object with batches, wakeups and a handles array of
+ *         {id, filter, layer, flags, priority, packets, bytes, reads, errors}.
+ */
+Napi::Value PipelineWrap::stats(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	Napi::Object result = Napi::Object::New(env);
+	result.Set("batches", Napi::Number::New(env, static_cast<double>(this->pipeline_->Batches())));
+	result.Set("wakeups", Napi::Number::New(env, static_cast<double>(this->pipeline_->Wakeups())));
+	Napi::Array handles = Napi::Array::New(env, this->handles_.size());
+	for (UINT32 id = 0; id < this->handles_.size(); id++)
+	{
+		PipelineHandleStats counters;
+		this->pipeline_->GetStats(id, &counters);
+		Napi::Object handle = Napi::Object::New(env);
+		handle.Set("id", Napi::Number::New(env, id));
+		handle.Set("filter", Napi::String::New(env, this->handles_[id].filter));
+		handle.Set("layer", Napi::Number::New(env, this->handles_[id].layer));
+		handle.Set("flags", Napi::Number::New(env, static_cast<double>(this->handles_[id].flags)));
+		handle.Set("priority", Napi::Number::New(env, this->handles_[id].priority));
+		handle.Set("packets", Napi::Number::New(env, static_cast<double>(counters.packets)));
+		handle.Set("bytes", Napi::Number::New(env, static_cast<double>(counters.bytes)));
+		handle.Set("reads", Napi::Number::New(env, static_cast<double>(counters.reads)));
+		handle.Set("errors", Napi::Number::New(env, static_cast<double>(counters.errors)));
+		handles.Set(id, handle);
+	}
+	result.Set("handles", handles);
+	return result;
+}
+
+/**
+ * @brief Stops the completion thread and closes every handle.
+ * Packets still queued in the driver are not delivered; the callback then receives null.
+ * @return Undefined.
+ */
+Napi::Value PipelineWrap::close(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	this->pipeline_->Close();
+	this->closed_ = true;
+	return env.Undefined();
+}
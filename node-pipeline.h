@@ -0,0 +1,110 @@
+/**
+ * @file node-pipeline.h
+ * @brief Node.js wrapper of the multi-handle pipeline
+ *
+ * A Pipeline object opens and owns several handles with their own filters, flags and
+ * priorities, reads all of them on one completion port thread and delivers their packets
+ * as one batched stream in which every packet carries the id of its handle.
+ */
+
+#ifndef NODE_PIPELINE_H_
+#define NODE_PIPELINE_H_
+
+#define NAPI_VERSION 4
+#include <napi.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "pipeline.h"
+
+/**
+ * @class PipelineWrap
+ * @brief JavaScript Pipeline class
+ */
+class PipelineWrap : public Napi::ObjectWrap<PipelineWrap> {
+	public:
+		/**
+		 * @brief Registers the Pipeline class
+		 * @param env The Node.js environment
+		 * @param exports The exports object to attach the class to
+		 * @return The modified exports object
+		 */
+		static Napi::Object Init(Napi::Env env, Napi::Object exports);
+
+		/**
+		 * @brief Constructor
+		 * @param info Contains optional batchSize and depth
+		 */
+		PipelineWrap(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Destructor - Stops the thread and closes the handles
+		 */
+		~PipelineWrap();
+
+	private:
+		/**
+		 * @brief Opens a handle and adds it to the pipeline
+		 * @param info Contains the filter or CompiledFilter and optional layer, flags and priority
+		 * @return Handle id
+		 */
+		Napi::Value add(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Starts the completion thread
+		 * @param info Contains the batch callback and optional initial credits
+		 * @return Undefined
+		 */
+		Napi::Value recv(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Grants read credits to the completion thread
+		 * @param info Contains the number of batches the consumer can accept
+		 * @return Number of credits now available
+		 */
+		Napi::Value credit(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Sends a packet through one of the handles
+		 * @param info Contains the handle id, packet and address
+		 * @return Boolean indicating success
+		 */
+		Napi::Value send(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Sends packets stored back to back, each through the handle its id names
+		 * @param info Contains handle ids, data, addresses and offsets as delivered by recv
+		 * @return Number of packets accepted by the driver
+		 */
+		Napi::Value sendBatch(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Returns the per-handle and pipeline counters
+		 */
+		Napi::Value stats(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Stops the thread and closes every handle
+		 * @param info Not used
+		 * @return Undefined
+		 */
+		Napi::Value close(const Napi::CallbackInfo& info);
+
+		/**
+		 * @struct HandleInfo
+		 * @brief What a handle was opened with, reported by stats
+		 */
+		struct HandleInfo {
+			std::string filter;
+			UINT32 layer;
+			UINT64 flags;
+			INT16 priority;
+		};
+
+		std::unique_ptr<Pipeline> pipeline_;   ///< Owns the handles and the thread
+		std::vector<HandleInfo> handles_;      ///< Indexed by handle id
+		Napi::ThreadSafeFunction tsfn_;        ///< Delivers the batches
+		bool closed_;                          ///< close() was called
+};
+
+#endif
@@ -0,0 +1,326 @@
+/**
+ * @file node-policer.cc
+ * @brief Node.js wrapper of the rate limiting stage
+ */
+
+#include <algorithm>
+#include "node-policer.h"
+
+/**
+ * @struct PolicerUpdate
+ * @brief One validated entry of an update call
+ */
+struct PolicerUpdate {
+	uint32_t rule;           ///< Rule index
+	bool hasProcess;         ///< Changes a process override instead of the rule limit
+	uint32_t processId;
+	bool remove;             ///< Removes the process override
+	bool hasRate;
+	double rate;
+	bool hasBurst;
+	double burst;
+	bool hasAction;
+	PolicerAction action;
+};
+
+/**
+ * @brief Registers the Policer class.
+ * @param env The Node.js environment.
+ * @param exports The exports object to attach the class to.
+ * @return The modified exports object containing the Policer class.
+ */
+Napi::Object PolicerWrap::Init(Napi::Env env, Napi::Object exports)
+{
+	return Register(env, exports, "Policer", {InstanceMethod("setRules", &PolicerWrap::setRules), InstanceMethod("update", &PolicerWrap::update), InstanceMethod("stats", &PolicerWrap::stats)});
+}
+
+/**
+ * @brief Constructs a Policer stage.
+ * @param info Contains an optional options object:
+ *             - flowIndex: FlowIndex used by process keyed rules
+ *             - maxBuckets: Buckets per rule, default POLICER_DEFAULT_MAX_BUCKETS
+ *             - maxBytes: Cap on bytes held by delaying rules, default SCHEDULER_DEFAULT_MAX_BYTES
+ *             - maxDelay: Longest hold in milliseconds, default POLICER_DEFAULT_MAX_DELAY
+ */
+PolicerWrap::PolicerWrap(const Napi::CallbackInfo &info) : StageWrap<PolicerWrap, PolicerStage>(info)
+{
+	std::shared_ptr<FlowIndex> flowIndex;
+	size_t maxBuckets = POLICER_DEFAULT_MAX_BUCKETS;
+	size_t maxBytes = SCHEDULER_DEFAULT_MAX_BYTES;
+	double maxDelay = POLICER_DEFAULT_MAX_DELAY;
+	if (info.Length() > 0 && info[0].IsObject())
+	{
+		Napi::Object options = info[0].As<Napi::Object>();
+		flowIndex = FlowIndexWrap::FromValue(options.Get("flowIndex"));
+		maxBuckets = static_cast<size_t>(NumberOption(options, "maxBuckets", static_cast<double>(maxBuckets)));
+		maxBytes = static_cast<size_t>(NumberOption(options, "maxBytes", static_cast<double>(maxBytes)));
+		maxDelay = NumberOption(options, "maxDelay", maxDelay);
+	}
+	this->stage_ = std::make_shared<PolicerStage>(flowIndex, maxBuckets, maxBytes, static_cast<UINT64>(maxDelay * 1e6));
+}
+
+/**
+ * @brief Reads rate and burst, burst defaults to ten milliseconds at rate but at least one full packet.
+ */
+static PolicerLimit ParseLimit(Napi::Object object)
+{
+	PolicerLimit limit;
+	limit.rate = NumberOption(object, "rate", 0);
+	limit.burst = NumberOption(object, "burst", std::max(limit.rate / 100, 1500.0));
+	return limit;
+}
+
+/**
+ * @brief Reads an action name.
+ */
+static bool ParseAction(Napi::Value value, PolicerAction *action)
+{
+	std::string name = value.IsString() ? value.As<Napi::String>().Utf8Value() : "";
+	if (name == "drop")
+	{
+		*action = POLICER_DROP;
+	}
+	else if (name == "delay")
+	{
+		*action = POLICER_DELAY;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Converts a rule object.
+ * @param object Rule with match fields (see ParsePacketMatch), rate in bytes per second,
+ *               optional burst in bytes, key ('rule', 'flow' or 'process'), action ('drop'
+ *               or 'delay') and processes, an array of {processId, rate, burst} overrides
+ * @param rule Receives the rule
+ * @return Error message, empty on success
+ */
+static std::string ParseRule(Napi::Object object, PolicerRule *rule)
+{
+	std::string error = ParsePacketMatch(object, &rule->match);
+	if (!error.empty())
+	{
+		return error;
+	}
+	Napi::Value key = object.Get("key");
+	std::string keyName = key.IsString() ? key.As<Napi::String>().Utf8Value() : "rule";
+	if (keyName == "rule")
+	{
+		rule->key = POLICER_KEY_RULE;
+	}
+	else if (keyName == "flow")
+	{
+		rule->key = POLICER_KEY_FLOW;
+	}
+	else if (keyName == "process")
+	{
+		rule->key = POLICER_KEY_PROCESS;
+	}
+	else
+	{
+		return "key must be 'rule', 'flow' or 'process'";
+	}
+	rule->action = POLICER_DROP;
+	if (!object.Get("action").IsUndefined() && !ParseAction(object.Get("action"), &rule->action))
+	{
+		return "action must be 'drop' or 'delay'";
+	}
+	rule->limit = ParseLimit(object);
+
+	Napi::Value processes = object.Get("processes");
+	if (processes.IsArray())
+	{
+		if (rule->key != POLICER_KEY_PROCESS)
+		{
+			return "processes requires key 'process'";
+		}
+		Napi::Array array = processes.As<Napi::Array>();
+		for (uint32_t i = 0; i < array.Length(); i++)
+		{
+			Napi::Value entry = array.Get(i);
+			if (!entry.IsObject() || !entry.As<Napi::Object>().Get("processId").IsNumber())
+			{
+				return "processes entries need a processId";
+			}
+			Napi::Object process = entry.As<Napi::Object>();
+			rule->processes[process.Get("processId").As<Napi::Number>().Uint32Value()] = ParseLimit(process);
+		}
+	}
+	return "";
+}
+
+/**
+ * @brief Replaces all rules; buckets and counters restart.
+ * @param info Contains an array of rule objects, the first matching rule applies.
+ * @return Undefined.
+ * @throws TypeError naming the first invalid rule, the previous rules stay active.
+ */
+Napi::Value PolicerWrap::setRules(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	if (info.Length() < 1 || !info[0].IsArray())
+	{
+		Napi::TypeError::New(env, "Array of rules expected").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	Napi::Array array = info[0].As<Napi::Array>();
+	std::vector<PolicerRule> rules(array.Length());
+	for (uint32_t i = 0; i < array.Length(); i++)
+	{
+		Napi::Value value = array.Get(i);
+		std::string error = value.IsObject() ? ParseRule(value.As<Napi::Object>(), &rules[i]) : "object expected";
+		if (!error.empty())
+		{
+			Napi::TypeError::New(env, "Invalid policer rule " + std::to_string(i) + ": " + error).ThrowAsJavaScriptException();
+			return env.Undefined();
+		}
+	}
+	this->stage_->SetRules(std::move(rules));
+	return env.Undefined();
+}
+
+/**
+ * @brief Converts an update object.
+ * @param object Update with rule (index) and any of rate, burst and action; with processId
+ *               it sets that process override instead, or removes it if remove is true
+ * @param ruleCount Number of rules
+ * @param update Receives the update
+ * @return Error message, empty on success
+ */
+static std::string ParseUpdate(Napi::Object object, size_t ruleCount, PolicerUpdate *update)
+{
+	std::memset(update, 0, sizeof(PolicerUpdate));
+	Napi::Value rule = object.Get("rule");
+	if (!rule.IsNumber() || rule.As<Napi::Number>().Uint32Value() >= ruleCount)
+	{
+		return "rule must be the index of a rule";
+	}
+	update->rule = rule.As<Napi::Number>().Uint32Value();
+	Napi::Value processId = object.Get("processId");
+	if (processId.IsNumber())
+	{
+		update->hasProcess = true;
+		update->processId = processId.As<Napi::Number>().Uint32Value();
+		update->remove = object.Get("remove").ToBoolean().Value();
+	}
+	update->hasRate = object.Get("rate").IsNumber();
+	update->rate = NumberOption(object, "rate", 0);
+	update->hasBurst = object.Get("burst").IsNumber();
+	update->burst = NumberOption(object, "burst", 0);
+	if (!object.Get("action").IsUndefined())
+	{
+		if (update->hasProcess || !ParseAction(object.Get("action"), &update->action))
+		{
+			return "action must be 'drop' or 'delay' and applies to rules only";
+		}
+		update->hasAction = true;
+	}
+	if (update->hasProcess && !update->remove && !update->hasRate)
+	{
+		return "process overrides need a rate";
+	}
+	return "";
+}
+
+/**
+ * @brief Changes limits of existing rules in one step; buckets and counters are kept.
+ * @param info Contains an array of update objects, see ParseUpdate.
+ * @return Undefined.
+ * @throws TypeError naming the first invalid update, nothing is changed then.
+ */
+Napi::Value PolicerWrap::update(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	if (info.Length() < 1 || !info[0].IsArray())
+	{
+		Napi::TypeError::New(env, "Array of updates expected").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	Napi::Array array = info[0].As<Napi::Array>();
+	const size_t ruleCount = this->stage_->RuleCount();
+	std::vector<PolicerUpdate> updates(array.Length());
+	for (uint32_t i = 0; i < array.Length(); i++)
+	{
+		Napi::Value value = array.Get(i);
+		std::string error = value.IsObject() ? ParseUpdate(value.As<Napi::Object>(), ruleCount, &updates[i]) : "object expected";
+		if (!error.empty())
+		{
+			Napi::TypeError::New(env, "Invalid policer update " + std::to_string(i) + ": " + error).ThrowAsJavaScriptException();
+			return env.Undefined();
+		}
+	}
+	this->stage_->UpdateRules([&updates](std::vector<PolicerRule> &rules)
+	{
+		for (const PolicerUpdate &update : updates)
+		{
+			if (update.rule >= rules.size())
+			{
+				continue;
+			}
+			PolicerRule &rule = rules[update.rule];
+			if (update.hasProcess && update.remove)
+			{
+				rule.processes.erase(update.processId);
+				continue;
+			}
+			PolicerLimit *limit = &rule.limit;
+			if (update.hasProcess)
+			{
+				auto inserted = rule.processes.emplace(update.processId, rule.limit);
+				limit = &inserted.first->second;
+			}
+			if (update.hasRate)
+			{
+				limit->rate = update.rate;
+				limit->burst = update.hasBurst ? update.burst : std::max(update.rate / 100, 1500.0);
+			}
+			else if (update.hasBurst)
+			{
+				limit->burst = update.burst;
+			}
+			if (update.hasAction)
+			{
+				rule.action = update.action;
+			}
+		}
+	});
+	return env.Undefined();
+}
+
+/**
+ * @brief Returns the stage counters.
+ * @return Object with held, heldBytes, sent, refused, flushed and failed of the delay
+ *         scheduler, and rules, one {packets, bytes, conformed, delayed, dropped, buckets} per rule.
+ */
+Napi::Value PolicerWrap::stats(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	SchedulerStats scheduler;
+	std::vector<PolicerRuleStats> rules;
+	this->stage_->GetStats(&scheduler, &rules);
+	Napi::Object result = Napi::Object::New(env);
+	result.Set("held", Napi::Number::New(env, static_cast<double>(scheduler.held)));
+	result.Set("heldBytes", Napi::Number::New(env, static_cast<double>(scheduler.heldBytes)));
+	result.Set("sent", Napi::Number::New(env, static_cast<double>(scheduler.sent)));
+	result.Set("refused", Napi::Number::New(env, static_cast<double>(scheduler.refused)));
+	result.Set("flushed", Napi::Number::New(env, static_cast<double>(scheduler.flushed)));
+	result.Set("failed", Napi::Number::New(env, static_cast<double>(scheduler.failed)));
+	Napi::Array list = Napi::Array::New(env, rules.size());
+	for (size_t i = 0; i < rules.size(); i++)
+	{
+		Napi::Object entry = Napi::Object::New(env);
+		entry.Set("packets", Napi::Number::New(env, static_cast<double>(rules[i].packets)));
+		entry.Set("bytes", Napi::Number::New(env, static_cast<double>(rules[i].bytes)));
+		entry.Set("conformed", Napi::Number::New(env, static_cast<double>(rules[i].conformed)));
+		entry.Set("delayed", Napi::Number::New(env, static_cast<double>(rules[i].delayed)));
+		entry.Set("dropped", Napi::Number::New(env, static_cast<double>(rules[i].dropped)));
+		entry.Set("buckets", Napi::Number::New(env, static_cast<double>(rules[i].buckets)));
+		list.Set(static_cast<uint32_t>(i), entry);
+	}
+	result.Set("rules", list);
+	return result;
+}
@@ -0,0 +1,61 @@
+/**
+ * @file node-policer.h
+ * @brief Node.js wrapper of the rate limiting stage
+ *
+ * A Policer object is attached to NETWORK layer handles with WinDivert.attachStage.
+ * JavaScript sets the rules and adjusts limits in bulk; policing happens in the
+ * receive thread.
+ */
+
+#ifndef NODE_POLICER_H_
+#define NODE_POLICER_H_
+
+#define NAPI_VERSION 4
+#include <napi.h>
+#include <memory>
+#include "policer.h"
+#include "node-stage.h"
+#include "node-flow-index.h"
+
+/**
+ * @class PolicerWrap
+ * @brief JavaScript Policer class
+ */
+class PolicerWrap : public StageWrap<PolicerWrap, PolicerStage> {
+	public:
+		/**
+		 * @brief Registers the Policer class
+		 * @param env The Node.js environment
+		 * @param exports The exports object to attach the class to
+		 * @return The modified exports object
+		 */
+		static Napi::Object Init(Napi::Env env, Napi::Object exports);
+
+		/**
+		 * @brief Constructor
+		 * @param info Contains optional flowIndex, maxBuckets, maxBytes and maxDelay
+		 */
+		PolicerWrap(const Napi::CallbackInfo& info);
+
+	private:
+		/**
+		 * @brief Replaces all rules
+		 * @param info Contains an array of rule objects
+		 * @return Undefined
+		 */
+		Napi::Value setRules(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Changes limits of existing rules in one step
+		 * @param info Contains an array of update objects
+		 * @return Undefined
+		 */
+		Napi::Value update(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Returns the scheduler and rule counters
+		 */
+		Napi::Value stats(const Napi::CallbackInfo& info);
+};
+
+#endif
@@ -0,0 +1,104 @@
+/**
+ * @file node-sampler.cc
+ * @brief Node.js wrapper of the sampling stage
+ */
+
+#include "node-sampler.h"
+
+/**
+ * @brief Registers the Sampler class.
+ * @param env The Node.js environment.
+ * @param exports The exports object to attach the class to.
+ * @return The modified exports object containing the Sampler class.
+ */
+Napi::Object SamplerWrap::Init(Napi::Env env, Napi::Object exports)
+{
+	return Register(env, exports, "Sampler", {InstanceMethod("stats", &SamplerWrap::stats)});
+}
+
+/**
+ * @brief Constructs a Sampler stage.
+ * @param info Contains the options object:
+ *             - policy: "rate" (default), "reservoir" or "first"
+ *             - by: "flow" (default) or "packet", what rate and reservoir decisions hash
+ *             - rate: rate policy, sample one in rate (default 100)
+ *             - size: reservoir policy, packets per interval (default 100)
+ *             - interval: reservoir policy, milliseconds (default SAMPLER_DEFAULT_INTERVAL)
+ *             - count: first policy, packets per flow (default 8)
+ *             - idleTimeout: first policy, milliseconds before an idle flow is forgotten (default SAMPLER_DEFAULT_IDLE)
+ *             - maxFlows: first policy, flows tracked (default SAMPLER_DEFAULT_MAX_FLOWS)
+ *             - seed: Mixed into the hash; samplers with the same seed pick the same flows (default 0)
+ */
+SamplerWrap::SamplerWrap(const Napi::CallbackInfo &info) : StageWrap<SamplerWrap, SamplerStage>(info)
+{
+	Napi::Env env = info.Env();
+	Napi::Object options = info.Length() > 0 && info[0].IsObject() ? info[0].As<Napi::Object>() : Napi::Object::New(env);
+	SamplerConfig config;
+	Napi::Value policy = options.Get("policy");
+	const std::string policyName = policy.IsString() ? policy.As<Napi::String>().Utf8Value() : "rate";
+	if (policyName == "rate")
+	{
+		config.policy = SAMPLER_RATE;
+	}
+	else if (policyName == "reservoir")
+	{
+		config.policy = SAMPLER_RESERVOIR;
+	}
+	else if (policyName == "first")
+	{
+		config.policy = SAMPLER_FIRST;
+	}
+	else
+	{
+		Napi::TypeError::New(env, "policy must be \"rate\", \"reservoir\" or \"first\"").ThrowAsJavaScriptException();
+		return;
+	}
+	Napi::Value by = options.Get("by");
+	const std::string byName = by.IsString() ? by.As<Napi::String>().Utf8Value() : "flow";
+	if (byName != "flow" && byName != "packet")
+	{
+		Napi::TypeError::New(env, "by must be \"flow\" or \"packet\"").ThrowAsJavaScriptException();
+		return;
+	}
+	config.key = byName == "flow" ? SAMPLER_BY_FLOW : SAMPLER_BY_PACKET;
+	const double rate = NumberOption(options, "rate", 100);
+	const double size = NumberOption(options, "size", 100);
+	const double interval = NumberOption(options, "interval", SAMPLER_DEFAULT_INTERVAL);
+	const double count = NumberOption(options, "count", 8);
+	const double idleTimeout = NumberOption(options, "idleTimeout", SAMPLER_DEFAULT_IDLE);
+	if (rate < 1 || rate > UINT32_MAX || size < 1 || size > UINT32_MAX || interval < 1 || interval > UINT32_MAX ||
+		count < 1 || count > UINT32_MAX || idleTimeout > UINT32_MAX)
+	{
+		Napi::RangeError::New(env, "rate, size, interval and count must be at least 1").ThrowAsJavaScriptException();
+		return;
+	}
+	config.rate = static_cast<UINT32>(rate);
+	config.size = static_cast<UINT32>(size);
+	config.interval = static_cast<UINT32>(interval);
+	config.count = static_cast<UINT32>(count);
+	config.idleTimeout = static_cast<UINT32>(idleTimeout);
+	config.maxFlows = static_cast<size_t>(NumberOption(options, "maxFlows", SAMPLER_DEFAULT_MAX_FLOWS));
+	config.seed = static_cast<UINT64>(NumberOption(options, "seed", 0));
+	this->stage_ = std::make_shared<SamplerStage>(config);
+}
+
+/**
+ * @brief Returns the sampling counters.
+ * @param info Not used.
+ * @return Object with packets, bytes, sampled, sampledBytes, flows, untracked and probability.
+ */
+Napi::Value SamplerWrap::stats(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	SamplerStats stats;
+	this->stage_->GetStats(&stats);
+	Napi::Object result = Napi::Object::New(env);
+	result.Set("packets", Napi::Number::New(env, static_cast<double>(stats.packets)));
+	result.Set("bytes", Napi::Number::New(env, static_cast<double>(stats.bytes)));
+	result.Set("sampled", Napi::Number::New(env, static_cast<double>(stats.sampled)));
+	result.Set("sampledBytes", Napi::Number::New(env, static_cast<double>(stats.sampledBytes)));
+	result.Set("flows", Napi::Number::New(env, static_cast<double>(stats.flows)));
+	result.Set("untracked", Napi::Number::New(env, static_cast<double>(stats.untracked)));
+	result.Set("probability", Napi::Number::New(env, stats.probability));
+	return result;
+}
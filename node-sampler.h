@@ -0,0 +1,46 @@
+/**
+ * @file node-sampler.h
+ * @brief Node.js wrapper of the sampling stage
+ *
+ * A Sampler object is attached to NETWORK layer handles with WinDivert.attachStage, usually
+ * SNIFF handles used for monitoring. The policy is fixed at construction; JavaScript reads
+ * the counters with stats().
+ */
+
+#ifndef NODE_SAMPLER_H_
+#define NODE_SAMPLER_H_
+
+#define NAPI_VERSION 4
+#include <napi.h>
+#include <memory>
+#include "sampler.h"
+#include "node-stage.h"
+
+/**
+ * @class SamplerWrap
+ * @brief JavaScript Sampler class
+ */
+class SamplerWrap : public StageWrap<SamplerWrap, SamplerStage> {
+	public:
+		/**
+		 * @brief Registers the Sampler class
+		 * @param env The Node.js environment
+		 * @param exports The exports object to attach the class to
+		 * @return The modified exports object
+		 */
+		static Napi::Object Init(Napi::Env env, Napi::Object exports);
+
+		/**
+		 * @brief Constructor
+		 * @param info Contains the policy options
+		 */
+		SamplerWrap(const Napi::CallbackInfo& info);
+
+	private:
+		/**
+		 * @brief Returns the sampling counters
+		 */
+		Napi::Value stats(const Napi::CallbackInfo& info);
+};
+
+#endif
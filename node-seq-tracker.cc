@@ -0,0 +1,101 @@
+/**
+ * @file node-seq-tracker.cc
+ * @brief Node.js wrapper of the TCP sequence offset tracker
+ */
+
+#include <algorithm>
+#include <cstring>
+#include "node-seq-tracker.h"
+
+/**
+ * @brief Registers the SeqTracker class.
+ * @param env The Node.js environment.
+ * @param exports The exports object to attach the class to.
+ * @return The modified exports object containing the SeqTracker class.
+ */
+Napi::Object SeqTrackerWrap::Init(Napi::Env env, Napi::Object exports)
+{
+	return Register(env, exports, "SeqTracker", {InstanceMethod("record", &SeqTrackerWrap::record), InstanceMethod("stats", &SeqTrackerWrap::stats)});
+}
+
+/**
+ * @brief Constructs a SeqTracker stage.
+ * @param info Contains an optional options object:
+ *             - maxFlows: Shifted flows tracked, default SEQ_TRACKER_DEFAULT_MAX_FLOWS
+ *             - idleTimeout: Idle milliseconds before a shifted flow is forgotten, default SEQ_TRACKER_DEFAULT_IDLE
+ */
+SeqTrackerWrap::SeqTrackerWrap(const Napi::CallbackInfo &info) : StageWrap<SeqTrackerWrap, SeqTrackerStage>(info)
+{
+	size_t maxFlows = SEQ_TRACKER_DEFAULT_MAX_FLOWS;
+	double idleTimeout = SEQ_TRACKER_DEFAULT_IDLE;
+	if (info.Length() > 0 && info[0].IsObject())
+	{
+		Napi::Object options = info[0].As<Napi::Object>();
+		maxFlows = static_cast<size_t>(NumberOption(options, "maxFlows", static_cast<double>(maxFlows)));
+		idleTimeout = NumberOption(options, "idleTimeout", idleTimeout);
+	}
+	this->stage_ = std::make_shared<SeqTrackerStage>(maxFlows, static_cast<UINT64>(idleTimeout));
+}
+
+/**
+ * @brief Records the size change of an outbound packet.
+ * @param info Contains:
+ *             - packet: The packet as received, before its payload was resized
+ *             - addr: Its address buffer
+ *             - growth: Bytes added to the payload, negative if removed
+ * @return false if the packet is not an outbound TCP packet, or the table is full.
+ *
+ * The packet must have passed through this tracker, so its sequence number is the one the peer sees.
+ */
+Napi::Value SeqTrackerWrap::record(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	if (info.Length() < 3 || !info[0].IsTypedArray() || !info[1].IsTypedArray() || !info[2].IsNumber())
+	{
+		Napi::TypeError::New(env, "Invalid arguments.  Expected usage: record(packet, addr, growth)").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	Napi::Uint8Array packet = info[0].As<Napi::Uint8Array>();
+	Napi::Uint8Array addr = info[1].As<Napi::Uint8Array>();
+	if (addr.ByteLength() < sizeof(WINDIVERT_ADDRESS) - 64)
+	{
+		Napi::TypeError::New(env, "Invalid addr buffer size").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	WINDIVERT_ADDRESS address;
+	std::memset(&address, 0, sizeof(address));
+	std::memcpy(&address, addr.Data(), std::min(addr.ByteLength(), sizeof(address)));
+	const INT32 growth = info[2].As<Napi::Number>().Int32Value();
+
+	PacketInfo parsed;
+	FlowKey key;
+	if (!address.Outbound || !ParsePacket(packet.Data(), static_cast<uint32_t>(packet.ByteLength()), &parsed) ||
+		parsed.fragment || parsed.protocol != PACKET_PROTO_TCP || parsed.transportLength < PACKET_TCP_HDR_MIN ||
+		!FlowKeyFromPacket(packet.Data(), parsed, true, &key))
+	{
+		return Napi::Boolean::New(env, false);
+	}
+	const UINT32 seq = ReadBE32(packet.Data() + parsed.transportOffset + 4);
+	return Napi::Boolean::New(env, growth == 0 ||
+		this->stage_->Record(key, seq, parsed.payloadLength, growth, true, GetTickCount64()));
+}
+
+/**
+ * @brief Returns the tracker counters.
+ * @param info Not used.
+ * @return Object with recorded, shifted, sackBlocks, untracked, expired and flows.
+ */
+Napi::Value SeqTrackerWrap::stats(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	SeqTrackerStats stats;
+	this->stage_->GetStats(&stats);
+	Napi::Object result = Napi::Object::New(env);
+	result.Set("recorded", Napi::Number::New(env, static_cast<double>(stats.recorded)));
+	result.Set("shifted", Napi::Number::New(env, static_cast<double>(stats.shifted)));
+	result.Set("sackBlocks", Napi::Number::New(env, static_cast<double>(stats.sackBlocks)));
+	result.Set("untracked", Napi::Number::New(env, static_cast<double>(stats.untracked)));
+	result.Set("expired", Napi::Number::New(env, static_cast<double>(stats.expired)));
+	result.Set("flows", Napi::Number::New(env, static_cast<double>(stats.flows)));
+	return result;
+}
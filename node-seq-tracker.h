@@ -0,0 +1,53 @@
+/**
+ * @file node-seq-tracker.h
+ * @brief Node.js wrapper of the TCP sequence offset tracker
+ *
+ * A SeqTracker object is attached to NETWORK layer handles with WinDivert.attachStage,
+ * ahead of the stages that resize payloads, and can be shared by several of them.
+ * JavaScript that resizes packets itself records the change with record().
+ */
+
+#ifndef NODE_SEQ_TRACKER_H_
+#define NODE_SEQ_TRACKER_H_
+
+#define NAPI_VERSION 4
+#include <napi.h>
+#include <memory>
+#include "seq-tracker.h"
+#include "node-stage.h"
+
+/**
+ * @class SeqTrackerWrap
+ * @brief JavaScript SeqTracker class
+ */
+class SeqTrackerWrap : public StageWrap<SeqTrackerWrap, SeqTrackerStage> {
+	public:
+		/**
+		 * @brief Registers the SeqTracker class
+		 * @param env The Node.js environment
+		 * @param exports The exports object to attach the class to
+		 * @return The modified exports object
+		 */
+		static Napi::Object Init(Napi::Env env, Napi::Object exports);
+
+		/**
+		 * @brief Constructor
+		 * @param info Contains optional maxFlows and idleTimeout
+		 */
+		SeqTrackerWrap(const Napi::CallbackInfo& info);
+
+	private:
+		/**
+		 * @brief Records the size change of an outbound packet
+		 * @param info Contains packet, addr and the number of bytes added or removed
+		 * @return false if the packet is not TCP or the change could not be recorded
+		 */
+		Napi::Value record(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Returns the tracker counters
+		 */
+		Napi::Value stats(const Napi::CallbackInfo& info);
+};
+
+#endif
@@ -0,0 +1,132 @@
+/**
+ * @file node-shaper.cc
+ * @brief Node.js wrapper of the shaping stage
+ */
+
+#include <algorithm>
+#include "node-shaper.h"
+
+/**
+ * @brief Registers the Shaper class.
+ * @param env The Node.js environment.
+ * @param exports The exports object to attach the class to.
+ * @return The modified exports object containing the Shaper class.
+ */
+Napi::Object ShaperWrap::Init(Napi::Env env, Napi::Object exports)
+{
+	return Register(env, exports, "Shaper", {InstanceMethod("setClasses", &ShaperWrap::setClasses), InstanceMethod("stats", &ShaperWrap::stats)});
+}
+
+/**
+ * @brief Constructs a Shaper stage.
+ * @param info Contains an optional options object:
+ *             - maxBytes: Cap on held packet bytes, default SCHEDULER_DEFAULT_MAX_BYTES
+ *             - resolution: Microseconds per scheduler tick, default SCHEDULER_DEFAULT_RESOLUTION
+ *             - maxFlows: Flow buckets per class, default SHAPER_DEFAULT_MAX_FLOWS
+ */
+ShaperWrap::ShaperWrap(const Napi::CallbackInfo &info) : StageWrap<ShaperWrap, ShaperStage>(info)
+{
+	size_t maxBytes = SCHEDULER_DEFAULT_MAX_BYTES;
+	UINT32 resolution = SCHEDULER_DEFAULT_RESOLUTION;
+	size_t maxFlows = SHAPER_DEFAULT_MAX_FLOWS;
+	if (info.Length() > 0 && info[0].IsObject())
+	{
+		Napi::Object options = info[0].As<Napi::Object>();
+		maxBytes = static_cast<size_t>(NumberOption(options, "maxBytes", static_cast<double>(maxBytes)));
+		resolution = static_cast<UINT32>(NumberOption(options, "resolution", resolution));
+		maxFlows = static_cast<size_t>(NumberOption(options, "maxFlows", static_cast<double>(maxFlows)));
+	}
+	this->stage_ = std::make_shared<ShaperStage>(maxBytes, resolution, maxFlows);
+}
+
+/**
+ * @brief Converts a class object.
+ * @param object Class with match fields (see ParsePacketMatch) and optional delay and
+ *               jitter in milliseconds, rate in bytes per second, burst in bytes and perFlow
+ * @param config Receives the class
+ * @return Error message, empty on success
+ */
+static std::string ParseClass(Napi::Object object, ShaperClass *config)
+{
+	std::memset(config, 0, sizeof(ShaperClass));
+	std::string error = ParsePacketMatch(object, &config->match);
+	if (!error.empty())
+	{
+		return error;
+	}
+	config->delay = static_cast<UINT64>(NumberOption(object, "delay", 0) * 1000);
+	config->jitter = static_cast<UINT64>(NumberOption(object, "jitter", 0) * 1000);
+	config->rate = NumberOption(object, "rate", 0);
+	// Ten milliseconds of traffic, but never less than a full sized packet.
+	config->burst = NumberOption(object, "burst", std::max(config->rate / 100, 1500.0));
+	config->perFlow = object.Get("perFlow").ToBoolean().Value();
+	if (config->delay == 0 && config->jitter == 0 && config->rate == 0)
+	{
+		return "class shapes nothing";
+	}
+	return "";
+}
+
+/**
+ * @brief Replaces all classes; buckets restart full, held packets keep their deadline.
+ * @param info Contains an array of class objects, the first matching class applies.
+ * @return Undefined.
+ * @throws TypeError naming the first invalid class, the previous classes stay active.
+ */
+Napi::Value ShaperWrap::setClasses(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	if (info.Length() < 1 || !info[0].IsArray())
+	{
+		Napi::TypeError::New(env, "Array of classes expected").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	Napi::Array array = info[0].As<Napi::Array>();
+	std::vector<ShaperClass> classes(array.Length());
+	for (uint32_t i = 0; i < array.Length(); i++)
+	{
+		Napi::Value value = array.Get(i);
+		std::string error = value.IsObject() ? ParseClass(value.As<Napi::Object>(), &classes[i]) : "object expected";
+		if (!error.empty())
+		{
+			Napi::TypeError::New(env, "Invalid shaper class " + std::to_string(i) + ": " + error).ThrowAsJavaScriptException();
+			return env.Undefined();
+		}
+	}
+	this->stage_->SetClasses(classes);
+	return env.Undefined();
+}
+
+/**
+ * @brief Returns the stage counters.
+ * @return Object with held, heldBytes, scheduled, sent, refused, flushed and failed of the
+ *         scheduler, and classes, one {packets, bytes, delayed, dropped, flows} per class.
+ */
+Napi::Value ShaperWrap::stats(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	SchedulerStats scheduler;
+	std::vector<ShaperClassStats> classes;
+	this->stage_->GetStats(&scheduler, &classes);
+	Napi::Object result = Napi::Object::New(env);
+	result.Set("held", Napi::Number::New(env, static_cast<double>(scheduler.held)));
+	result.Set("heldBytes", Napi::Number::New(env, static_cast<double>(scheduler.heldBytes)));
+	result.Set("scheduled", Napi::Number::New(env, static_cast<double>(scheduler.scheduled)));
+	result.Set("sent", Napi::Number::New(env, static_cast<double>(scheduler.sent)));
+	result.Set("refused", Napi::Number::New(env, static_cast<double>(scheduler.refused)));
+	result.Set("flushed", Napi::Number::New(env, static_cast<double>(scheduler.flushed)));
+	result.Set("failed", Napi::Number::New(env, static_cast<double>(scheduler.failed)));
+	Napi::Array list = Napi::Array::New(env, classes.size());
+	for (size_t i = 0; i < classes.size(); i++)
+	{
+		Napi::Object entry = Napi::Object::New(env);
+		entry.Set("packets", Napi::Number::New(env, static_cast<double>(classes[i].packets)));
+		entry.Set("bytes", Napi::Number::New(env, static_cast<double>(classes[i].bytes)));
+		entry.Set("delayed", Napi::Number::New(env, static_cast<double>(classes[i].delayed)));
+		entry.Set("dropped", Napi::Number::New(env, static_cast<double>(classes[i].dropped)));
+		entry.Set("flows", Napi::Number::New(env, static_cast<double>(classes[i].flows)));
+		list.Set(static_cast<uint32_t>(i), entry);
+	}
+	result.Set("classes", list);
+	return result;
+}
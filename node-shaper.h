@@ -0,0 +1,52 @@
+/**
+ * @file node-shaper.h
+ * @brief Node.js wrapper of the shaping stage
+ *
+ * A Shaper object is attached to NETWORK layer handles with WinDivert.attachStage; held
+ * packets are reinjected by its own scheduler thread, JavaScript only sets the classes.
+ */
+
+#ifndef NODE_SHAPER_H_
+#define NODE_SHAPER_H_
+
+#define NAPI_VERSION 4
+#include <napi.h>
+#include <memory>
+#include "shaper.h"
+#include "node-stage.h"
+
+/**
+ * @class ShaperWrap
+ * @brief JavaScript Shaper class
+ */
+class ShaperWrap : public StageWrap<ShaperWrap, ShaperStage> {
+	public:
+		/**
+		 * @brief Registers the Shaper class
+		 * @param env The Node.js environment
+		 * @param exports The exports object to attach the class to
+		 * @return The modified exports object
+		 */
+		static Napi::Object Init(Napi::Env env, Napi::Object exports);
+
+		/**
+		 * @brief Constructor
+		 * @param info Contains optional maxBytes, resolution and maxFlows
+		 */
+		ShaperWrap(const Napi::CallbackInfo& info);
+
+	private:
+		/**
+		 * @brief Replaces all classes
+		 * @param info Contains an array of class objects
+		 * @return Undefined
+		 */
+		Napi::Value setClasses(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Returns the scheduler and class counters
+		 */
+		Napi::Value stats(const Napi::CallbackInfo& info);
+};
+
+#endif
@@ -0,0 +1,119 @@
+/**
+ * @file node-stage.cc
+ * @brief Helpers shared by the Node.js wrappers of native stages
+ */
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+#include "node-stage.h"
+
+/**
+ * @brief Reads a port or [min, max] port range, the full range when undefined.
+ */
+static bool ParsePortRange(Napi::Value value, uint16_t *min, uint16_t *max)
+{
+	*min = 0;
+	*max = 65535;
+	if (value.IsUndefined())
+	{
+		return true;
+	}
+	if (value.IsNumber())
+	{
+		const uint32_t port = value.As<Napi::Number>().Uint32Value();
+		*min = *max = static_cast<uint16_t>(port);
+		return port <= 65535;
+	}
+	if (value.IsArray() && value.As<Napi::Array>().Length() == 2)
+	{
+		Napi::Array range = value.As<Napi::Array>();
+		if (!range.Get(0u).IsNumber() || !range.Get(1u).IsNumber())
+		{
+			return false;
+		}
+		const uint32_t lo = range.Get(0u).As<Napi::Number>().Uint32Value();
+		const uint32_t hi = range.Get(1u).As<Napi::Number>().Uint32Value();
+		*min = static_cast<uint16_t>(lo);
+		*max = static_cast<uint16_t>(hi);
+		return lo <= hi && hi <= 65535;
+	}
+	return false;
+}
+
+std::string ParsePacketMatch(Napi::Object object, PacketMatch *match)
+{
+	PacketMatchAny(match);
+	Napi::Value protocol = object.Get("protocol");
+	if (protocol.IsNumber())
+	{
+		const uint32_t value = protocol.As<Napi::Number>().Uint32Value();
+		if (value > 255)
+		{
+			return "invalid protocol";
+		}
+		match->protocol = static_cast<uint8_t>(value);
+	}
+	Napi::Value outbound = object.Get("outbound");
+	match->outbound = outbound.IsBoolean() ? (outbound.As<Napi::Boolean>().Value() ? 1 : 0) : -1;
+	match->matchImpostor = object.Get("matchImpostor").ToBoolean().Value();
+
+	Napi::Value src = object.Get("src");
+	Napi::Value dst = object.Get("dst");
+	if (!ParsePrefix(src.IsString() ? src.As<Napi::String>().Utf8Value() : "", &match->src) ||
+		!ParsePrefix(dst.IsString() ? dst.As<Napi::String>().Utf8Value() : "", &match->dst))
+	{
+		return "invalid src or dst prefix";
+	}
+	if (!ParsePortRange(object.Get("srcPort"), &match->srcPortMin, &match->srcPortMax) ||
+		!ParsePortRange(object.Get("dstPort"), &match->dstPortMin, &match->dstPortMax))
+	{
+		return "invalid srcPort or dstPort";
+	}
+	return "";
+}
+
+double NumberOption(Napi::Object object, const char *name, double fallback)
+{
+	Napi::Value value = object.Get(name);
+	if (!value.IsNumber() || value.As<Napi::Number>().DoubleValue() < 0)
+	{
+		return fallback;
+	}
+	return value.As<Napi::Number>().DoubleValue();
+}
+
+bool BooleanOption(Napi::Object object, const char *name)
+{
+	Napi::Value value = object.Get(name);
+	return value.IsBoolean() && value.As<Napi::Boolean>().Value();
+}
+
+/**
+ * @brief Unwrappers of the registered stage classes, in registration order.
+ */
+static std::vector<StageUnwrap> stageClasses;
+static std::mutex stageClassesMutex;    ///< Guards stageClasses, classes register once per environment
+
+void RegisterStageClass(StageUnwrap unwrap)
+{
+	std::lock_guard<std::mutex> lock(stageClassesMutex);
+	if (std::find(stageClasses.begin(), stageClasses.end(), unwrap) == stageClasses.end())
+	{
+		stageClasses.push_back(unwrap);
+	}
+}
+
+std::shared_ptr<PacketStage> StageFromValue(Napi::Value value)
+{
+	std::lock_guard<std::mutex> lock(stageClassesMutex);
+	for (StageUnwrap unwrap : stageClasses)
+	{
+		std::shared_ptr<PacketStage> stage = unwrap(value);
+		if (stage)
+		{
+			return stage;
+		}
+	}
+	return std::shared_ptr<PacketStage>();
+}
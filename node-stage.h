@@ -0,0 +1,122 @@
+/**
+ * @file node-stage.h
+ * @brief Helpers shared by the Node.js wrappers of native stages
+ */
+
+#ifndef NODE_STAGE_H_
+#define NODE_STAGE_H_
+
+#define NAPI_VERSION 4
+#include <napi.h>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include "packet-match.h"
+#include "packet-stage.h"
+
+/**
+ * @brief Reads the match fields of a rule object
+ * @param object Rule with optional protocol, outbound, src, dst, srcPort, dstPort and matchImpostor;
+ *               ports are a number or a [min, max] range, prefixes are "address[/length]"
+ * @param match Receives the match
+ * @return Error message, empty on success
+ */
+std::string ParsePacketMatch(Napi::Object object, PacketMatch *match);
+
+/**
+ * @brief Reads an optional non-negative number option
+ * @param object Options object
+ * @param name Option name
+ * @param fallback Value when the option is missing
+ */
+double NumberOption(Napi::Object object, const char *name, double fallback);
+
+/**
+ * @brief Reads an optional boolean option
+ * @return false when the option is missing or not a boolean
+ */
+bool BooleanOption(Napi::Object object, const char *name);
+
+/**
+ * @brief Returns the stage wrapped by an object of one stage class, or an empty pointer
+ */
+typedef std::shared_ptr<PacketStage> (*StageUnwrap)(Napi::Value value);
+
+/**
+ * @brief Makes a stage class attachable with WinDivert.attachStage
+ * @param unwrap Unwraps objects of the class; registering it again has no effect
+ */
+void RegisterStageClass(StageUnwrap unwrap);
+
+/**
+ * @brief Returns the native stage wrapped by an object of any registered stage class
+ * @param value Value to unwrap
+ * @return The stage, or an empty pointer if value is not a stage object
+ */
+std::shared_ptr<PacketStage> StageFromValue(Napi::Value value);
+
+/**
+ * @class StageWrap
+ * @brief Base of the JavaScript classes wrapping a native stage
+ *
+ * Wrap is the derived class and Stage the stage it owns. Register defines and exports the
+ * class and registers it with StageFromValue, so a new stage only needs its own methods.
+ */
+template <typename Wrap, typename Stage>
+class StageWrap : public Napi::ObjectWrap<Wrap> {
+	public:
+		/**
+		 * @brief Returns the stage wrapped by an object of the class
+		 * @param value Value to unwrap
+		 * @return The shared stage, or an empty pointer if value is not an object of the class
+		 */
+		static std::shared_ptr<Stage> FromValue(Napi::Value value)
+		{
+			if (!value.IsObject() || !value.As<Napi::Object>().InstanceOf(constructor.Value()))
+			{
+				return std::shared_ptr<Stage>();
+			}
+			return Napi::ObjectWrap<Wrap>::Unwrap(value.As<Napi::Object>())->stage_;
+		}
+
+	protected:
+		explicit StageWrap(const Napi::CallbackInfo &info) : Napi::ObjectWrap<Wrap>(info)
+		{
+		}
+
+		/**
+		 * @brief Defines the class, exports it and registers it as a stage class
+		 * @param env The Node.js environment
+		 * @param exports The exports object to attach the class to
+		 * @param name Class name
+		 * @param properties Methods of the class
+		 * @return The modified exports object
+		 */
+		static Napi::Object Register(Napi::Env env, Napi::Object exports, const char *name,
+									 const std::initializer_list<Napi::ClassPropertyDescriptor<Wrap>> &properties)
+		{
+			Napi::Function func = Napi::ObjectWrap<Wrap>::DefineClass(env, name, properties);
+
+			constructor = Napi::Persistent(func);
+			constructor.SuppressDestruct();
+			RegisterStageClass(&StageWrap::UnwrapStage);
+
+			exports.Set(name, func);
+			return exports;
+		}
+
+		std::shared_ptr<Stage> stage_;    ///< Shared with attached handles
+
+	private:
+		static std::shared_ptr<PacketStage> UnwrapStage(Napi::Value value)
+		{
+			return FromValue(value);
+		}
+
+		static Napi::FunctionReference constructor;   ///< Used to recognise objects of the class
+};
+
+template <typename Wrap, typename Stage>
+Napi::FunctionReference StageWrap<Wrap, Stage>::constructor;
+
+#endif
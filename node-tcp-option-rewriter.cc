@@ -0,0 +1,225 @@
+/**
+ * @file node-tcp-option-rewriter.cc
+ * @brief Node.js wrapper of the TCP option rewriting stage
+ */
+
+#include <cstring>
+#include "node-tcp-option-rewriter.h"
+
+/**
+ * @brief Registers the TcpOptionRewriter class.
+ * @param env The Node.js environment.
+ * @param exports The exports object to attach the class to.
+ * @return The modified exports object containing the TcpOptionRewriter class.
+ */
+Napi::Object TcpOptionRewriterWrap::Init(Napi::Env env, Napi::Object exports)
+{
+	return Register(env, exports, "TcpOptionRewriter", {InstanceMethod("setRules", &TcpOptionRewriterWrap::setRules), InstanceMethod("stats", &TcpOptionRewriterWrap::stats)});
+}
+
+/**
+ * @brief Constructs a TcpOptionRewriter stage without rules.
+ */
+TcpOptionRewriterWrap::TcpOptionRewriterWrap(const Napi::CallbackInfo &info) : StageWrap<TcpOptionRewriterWrap, TcpOptionRewriterStage>(info)
+{
+	this->stage_ = std::make_shared<TcpOptionRewriterStage>();
+}
+
+/**
+ * @brief Converts an option name or kind number.
+ * @param value 'mss', 'windowScale', 'sackPermitted', 'sack', 'timestamps' or a kind from 2 to 255
+ * @param kind Receives the kind
+ * @return false if value names no option
+ */
+static bool ParseOptionKind(Napi::Value value, UINT8 *kind)
+{
+	if (value.IsNumber())
+	{
+		const uint32_t number = value.As<Napi::Number>().Uint32Value();
+		if (number < 2 || number > 255)
+		{
+			return false;
+		}
+		*kind = static_cast<UINT8>(number);
+		return true;
+	}
+	std::string name = value.IsString() ? value.As<Napi::String>().Utf8Value() : "";
+	if (name == "mss")
+	{
+		*kind = TCP_OPT_MSS;
+	}
+	else if (name == "windowScale")
+	{
+		*kind = TCP_OPT_WSCALE;
+	}
+	else if (name == "sackPermitted")
+	{
+		*kind = TCP_OPT_SACK_PERM;
+	}
+	else if (name == "sack")
+	{
+		*kind = PACKET_TCP_OPT_SACK;
+	}
+	else if (name == "timestamps")
+	{
+		*kind = TCP_OPT_TIMESTAMPS;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Converts a rule object.
+ * @param object Rule with match fields (see ParsePacketMatch), and optional mss, window,
+ *               windowScale, strip (array of option names or kinds) and insert (array of
+ *               'mss', 'windowScale' and 'sackPermitted')
+ * @param rule Receives the rule
+ * @return Error message, empty on success
+ */
+static std::string ParseRule(Napi::Object object, TcpOptionRule *rule)
+{
+	std::memset(rule, 0, sizeof(TcpOptionRule));
+	rule->windowScale = -1;
+	std::string error = ParsePacketMatch(object, &rule->match);
+	if (!error.empty())
+	{
+		return error;
+	}
+	if (rule->match.protocol != 0 && rule->match.protocol != PACKET_PROTO_TCP)
+	{
+		return "protocol must be TCP";
+	}
+	rule->match.protocol = PACKET_PROTO_TCP;
+
+	Napi::Value mss = object.Get("mss");
+	if (mss.IsNumber())
+	{
+		const uint32_t value = mss.As<Napi::Number>().Uint32Value();
+		if (value == 0 || value > 65535)
+		{
+			return "invalid mss";
+		}
+		rule->mss = static_cast<UINT16>(value);
+	}
+	Napi::Value window = object.Get("window");
+	if (window.IsNumber())
+	{
+		const uint32_t value = window.As<Napi::Number>().Uint32Value();
+		if (value > 65535)
+		{
+			return "invalid window";
+		}
+		rule->hasWindow = true;
+		rule->window = static_cast<UINT16>(value);
+	}
+	Napi::Value windowScale = object.Get("windowScale");
+	if (windowScale.IsNumber())
+	{
+		const uint32_t value = windowScale.As<Napi::Number>().Uint32Value();
+		if (value > 14)
+		{
+			return "windowScale must be 0 to 14";
+		}
+		rule->windowScale = static_cast<INT8>(value);
+	}
+
+	Napi::Value strip = object.Get("strip");
+	if (strip.IsArray())
+	{
+		Napi::Array kinds = strip.As<Napi::Array>();
+		for (uint32_t i = 0; i < kinds.Length(); i++)
+		{
+			UINT8 kind;
+			if (!ParseOptionKind(kinds.Get(i), &kind))
+			{
+				return "invalid option in strip";
+			}
+			rule->strip[kind >> 3] |= static_cast<UINT8>(1 << (kind & 7));
+		}
+	}
+	Napi::Value insert = object.Get("insert");
+	if (insert.IsArray())
+	{
+		Napi::Array names = insert.As<Napi::Array>();
+		for (uint32_t i = 0; i < names.Length(); i++)
+		{
+			UINT8 kind = 0;
+			ParseOptionKind(names.Get(i), &kind);
+			if (kind == TCP_OPT_MSS && rule->mss != 0)
+			{
+				rule->insert |= TCP_OPTION_INSERT_MSS;
+			}
+			else if (kind == TCP_OPT_WSCALE && rule->windowScale >= 0)
+			{
+				rule->insert |= TCP_OPTION_INSERT_WSCALE;
+			}
+			else if (kind == TCP_OPT_SACK_PERM)
+			{
+				rule->insert |= TCP_OPTION_INSERT_SACK_PERM;
+			}
+			else if (kind == TCP_OPT_MSS || kind == TCP_OPT_WSCALE)
+			{
+				return "inserting an option requires its value";
+			}
+			else
+			{
+				// Timestamps would have to be added to every later segment of the connection.
+				return "only mss, windowScale and sackPermitted can be inserted";
+			}
+		}
+	}
+	return "";
+}
+
+/**
+ * @brief Replaces all rules.
+ * @param info Contains an array of rule objects, evaluated in order.
+ * @return Undefined.
+ * @throws TypeError naming the first invalid rule, the previous rules stay active.
+ */
+Napi::Value TcpOptionRewriterWrap::setRules(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	if (info.Length() < 1 || !info[0].IsArray())
+	{
+		Napi::TypeError::New(env, "Array of rules expected").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	Napi::Array array = info[0].As<Napi::Array>();
+	std::vector<TcpOptionRule> rules(array.Length());
+	for (uint32_t i = 0; i < array.Length(); i++)
+	{
+		Napi::Value value = array.Get(i);
+		std::string error = value.IsObject() ? ParseRule(value.As<Napi::Object>(), &rules[i]) : "object expected";
+		if (!error.empty())
+		{
+			Napi::TypeError::New(env, "Invalid TCP option rule " + std::to_string(i) + ": " + error).ThrowAsJavaScriptException();
+			return env.Undefined();
+		}
+	}
+	this->stage_->SetRules(std::move(rules));
+	return env.Undefined();
+}
+
+/**
+ * @brief Returns the stage counters.
+ * @return Object with matched, rewritten, resized, clamped, stripped, inserted and malformed.
+ */
+Napi::Value TcpOptionRewriterWrap::stats(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	TcpOptionStats stats;
+	this->stage_->GetStats(&stats);
+	Napi::Object result = Napi::Object::New(env);
+	result.Set("matched", Napi::Number::New(env, static_cast<double>(stats.matched)));
+	result.Set("rewritten", Napi::Number::New(env, static_cast<double>(stats.rewritten)));
+	result.Set("resized", Napi::Number::New(env, static_cast<double>(stats.resized)));
+	result.Set("clamped", Napi::Number::New(env, static_cast<double>(stats.clamped)));
+	result.Set("stripped", Napi::Number::New(env, static_cast<double>(stats.stripped)));
+	result.Set("inserted", Napi::Number::New(env, static_cast<double>(stats.inserted)));
+	result.Set("malformed", Napi::Number::New(env, static_cast<double>(stats.malformed)));
+	return result;
+}
@@ -0,0 +1,53 @@
+/**
+ * @file node-tcp-option-rewriter.h
+ * @brief Node.js wrapper of the TCP option rewriting stage
+ *
+ * A TcpOptionRewriter object is attached to NETWORK layer handles with WinDivert.attachStage;
+ * JavaScript only replaces its rules and reads its counters, segments are rewritten in the
+ * receive thread.
+ */
+
+#ifndef NODE_TCP_OPTION_REWRITER_H_
+#define NODE_TCP_OPTION_REWRITER_H_
+
+#define NAPI_VERSION 4
+#include <napi.h>
+#include <memory>
+#include "tcp-option-rewriter.h"
+#include "node-stage.h"
+
+/**
+ * @class TcpOptionRewriterWrap
+ * @brief JavaScript TcpOptionRewriter class
+ */
+class TcpOptionRewriterWrap : public StageWrap<TcpOptionRewriterWrap, TcpOptionRewriterStage> {
+	public:
+		/**
+		 * @brief Registers the TcpOptionRewriter class
+		 * @param env The Node.js environment
+		 * @param exports The exports object to attach the class to
+		 * @return The modified exports object
+		 */
+		static Napi::Object Init(Napi::Env env, Napi::Object exports);
+
+		/**
+		 * @brief Constructor
+		 * @param info Unused
+		 */
+		TcpOptionRewriterWrap(const Napi::CallbackInfo& info);
+
+	private:
+		/**
+		 * @brief Replaces all rules
+		 * @param info Contains an array of rule objects
+		 * @return Undefined
+		 */
+		Napi::Value setRules(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Returns the stage counters
+		 */
+		Napi::Value stats(const Napi::CallbackInfo& info);
+};
+
+#endif
@@ -13,11 +13,73 @@
 #include <napi.h>
 #include <iostream>
 #include "windivert.h"
+#include "packet.h"
+#include "packet-ring.h"
+#include "send-batch.h"
+#include "address-columns.h"
+#include "node-flow-index.h"
+#include "packet-stage.h"
+#include "reject.h"
+#include "node-nat.h"
+#include "node-shaper.h"
+#include "node-policer.h"
+#include "node-sampler.h"
+#include "node-flow-cache.h"
+#include "node-http-rewriter.h"
+#include "node-seq-tracker.h"
+#include "node-fake-injector.h"
+#include "node-hop-estimator.h"
+#include "node-fragmenter.h"
+#include "node-disorder.h"
+#include "node-tcp-option-rewriter.h"
+#include "node-compiled-filter.h"
+#include "node-pipeline.h"
+#include "packet-sink.h"
 #include <thread>
 #include <atomic>
 #include <codecvt>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <chrono>
 
 #define MAXBUF  WINDIVERT_MTU_MAX
+#define BATCH_PACKET_RESERVE 2048
+#define RING_RECV_BATCH 32
+#define RING_LANES_MAX 32
+
+/**
+ * @enum RecvMode
+ * @brief How the receive thread delivers packets
+ */
+enum RecvMode {
+	RECV_PACKETS,       ///< One callback per packet
+	RECV_BATCHES,       ///< One callback per credited batch
+	RECV_RING,          ///< Shared memory lanes, verdicts returned through the lanes
+	RECV_SINK           ///< Counted, sampled or dropped natively, no per-packet callback
+};
+
+/**
+ * @enum RingAffinity
+ * @brief How packets are distributed over ring lanes
+ */
+enum RingAffinity {
+	RING_AFFINITY_FLOW = 0,         ///< All packets of a flow go to the same lane
+	RING_AFFINITY_ROUND_ROBIN = 1   ///< Packets are spread evenly over the lanes
+};
+
+/**
+ * @struct PacketBatch
+ * @brief Packets and addresses returned by a single WinDivertRecvEx call
+ */
+struct PacketBatch {
+	std::vector<char> data;                  ///< Concatenated packet data
+	std::vector<WINDIVERT_ADDRESS> addrs;    ///< One address per packet
+	std::vector<UINT32> offsets;             ///< Packet boundaries into data (count + 1 entries)
+	std::vector<UINT64> columns;             ///< Addresses decoded by DecodeAddressColumns, 8 byte aligned
+};
 
 using namespace std;
 
@@ -65,6 +127,55 @@ class WinDivert : public Napi::ObjectWrap<WinDivert> {
 		 */
 		Napi::Value recv(const Napi::CallbackInfo& info);
 
+		/**
+		 * @brief Starts credit-driven batched packet reception
+		 * @param info Contains callback function, batch size and initial credits
+		 * @return Undefined
+		 */
+		Napi::Value recvBatch(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Starts delivering packets into SharedArrayBuffer lanes
+		 * @param info Contains doorbell callback, lane views, slot count, slot size and affinity
+		 * @return Undefined
+		 */
+		Napi::Value recvRing(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Starts consuming packets natively into a PacketSink
+		 * @param info Contains the optional sink options
+		 * @return Undefined
+		 */
+		Napi::Value recvSink(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Reads the counters of the sink started by recvSink
+		 * @param info Not used
+		 * @return Object with the counters, or undefined if no sink was started
+		 */
+		Napi::Value sinkStats(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Joins the handle to a FlowIndex
+		 * @param info Contains the FlowIndex object
+		 * @return Undefined
+		 */
+		Napi::Value attachFlowIndex(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Appends a native stage to the handle's StageChain
+		 * @param info Contains the stage object
+		 * @return Undefined
+		 */
+		Napi::Value attachStage(const Napi::CallbackInfo& info);
+
+		/**
+		 * @brief Grants read credits to the batched receiver
+		 * @param info Contains the number of batches the consumer can accept, negative to take credits back
+		 * @return Number of credits now available
+		 */
+		Napi::Value credit(const Napi::CallbackInfo& info);
+
 		/**
 		 * @brief Closes the WinDivert handle
 		 * @param info Not used
@@ -72,19 +183,26 @@ class WinDivert : public Napi::ObjectWrap<WinDivert> {
 		 */
 		Napi::Value close(const Napi::CallbackInfo& info);
 
+		/**
+		 * @brief Opens a handle for a new filter one priority above the current one and retires the old handle
+		 * @param info Contains the filter string or CompiledFilter
+		 * @return Promise resolved with the switchover metrics once the old handle is closed
+		 */
+		Napi::Value replaceFilter(const Napi::CallbackInfo& info);
+
 		/**
 		 * @brief Sends a packet through WinDivert
 		 * @param info Contains packet data and address
 		 * @return Boolean indicating success
 		 */
-		Napi::Value WinDivert::send(const Napi::CallbackInfo& info);
+		Napi::Value send(const Napi::CallbackInfo& info);
 
 		/**
 		 * @brief Calculates packet checksums
 		 * @param info Contains packet and flags
 		 * @return Object with calculated checksums
 		 */
-		Napi::Value WinDivert::HelperCalcChecksums(const Napi::CallbackInfo& info);
+		Napi::Value HelperCalcChecksums(const Napi::CallbackInfo& info);
 
 		/**
 		 * @brief Starts the packet receiving thread
@@ -100,14 +218,153 @@ class WinDivert : public Napi::ObjectWrap<WinDivert> {
 		 * @brief Main thread function for packet reception
 		 */
 		void ThreadFunction();
-		
+
+		/**
+		 * @brief Receives one packet at a time and calls the JavaScript callback for each
+		 */
+		void ReceivePackets();
+
+		/**
+		 * @brief Receives packet batches, waiting for a read credit before each batch
+		 */
+		void ReceiveBatches();
+
+		/**
+		 * @brief Receives packet batches and publishes them to the ring lanes
+		 */
+		void ReceiveToRing();
+
+		/**
+		 * @brief Receives packet batches and hands every packet to the sink
+		 */
+		void ReceiveToSink();
+
+		/**
+		 * @brief Applies verdicts returned through the ring lanes
+		 */
+		void VerdictThreadFunction();
+
+		/**
+		 * @brief Picks the lane for a packet according to ringAffinity_
+		 * @param packet Packet data
+		 * @param length Packet length
+		 * @param addr Packet address
+		 * @return Lane index
+		 */
+		UINT32 SelectLane(const UINT8* packet, UINT length, const WINDIVERT_ADDRESS& addr);
+
+		/**
+		 * @brief Wakes sleeping lane consumers through the doorbell callback
+		 * @param lanes Bit mask of lanes that received packets
+		 */
+		void RingDoorbell(UINT32 lanes);
+
+		/**
+		 * @brief Blocks until a ring lane has a free slot
+		 * @return false if the handle is closing
+		 */
+		bool AcquireSlot(PacketRingLane* lane);
+
+		/**
+		 * @brief Blocks until a read credit is available or the handle is closing
+		 * @return false if the receiver should stop
+		 */
+		bool AcquireCredit();
+
+		/**
+		 * @brief Splits a received batch into per-packet offsets
+		 * @param batch Batch whose data and addrs are already filled
+		 */
+		static void SplitBatch(PacketBatch* batch);
+
+		/**
+		 * @brief Feeds FLOW/SOCKET events into the flow index, or attributes NETWORK packets to processes
+		 * @param batch Split batch whose columns are already decoded
+		 */
+		void IndexBatch(PacketBatch* batch);
+
+		/**
+		 * @brief Runs a received packet through the attached stages
+		 * @param packet Packet data, may be rewritten
+		 * @param length Packet length
+		 * @param addr Packet address, may be rewritten
+		 * @param now GetTickCount64 of the receive batch
+		 * @param send Batch passed packets and packets emitted by stages are added to
+		 * @return true if the packet is still to be delivered to JavaScript
+		 */
+		bool ProcessStages(UINT8* packet, UINT length, WINDIVERT_ADDRESS* addr, UINT64 now, SendBatch& send);
+
+		/**
+		 * @brief Runs a split batch through the attached stages and compacts it to the delivered packets
+		 * @param batch Split batch
+		 * @param send Batch for passed and emitted packets
+		 * @return false if no packet is left to deliver
+		 */
+		bool FilterBatch(PacketBatch* batch, SendBatch& send);
+
+		/**
+		 * @brief Moves the receive thread to the pending handle once the old one is drained
+		 * @param direct Receive thread batch, flushed and moved to the new handle
+		 * @return true if the thread is to keep receiving on the new handle
+		 */
+		bool SwitchHandle(SendBatch& direct);
+
+		/**
+		 * @brief Closes the retired handle and resolves the replaceFilter promise
+		 * @param env The Node.js environment
+		 * @param drainedAt Steady clock time in microseconds at which the old handle ran dry
+		 */
+		void FinishReplace(Napi::Env env, UINT64 drainedAt);
+
+		/**
+		 * @brief Closes handles left by an unfinished replaceFilter after the threads are stopped
+		 */
+		void CloseReplaceHandles();
+
 		string filter_;                  ///< WinDivert filter string
 		UINT32 flags_;                  ///< WinDivert operation flags
 		UINT32 layer_;                  ///< WinDivert operation layer
-		HANDLE handle_;                 ///< WinDivert handle
+		INT16 priority_;                ///< WinDivert handle priority, switched by replaceFilter
+		INT16 basePriority_;            ///< Priority the handle was created with
+		std::atomic<HANDLE> handle_;    ///< WinDivert handle
+
+		std::atomic<HANDLE> pendingHandle_;    ///< Handle opened by replaceFilter, waiting for the old one to drain
+		HANDLE retiredHandle_;                 ///< Drained handle waiting to be closed on the JavaScript thread
+		std::atomic<UINT32> handleGeneration_; ///< Bumped by the receive thread on every switch
+		std::atomic<UINT32> verdictGeneration_; ///< Generation the verdict thread injects on
+		std::atomic<UINT64> drainedAt_;        ///< Steady clock time in microseconds the receive thread left the old handle
+		std::atomic<UINT64> drained_;          ///< Packets read from the old handle during the switch
+		UINT64 replaceStart_;                  ///< Steady clock time in microseconds of the replaceFilter call
+		std::unique_ptr<Napi::Promise::Deferred> replaceDeferred_; ///< Promise returned by replaceFilter
 
 		Napi::ThreadSafeFunction tsfn;  ///< Thread-safe function for callbacks
 		std::thread recvThread;         ///< Packet receiving thread
 		std::atomic<int> closeFlag;     ///< Flag to signal thread closure			
+
+		RecvMode recvMode_;             ///< Active delivery mode
+		UINT32 batchSize_;              ///< Packets per batch in RECV_BATCHES mode
+		int credits;                    ///< Batches the JavaScript consumer can accept
+		std::mutex creditMutex;         ///< Guards credits
+		std::condition_variable creditCond; ///< Signalled when credits are granted or on close
+
+		std::vector<std::unique_ptr<PacketRingLane>> ringLanes;       ///< Lanes in RECV_RING mode
+		std::vector<Napi::Reference<Napi::Uint8Array>> ringRefs;      ///< Keeps lane memory alive
+		UINT32 ringAffinity_;           ///< RingAffinity of the lanes
+		UINT32 ringNext_;               ///< Next lane for round-robin affinity
+		std::thread verdictThread;      ///< Applies verdicts from the lanes
+		std::mutex ringMutex;           ///< Used to wait for free slots
+		std::condition_variable ringCond; ///< Signalled when slots are released
+		std::shared_ptr<std::atomic<UINT32>> doorbellMask; ///< Lanes with a doorbell call pending
+
+		std::shared_ptr<FlowIndex> flowIndex_; ///< Joined flow index, may be empty
+		StageChain stages_;             ///< Native stages run before delivery
+		std::unique_ptr<PacketSink> sink_; ///< Sink of RECV_SINK mode, kept after close for its counters
 };
+
+#ifdef WINDIVERT_MOCK
+/**
+ * @brief Exports mockConfigure and mockStats, see mock/mock-binding.cc
+ */
+void InitMock(Napi::Env env, Napi::Object exports);
+#endif
 #endif
\ No newline at end of file
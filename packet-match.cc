@@ -0,0 +1,92 @@
+/**
+ * @file packet-match.cc
+ * @brief Packet classification shared by the rule based stages
+ */
+
+#include "packet-match.h"
+
+void PacketMatchAny(PacketMatch *match)
+{
+	std::memset(match, 0, sizeof(PacketMatch));
+	match->outbound = -1;
+	match->src.any = true;
+	match->dst.any = true;
+	match->srcPortMax = 65535;
+	match->dstPortMax = 65535;
+}
+
+bool ParsePrefix(const std::string &text, AddressPrefix *prefix)
+{
+	std::memset(prefix, 0, sizeof(AddressPrefix));
+	if (text.empty() || text == "*")
+	{
+		prefix->any = true;
+		return true;
+	}
+	const size_t slash = text.find('/');
+	if (!ParseAddress(text.substr(0, slash).c_str(), prefix->bytes, &prefix->ipv6))
+	{
+		return false;
+	}
+	const uint32_t maxLength = prefix->ipv6 ? 128 : 32;
+	prefix->length = static_cast<uint8_t>(maxLength);
+	if (slash != std::string::npos)
+	{
+		const std::string length = text.substr(slash + 1);
+		if (length.empty() || length.size() > 3 || length.find_first_not_of("0123456789") != std::string::npos ||
+			static_cast<uint32_t>(std::stoul(length)) > maxLength)
+		{
+			return false;
+		}
+		prefix->length = static_cast<uint8_t>(std::stoul(length));
+	}
+	return true;
+}
+
+bool PrefixContains(const AddressPrefix &prefix, const uint8_t *addr, bool ipv6)
+{
+	if (prefix.any)
+	{
+		return true;
+	}
+	if (prefix.ipv6 != ipv6)
+	{
+		return false;
+	}
+	const uint32_t bytes = prefix.length / 8;
+	const uint32_t bits = prefix.length % 8;
+	if (std::memcmp(prefix.bytes, addr, bytes) != 0)
+	{
+		return false;
+	}
+	if (bits == 0)
+	{
+		return true;
+	}
+	const uint8_t mask = static_cast<uint8_t>(0xFF << (8 - bits));
+	return (prefix.bytes[bytes] & mask) == (addr[bytes] & mask);
+}
+
+bool MatchFields(const PacketMatch &match, const uint8_t *src, const uint8_t *dst, bool ipv6, uint8_t protocol,
+				 uint16_t srcPort, uint16_t dstPort, const WINDIVERT_ADDRESS &addr)
+{
+	return (match.protocol == 0 || match.protocol == protocol) &&
+		   (match.outbound < 0 || match.outbound == static_cast<int8_t>(addr.Outbound)) &&
+		   (!addr.Impostor || match.matchImpostor) &&
+		   srcPort >= match.srcPortMin && srcPort <= match.srcPortMax &&
+		   dstPort >= match.dstPortMin && dstPort <= match.dstPortMax &&
+		   PrefixContains(match.src, src, ipv6) && PrefixContains(match.dst, dst, ipv6);
+}
+
+bool MatchPacket(const PacketMatch &match, const uint8_t *data, const PacketInfo &info, const WINDIVERT_ADDRESS &addr)
+{
+	const bool ipv6 = info.version == 6;
+	uint16_t srcPort = 0;
+	uint16_t dstPort = 0;
+	if ((info.protocol == PACKET_PROTO_TCP || info.protocol == PACKET_PROTO_UDP) && info.transportLength > 0)
+	{
+		srcPort = ReadBE16(data + info.transportOffset);
+		dstPort = ReadBE16(data + info.transportOffset + 2);
+	}
+	return MatchFields(match, data + (ipv6 ? 8 : 12), data + (ipv6 ? 24 : 16), ipv6, info.protocol, srcPort, dstPort, addr);
+}
@@ -0,0 +1,89 @@
+/**
+ * @file packet-match.h
+ * @brief Packet classification shared by the rule based stages
+ *
+ * A PacketMatch selects packets by protocol, direction, address prefixes and port ranges.
+ * Stages evaluate their rules in order and use the first whose PacketMatch accepts the
+ * packet.
+ */
+
+#ifndef PACKET_MATCH_H_
+#define PACKET_MATCH_H_
+
+#include <cstdint>
+#include <string>
+#include "windivert.h"
+#include "packet.h"
+
+/**
+ * @struct AddressPrefix
+ * @brief Address prefix in network order
+ */
+struct AddressPrefix {
+	bool any;             ///< Matches every address of both families
+	bool ipv6;            ///< Address family
+	uint8_t length;       ///< Prefix length in bits
+	uint8_t bytes[16];    ///< Prefix address
+};
+
+/**
+ * @struct PacketMatch
+ * @brief Match part of a stage rule
+ */
+struct PacketMatch {
+	uint8_t protocol;         ///< Transport protocol, 0 for any
+	int8_t outbound;          ///< 1 outbound, 0 inbound, -1 either direction
+	bool matchImpostor;       ///< Also match impostor packets
+	AddressPrefix src;        ///< Source prefix
+	AddressPrefix dst;        ///< Destination prefix
+	uint16_t srcPortMin;      ///< Source port range, packets without ports have port 0
+	uint16_t srcPortMax;
+	uint16_t dstPortMin;      ///< Destination port range
+	uint16_t dstPortMax;
+};
+
+/**
+ * @brief Resets a match to accept every packet
+ */
+void PacketMatchAny(PacketMatch *match);
+
+/**
+ * @brief Parses "address" or "address/length"
+ * @param text Prefix text, "*" or an empty string matches any address
+ * @param prefix Receives the prefix
+ * @return false if text is not a prefix
+ */
+bool ParsePrefix(const std::string &text, AddressPrefix *prefix);
+
+/**
+ * @brief Tests whether an address lies in a prefix
+ * @param prefix Prefix
+ * @param addr Address in network order
+ * @param ipv6 Address family
+ */
+bool PrefixContains(const AddressPrefix &prefix, const uint8_t *addr, bool ipv6);
+
+/**
+ * @brief Tests a packet given by its fields
+ * @param match Match to evaluate
+ * @param src Source address in network order
+ * @param dst Destination address in network order
+ * @param ipv6 Address family
+ * @param protocol Transport protocol
+ * @param srcPort Source port, 0 if the packet has none
+ * @param dstPort Destination port, 0 if the packet has none
+ * @param addr Packet address for the direction and impostor flags
+ */
+bool MatchFields(const PacketMatch &match, const uint8_t *src, const uint8_t *dst, bool ipv6, uint8_t protocol,
+				 uint16_t srcPort, uint16_t dstPort, const WINDIVERT_ADDRESS &addr);
+
+/**
+ * @brief Tests a parsed packet
+ * @param match Match to evaluate
+ * @param data Packet data
+ * @param info Parsed headers
+ * @param addr Packet address
+ */
+bool MatchPacket(const PacketMatch &match, const uint8_t *data, const PacketInfo &info, const WINDIVERT_ADDRESS &addr);
+
+#endif
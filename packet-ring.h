@@ -0,0 +1,240 @@
+/**
+ * @file packet-ring.h
+ * @brief Shared memory packet lanes consumed by worker_threads
+ *
+ * A lane is a single SharedArrayBuffer split into a control block, per-slot packet
+ * lengths, per-slot WINDIVERT_ADDRESS copies, a verdict ring and the slot data area.
+ * A verdict is two Int32 words: the slot id with the action in the top byte, and the
+ * new packet length or 0 to keep the received length.
+ * The receive thread is the only producer of packets and the only consumer of verdicts;
+ * one JavaScript worker consumes packets and produces verdicts. Indices are free running
+ * 32-bit counters shared with JavaScript through Atomics, so the layout below must match
+ * ring.js.
+ */
+
+#ifndef PACKET_RING_H_
+#define PACKET_RING_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <atomic>
+#include <memory>
+
+#define RING_CONTROL_BYTES   512
+#define RING_HEAD            0      ///< Packet producer index (native)
+#define RING_TAIL            16     ///< Packet consumer index (worker)
+#define RING_VERDICT_HEAD    32     ///< Verdict producer index (worker)
+#define RING_VERDICT_TAIL    48     ///< Verdict consumer index (native)
+#define RING_WAITING         64     ///< Non-zero while the worker sleeps in Atomics.wait
+#define RING_OVERSIZE        80     ///< Packets too large for a slot, reinjected natively
+#define RING_ADDRESS_SIZE    80     ///< sizeof(WINDIVERT_ADDRESS)
+#define RING_VERDICT_WORDS   2
+#define RING_SLOT_MASK       0x00FFFFFFu
+#define RING_ACTION_SHIFT    24
+
+/**
+ * @enum RingAction
+ * @brief What the verdict thread does with a slot
+ */
+enum RingAction {
+	RING_ACTION_PASS = 0,           ///< Reinject the slot unchanged
+	RING_ACTION_DROP = 1,           ///< Drop the packet
+	RING_ACTION_PASS_CHECKSUM = 2   ///< Recalculate checksums, then reinject
+};
+
+static_assert(sizeof(std::atomic<int32_t>) == sizeof(int32_t), "lock-free int32 atomics required");
+
+/**
+ * @struct RingLayout
+ * @brief Byte offsets of the regions of one lane
+ */
+struct RingLayout {
+	uint32_t slots;             ///< Slot count, a power of two
+	uint32_t slotSize;          ///< Bytes of packet data per slot
+	size_t lengthsOffset;       ///< Int32 packet length per slot
+	size_t addrsOffset;         ///< WINDIVERT_ADDRESS per slot
+	size_t verdictsOffset;      ///< Verdict ring, RING_VERDICT_WORDS Int32 per entry
+	size_t dataOffset;          ///< Slot data, 64 byte aligned
+	size_t byteLength;          ///< Total lane size
+
+	RingLayout(uint32_t slots, uint32_t slotSize) : slots(slots), slotSize(slotSize)
+	{
+		lengthsOffset = RING_CONTROL_BYTES;
+		addrsOffset = lengthsOffset + slots * sizeof(int32_t);
+		verdictsOffset = addrsOffset + static_cast<size_t>(slots) * RING_ADDRESS_SIZE;
+		dataOffset = (verdictsOffset + slots * RING_VERDICT_WORDS * sizeof(int32_t) + 63) & ~static_cast<size_t>(63);
+		byteLength = dataOffset + static_cast<size_t>(slots) * slotSize;
+	}
+};
+
+/**
+ * @class PacketRingLane
+ * @brief Native side of one lane
+ */
+class PacketRingLane {
+	public:
+		/**
+		 * @brief Attaches to lane memory owned by a SharedArrayBuffer
+		 * @param base Start of the lane
+		 * @param layout Lane layout, base must hold layout.byteLength bytes
+		 */
+		PacketRingLane(uint8_t *base, const RingLayout &layout)
+			: base_(base), layout_(layout), head_(0), verdictTail_(0),
+			  busy_(new std::atomic<uint8_t>[layout.slots]), lengths_(new uint32_t[layout.slots])
+		{
+			for (uint32_t i = 0; i < layout_.slots; i++)
+			{
+				busy_[i].store(0, std::memory_order_relaxed);
+				lengths_[i] = 0;
+			}
+			head_ = static_cast<uint32_t>(Word(RING_HEAD).load());
+			verdictTail_ = static_cast<uint32_t>(Word(RING_VERDICT_TAIL).load());
+		}
+
+		/**
+		 * @brief Returns true if the next slot can take a packet
+		 */
+		bool CanPublish() const
+		{
+			return busy_[head_ & (layout_.slots - 1)].load(std::memory_order_acquire) == 0;
+		}
+
+		/**
+		 * @brief Copies a packet into the next slot and makes it visible to the worker
+		 * @param packet Packet data, at most layout.slotSize bytes
+		 * @param length Packet length
+		 * @param addr WINDIVERT_ADDRESS of the packet
+		 * @return false if the next slot is still waiting for a verdict
+		 */
+		bool Publish(const void *packet, uint32_t length, const void *addr)
+		{
+			const uint32_t slot = head_ & (layout_.slots - 1);
+			if (busy_[slot].load(std::memory_order_acquire) != 0)
+			{
+				return false;
+			}
+			busy_[slot].store(1, std::memory_order_relaxed);
+			std::memcpy(SlotData(slot), packet, length);
+			std::memcpy(SlotAddr(slot), addr, RING_ADDRESS_SIZE);
+			Lengths()[slot] = static_cast<int32_t>(length);
+			lengths_[slot] = length;
+			head_++;
+			Word(RING_HEAD).store(static_cast<int32_t>(head_));
+			return true;
+		}
+
+		/**
+		 * @brief Returns true if the worker announced it is about to sleep
+		 */
+		bool ConsumerWaiting()
+		{
+			return Word(RING_WAITING).load() != 0;
+		}
+
+		/**
+		 * @brief Consumes all pending verdicts
+		 *
+		 * The verdict head is written by JavaScript, so at most one ring of verdicts is read per call
+		 * and verdicts naming a slot that is not waiting for one are skipped.
+		 * @param apply Called as apply(slot, action, newLength) for each verdict; it must call
+		 *              Release(slot) once the slot data is no longer needed
+		 * @return Number of verdicts consumed
+		 */
+		template <typename F>
+		size_t DrainVerdicts(F apply)
+		{
+			uint32_t verdictHead = static_cast<uint32_t>(Word(RING_VERDICT_HEAD).load());
+			if (verdictHead - verdictTail_ > layout_.slots)
+			{
+				verdictHead = verdictTail_ + layout_.slots;
+			}
+			size_t count = 0;
+			while (verdictTail_ != verdictHead)
+			{
+				volatile int32_t *verdict = Verdicts() + (verdictTail_ & (layout_.slots - 1)) * RING_VERDICT_WORDS;
+				const uint32_t entry = static_cast<uint32_t>(verdict[0]);
+				const uint32_t slot = (entry & RING_SLOT_MASK) & (layout_.slots - 1);
+				uint32_t newLength = static_cast<uint32_t>(verdict[1]);
+				if (newLength > layout_.slotSize)
+				{
+					newLength = 0;
+				}
+				if (busy_[slot].load(std::memory_order_acquire) != 0)
+				{
+					apply(slot, entry >> RING_ACTION_SHIFT, newLength);
+				}
+				verdictTail_++;
+				count++;
+			}
+			if (count > 0)
+			{
+				Word(RING_VERDICT_TAIL).store(static_cast<int32_t>(verdictTail_));
+			}
+			return count;
+		}
+
+		/**
+		 * @brief Returns a slot to the producer
+		 */
+		void Release(uint32_t slot)
+		{
+			busy_[slot].store(0, std::memory_order_release);
+		}
+
+		/**
+		 * @brief Adds to a statistics counter in the control block
+		 */
+		void Count(size_t word, int32_t value)
+		{
+			Word(word).fetch_add(value);
+		}
+
+		uint8_t *SlotData(uint32_t slot)
+		{
+			return base_ + layout_.dataOffset + static_cast<size_t>(slot) * layout_.slotSize;
+		}
+
+		uint8_t *SlotAddr(uint32_t slot)
+		{
+			return base_ + layout_.addrsOffset + static_cast<size_t>(slot) * RING_ADDRESS_SIZE;
+		}
+
+		/**
+		 * @brief Length the slot was published with, kept natively so JavaScript cannot change it
+		 */
+		uint32_t SlotLength(uint32_t slot)
+		{
+			return lengths_[slot];
+		}
+
+		const RingLayout &Layout() const
+		{
+			return layout_;
+		}
+
+	private:
+		std::atomic<int32_t> &Word(size_t index)
+		{
+			return *reinterpret_cast<std::atomic<int32_t> *>(base_ + index * sizeof(int32_t));
+		}
+
+		int32_t *Lengths()
+		{
+			return reinterpret_cast<int32_t *>(base_ + layout_.lengthsOffset);
+		}
+
+		volatile int32_t *Verdicts()
+		{
+			return reinterpret_cast<volatile int32_t *>(base_ + layout_.verdictsOffset);
+		}
+
+		uint8_t *base_;                              ///< Lane memory
+		RingLayout layout_;                          ///< Region offsets
+		uint32_t head_;                              ///< Local copy of RING_HEAD
+		uint32_t verdictTail_;                       ///< Local copy of RING_VERDICT_TAIL
+		std::unique_ptr<std::atomic<uint8_t>[]> busy_; ///< Slot waits for a verdict
+		std::unique_ptr<uint32_t[]> lengths_;        ///< Published length of each slot
+};
+
+#endif
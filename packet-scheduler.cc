@@ -0,0 +1,195 @@
+/**
+ * @file packet-scheduler.cc
+ * @brief Holds packet copies until a deadline and reinjects them with batched sends
+ */
+
+#include <chrono>
+#include "packet-scheduler.h"
+
+PacketScheduler::PacketScheduler(size_t maxBytes, UINT32 resolution)
+	: maxBytes_(maxBytes), resolution_(resolution > 0 ? resolution : 1), wakeAt_(UINT64_MAX), heldBytes_(0), held_(0),
+	  scheduled_(0), sent_(0), refused_(0), flushed_(0), failed_(0), stop_(false)
+{
+	this->wheel_ = TimerWheel(Now() / this->resolution_);
+}
+
+PacketScheduler::~PacketScheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex_);
+		this->stop_ = true;
+	}
+	this->wake_.notify_one();
+	if (this->thread_.joinable())
+	{
+		this->thread_.join();
+	}
+}
+
+UINT64 PacketScheduler::Now()
+{
+	return static_cast<UINT64>(std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+UINT64 PacketScheduler::Ticks(UINT64 time) const
+{
+	return (time + this->resolution_ - 1) / this->resolution_;
+}
+
+bool PacketScheduler::Schedule(HANDLE handle, const UINT8 *packet, UINT length, const WINDIVERT_ADDRESS &addr, UINT64 deadline)
+{
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	if (this->heldBytes_ + length > this->maxBytes_)
+	{
+		this->refused_++;
+		return false;
+	}
+	UINT32 id;
+	if (this->free_.empty())
+	{
+		id = static_cast<UINT32>(this->packets_.size());
+		this->packets_.emplace_back();
+	}
+	else
+	{
+		id = this->free_.back();
+		this->free_.pop_back();
+	}
+	HeldPacket &held = this->packets_[id];
+	held.handle = handle;
+	held.addr = addr;
+	held.data.assign(packet, packet + length);
+	this->heldBytes_ += length;
+	this->held_++;
+	this->scheduled_++;
+
+	// An idle wheel has not been advanced; catch it up so the deadline is not clamped.
+	if (this->wheel_.Size() == 0)
+	{
+		this->wheel_.Advance(Now() / this->resolution_, [](UINT32) {});
+	}
+	const UINT64 tick = Ticks(deadline);
+	this->wheel_.Schedule(id, tick);
+	if (!this->thread_.joinable())
+	{
+		this->thread_ = std::thread(&PacketScheduler::ThreadFunction, this);
+	}
+	else if (tick < this->wakeAt_)
+	{
+		this->wake_.notify_one();
+	}
+	return true;
+}
+
+SendBatch &PacketScheduler::BatchFor(HANDLE handle)
+{
+	for (const std::unique_ptr<SendBatch> &batch : this->batches_)
+	{
+		if (batch->Handle() == handle)
+		{
+			return *batch;
+		}
+	}
+	this->batches_.emplace_back(new SendBatch(handle));
+	return *this->batches_.back();
+}
+
+void PacketScheduler::ThreadFunction()
+{
+	std::unique_lock<std::mutex> lock(this->mutex_);
+	while (!this->stop_)
+	{
+		this->wakeAt_ = this->wheel_.NextExpiry();
+		if (this->wakeAt_ == UINT64_MAX)
+		{
+			this->wake_.wait(lock);
+		}
+		else
+		{
+			const UINT64 now = Now();
+			const UINT64 at = this->wakeAt_ * this->resolution_;
+			if (at > now)
+			{
+				this->wake_.wait_for(lock, std::chrono::microseconds(at - now));
+			}
+		}
+		if (this->stop_)
+		{
+			break;
+		}
+
+		this->wheel_.Advance(Now() / this->resolution_, [this](UINT32 id)
+		{
+			HeldPacket &held = this->packets_[id];
+			if (held.handle != NULL)
+			{
+				SendBatch &batch = BatchFor(held.handle);
+				const UINT64 failed = batch.Failed();
+				batch.Add(held.data.data(), static_cast<UINT>(held.data.size()), held.addr);
+				this->failed_ += batch.Failed() - failed;
+				this->heldBytes_ -= held.data.size();
+				this->held_--;
+				this->sent_++;
+				held.handle = NULL;
+			}
+			this->free_.push_back(id);
+		});
+
+		// Send without blocking Schedule; Detach waits on sendMutex_ so it never races a send.
+		std::unique_lock<std::mutex> sendLock(this->sendMutex_);
+		lock.unlock();
+		UINT64 failed = 0;
+		for (const std::unique_ptr<SendBatch> &batch : this->batches_)
+		{
+			const UINT64 before = batch->Failed();
+			batch->Flush();
+			failed += batch->Failed() - before;
+		}
+		sendLock.unlock();
+		lock.lock();
+		this->failed_ += failed;
+	}
+}
+
+void PacketScheduler::Detach(HANDLE handle)
+{
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	std::lock_guard<std::mutex> sendLock(this->sendMutex_);
+	SendBatch batch(handle);
+	for (HeldPacket &held : this->packets_)
+	{
+		if (held.handle != handle)
+		{
+			continue;
+		}
+		// The wheel still holds the id; it is released when it fires.
+		batch.Add(held.data.data(), static_cast<UINT>(held.data.size()), held.addr);
+		this->heldBytes_ -= held.data.size();
+		this->held_--;
+		this->flushed_++;
+		held.handle = NULL;
+	}
+	batch.Flush();
+	this->failed_ += batch.Failed();
+	for (auto it = this->batches_.begin(); it != this->batches_.end(); ++it)
+	{
+		if ((*it)->Handle() == handle)
+		{
+			this->batches_.erase(it);
+			break;
+		}
+	}
+}
+
+void PacketScheduler::GetStats(SchedulerStats *stats)
+{
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	stats->held = this->held_;
+	stats->heldBytes = this->heldBytes_;
+	stats->scheduled = this->scheduled_;
+	stats->sent = this->sent_;
+	stats->refused = this->refused_;
+	stats->flushed = this->flushed_;
+	stats->failed = this->failed_;
+}
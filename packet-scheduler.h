@@ -0,0 +1,128 @@
+/**
+ * @file packet-scheduler.h
+ * @brief Holds packet copies until a deadline and reinjects them with batched sends
+ *
+ * Stages hand a packet over with Schedule and return STAGE_HOLD; the scheduler copies it
+ * into a pooled buffer, files it in a TimerWheel and wakes its thread only when the new
+ * deadline is earlier than the one it sleeps for. The thread fires due packets and sends
+ * them with one WinDivertSendEx per handle and round. Held bytes are capped; packets over
+ * the cap are refused and the caller drops them.
+ */
+
+#ifndef PACKET_SCHEDULER_H_
+#define PACKET_SCHEDULER_H_
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "windivert.h"
+#include "send-batch.h"
+#include "timer-wheel.h"
+
+#define SCHEDULER_DEFAULT_MAX_BYTES  (64 * 1024 * 1024)
+#define SCHEDULER_DEFAULT_RESOLUTION 1000     ///< Microseconds per wheel tick
+
+/**
+ * @struct SchedulerStats
+ * @brief Counters since the scheduler was created
+ */
+struct SchedulerStats {
+	UINT64 held;          ///< Packets waiting
+	UINT64 heldBytes;     ///< Bytes waiting
+	UINT64 scheduled;     ///< Packets accepted
+	UINT64 sent;          ///< Packets reinjected at their deadline
+	UINT64 refused;       ///< Packets refused because maxBytes was reached
+	UINT64 flushed;       ///< Packets reinjected early because their handle was closing
+	UINT64 failed;        ///< Packets the driver rejected
+};
+
+/**
+ * @class PacketScheduler
+ * @brief Timer wheel of held packets with its own send thread
+ */
+class PacketScheduler {
+	public:
+		/**
+		 * @brief Creates an idle scheduler, its thread starts with the first packet
+		 * @param maxBytes Cap on held packet bytes
+		 * @param resolution Microseconds per tick, deadlines are rounded up to a tick
+		 */
+		PacketScheduler(size_t maxBytes, UINT32 resolution);
+
+		/**
+		 * @brief Stops the thread and discards held packets
+		 */
+		~PacketScheduler();
+
+		/**
+		 * @brief Monotonic clock the deadlines refer to
+		 * @return Microseconds
+		 */
+		static UINT64 Now();
+
+		/**
+		 * @brief Copies a packet and reinjects it at a deadline
+		 * @param handle Handle to send on; callers Detach it before closing it
+		 * @param packet Packet data
+		 * @param length Packet length
+		 * @param addr Address to send with
+		 * @param deadline Now() based time in microseconds
+		 * @return false if the packet would exceed maxBytes; it was not taken
+		 */
+		bool Schedule(HANDLE handle, const UINT8 *packet, UINT length, const WINDIVERT_ADDRESS &addr, UINT64 deadline);
+
+		/**
+		 * @brief Sends the held packets of a handle right away and forgets the handle
+		 * @param handle Handle about to be closed
+		 */
+		void Detach(HANDLE handle);
+
+		void GetStats(SchedulerStats *stats);
+
+	private:
+		/**
+		 * @struct HeldPacket
+		 * @brief Pooled packet copy, handle is NULL while the slot is free or cancelled
+		 */
+		struct HeldPacket {
+			HANDLE handle;
+			WINDIVERT_ADDRESS addr;
+			std::vector<UINT8> data;
+		};
+
+		/**
+		 * @brief Sleeps until the next deadline and sends what is due
+		 */
+		void ThreadFunction();
+
+		/**
+		 * @brief Returns the send batch of a handle, creating it on first use
+		 */
+		SendBatch &BatchFor(HANDLE handle);
+
+		UINT64 Ticks(UINT64 time) const;
+
+		size_t maxBytes_;                     ///< Cap on heldBytes_
+		UINT32 resolution_;                   ///< Microseconds per tick
+		std::mutex mutex_;                    ///< Guards everything below except batches_
+		std::mutex sendMutex_;                ///< Guards batches_; taken after mutex_, never before
+		std::condition_variable wake_;        ///< Signalled for earlier deadlines and on stop
+		TimerWheel wheel_;                    ///< Ids index packets_
+		std::vector<HeldPacket> packets_;     ///< Packet pool
+		std::vector<UINT32> free_;            ///< Unused pool ids
+		std::vector<std::unique_ptr<SendBatch>> batches_;   ///< One per handle seen
+		UINT64 wakeAt_;                       ///< Tick the thread sleeps until
+		size_t heldBytes_;
+		size_t held_;
+		UINT64 scheduled_;
+		UINT64 sent_;
+		UINT64 refused_;
+		UINT64 flushed_;
+		UINT64 failed_;
+		bool stop_;
+		std::thread thread_;                  ///< Started by the first Schedule
+};
+
+#endif
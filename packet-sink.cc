@@ -0,0 +1,203 @@
+/**
+ * @file packet-sink.cc
+ * @brief Consumes packets in the receive thread when no JavaScript needs to see them
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include "packet.h"
+#include "packet-sink.h"
+
+/**
+ * @struct PcapFileHeader
+ * @brief Classic pcap header with microsecond timestamps, written in host byte order
+ */
+struct PcapFileHeader {
+	UINT32 magic;
+	UINT16 versionMajor;
+	UINT16 versionMinor;
+	INT32 thisZone;
+	UINT32 sigFigs;
+	UINT32 snapLength;
+	UINT32 linkType;
+};
+
+/**
+ * @struct PcapRecordHeader
+ * @brief Header in front of each captured packet
+ */
+struct PcapRecordHeader {
+	UINT32 seconds;
+	UINT32 microseconds;
+	UINT32 capturedLength;
+	UINT32 originalLength;
+};
+
+PacketSink::PacketSink(const SinkConfig &config)
+	: config_(config), capture_(nullptr), untilSample_(1), packets_(0), bytes_(0), ipv4_(0), ipv6_(0), tcp_(0), udp_(0),
+	  icmp_(0), other_(0), inbound_(0), outbound_(0), reinjected_(0), sampled_(0), captureBytes_(0), captureErrors_(0),
+	  patternHits_(new std::atomic<UINT64>[config.patterns.size() + 1])
+{
+	for (size_t i = 0; i < this->config_.patterns.size(); i++)
+	{
+		this->patternHits_[i] = 0;
+		const std::string &pattern = this->config_.patterns[i];
+		std::boyer_moore_horspool_searcher<std::string::const_iterator> searcher(pattern.begin(), pattern.end());
+		this->searchers_.push_back([searcher](const char *first, const char *last)
+		{
+			return std::search(first, last, searcher) != last;
+		});
+	}
+}
+
+PacketSink::~PacketSink()
+{
+	this->Close();
+}
+
+std::string PacketSink::Open()
+{
+	if (this->config_.capturePath.empty() || this->config_.sampleRate == 0 || this->capture_ != nullptr)
+	{
+		return "";
+	}
+	this->capture_ = std::fopen(this->config_.capturePath.c_str(), "wb");
+	if (this->capture_ == nullptr)
+	{
+		return "Cannot create capture file " + this->config_.capturePath;
+	}
+	this->captureBuffer_.resize(SINK_CAPTURE_BUFFER);
+	std::setvbuf(this->capture_, this->captureBuffer_.data(), _IOFBF, this->captureBuffer_.size());
+	const PcapFileHeader header = {0xA1B2C3D4, 2, 4, 0, 0, this->config_.snapLength, SINK_LINKTYPE_RAW};
+	if (std::fwrite(&header, sizeof(header), 1, this->capture_) != 1)
+	{
+		std::fclose(this->capture_);
+		this->capture_ = nullptr;
+		return "Cannot write capture file " + this->config_.capturePath;
+	}
+	this->captureBytes_ = sizeof(header);
+	return "";
+}
+
+bool PacketSink::Consume(const UINT8 *packet, UINT length, const WINDIVERT_ADDRESS &addr)
+{
+	Bump(this->packets_, 1);
+	Bump(this->bytes_, length);
+	Bump(addr.Outbound ? this->outbound_ : this->inbound_, 1);
+
+	PacketInfo info;
+	if (ParsePacket(packet, length, &info))
+	{
+		Bump(info.version == 4 ? this->ipv4_ : this->ipv6_, 1);
+		switch (info.protocol)
+		{
+			case PACKET_PROTO_TCP:
+				Bump(this->tcp_, 1);
+				break;
+			case PACKET_PROTO_UDP:
+				Bump(this->udp_, 1);
+				break;
+			case PACKET_PROTO_ICMP:
+			case PACKET_PROTO_ICMPV6:
+				Bump(this->icmp_, 1);
+				break;
+			default:
+				Bump(this->other_, 1);
+				break;
+		}
+		if (info.payloadLength > 0)
+		{
+			const char *payload = reinterpret_cast<const char *>(packet + info.payloadOffset);
+			for (size_t i = 0; i < this->searchers_.size(); i++)
+			{
+				if (this->searchers_[i](payload, payload + info.payloadLength))
+				{
+					Bump(this->patternHits_[i], 1);
+				}
+			}
+		}
+	}
+	else
+	{
+		Bump(this->other_, 1);
+	}
+
+	// Events of the flow, socket and reflect layers have no packet to record.
+	if (length > 0 && this->capture_ != nullptr && --this->untilSample_ == 0)
+	{
+		this->untilSample_ = this->config_.sampleRate;
+		this->Capture(packet, length);
+	}
+	if (this->config_.reinject)
+	{
+		Bump(this->reinjected_, 1);
+	}
+	return this->config_.reinject;
+}
+
+void PacketSink::Capture(const UINT8 *packet, UINT length)
+{
+	// Driver timestamps are performance counter ticks; records carry the wall clock instead.
+	const UINT64 now = static_cast<UINT64>(std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count());
+	const UINT32 captured = std::min<UINT32>(length, this->config_.snapLength);
+	const PcapRecordHeader header = {static_cast<UINT32>(now / 1000000), static_cast<UINT32>(now % 1000000), captured, length};
+	if (std::fwrite(&header, sizeof(header), 1, this->capture_) != 1 ||
+		std::fwrite(packet, 1, captured, this->capture_) != captured)
+	{
+		Bump(this->captureErrors_, 1);
+		return;
+	}
+	Bump(this->sampled_, 1);
+	Bump(this->captureBytes_, sizeof(header) + captured);
+}
+
+void PacketSink::Flush()
+{
+	if (this->capture_ != nullptr && std::fflush(this->capture_) != 0)
+	{
+		Bump(this->captureErrors_, 1);
+	}
+}
+
+void PacketSink::Close()
+{
+	if (this->capture_ != nullptr)
+	{
+		if (std::fclose(this->capture_) != 0)
+		{
+			Bump(this->captureErrors_, 1);
+		}
+		this->capture_ = nullptr;
+	}
+}
+
+void PacketSink::GetStats(SinkStats *stats) const
+{
+	stats->packets = this->packets_.load(std::memory_order_relaxed);
+	stats->bytes = this->bytes_.load(std::memory_order_relaxed);
+	stats->ipv4 = this->ipv4_.load(std::memory_order_relaxed);
+	stats->ipv6 = this->ipv6_.load(std::memory_order_relaxed);
+	stats->tcp = this->tcp_.load(std::memory_order_relaxed);
+	stats->udp = this->udp_.load(std::memory_order_relaxed);
+	stats->icmp = this->icmp_.load(std::memory_order_relaxed);
+	stats->other = this->other_.load(std::memory_order_relaxed);
+	stats->inbound = this->inbound_.load(std::memory_order_relaxed);
+	stats->outbound = this->outbound_.load(std::memory_order_relaxed);
+	stats->reinjected = this->reinjected_.load(std::memory_order_relaxed);
+	stats->sampled = this->sampled_.load(std::memory_order_relaxed);
+	stats->captureBytes = this->captureBytes_.load(std::memory_order_relaxed);
+	stats->captureErrors = this->captureErrors_.load(std::memory_order_relaxed);
+	stats->patterns.resize(this->config_.patterns.size());
+	for (size_t i = 0; i < stats->patterns.size(); i++)
+	{
+		stats->patterns[i] = this->patternHits_[i].load(std::memory_order_relaxed);
+	}
+}
+
+const SinkConfig &PacketSink::Config() const
+{
+	return this->config_;
+}
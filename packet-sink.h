@@ -0,0 +1,146 @@
+/**
+ * @file packet-sink.h
+ * @brief Consumes packets in the receive thread when no JavaScript needs to see them
+ *
+ * A sink counts packets by family, protocol and direction, optionally writes every Nth
+ * packet to a pcap file and optionally counts the packets whose payload contains one of a
+ * few byte patterns. Counters have a single writer, the receive thread, and are read on
+ * demand from the JavaScript thread, so nothing is queued and no callback is made.
+ */
+
+#ifndef PACKET_SINK_H_
+#define PACKET_SINK_H_
+
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "windivert.h"
+
+#define SINK_MAX_PATTERNS 32
+#define SINK_DEFAULT_SNAPLEN 256
+#define SINK_CAPTURE_BUFFER (64 * 1024)
+#define SINK_LINKTYPE_RAW 101            ///< pcap link type of packets starting with the IP header
+
+/**
+ * @struct SinkConfig
+ * @brief What a sink does with each packet besides counting it
+ */
+struct SinkConfig {
+	bool reinject;                       ///< Send packets back unchanged instead of dropping them
+	std::string capturePath;             ///< pcap file, empty for no capture
+	UINT32 sampleRate;                   ///< Write one packet in sampleRate to the capture file
+	UINT32 snapLength;                   ///< Bytes of each packet written
+	std::vector<std::string> patterns;   ///< Byte strings searched for in transport payloads
+};
+
+/**
+ * @struct SinkStats
+ * @brief Counters since the sink was created
+ */
+struct SinkStats {
+	UINT64 packets;
+	UINT64 bytes;
+	UINT64 ipv4;
+	UINT64 ipv6;
+	UINT64 tcp;
+	UINT64 udp;
+	UINT64 icmp;
+	UINT64 other;            ///< Other transports and packets that do not parse
+	UINT64 inbound;
+	UINT64 outbound;
+	UINT64 reinjected;       ///< Packets handed back for injection
+	UINT64 sampled;          ///< Packets written to the capture file
+	UINT64 captureBytes;     ///< Bytes written to the capture file, headers included
+	UINT64 captureErrors;    ///< Failed writes
+	std::vector<UINT64> patterns;   ///< Packets matching each pattern
+};
+
+/**
+ * @class PacketSink
+ * @brief Counters, sampled capture and pattern counts of one handle
+ */
+class PacketSink {
+	public:
+		/**
+		 * @param config What to do besides counting; sampleRate 0 disables capture
+		 */
+		explicit PacketSink(const SinkConfig &config);
+
+		/**
+		 * @brief Flushes and closes the capture file
+		 */
+		~PacketSink();
+
+		/**
+		 * @brief Creates the capture file and writes the pcap header
+		 * @return Error message, empty on success or if there is nothing to open
+		 */
+		std::string Open();
+
+		/**
+		 * @brief Counts, samples and searches one packet; called by the receive thread only
+		 * @return true if the packet is to be reinjected
+		 */
+		bool Consume(const UINT8 *packet, UINT length, const WINDIVERT_ADDRESS &addr);
+
+		/**
+		 * @brief Writes buffered capture records to the file
+		 */
+		void Flush();
+
+		/**
+		 * @brief Flushes and closes the capture file; the receive thread must have stopped
+		 */
+		void Close();
+
+		/**
+		 * @brief Reads the counters; safe while the receive thread runs
+		 */
+		void GetStats(SinkStats *stats) const;
+
+		/**
+		 * @brief Configuration the sink was created with
+		 */
+		const SinkConfig &Config() const;
+
+	private:
+		/**
+		 * @brief Increments a counter that only the receive thread writes
+		 */
+		static void Bump(std::atomic<UINT64> &counter, UINT64 value)
+		{
+			counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+		}
+
+		/**
+		 * @brief Appends one pcap record
+		 */
+		void Capture(const UINT8 *packet, UINT length);
+
+		SinkConfig config_;
+		std::vector<std::function<bool(const char *, const char *)>> searchers_;   ///< One per pattern
+		FILE *capture_;
+		std::vector<char> captureBuffer_;    ///< stdio buffer of the capture file
+		UINT32 untilSample_;                 ///< Packets left before the next sample
+
+		std::atomic<UINT64> packets_;
+		std::atomic<UINT64> bytes_;
+		std::atomic<UINT64> ipv4_;
+		std::atomic<UINT64> ipv6_;
+		std::atomic<UINT64> tcp_;
+		std::atomic<UINT64> udp_;
+		std::atomic<UINT64> icmp_;
+		std::atomic<UINT64> other_;
+		std::atomic<UINT64> inbound_;
+		std::atomic<UINT64> outbound_;
+		std::atomic<UINT64> reinjected_;
+		std::atomic<UINT64> sampled_;
+		std::atomic<UINT64> captureBytes_;
+		std::atomic<UINT64> captureErrors_;
+		std::unique_ptr<std::atomic<UINT64>[]> patternHits_;
+};
+
+#endif
@@ -0,0 +1,151 @@
+/**
+ * @file packet-stage.h
+ * @brief Native processing stages run by the receive thread before packets reach JavaScript
+ *
+ * A handle owns a StageChain built with WinDivert.attachStage. Every received packet of a
+ * NETWORK layer handle runs through the chain in attach order; each stage may rewrite the
+ * packet in place, emit extra packets through the shared SendBatch, or decide its fate.
+ * Packets no stage decided on are delivered to JavaScript as before.
+ */
+
+#ifndef PACKET_STAGE_H_
+#define PACKET_STAGE_H_
+
+#include <memory>
+#include <vector>
+#include "windivert.h"
+#include "packet.h"
+#include "send-batch.h"
+
+/**
+ * @enum StageVerdict
+ * @brief Result of a stage, and of a chain
+ */
+enum StageVerdict {
+	STAGE_CONTINUE = 0,   ///< Undecided; after the last stage the packet is delivered to JavaScript
+	STAGE_PASS = 1,       ///< Reinject natively once the remaining stages have run
+	STAGE_DROP = 2,       ///< Discard, remaining stages are skipped
+	STAGE_HOLD = 3,       ///< The stage took the packet (queued or already sent), remaining stages are skipped
+	STAGE_REJECT = 4      ///< Discard and answer the sender with a TCP RST or ICMP unreachable, remaining stages are skipped
+};
+
+/**
+ * @struct PacketContext
+ * @brief A packet on its way through a StageChain
+ */
+struct PacketContext {
+	UINT8 *data;                 ///< Packet data, rewritten in place
+	UINT length;                 ///< Packet length
+	WINDIVERT_ADDRESS *addr;     ///< Packet address, stages may change direction flags
+	PacketInfo info;             ///< Parsed headers, valid if parsed is true
+	bool parsed;                 ///< ParsePacket succeeded
+	UINT64 now;                  ///< GetTickCount64 when the receive batch was read
+	SendBatch *send;             ///< Batch of the receive thread for packets the stages emit
+	HANDLE handle;               ///< Handle the packet was received on
+	bool reinject;               ///< The handle can send, so held packets may be reinjected later
+};
+
+/**
+ * @class PacketStage
+ * @brief Base class of native stages
+ *
+ * A stage object may be attached to several handles, so Process can be called from
+ * several receive threads at once.
+ */
+class PacketStage {
+	public:
+		virtual ~PacketStage()
+		{
+		}
+
+		/**
+		 * @brief Processes one packet
+		 * @param ctx Packet and receive thread state
+		 * @return What should happen to the packet
+		 */
+		virtual StageVerdict Process(PacketContext &ctx) = 0;
+
+		/**
+		 * @brief Called once per receive batch after its packets were processed
+		 * @param now GetTickCount64 of the batch
+		 */
+		virtual void Tick(UINT64 /* now */)
+		{
+		}
+
+		/**
+		 * @brief Called before a handle the stage is attached to is closed
+		 * @param handle Handle that must no longer be used once this returns
+		 */
+		virtual void Detach(HANDLE /* handle */)
+		{
+		}
+};
+
+/**
+ * @class StageChain
+ * @brief Ordered stages of one handle, fixed once reception starts
+ */
+class StageChain {
+	public:
+		void Add(const std::shared_ptr<PacketStage> &stage)
+		{
+			stages_.push_back(stage);
+		}
+
+		bool Empty() const
+		{
+			return stages_.empty();
+		}
+
+		/**
+		 * @brief Runs a packet through every stage
+		 * @param ctx Packet and receive thread state, ctx.info is parsed here
+		 * @return STAGE_CONTINUE if no stage decided, otherwise the deciding verdict
+		 */
+		StageVerdict Run(PacketContext &ctx)
+		{
+			ctx.parsed = ParsePacket(ctx.data, ctx.length, &ctx.info);
+			StageVerdict result = STAGE_CONTINUE;
+			for (const std::shared_ptr<PacketStage> &stage : stages_)
+			{
+				StageVerdict verdict = stage->Process(ctx);
+				if (verdict == STAGE_DROP || verdict == STAGE_HOLD || verdict == STAGE_REJECT)
+				{
+					return verdict;
+				}
+				if (verdict == STAGE_PASS)
+				{
+					result = STAGE_PASS;
+				}
+			}
+			return result;
+		}
+
+		/**
+		 * @brief Ticks every stage after a receive batch
+		 */
+		void Tick(UINT64 now)
+		{
+			for (const std::shared_ptr<PacketStage> &stage : stages_)
+			{
+				stage->Tick(now);
+			}
+		}
+
+		/**
+		 * @brief Tells every stage that the handle is about to be closed
+		 */
+		void Detach(HANDLE handle)
+		{
+			for (const std::shared_ptr<PacketStage> &stage : stages_)
+			{
+				stage->Detach(handle);
+			}
+		}
+
+	private:
+		std::vector<std::shared_ptr<PacketStage>> stages_;   ///< In attach order
+};
+
+#endif
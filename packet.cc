@@ -0,0 +1,384 @@
+/**
+ * @file packet.cc
+ * @brief Portable IPv4/IPv6 packet parsing and flow keys
+ */
+
+#include "packet.h"
+
+/**
+ * @brief Walks IPv6 extension headers until the transport header.
+ * @param data Packet data
+ * @param info Packet information, transportOffset and protocol are advanced in place
+ */
+static void ParseIPv6ExtHeaders(const uint8_t *data, PacketInfo *info)
+{
+	while (info->fragOffset == 0 && info->length >= info->transportOffset + 2)
+	{
+		const uint8_t *hdr = data + info->transportOffset;
+		uint32_t headerLength;
+
+		switch (info->protocol)
+		{
+			case 44: // IPPROTO_FRAGMENT
+				if (info->fragment || info->length < info->transportOffset + 8)
+				{
+					return;
+				}
+				info->fragOffset = ReadBE16(hdr + 2) >> 3;
+				info->moreFragments = (hdr[3] & 0x01) != 0;
+				info->fragment = true;
+				headerLength = 8;
+				break;
+			case 51: // IPPROTO_AH
+				headerLength = (hdr[1] + 2) * 4;
+				break;
+			case 0:   // IPPROTO_HOPOPTS
+			case 60:  // IPPROTO_DSTOPTS
+			case 43:  // IPPROTO_ROUTING
+			case 135: // IPPROTO_MH
+				headerLength = (hdr[1] + 1) * 8;
+				break;
+			default:
+				return;
+		}
+		if (info->length < info->transportOffset + headerLength)
+		{
+			return;
+		}
+		info->protocol = hdr[0];
+		info->transportOffset += headerLength;
+	}
+}
+
+bool ParsePacket(const uint8_t *data, uint32_t length, PacketInfo *info)
+{
+	std::memset(info, 0, sizeof(PacketInfo));
+	if (length < 1)
+	{
+		return false;
+	}
+	info->version = data[0] >> 4;
+
+	if (info->version == 4)
+	{
+		if (length < PACKET_IPV4_HDR_MIN)
+		{
+			return false;
+		}
+		uint32_t headerLength = (data[0] & 0x0F) * 4;
+		uint32_t totalLength = ReadBE16(data + 2);
+		if (headerLength < PACKET_IPV4_HDR_MIN || totalLength < headerLength || length < headerLength)
+		{
+			return false;
+		}
+		uint16_t fragOff0 = ReadBE16(data + 6);
+		info->protocol = data[9];
+		info->fragOffset = fragOff0 & 0x1FFF;
+		info->moreFragments = (fragOff0 & 0x2000) != 0;
+		info->fragment = info->moreFragments || info->fragOffset != 0;
+		info->length = totalLength < length ? totalLength : length;
+		info->transportOffset = headerLength;
+	}
+	else if (info->version == 6)
+	{
+		if (length < PACKET_IPV6_HDR_LEN)
+		{
+			return false;
+		}
+		uint32_t totalLength = ReadBE16(data + 4) + PACKET_IPV6_HDR_LEN;
+		info->protocol = data[6];
+		info->length = totalLength < length ? totalLength : length;
+		info->transportOffset = PACKET_IPV6_HDR_LEN;
+		ParseIPv6ExtHeaders(data, info);
+	}
+	else
+	{
+		return false;
+	}
+
+	info->payloadOffset = info->transportOffset;
+	if (info->fragOffset == 0)
+	{
+		uint32_t available = info->length - info->transportOffset;
+		switch (info->protocol)
+		{
+			case PACKET_PROTO_TCP:
+				if (available >= PACKET_TCP_HDR_MIN)
+				{
+					uint32_t tcpLength = (data[info->transportOffset + 12] >> 4) * 4;
+					if (tcpLength >= PACKET_TCP_HDR_MIN)
+					{
+						info->transportLength = tcpLength < available ? tcpLength : available;
+					}
+				}
+				break;
+			case PACKET_PROTO_UDP:
+				if (available >= PACKET_UDP_HDR_LEN)
+				{
+					info->transportLength = PACKET_UDP_HDR_LEN;
+				}
+				break;
+			case PACKET_PROTO_ICMP:
+			case PACKET_PROTO_ICMPV6:
+				if (available >= PACKET_ICMP_HDR_LEN)
+				{
+					info->transportLength = PACKET_ICMP_HDR_LEN;
+				}
+				break;
+		}
+		info->payloadOffset += info->transportLength;
+	}
+	info->payloadLength = info->length - info->payloadOffset;
+	return true;
+}
+
+uint32_t PacketLength(const uint8_t *data, uint32_t available)
+{
+	uint32_t length = available;
+	if (available >= PACKET_IPV4_HDR_MIN && (data[0] >> 4) == 4)
+	{
+		length = ReadBE16(data + 2);
+	}
+	else if (available >= PACKET_IPV6_HDR_LEN && (data[0] >> 4) == 6)
+	{
+		length = ReadBE16(data + 4) + PACKET_IPV6_HDR_LEN;
+	}
+	if (length == 0 || length > available)
+	{
+		length = available;
+	}
+	return length;
+}
+
+void SetPacketLength(uint8_t *data, uint32_t length)
+{
+	if ((data[0] >> 4) == 6)
+	{
+		WriteBE16(data + 4, static_cast<uint16_t>(length - PACKET_IPV6_HDR_LEN));
+	}
+	else
+	{
+		WriteBE16(data + 2, static_cast<uint16_t>(length));
+	}
+}
+
+uint32_t EditPayload(const uint8_t *data, const PacketInfo &info, const PayloadEdit *edits, size_t count, uint8_t *out)
+{
+	const uint8_t *payload = data + info.payloadOffset;
+	uint32_t in = 0;
+	uint32_t length = info.payloadOffset;
+	std::memcpy(out, data, info.payloadOffset);
+	for (size_t i = 0; i < count; i++)
+	{
+		std::memcpy(out + length, payload + in, edits[i].offset - in);
+		length += edits[i].offset - in;
+		std::memcpy(out + length, edits[i].insert, edits[i].insertLength);
+		length += edits[i].insertLength;
+		in = edits[i].offset + edits[i].remove;
+	}
+	std::memcpy(out + length, payload + in, info.payloadLength - in);
+	length += info.payloadLength - in;
+	SetPacketLength(out, length);
+	return length;
+}
+
+/**
+ * @brief Parses a dotted quad.
+ * @return Number of characters consumed, 0 if text does not start with an IPv4 address
+ */
+static size_t ParseIPv4(const char *text, uint8_t *bytes)
+{
+	const char *p = text;
+	for (int i = 0; i < 4; i++)
+	{
+		if (i > 0 && *p++ != '.')
+		{
+			return 0;
+		}
+		uint32_t value = 0;
+		int digits = 0;
+		for (; *p >= '0' && *p <= '9' && digits < 4; p++, digits++)
+		{
+			value = value * 10 + (*p - '0');
+		}
+		if (digits == 0 || digits > 3 || value > 255)
+		{
+			return 0;
+		}
+		bytes[i] = static_cast<uint8_t>(value);
+	}
+	return static_cast<size_t>(p - text);
+}
+
+/**
+ * @brief Parses an IPv6 address.
+ * Groups before and after :: are collected separately and the gap is zero filled.
+ */
+static bool ParseIPv6(const char *text, uint8_t *bytes)
+{
+	uint16_t head[8];
+	uint16_t tail[8];
+	int headCount = 0;
+	int tailCount = 0;
+	bool gap = false;
+	const char *p = text;
+
+	if (p[0] == ':' && p[1] == ':')
+	{
+		gap = true;
+		p += 2;
+	}
+	while (*p != '\0')
+	{
+		uint16_t *groups = gap ? tail : head;
+		int &count = gap ? tailCount : headCount;
+		if (headCount + tailCount >= 8)
+		{
+			return false;
+		}
+		uint8_t v4[4];
+		if (std::strchr(p, ':') == NULL && std::strchr(p, '.') != NULL)
+		{
+			// Trailing dotted quad occupies the last two groups.
+			if (headCount + tailCount > 6 || ParseIPv4(p, v4) != std::strlen(p))
+			{
+				return false;
+			}
+			groups[count++] = static_cast<uint16_t>((v4[0] << 8) | v4[1]);
+			groups[count++] = static_cast<uint16_t>((v4[2] << 8) | v4[3]);
+			break;
+		}
+		uint32_t value = 0;
+		int digits = 0;
+		for (; digits < 5; p++, digits++)
+		{
+			char c = *p;
+			int nibble = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+			if (nibble < 0)
+			{
+				break;
+			}
+			value = (value << 4) | static_cast<uint32_t>(nibble);
+		}
+		if (digits == 0 || digits > 4)
+		{
+			return false;
+		}
+		groups[count++] = static_cast<uint16_t>(value);
+		if (*p == '\0')
+		{
+			break;
+		}
+		if (*p != ':')
+		{
+			return false;
+		}
+		p++;
+		if (*p == ':')
+		{
+			if (gap)
+			{
+				return false;
+			}
+			gap = true;
+			p++;
+		}
+		else if (*p == '\0')
+		{
+			return false;
+		}
+	}
+	if ((gap && headCount + tailCount > 7) || (!gap && headCount != 8))
+	{
+		return false;
+	}
+	std::memset(bytes, 0, 16);
+	for (int i = 0; i < headCount; i++)
+	{
+		WriteBE16(bytes + i * 2, head[i]);
+	}
+	for (int i = 0; i < tailCount; i++)
+	{
+		WriteBE16(bytes + (8 - tailCount + i) * 2, tail[i]);
+	}
+	return true;
+}
+
+bool ParseAddress(const char *text, uint8_t *bytes, bool *ipv6)
+{
+	if (std::strchr(text, ':') != NULL)
+	{
+		*ipv6 = true;
+		return ParseIPv6(text, bytes);
+	}
+	*ipv6 = false;
+	return ParseIPv4(text, bytes) == std::strlen(text) && *text != '\0';
+}
+
+/**
+ * @brief Converts a packet address to the WinDivert FLOW layer representation.
+ * @param addr Address bytes in network order (4 or 16 bytes)
+ * @param ipv6 true for a 16 byte address
+ * @param out Receives four host order words
+ */
+static void LoadFlowAddr(const uint8_t *addr, bool ipv6, uint32_t *out)
+{
+	if (ipv6)
+	{
+		out[0] = ReadBE32(addr + 12);
+		out[1] = ReadBE32(addr + 8);
+		out[2] = ReadBE32(addr + 4);
+		out[3] = ReadBE32(addr);
+	}
+	else
+	{
+		out[0] = ReadBE32(addr);
+		out[1] = 0x0000FFFF;
+		out[2] = 0;
+		out[3] = 0;
+	}
+}
+
+bool FlowKeyFromPacket(const uint8_t *data, const PacketInfo &info, bool outbound, FlowKey *key)
+{
+	std::memset(key, 0, sizeof(FlowKey));
+	const bool ipv6 = info.version == 6;
+	const uint8_t *src = data + (ipv6 ? 8 : 12);
+	const uint8_t *dst = data + (ipv6 ? 24 : 16);
+	LoadFlowAddr(outbound ? src : dst, ipv6, key->localAddr);
+	LoadFlowAddr(outbound ? dst : src, ipv6, key->remoteAddr);
+	key->protocol = info.protocol;
+
+	if ((info.protocol != PACKET_PROTO_TCP && info.protocol != PACKET_PROTO_UDP) || info.transportLength == 0)
+	{
+		return false;
+	}
+	uint16_t srcPort = ReadBE16(data + info.transportOffset);
+	uint16_t dstPort = ReadBE16(data + info.transportOffset + 2);
+	key->localPort = outbound ? srcPort : dstPort;
+	key->remotePort = outbound ? dstPort : srcPort;
+	return true;
+}
+
+void HostKey(const uint8_t *addr, bool ipv6, FlowKey *key)
+{
+	std::memset(key, 0, sizeof(FlowKey));
+	LoadFlowAddr(addr, ipv6, key->remoteAddr);
+}
+
+uint64_t FlowHash(const FlowKey &key)
+{
+	// FNV-1a over the key words followed by a 64-bit finalizer for better low-bit spread.
+	uint32_t words[sizeof(FlowKey) / sizeof(uint32_t)];
+	std::memcpy(words, &key, sizeof(FlowKey));
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	for (uint32_t word : words)
+	{
+		hash ^= word;
+		hash *= 0x100000001B3ULL;
+	}
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDULL;
+	hash ^= hash >> 33;
+	return hash;
+}
@@ -0,0 +1,193 @@
+/**
+ * @file packet.h
+ * @brief Portable IPv4/IPv6 packet parsing and flow keys
+ *
+ * These helpers only depend on the C++ standard library so they can be used from the
+ * receive thread, the mock driver and the benchmarks alike.
+ */
+
+#ifndef PACKET_H_
+#define PACKET_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#define PACKET_PROTO_ICMP    1
+#define PACKET_PROTO_TCP     6
+#define PACKET_PROTO_UDP     17
+#define PACKET_PROTO_ICMPV6  58
+
+#define PACKET_IPV4_HDR_MIN  20
+#define PACKET_IPV6_HDR_LEN  40
+#define PACKET_TCP_HDR_MIN   20
+#define PACKET_UDP_HDR_LEN   8
+#define PACKET_ICMP_HDR_LEN  8
+
+#define PACKET_TCP_FIN 0x01
+#define PACKET_TCP_SYN 0x02
+#define PACKET_TCP_RST 0x04
+#define PACKET_TCP_PSH 0x08
+#define PACKET_TCP_ACK 0x10
+
+#define PACKET_TCP_OPT_EOL  0
+#define PACKET_TCP_OPT_NOP  1
+#define PACKET_TCP_OPT_SACK 5
+
+/**
+ * @brief Reads a big-endian 16-bit value
+ */
+inline uint16_t ReadBE16(const uint8_t *p)
+{
+	return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+/**
+ * @brief Reads a big-endian 32-bit value
+ */
+inline uint32_t ReadBE32(const uint8_t *p)
+{
+	return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+		   (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+/**
+ * @brief Writes a big-endian 16-bit value
+ */
+inline void WriteBE16(uint8_t *p, uint16_t value)
+{
+	p[0] = static_cast<uint8_t>(value >> 8);
+	p[1] = static_cast<uint8_t>(value);
+}
+
+/**
+ * @brief Writes a big-endian 32-bit value
+ */
+inline void WriteBE32(uint8_t *p, uint32_t value)
+{
+	p[0] = static_cast<uint8_t>(value >> 24);
+	p[1] = static_cast<uint8_t>(value >> 16);
+	p[2] = static_cast<uint8_t>(value >> 8);
+	p[3] = static_cast<uint8_t>(value);
+}
+
+/**
+ * @struct PacketInfo
+ * @brief Header offsets of a parsed packet, all relative to the packet start
+ */
+struct PacketInfo {
+	uint8_t version;            ///< IP version, 4 or 6
+	uint8_t protocol;           ///< Transport protocol after IPv6 extension headers
+	bool fragment;              ///< Packet is an IP fragment
+	bool moreFragments;         ///< MF flag is set
+	uint16_t fragOffset;        ///< Fragment offset in 8-byte units
+	uint32_t length;            ///< Packet length from the IP header, clamped to the buffer
+	uint32_t transportOffset;   ///< Start of the transport header (end of IP headers)
+	uint32_t transportLength;   ///< Transport header length, 0 if not parsed
+	uint32_t payloadOffset;     ///< Start of the transport payload
+	uint32_t payloadLength;     ///< Transport payload length
+};
+
+/**
+ * @brief Parses the IP and transport headers of a packet
+ * @param data Packet data
+ * @param length Bytes available in data
+ * @param info Receives the header offsets
+ * @return false if the packet is not a valid IPv4 or IPv6 packet
+ */
+bool ParsePacket(const uint8_t *data, uint32_t length, PacketInfo *info);
+
+/**
+ * @brief Returns the length of the first packet in a buffer according to its IP header
+ * @param data Packet data
+ * @param available Bytes available in data
+ * @return Packet length clamped to available, or available if the header is invalid
+ */
+uint32_t PacketLength(const uint8_t *data, uint32_t available);
+
+/**
+ * @brief Stores a new packet length in the IPv4 total length or IPv6 payload length field
+ * @param data Packet data
+ * @param length New packet length in bytes
+ */
+void SetPacketLength(uint8_t *data, uint32_t length);
+
+/**
+ * @struct PayloadEdit
+ * @brief Replacement of a range of a transport payload
+ */
+struct PayloadEdit {
+	uint32_t offset;            ///< Start of the range, relative to the payload
+	uint32_t remove;            ///< Bytes removed at offset
+	const uint8_t *insert;      ///< Bytes inserted at offset
+	uint32_t insertLength;
+};
+
+/**
+ * @brief Copies a packet while applying edits to its transport payload
+ * @param data Parsed packet
+ * @param info Its headers
+ * @param edits Edits sorted by offset, not overlapping and inside the payload
+ * @param count Number of edits
+ * @param out Receives the edited packet, which must not overlap data
+ * @return Length of the edited packet, with the IP length updated; checksums are left stale
+ */
+uint32_t EditPayload(const uint8_t *data, const PacketInfo &info, const PayloadEdit *edits, size_t count, uint8_t *out);
+
+/**
+ * @brief Parses a textual IPv4 or IPv6 address
+ * @param text Dotted quad, or IPv6 with optional :: and trailing dotted quad
+ * @param bytes Receives the address in network order, 4 or 16 bytes
+ * @param ipv6 Receives true for an IPv6 address
+ * @return false if text is not an address
+ */
+bool ParseAddress(const char *text, uint8_t *bytes, bool *ipv6);
+
+/**
+ * @struct FlowKey
+ * @brief Direction independent 5-tuple
+ *
+ * Addresses and ports use the WinDivert FLOW/SOCKET layer representation: host byte
+ * order, IPv6 words in reverse order and IPv4 stored as an IPv4-mapped IPv6 address.
+ * Keys built from packets and from FLOW layer events can therefore be compared directly.
+ */
+struct FlowKey {
+	uint32_t localAddr[4];      ///< Local address
+	uint32_t remoteAddr[4];     ///< Remote address
+	uint16_t localPort;         ///< Local port
+	uint16_t remotePort;        ///< Remote port
+	uint8_t protocol;           ///< Transport protocol
+	uint8_t reserved[3];        ///< Always zero so keys can be compared with memcmp
+};
+
+inline bool operator==(const FlowKey &a, const FlowKey &b)
+{
+	return std::memcmp(&a, &b, sizeof(FlowKey)) == 0;
+}
+
+/**
+ * @brief Builds the flow key of a parsed packet
+ * @param data Packet data
+ * @param info Parsed headers
+ * @param outbound true if the packet's source is the local endpoint
+ * @param key Receives the flow key
+ * @return false if the packet has no ports (fragment or non TCP/UDP packet use port 0)
+ */
+bool FlowKeyFromPacket(const uint8_t *data, const PacketInfo &info, bool outbound, FlowKey *key);
+
+/**
+ * @brief Builds a key holding only a remote address, for tables kept per host
+ * @param addr Address in network order, 4 or 16 bytes
+ * @param ipv6 true for a 16 byte address
+ * @param key Receives the key, with the local address, ports and protocol zero
+ */
+void HostKey(const uint8_t *addr, bool ipv6, FlowKey *key);
+
+/**
+ * @brief Hashes a flow key
+ * @param key Flow key
+ * @return 64-bit hash value
+ */
+uint64_t FlowHash(const FlowKey &key);
+
+#endif
@@ -0,0 +1,313 @@
+/**
+ * @file pipeline.cc
+ * @brief Several WinDivert handles read by one thread through an I/O completion port
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include "packet.h"
+#include "pipeline.h"
+
+Pipeline::Pipeline(UINT32 batchSize, UINT32 depth)
+	: batchSize_(batchSize), depth_(depth), port_(NULL), credits_(0), closing_(false), batches_(0), wakeups_(0)
+{
+}
+
+Pipeline::~Pipeline()
+{
+	this->Close();
+}
+
+int Pipeline::Add(HANDLE handle, UINT64 flags)
+{
+	if (this->port_ != NULL || this->entries_.size() >= PIPELINE_MAX_HANDLES)
+	{
+		return -1;
+	}
+	std::unique_ptr<Entry> entry(new Entry());
+	entry->handle = handle;
+	entry->receives = (flags & (WINDIVERT_FLAG_DROP | WINDIVERT_FLAG_SEND_ONLY)) == 0;
+	entry->packets = 0;
+	entry->bytes = 0;
+	entry->completed = 0;
+	entry->errors = 0;
+	this->entries_.push_back(std::move(entry));
+	return static_cast<int>(this->entries_.size() - 1);
+}
+
+bool Pipeline::Start(std::function<bool(PipelineBatch *)> deliver)
+{
+	if (this->port_ != NULL)
+	{
+		return false;
+	}
+	this->port_ = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+	if (this->port_ == NULL)
+	{
+		std::cerr << "Warning: Failed to create completion port. Error code: " << GetLastError() << std::endl;
+		return false;
+	}
+	bool receives = false;
+	for (size_t id = 0; id < this->entries_.size(); id++)
+	{
+		Entry &entry = *this->entries_[id];
+		if (!entry.receives)
+		{
+			continue;
+		}
+		if (CreateIoCompletionPort(entry.handle, this->port_, id, 0) == NULL)
+		{
+			std::cerr << "Warning: Failed to associate handle " << id << " with the completion port. Error code: "
+					  << GetLastError() << std::endl;
+			entry.receives = false;
+			continue;
+		}
+		for (UINT32 i = 0; i < this->depth_; i++)
+		{
+			std::unique_ptr<PipelineRead> read(new PipelineRead());
+			read->id = static_cast<UINT32>(id);
+			read->data.resize(std::max<UINT>(WINDIVERT_MTU_MAX, this->batchSize_ * PIPELINE_READ_RESERVE));
+			read->addrs.resize(this->batchSize_);
+			entry.reads.push_back(std::move(read));
+		}
+		receives = true;
+	}
+	if (!receives)
+	{
+		return false;
+	}
+	this->deliver_ = std::move(deliver);
+	this->closing_ = false;
+	this->thread_ = std::thread(&Pipeline::ThreadFunction, this);
+	return true;
+}
+
+int Pipeline::Credit(int count)
+{
+	std::lock_guard<std::mutex> lock(this->creditMutex_);
+	this->credits_ += count;
+	this->creditCond_.notify_one();
+	return this->credits_;
+}
+
+bool Pipeline::AcquireCredit()
+{
+	std::unique_lock<std::mutex> lock(this->creditMutex_);
+	this->creditCond_.wait(lock, [this] { return this->credits_ > 0 || this->closing_; });
+	if (this->closing_)
+	{
+		return false;
+	}
+	this->credits_--;
+	return true;
+}
+
+void Pipeline::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->creditMutex_);
+		this->closing_ = true;
+	}
+	this->creditCond_.notify_all();
+	// Pending reads complete with what is still queued, then with ERROR_NO_DATA.
+	for (const std::unique_ptr<Entry> &entry : this->entries_)
+	{
+		if (entry->receives && entry->handle != INVALID_HANDLE_VALUE)
+		{
+			WinDivertShutdown(entry->handle, WINDIVERT_SHUTDOWN_RECV);
+		}
+	}
+}
+
+void Pipeline::Stop()
+{
+	if (!this->thread_.joinable())
+	{
+		return;
+	}
+	this->Shutdown();
+	this->thread_.join();
+}
+
+void Pipeline::Close()
+{
+	this->Stop();
+	for (const std::unique_ptr<Entry> &entry : this->entries_)
+	{
+		if (entry->handle != INVALID_HANDLE_VALUE)
+		{
+			WinDivertClose(entry->handle);
+			CloseHandle(entry->handle);
+			entry->handle = INVALID_HANDLE_VALUE;
+		}
+	}
+	if (this->port_ != NULL)
+	{
+		CloseHandle(this->port_);
+		this->port_ = NULL;
+	}
+}
+
+HANDLE Pipeline::Handle(UINT32 id) const
+{
+	return id < this->entries_.size() ? this->entries_[id]->handle : INVALID_HANDLE_VALUE;
+}
+
+size_t Pipeline::Size() const
+{
+	return this->entries_.size();
+}
+
+void Pipeline::GetStats(UINT32 id, PipelineHandleStats *stats) const
+{
+	const Entry &entry = *this->entries_[id];
+	stats->packets = entry.packets;
+	stats->bytes = entry.bytes;
+	stats->reads = entry.completed;
+	stats->errors = entry.errors;
+}
+
+UINT64 Pipeline::Batches() const
+{
+	return this->batches_;
+}
+
+UINT64 Pipeline::Wakeups() const
+{
+	return this->wakeups_;
+}
+
+bool Pipeline::PostRead(PipelineRead *read)
+{
+	if (this->closing_)
+	{
+		return false;
+	}
+	std::memset(&read->overlapped, 0, sizeof(OVERLAPPED));
+	read->addrLen = static_cast<UINT>(read->addrs.size() * sizeof(WINDIVERT_ADDRESS));
+	// A read that completes at once is still reported through the port.
+	if (WinDivertRecvEx(this->entries_[read->id]->handle, read->data.data(), static_cast<UINT>(read->data.size()), NULL, 0,
+						read->addrs.data(), &read->addrLen, &read->overlapped) ||
+		GetLastError() == ERROR_IO_PENDING)
+	{
+		return true;
+	}
+	const DWORD error = GetLastError();
+	if (error != ERROR_NO_DATA)
+	{
+		std::cerr << "Warning: Failed to post a read on handle " << read->id << ". Error code: " << error << std::endl;
+	}
+	return false;
+}
+
+void Pipeline::Append(PipelineBatch *batch, PipelineRead *read, UINT length)
+{
+	Entry &entry = *this->entries_[read->id];
+	const UINT count = read->addrLen / sizeof(WINDIVERT_ADDRESS);
+	const UINT32 base = static_cast<UINT32>(batch->data.size());
+	if (batch->offsets.empty())
+	{
+		batch->offsets.push_back(0);
+	}
+	batch->data.insert(batch->data.end(), read->data.data(), read->data.data() + length);
+	UINT offset = 0;
+	UINT appended = 0;
+	for (; appended < count && offset < length; appended++)
+	{
+		offset += PacketLength(read->data.data() + offset, length - offset);
+		batch->offsets.push_back(base + offset);
+		batch->addrs.push_back(read->addrs[appended]);
+		batch->handles.push_back(static_cast<UINT8>(read->id));
+	}
+	entry.packets += appended;
+	entry.bytes += length;
+	entry.completed++;
+}
+
+/**
+ * @brief Dequeues every completion that is ready, merges the packets into one batch and reposts the reads.
+ * Nothing is dequeued while the consumer has no credit; completed reads then wait on the port and
+ * new packets in the driver queues, as with WinDivert.recvBatch.
+ */
+void Pipeline::ThreadFunction()
+{
+	std::vector<OVERLAPPED_ENTRY> completions(PIPELINE_MAX_COMPLETIONS);
+	size_t outstanding = 0;
+	for (const std::unique_ptr<Entry> &entry : this->entries_)
+	{
+		for (const std::unique_ptr<PipelineRead> &read : entry->reads)
+		{
+			outstanding += this->PostRead(read.get()) ? 1 : 0;
+		}
+	}
+
+	while (outstanding > 0)
+	{
+		// Once stopping, completions are still dequeued so every read ends before its buffers are freed.
+		const bool deliver = this->AcquireCredit();
+		ULONG removed = 0;
+		if (!GetQueuedCompletionStatusEx(this->port_, completions.data(), static_cast<ULONG>(completions.size()), &removed,
+										 INFINITE, FALSE))
+		{
+			std::cerr << "Warning: Failed to dequeue completions. Error code: " << GetLastError() << std::endl;
+			if (deliver)
+			{
+				this->Credit(1);
+			}
+			continue;
+		}
+		this->wakeups_++;
+
+		PipelineBatch *batch = deliver ? new PipelineBatch() : nullptr;
+		for (ULONG i = 0; i < removed; i++)
+		{
+			PipelineRead *read = reinterpret_cast<PipelineRead *>(completions[i].lpOverlapped);
+			if (read == nullptr)
+			{
+				continue;
+			}
+			Entry &entry = *this->entries_[read->id];
+			DWORD length = 0;
+			if (GetOverlappedResult(entry.handle, &read->overlapped, &length, FALSE))
+			{
+				if (batch != nullptr)
+				{
+					this->Append(batch, read, length);
+				}
+			}
+			else
+			{
+				const DWORD error = GetLastError();
+				if (error == ERROR_NO_DATA || error == ERROR_OPERATION_ABORTED)
+				{
+					outstanding--;
+					continue;
+				}
+				entry.errors++;
+				std::cerr << "Warning: Failed to read packet batch on handle " << read->id << ". Error code: " << error << std::endl;
+			}
+			if (!this->PostRead(read))
+			{
+				outstanding--;
+			}
+		}
+
+		if (batch == nullptr)
+		{
+			continue;
+		}
+		if (batch->handles.empty())
+		{
+			delete batch;
+			this->Credit(1);
+			continue;
+		}
+		this->batches_++;
+		if (!this->deliver_(batch))
+		{
+			this->Shutdown();
+		}
+	}
+	this->deliver_(nullptr);
+}
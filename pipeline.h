@@ -0,0 +1,200 @@
+/**
+ * @file pipeline.h
+ * @brief Several WinDivert handles read by one thread through an I/O completion port
+ *
+ * Every receiving handle keeps a few overlapped WinDivertRecvEx calls posted to a shared
+ * completion port. One thread dequeues whatever completed, merges the packets of all handles
+ * into a single batch tagged with handle ids and reposts the reads, so the number of threads
+ * stays the same however many filters are open.
+ */
+
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "windivert.h"
+
+#define PIPELINE_MAX_HANDLES 64
+#define PIPELINE_DEFAULT_BATCH 64
+#define PIPELINE_DEFAULT_DEPTH 2
+#define PIPELINE_MAX_DEPTH 16
+#define PIPELINE_MAX_COMPLETIONS 64
+#define PIPELINE_READ_RESERVE 2048
+
+/**
+ * @struct PipelineBatch
+ * @brief Packets of every read that completed together
+ */
+struct PipelineBatch {
+	std::vector<char> data;                  ///< Concatenated packet data
+	std::vector<WINDIVERT_ADDRESS> addrs;    ///< One address per packet
+	std::vector<UINT32> offsets;             ///< Packet boundaries into data (count + 1 entries)
+	std::vector<UINT8> handles;              ///< Id of the handle each packet was read from
+};
+
+/**
+ * @struct PipelineRead
+ * @brief One overlapped WinDivertRecvEx and its buffers
+ */
+struct PipelineRead {
+	OVERLAPPED overlapped;                   ///< Returned by the completion port, must stay first
+	UINT32 id;                               ///< Handle id
+	UINT addrLen;                            ///< Written by the driver on completion
+	std::vector<UINT8> data;
+	std::vector<WINDIVERT_ADDRESS> addrs;
+};
+
+/**
+ * @struct PipelineHandleStats
+ * @brief Counters of one handle
+ */
+struct PipelineHandleStats {
+	UINT64 packets;     ///< Packets read
+	UINT64 bytes;       ///< Bytes read
+	UINT64 reads;       ///< Completed reads that returned packets
+	UINT64 errors;      ///< Reads that failed for another reason than shutdown
+};
+
+/**
+ * @class Pipeline
+ * @brief Owns the handles and the completion thread
+ *
+ * Handles are added before Start. Handles opened with WINDIVERT_FLAG_DROP or
+ * WINDIVERT_FLAG_SEND_ONLY are owned for their lifetime and priority but never read.
+ */
+class Pipeline {
+	public:
+		/**
+		 * @param batchSize Packets per read, 1..WINDIVERT_BATCH_MAX
+		 * @param depth Reads kept posted per handle, 1..PIPELINE_MAX_DEPTH
+		 */
+		Pipeline(UINT32 batchSize, UINT32 depth);
+
+		/**
+		 * @brief Stops the thread and closes every handle
+		 */
+		~Pipeline();
+
+		/**
+		 * @brief Takes ownership of an opened handle
+		 * @param handle Opened WinDivert handle
+		 * @param flags Flags the handle was opened with
+		 * @return Handle id, or -1 with the handle left open if the pipeline is started or full
+		 */
+		int Add(HANDLE handle, UINT64 flags);
+
+		/**
+		 * @brief Posts the reads and starts the completion thread
+		 * @param deliver Takes ownership of each non-empty batch; returning false stops the pipeline.
+		 *                Called once with nullptr when every handle is drained.
+		 * @return false if the completion port cannot be created or no handle receives
+		 */
+		bool Start(std::function<bool(PipelineBatch *)> deliver);
+
+		/**
+		 * @brief Lets the thread deliver more batches
+		 * @param count Batches the consumer can accept
+		 * @return Credits now available
+		 */
+		int Credit(int count);
+
+		/**
+		 * @brief Shuts the handles down for receive and waits for the thread to drain them
+		 */
+		void Stop();
+
+		/**
+		 * @brief Stops the thread and closes every handle
+		 */
+		void Close();
+
+		/**
+		 * @brief Handle of an id
+		 * @return INVALID_HANDLE_VALUE if the id is unknown or the pipeline is closed
+		 */
+		HANDLE Handle(UINT32 id) const;
+
+		/**
+		 * @brief Number of handles added
+		 */
+		size_t Size() const;
+
+		/**
+		 * @brief Reads the counters of a handle
+		 */
+		void GetStats(UINT32 id, PipelineHandleStats *stats) const;
+
+		/**
+		 * @brief Batches delivered so far
+		 */
+		UINT64 Batches() const;
+
+		/**
+		 * @brief Completion port dequeues so far; each may merge several reads
+		 */
+		UINT64 Wakeups() const;
+
+	private:
+		/**
+		 * @struct Entry
+		 * @brief A handle and its reads
+		 */
+		struct Entry {
+			HANDLE handle;                                      ///< Owned WinDivert handle
+			bool receives;                                      ///< Reads are posted for the handle
+			std::vector<std::unique_ptr<PipelineRead>> reads;   ///< depth_ reads, created by Start
+			std::atomic<UINT64> packets;
+			std::atomic<UINT64> bytes;
+			std::atomic<UINT64> completed;
+			std::atomic<UINT64> errors;
+		};
+
+		/**
+		 * @brief Dequeues completions until every read has ended
+		 */
+		void ThreadFunction();
+
+		/**
+		 * @brief Posts an overlapped read
+		 * @return false if the handle does not accept reads any more
+		 */
+		bool PostRead(PipelineRead *read);
+
+		/**
+		 * @brief Appends the packets of a completed read to a batch
+		 */
+		void Append(PipelineBatch *batch, PipelineRead *read, UINT length);
+
+		/**
+		 * @brief Waits for a credit and takes it
+		 * @return false once the pipeline is stopping
+		 */
+		bool AcquireCredit();
+
+		/**
+		 * @brief Marks the pipeline as stopping and shuts the handles down for receive
+		 */
+		void Shutdown();
+
+		const UINT32 batchSize_;                        ///< Packets per read
+		const UINT32 depth_;                            ///< Reads posted per handle
+		std::vector<std::unique_ptr<Entry>> entries_;   ///< Indexed by handle id
+		HANDLE port_;                                   ///< Completion port, NULL until Start
+		std::thread thread_;                            ///< Completion thread
+		std::function<bool(PipelineBatch *)> deliver_;  ///< Receives the merged batches
+		std::mutex creditMutex_;                        ///< Guards credits_ and closing_
+		std::condition_variable creditCond_;            ///< Signalled on credits and on stop
+		int credits_;                                   ///< Batches the consumer can accept
+		std::atomic<bool> closing_;                     ///< Set by Stop, no read is posted afterwards
+		std::atomic<UINT64> batches_;
+		std::atomic<UINT64> wakeups_;
+};
+
+#endif
@@ -0,0 +1,80 @@
+/**
+ * @module pipeline
+ * @description Batches delivered by a native Pipeline, where every packet carries the id of its handle
+ */
+
+const { Readable } = require('stream');
+const { PacketBatch } = require('./batch.js');
+
+/**
+ * Class wrapping one batch delivered by Pipeline.recv.
+ * The packets of several handles are merged into one batch; handle(i) tells which handle read packet i.
+ */
+class PipelineBatch extends PacketBatch {
+	/**
+	 * Creates a new PipelineBatch
+	 * @param {Buffer} data - Concatenated packet data
+	 * @param {Buffer} addrs - Concatenated WINDIVERT_ADDRESS entries
+	 * @param {Uint32Array} offsets - Packet boundaries into data (count + 1 entries)
+	 * @param {Uint8Array} handles - Handle id of each packet, as returned by Pipeline.add
+	 */
+	constructor(data, addrs, offsets, handles) {
+		super(data, addrs, offsets);
+		this.handles = handles;
+	}
+
+	/**
+	 * Returns the id of the handle the packet at the given index was read from
+	 * @param {number} index - Packet index
+	 * @returns {number} Handle id
+	 */
+	handle(index) {
+		return this.handles[index];
+	}
+
+	/**
+	 * Iterates over the packets of the batch
+	 * @yields {{packet: Buffer, addr: Buffer, handle: number}}
+	 */
+	*[Symbol.iterator]() {
+		for (let i = 0; i < this.count; i++) {
+			yield { packet: this.packet(i), addr: this.addr(i), handle: this.handles[i] };
+		}
+	}
+}
+
+/**
+ * @function createPipelineStream
+ * @description Starts the pipeline and returns an object mode Readable of PipelineBatch objects.
+ * Each _read() grants one native read credit, so backpressure reaches the driver queues of every handle.
+ * @param {Pipeline} pipeline - Pipeline whose handles were all added
+ * @param {Object} [options]
+ * @param {number} [options.highWaterMark=4] - Readable highWaterMark, in batches
+ * @returns {Readable}
+ */
+function createPipelineStream(pipeline, { highWaterMark = 4 } = {}) {
+	const stream = new Readable({
+		objectMode: true,
+		highWaterMark,
+		read() {
+			pipeline.credit(1);
+		}
+	});
+	pipeline.recv((data, addrs, offsets, handles) => {
+		stream.push(data === null ? null : new PipelineBatch(data, addrs, offsets, handles));
+	}, 0);
+	return stream;
+}
+
+/**
+ * @function reinject
+ * @description Sends every packet of a batch back through the handle it was read from
+ * @param {Pipeline} pipeline - Pipeline the batch came from
+ * @param {PipelineBatch} batch - Batch, possibly with packets modified in place
+ * @returns {number} Packets accepted by the driver
+ */
+function reinject(pipeline, batch) {
+	return pipeline.sendBatch(batch.handles, batch.data, batch.addrs, batch.offsets);
+}
+
+module.exports = { PipelineBatch, createPipelineStream, reinject };
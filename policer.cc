@@ -0,0 +1,224 @@
+/**
+ * @file policer.cc
+ * @brief Rate limiting stage with lock-free buckets per rule, flow or process
+ */
+
+#include <algorithm>
+#include <chrono>
+#include "policer.h"
+
+/**
+ * @brief Monotonic clock of the buckets in nanoseconds
+ */
+static UINT64 NowNs()
+{
+	return static_cast<UINT64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+PolicerStage::PolicerStage(const std::shared_ptr<FlowIndex> &flowIndex, size_t maxBuckets, size_t maxBytes, UINT64 maxDelay)
+	: flowIndex_(flowIndex), scheduler_(std::make_shared<PacketScheduler>(maxBytes, SCHEDULER_DEFAULT_RESOLUTION)),
+	  maxBuckets_(maxBuckets), maxDelay_(maxDelay), rules_(std::make_shared<const RuleSet>()), lastSweep_(0)
+{
+}
+
+void PolicerStage::SetRules(std::vector<PolicerRule> rules)
+{
+	std::shared_ptr<RuleSet> set = std::make_shared<RuleSet>();
+	for (size_t i = 0; i < rules.size(); i++)
+	{
+		set->states.push_back(std::make_shared<RuleState>(this->maxBuckets_));
+	}
+	set->rules = std::move(rules);
+	std::lock_guard<std::mutex> lock(this->updateMutex_);
+	std::atomic_store(&this->rules_, std::shared_ptr<const RuleSet>(set));
+}
+
+size_t PolicerStage::RuleCount()
+{
+	return std::atomic_load(&this->rules_)->rules.size();
+}
+
+UINT64 PolicerStage::Charge(Bucket &bucket, const PolicerLimit &limit, UINT length, UINT64 now, UINT64 maxWait)
+{
+	const UINT64 increment = static_cast<UINT64>(length * 1e9 / limit.rate);
+	const UINT64 tolerance = static_cast<UINT64>(limit.burst * 1e9 / limit.rate);
+	UINT64 tat = bucket.tat.load(std::memory_order_relaxed);
+	while (true)
+	{
+		const UINT64 base = std::max(tat, now);
+		const UINT64 wait = base > now + tolerance ? base - now - tolerance : 0;
+		if (wait > maxWait)
+		{
+			return wait;
+		}
+		if (bucket.tat.compare_exchange_weak(tat, base + increment, std::memory_order_relaxed))
+		{
+			return wait;
+		}
+	}
+}
+
+void PolicerStage::Refund(Bucket &bucket, const PolicerLimit &limit, UINT length)
+{
+	const UINT64 increment = static_cast<UINT64>(length * 1e9 / limit.rate);
+	UINT64 tat = bucket.tat.load(std::memory_order_relaxed);
+	while (!bucket.tat.compare_exchange_weak(tat, tat > increment ? tat - increment : 0, std::memory_order_relaxed))
+	{
+	}
+}
+
+StageVerdict PolicerStage::Process(PacketContext &ctx)
+{
+	if (!ctx.parsed)
+	{
+		return STAGE_CONTINUE;
+	}
+	std::shared_ptr<const RuleSet> set = std::atomic_load(&this->rules_);
+	size_t index = 0;
+	while (index < set->rules.size() && !MatchPacket(set->rules[index].match, ctx.data, ctx.info, *ctx.addr))
+	{
+		index++;
+	}
+	if (index == set->rules.size())
+	{
+		return STAGE_CONTINUE;
+	}
+	const PolicerRule &rule = set->rules[index];
+	RuleState &state = *set->states[index];
+	state.packets++;
+	state.bytes += ctx.length;
+
+	PolicerLimit limit = rule.limit;
+	FlowKey key;
+	bool keyed = false;
+	if (rule.key != POLICER_KEY_RULE && FlowKeyFromPacket(ctx.data, ctx.info, ctx.addr->Outbound != 0, &key))
+	{
+		keyed = true;
+		if (rule.key == POLICER_KEY_PROCESS)
+		{
+			FlowEntry entry;
+			const uint32_t processId = this->flowIndex_ && this->flowIndex_->Lookup(key, &entry) ? entry.processId : 0;
+			auto found = rule.processes.find(processId);
+			if (found != rule.processes.end())
+			{
+				limit = found->second;
+			}
+			std::memset(&key, 0, sizeof(FlowKey));
+			key.localAddr[0] = processId;
+		}
+	}
+	if (limit.rate <= 0)
+	{
+		state.conformed++;
+		return STAGE_PASS;
+	}
+
+	// Sniffed copies cannot be reinjected later, so a delaying rule drops them instead.
+	const bool delay = rule.action == POLICER_DELAY && ctx.reinject;
+	const UINT64 maxWait = delay ? this->maxDelay_ : 0;
+	const UINT64 now = NowNs();
+	UINT64 wait = 0;
+	if (!keyed)
+	{
+		wait = Charge(state.shared, limit, ctx.length, now, maxWait);
+	}
+	else
+	{
+		bool found = false;
+		{
+			std::shared_lock<std::shared_mutex> lock(state.mutex);
+			Bucket *bucket = state.table.Find(key);
+			if (bucket != nullptr)
+			{
+				wait = Charge(*bucket, limit, ctx.length, now, maxWait);
+				found = true;
+			}
+		}
+		if (!found)
+		{
+			std::unique_lock<std::shared_mutex> lock(state.mutex);
+			Bucket *bucket = state.table.Find(key);
+			if (bucket == nullptr)
+			{
+				bucket = state.table.Insert(key, Bucket());
+			}
+			wait = Charge(bucket != nullptr ? *bucket : state.shared, limit, ctx.length, now, maxWait);
+		}
+	}
+
+	if (wait == 0)
+	{
+		state.conformed++;
+		return STAGE_PASS;
+	}
+	if (wait > maxWait)
+	{
+		state.dropped++;
+		return STAGE_DROP;
+	}
+	if (!this->scheduler_->Schedule(ctx.handle, ctx.data, ctx.length, *ctx.addr, PacketScheduler::Now() + (wait + 999) / 1000))
+	{
+		// The packet never departs, so it must not use up the bucket either.
+		if (!keyed)
+		{
+			Refund(state.shared, limit, ctx.length);
+		}
+		else
+		{
+			std::shared_lock<std::shared_mutex> lock(state.mutex);
+			Bucket *bucket = state.table.Find(key);
+			Refund(bucket != nullptr ? *bucket : state.shared, limit, ctx.length);
+		}
+		state.dropped++;
+		return STAGE_DROP;
+	}
+	state.delayed++;
+	return STAGE_HOLD;
+}
+
+void PolicerStage::Tick(UINT64 now)
+{
+	UINT64 last = this->lastSweep_.load();
+	if (now - last < POLICER_SWEEP_INTERVAL || !this->lastSweep_.compare_exchange_strong(last, now))
+	{
+		return;
+	}
+	std::shared_ptr<const RuleSet> set = std::atomic_load(&this->rules_);
+	const UINT64 time = NowNs();
+	for (const std::shared_ptr<RuleState> &state : set->states)
+	{
+		// A bucket whose arrival time has passed is as good as a new one.
+		std::unique_lock<std::shared_mutex> lock(state->mutex);
+		state->table.EraseIf([time](const FlowKey &, const Bucket &bucket)
+		{
+			return bucket.tat.load(std::memory_order_relaxed) <= time;
+		});
+	}
+}
+
+void PolicerStage::Detach(HANDLE handle)
+{
+	this->scheduler_->Detach(handle);
+}
+
+void PolicerStage::GetStats(SchedulerStats *scheduler, std::vector<PolicerRuleStats> *rules)
+{
+	this->scheduler_->GetStats(scheduler);
+	std::shared_ptr<const RuleSet> set = std::atomic_load(&this->rules_);
+	rules->clear();
+	for (const std::shared_ptr<RuleState> &state : set->states)
+	{
+		PolicerRuleStats stats;
+		stats.packets = state->packets;
+		stats.bytes = state->bytes;
+		stats.conformed = state->conformed;
+		stats.delayed = state->delayed;
+		stats.dropped = state->dropped;
+		{
+			std::shared_lock<std::shared_mutex> lock(state->mutex);
+			stats.buckets = state->table.Size();
+		}
+		rules->push_back(stats);
+	}
+}
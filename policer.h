@@ -0,0 +1,218 @@
+/**
+ * @file policer.h
+ * @brief Rate limiting stage with lock-free buckets per rule, flow or process
+ *
+ * Every bucket is a single atomic theoretical arrival time (GCRA, the virtual scheduling
+ * form of a token bucket): a packet of L bytes advances it by L / rate, and the packet
+ * conforms while the arrival time lies less than burst / rate ahead of now. Receive
+ * threads update buckets with compare and swap under a shared lock of their table; the
+ * exclusive lock is only taken to add a bucket for a new key or to sweep idle ones.
+ *
+ * Buckets are kept per rule, per flow, or per owning process when the policer is given a
+ * FlowIndex. Packets over the limit are dropped, or held by a PacketScheduler until they
+ * conform if the rule delays. Rules are replaced as a whole and read without locking.
+ */
+
+#ifndef POLICER_H_
+#define POLICER_H_
+
+#include <atomic>
+#include <memory>
+#include <shared_mutex>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "windivert.h"
+#include "packet.h"
+#include "flow-table.h"
+#include "flow-index.h"
+#include "packet-match.h"
+#include "packet-stage.h"
+#include "packet-scheduler.h"
+
+#define POLICER_DEFAULT_MAX_BUCKETS (1 << 16)
+#define POLICER_DEFAULT_MAX_DELAY   200      ///< Milliseconds a delaying rule may hold a packet
+#define POLICER_SWEEP_INTERVAL      1000     ///< Milliseconds between sweeps of idle buckets
+
+/**
+ * @enum PolicerKey
+ * @brief What a rule keeps separate buckets for
+ */
+enum PolicerKey {
+	POLICER_KEY_RULE = 0,      ///< One bucket for all matching packets
+	POLICER_KEY_FLOW = 1,      ///< One bucket per 5-tuple, both directions
+	POLICER_KEY_PROCESS = 2    ///< One bucket per owning process, unknown flows share process 0
+};
+
+/**
+ * @enum PolicerAction
+ * @brief Fate of packets over the limit
+ */
+enum PolicerAction {
+	POLICER_DROP = 0,
+	POLICER_DELAY = 1          ///< Hold until the packet conforms, drop if that exceeds maxDelay
+};
+
+/**
+ * @struct PolicerLimit
+ * @brief Rate of a bucket
+ */
+struct PolicerLimit {
+	double rate;               ///< Bytes per second, 0 for no limit
+	double burst;              ///< Bytes sent back to back before the rate applies
+};
+
+/**
+ * @struct PolicerRule
+ * @brief Match, key and limits of a rule
+ */
+struct PolicerRule {
+	PacketMatch match;
+	PolicerKey key;
+	PolicerAction action;
+	PolicerLimit limit;                                     ///< Limit of every bucket of the rule
+	std::unordered_map<uint32_t, PolicerLimit> processes;   ///< Per process overrides of limit
+};
+
+/**
+ * @struct PolicerRuleStats
+ * @brief Counters of one rule since the rules were set
+ */
+struct PolicerRuleStats {
+	UINT64 packets;            ///< Matched packets
+	UINT64 bytes;              ///< Matched bytes
+	UINT64 conformed;          ///< Packets within the limit
+	UINT64 delayed;            ///< Packets held until they conformed
+	UINT64 dropped;            ///< Packets dropped
+	UINT64 buckets;            ///< Buckets in use
+};
+
+/**
+ * @class PolicerStage
+ * @brief PacketStage enforcing PolicerRule limits
+ */
+class PolicerStage : public PacketStage {
+	public:
+		/**
+		 * @param flowIndex Index to attribute packets to processes, may be empty
+		 * @param maxBuckets Buckets per rule; new keys beyond share the rule bucket
+		 * @param maxBytes Cap on bytes held by delaying rules
+		 * @param maxDelay Longest hold in nanoseconds
+		 */
+		PolicerStage(const std::shared_ptr<FlowIndex> &flowIndex, size_t maxBuckets, size_t maxBytes, UINT64 maxDelay);
+
+		/**
+		 * @brief Replaces the rules, evaluated in order; buckets and counters restart
+		 */
+		void SetRules(std::vector<PolicerRule> rules);
+
+		/**
+		 * @brief Changes rules in place, keeping their buckets and counters
+		 * @param apply Called once with a copy of the rules to modify
+		 */
+		template <typename F>
+		void UpdateRules(F apply)
+		{
+			std::lock_guard<std::mutex> lock(this->updateMutex_);
+			std::shared_ptr<RuleSet> set = std::make_shared<RuleSet>(*std::atomic_load(&this->rules_));
+			apply(set->rules);
+			std::atomic_store(&this->rules_, std::shared_ptr<const RuleSet>(set));
+		}
+
+		/**
+		 * @brief Number of rules currently set
+		 */
+		size_t RuleCount();
+
+		/**
+		 * @brief Polices a packet
+		 * @return STAGE_PASS if it conforms, STAGE_HOLD if delayed, STAGE_DROP if over the
+		 *         limit, STAGE_CONTINUE if no rule matched
+		 */
+		StageVerdict Process(PacketContext &ctx) override;
+
+		/**
+		 * @brief Forgets refilled buckets at most once per POLICER_SWEEP_INTERVAL
+		 */
+		void Tick(UINT64 now) override;
+
+		/**
+		 * @brief Sends the packets still held for a closing handle
+		 */
+		void Detach(HANDLE handle) override;
+
+		void GetStats(SchedulerStats *scheduler, std::vector<PolicerRuleStats> *rules);
+
+	private:
+		/**
+		 * @struct Bucket
+		 * @brief Theoretical arrival time in nanoseconds, copyable so it can live in a FlowTable
+		 */
+		struct Bucket {
+			std::atomic<UINT64> tat;
+
+			Bucket() : tat(0)
+			{
+			}
+
+			Bucket(const Bucket &other) : tat(other.tat.load(std::memory_order_relaxed))
+			{
+			}
+
+			Bucket &operator=(const Bucket &other)
+			{
+				tat.store(other.tat.load(std::memory_order_relaxed), std::memory_order_relaxed);
+				return *this;
+			}
+		};
+
+		/**
+		 * @struct RuleState
+		 * @brief Buckets and counters of a rule, kept across UpdateRules
+		 */
+		struct RuleState {
+			explicit RuleState(size_t maxBuckets) : table(maxBuckets), packets(0), bytes(0), conformed(0), delayed(0), dropped(0)
+			{
+			}
+
+			std::shared_mutex mutex;          ///< Exclusive to change table, shared to update its buckets
+			FlowTable<Bucket> table;          ///< Flow or process buckets
+			Bucket shared;                    ///< Rule bucket, also used when table is full
+			std::atomic<UINT64> packets;
+			std::atomic<UINT64> bytes;
+			std::atomic<UINT64> conformed;
+			std::atomic<UINT64> delayed;
+			std::atomic<UINT64> dropped;
+		};
+
+		/**
+		 * @struct RuleSet
+		 * @brief Rules with their state, replaced as a whole
+		 */
+		struct RuleSet {
+			std::vector<PolicerRule> rules;
+			std::vector<std::shared_ptr<RuleState>> states;
+		};
+
+		/**
+		 * @brief Charges a packet to a bucket
+		 * @return Nanoseconds until the packet conforms; the bucket is only charged if that
+		 *         is 0, or at most maxWait
+		 */
+		static UINT64 Charge(Bucket &bucket, const PolicerLimit &limit, UINT length, UINT64 now, UINT64 maxWait);
+
+		/**
+		 * @brief Gives back the charge of a packet that was not sent after all
+		 */
+		static void Refund(Bucket &bucket, const PolicerLimit &limit, UINT length);
+
+		std::shared_ptr<FlowIndex> flowIndex_;          ///< Process attribution, may be empty
+		std::shared_ptr<PacketScheduler> scheduler_;    ///< Holds delayed packets
+		size_t maxBuckets_;
+		UINT64 maxDelay_;                               ///< Nanoseconds
+		std::shared_ptr<const RuleSet> rules_;          ///< Accessed with std::atomic_load/store
+		std::mutex updateMutex_;                        ///< Serialises SetRules and UpdateRules
+		std::atomic<UINT64> lastSweep_;
+};
+
+#endif
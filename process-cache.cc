@@ -0,0 +1,104 @@
+/**
+ * @file process-cache.cc
+ * @brief ProcessId to image path cache
+ */
+
+#include "process-cache.h"
+
+ProcessCache::ProcessCache(ULONGLONG ttl) : ttl_(ttl)
+{
+}
+
+/**
+ * @brief Opens a process and reads its creation time
+ * @return Process handle, or NULL if the process cannot be opened
+ */
+static HANDLE OpenProcessInfo(UINT32 processId, UINT64 *creationTime)
+{
+	HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId);
+	if (process == NULL)
+	{
+		return NULL;
+	}
+	FILETIME creation, exit, kernel, user;
+	if (!GetProcessTimes(process, &creation, &exit, &kernel, &user))
+	{
+		CloseHandle(process);
+		return NULL;
+	}
+	*creationTime = (static_cast<UINT64>(creation.dwHighDateTime) << 32) | creation.dwLowDateTime;
+	return process;
+}
+
+bool ProcessCache::Lookup(UINT32 processId, std::string *path)
+{
+	const ULONGLONG now = GetTickCount64();
+	std::unique_lock<std::mutex> lock(this->mutex_);
+	auto it = this->entries_.find(processId);
+	if (it != this->entries_.end() && now - it->second.checkedAt < this->ttl_)
+	{
+		*path = it->second.path;
+		return true;
+	}
+	lock.unlock();
+
+	UINT64 creationTime = 0;
+	HANDLE process = OpenProcessInfo(processId, &creationTime);
+	if (process == NULL)
+	{
+		this->Invalidate(processId);
+		return false;
+	}
+
+	lock.lock();
+	it = this->entries_.find(processId);
+	if (it != this->entries_.end() && it->second.creationTime == creationTime)
+	{
+		// Same process as before, only the time to live expired.
+		it->second.checkedAt = now;
+		*path = it->second.path;
+		CloseHandle(process);
+		return true;
+	}
+	lock.unlock();
+
+	WCHAR image[MAX_PATH * 2];
+	DWORD size = sizeof(image) / sizeof(image[0]);
+	BOOL ok = QueryFullProcessImageNameW(process, 0, image, &size);
+	CloseHandle(process);
+	if (!ok)
+	{
+		this->Invalidate(processId);
+		return false;
+	}
+	// UTF-16 to UTF-8, keeping surrogate pairs together.
+	const int length = WideCharToMultiByte(CP_UTF8, 0, image, static_cast<int>(size), NULL, 0, NULL, NULL);
+	path->assign(length > 0 ? length : 0, '\0');
+	if (length > 0)
+	{
+		WideCharToMultiByte(CP_UTF8, 0, image, static_cast<int>(size), &(*path)[0], length, NULL, NULL);
+	}
+
+	lock.lock();
+	if (this->entries_.size() >= PROCESS_CACHE_MAX)
+	{
+		for (auto entry = this->entries_.begin(); entry != this->entries_.end();)
+		{
+			entry = now - entry->second.checkedAt >= this->ttl_ ? this->entries_.erase(entry) : std::next(entry);
+		}
+	}
+	this->entries_[processId] = Entry{*path, creationTime, now};
+	return true;
+}
+
+void ProcessCache::Invalidate(UINT32 processId)
+{
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	this->entries_.erase(processId);
+}
+
+void ProcessCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	this->entries_.clear();
+}
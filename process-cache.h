@@ -0,0 +1,59 @@
+/**
+ * @file process-cache.h
+ * @brief ProcessId to image path cache
+ *
+ * Entries are revalidated once their time to live expires: the process creation time is
+ * compared with the cached one, so a reused ProcessId is detected and the image path is
+ * only queried again when the process actually changed.
+ */
+
+#ifndef PROCESS_CACHE_H_
+#define PROCESS_CACHE_H_
+
+#include <windows.h>
+#include <string>
+#include <mutex>
+#include <unordered_map>
+
+#define PROCESS_CACHE_TTL_MS   5000
+#define PROCESS_CACHE_MAX      4096
+
+/**
+ * @class ProcessCache
+ * @brief Thread safe cache of QueryFullProcessImageNameW results
+ */
+class ProcessCache {
+	public:
+		explicit ProcessCache(ULONGLONG ttl = PROCESS_CACHE_TTL_MS);
+
+		/**
+		 * @brief Returns the UTF-8 image path of a process
+		 * @param processId Process to look up
+		 * @param path Receives the image path
+		 * @return false if the process does not exist or cannot be queried
+		 */
+		bool Lookup(UINT32 processId, std::string *path);
+
+		/**
+		 * @brief Forgets one process, the next lookup queries the system again
+		 */
+		void Invalidate(UINT32 processId);
+
+		/**
+		 * @brief Forgets all processes
+		 */
+		void Clear();
+
+	private:
+		struct Entry {
+			std::string path;        ///< UTF-8 image path
+			UINT64 creationTime;     ///< Process creation FILETIME
+			ULONGLONG checkedAt;     ///< GetTickCount64 of the last validation
+		};
+
+		std::mutex mutex_;                              ///< Guards entries_
+		std::unordered_map<UINT32, Entry> entries_;     ///< Cached processes
+		ULONGLONG ttl_;                                 ///< Milliseconds before revalidation
+};
+
+#endif
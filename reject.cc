@@ -0,0 +1,130 @@
+/**
+ * @file reject.cc
+ * @brief Replies that refuse a packet instead of silently dropping it
+ */
+
+#include <cstring>
+#include "checksum.h"
+#include "reject.h"
+
+#define ICMP_UNREACH          3
+#define ICMP_UNREACH_PORT     3
+#define ICMPV6_UNREACH        1
+#define ICMPV6_UNREACH_PORT   4
+
+/**
+ * @brief Tests whether a packet is one RFC 1122 and RFC 4443 forbid answering with an error.
+ */
+static bool Unanswerable(const UINT8 *data, const PacketInfo &info)
+{
+	if (info.version == 4)
+	{
+		const UINT8 *src = data + 12;
+		const UINT8 *dst = data + 16;
+		if (ReadBE32(src) == 0 || (src[0] & 0xF0) == 0xE0 || (dst[0] & 0xF0) == 0xE0 || ReadBE32(dst) == 0xFFFFFFFF)
+		{
+			return true;
+		}
+		if (info.protocol == PACKET_PROTO_ICMP && info.transportLength != 0)
+		{
+			const UINT8 type = data[info.transportOffset];
+			return type != 0 && type != 8 && type != 13 && type != 14;
+		}
+		return false;
+	}
+	static const UINT8 unspecified[16] = {0};
+	if (std::memcmp(data + 8, unspecified, 16) == 0 || data[8] == 0xFF || data[24] == 0xFF)
+	{
+		return true;
+	}
+	// ICMPv6 types below 128 are errors.
+	return info.protocol == PACKET_PROTO_ICMPV6 && info.transportLength != 0 && data[info.transportOffset] < 128;
+}
+
+/**
+ * @brief Writes an IP header carrying a reply back to the packet's source.
+ * @return Header length
+ */
+static UINT32 WriteReplyHeader(const UINT8 *data, const PacketInfo &info, UINT8 protocol, UINT32 length, UINT8 *out)
+{
+	if (info.version == 4)
+	{
+		std::memset(out, 0, PACKET_IPV4_HDR_MIN);
+		out[0] = 0x45;
+		WriteBE16(out + 2, static_cast<UINT16>(length));
+		out[8] = REJECT_TTL;
+		out[9] = protocol;
+		std::memcpy(out + 12, data + 16, 4);
+		std::memcpy(out + 16, data + 12, 4);
+		return PACKET_IPV4_HDR_MIN;
+	}
+	std::memset(out, 0, PACKET_IPV6_HDR_LEN);
+	out[0] = 0x60;
+	WriteBE16(out + 4, static_cast<UINT16>(length - PACKET_IPV6_HDR_LEN));
+	out[6] = protocol;
+	out[7] = REJECT_TTL;
+	std::memcpy(out + 8, data + 24, 16);
+	std::memcpy(out + 24, data + 8, 16);
+	return PACKET_IPV6_HDR_LEN;
+}
+
+UINT32 BuildReject(const UINT8 *data, const PacketInfo &info, UINT8 *out)
+{
+	if (info.fragOffset != 0 || Unanswerable(data, info))
+	{
+		return 0;
+	}
+	const UINT32 ipLength = info.version == 4 ? PACKET_IPV4_HDR_MIN : PACKET_IPV6_HDR_LEN;
+
+	if (info.protocol == PACKET_PROTO_TCP)
+	{
+		const UINT8 *tcp = data + info.transportOffset;
+		if (info.transportLength < PACKET_TCP_HDR_MIN || (tcp[13] & PACKET_TCP_RST) != 0)
+		{
+			return 0;
+		}
+		const UINT32 length = ipLength + PACKET_TCP_HDR_MIN;
+		UINT8 *reply = out + WriteReplyHeader(data, info, PACKET_PROTO_TCP, length, out);
+		std::memset(reply, 0, PACKET_TCP_HDR_MIN);
+		std::memcpy(reply, tcp + 2, 2);
+		std::memcpy(reply + 2, tcp, 2);
+		reply[12] = (PACKET_TCP_HDR_MIN / 4) << 4;
+		if (tcp[13] & PACKET_TCP_ACK)
+		{
+			// RFC 793: the RST takes its sequence number from the acknowledgement.
+			std::memcpy(reply + 4, tcp + 8, 4);
+			reply[13] = PACKET_TCP_RST;
+		}
+		else
+		{
+			const UINT32 segment = info.payloadLength + ((tcp[13] & PACKET_TCP_SYN) ? 1 : 0) + ((tcp[13] & PACKET_TCP_FIN) ? 1 : 0);
+			WriteBE32(reply + 8, ReadBE32(tcp + 4) + segment);
+			reply[13] = PACKET_TCP_RST | PACKET_TCP_ACK;
+		}
+		CalcPacketChecksums(out, length);
+		return length;
+	}
+
+	const UINT32 limit = info.version == 4 ? REJECT_QUOTE_IPV4 : REJECT_QUOTE_IPV6;
+	const UINT32 quote = info.length < limit ? info.length : limit;
+	const UINT32 length = ipLength + PACKET_ICMP_HDR_LEN + quote;
+	UINT8 *reply = out + WriteReplyHeader(data, info, info.version == 4 ? PACKET_PROTO_ICMP : PACKET_PROTO_ICMPV6, length, out);
+	std::memset(reply, 0, PACKET_ICMP_HDR_LEN);
+	reply[0] = info.version == 4 ? ICMP_UNREACH : ICMPV6_UNREACH;
+	reply[1] = info.version == 4 ? ICMP_UNREACH_PORT : ICMPV6_UNREACH_PORT;
+	std::memcpy(reply + PACKET_ICMP_HDR_LEN, data, quote);
+	CalcPacketChecksums(out, length);
+	return length;
+}
+
+void RejectAddress(const WINDIVERT_ADDRESS &addr, WINDIVERT_ADDRESS *reply)
+{
+	*reply = addr;
+	if (!addr.Loopback)
+	{
+		reply->Outbound = addr.Outbound ? 0 : 1;
+	}
+	reply->IPChecksum = 1;
+	reply->TCPChecksum = 1;
+	reply->UDPChecksum = 1;
+}
@@ -0,0 +1,42 @@
+/**
+ * @file reject.h
+ * @brief Replies that refuse a packet instead of silently dropping it
+ *
+ * A dropped packet leaves its sender retrying until a timeout; a reply tells it at once.
+ * TCP segments are answered with a RST whose sequence and acknowledgement numbers the
+ * sender accepts, everything else with an ICMP or ICMPv6 port unreachable quoting the
+ * start of the packet. The receive thread adds the reply to its send batch when a stage
+ * returns STAGE_REJECT.
+ */
+
+#ifndef REJECT_H_
+#define REJECT_H_
+
+#include "windivert.h"
+#include "packet.h"
+
+#define REJECT_QUOTE_IPV4 548   ///< Bytes quoted, so an ICMP reply fits in 576 bytes
+#define REJECT_QUOTE_IPV6 1232  ///< Bytes quoted, so an ICMPv6 reply fits in the IPv6 minimum MTU
+#define REJECT_TTL        64
+#define REJECT_MAX_LENGTH (PACKET_IPV6_HDR_LEN + PACKET_ICMP_HDR_LEN + REJECT_QUOTE_IPV6)
+
+/**
+ * @brief Builds the reply refusing a packet
+ * @param data Packet to refuse
+ * @param info Its headers
+ * @param out Receives up to REJECT_MAX_LENGTH bytes, checksums included
+ * @return Reply length, or 0 for packets that must not be answered: non-first fragments,
+ *         RSTs, ICMP errors, truncated TCP headers, and packets from an unspecified or to a
+ *         multicast or broadcast address
+ */
+UINT32 BuildReject(const UINT8 *data, const PacketInfo &info, UINT8 *out);
+
+/**
+ * @brief Derives the address of a reply from the address of the packet it answers
+ * @param addr Address of the refused packet
+ * @param reply Receives the reply's address, sent in the opposite direction on the same
+ *              interface; loopback traffic stays outbound
+ */
+void RejectAddress(const WINDIVERT_ADDRESS &addr, WINDIVERT_ADDRESS *reply);
+
+#endif
@@ -0,0 +1,271 @@
+/**
+ * @module ring
+ * @description SharedArrayBuffer packet lanes for worker_threads consumers.
+ * The native receive thread publishes packets into one lane per worker; workers read them
+ * in place and return verdicts through the same lane, so no packet is copied through postMessage.
+ * The memory layout must match packet-ring.h.
+ */
+
+/**
+ * @constant {Object} RING
+ * @description Int32 indices of the lane control block and lane constants
+ */
+const RING = Object.freeze({
+	CONTROL_BYTES: 512,
+	HEAD: 0,
+	TAIL: 16,
+	VERDICT_HEAD: 32,
+	VERDICT_TAIL: 48,
+	WAITING: 64,
+	OVERSIZE: 80,
+	ADDRESS_SIZE: 80,
+	VERDICT_WORDS: 2,
+	ACTION_SHIFT: 24,
+	WAIT_SLICE_MS: 50
+});
+
+/**
+ * @constant {Object} VERDICT
+ * @description What the native verdict thread does with a slot
+ * @property {number} PASS - Reinject the slot as it is
+ * @property {number} DROP - Drop the packet
+ * @property {number} PASS_CHECKSUM - Recalculate checksums, then reinject
+ */
+const VERDICT = Object.freeze({
+	PASS: 0,
+	DROP: 1,
+	PASS_CHECKSUM: 2
+});
+
+/**
+ * @constant {Object} AFFINITY
+ * @description How the native receiver distributes packets over lanes
+ * @property {number} FLOW - Both directions of a flow always go to the same lane
+ * @property {number} ROUND_ROBIN - Packets are spread evenly over the lanes
+ */
+const AFFINITY = Object.freeze({
+	FLOW: 0,
+	ROUND_ROBIN: 1
+});
+
+/**
+ * Computes the byte offsets of the regions of one lane
+ * @param {number} slots - Slot count, a power of two
+ * @param {number} slotSize - Bytes of packet data per slot
+ * @returns {Object} Region offsets and total byteLength
+ */
+function ringLayout(slots, slotSize) {
+	const lengthsOffset = RING.CONTROL_BYTES;
+	const addrsOffset = lengthsOffset + slots * 4;
+	const verdictsOffset = addrsOffset + slots * RING.ADDRESS_SIZE;
+	const dataOffset = (verdictsOffset + slots * RING.VERDICT_WORDS * 4 + 63) & ~63;
+	return {
+		lengthsOffset,
+		addrsOffset,
+		verdictsOffset,
+		dataOffset,
+		byteLength: dataOffset + slots * slotSize
+	};
+}
+
+/**
+ * Consumer side of one lane. Use it from exactly one thread.
+ */
+class RingLane {
+	/**
+	 * Creates a new RingLane
+	 * @param {SharedArrayBuffer} buffer - Lane memory
+	 * @param {number} slots - Slot count
+	 * @param {number} slotSize - Bytes of packet data per slot
+	 */
+	constructor(buffer, slots, slotSize) {
+		this.buffer = buffer;
+		this.slots = slots;
+		this.slotSize = slotSize;
+		this.mask = slots - 1;
+		this.layout = ringLayout(slots, slotSize);
+		this.control = new Int32Array(buffer, 0, RING.CONTROL_BYTES / 4);
+		this.lengths = new Int32Array(buffer, this.layout.lengthsOffset, slots);
+		this.verdicts = new Int32Array(buffer, this.layout.verdictsOffset, slots * RING.VERDICT_WORDS);
+	}
+
+	/**
+	 * Takes the next published slot
+	 * @param {number} [timeout=Infinity] - Milliseconds to wait; 0 never blocks (required on the main thread)
+	 * @returns {number} Slot id, or -1 if no packet arrived in time
+	 */
+	next(timeout = Infinity) {
+		const tail = Atomics.load(this.control, RING.TAIL);
+		let head = Atomics.load(this.control, RING.HEAD);
+		if (head === tail) {
+			if (timeout <= 0) {
+				return -1;
+			}
+			const deadline = Date.now() + timeout;
+			Atomics.store(this.control, RING.WAITING, 1);
+			while (head === tail) {
+				const remaining = deadline - Date.now();
+				if (remaining <= 0) {
+					break;
+				}
+				// Wait in slices so a doorbell lost to a busy main thread only costs one slice.
+				Atomics.wait(this.control, RING.HEAD, head, Math.min(remaining, RING.WAIT_SLICE_MS));
+				head = Atomics.load(this.control, RING.HEAD);
+			}
+			Atomics.store(this.control, RING.WAITING, 0);
+			if (head === tail) {
+				return -1;
+			}
+		}
+		Atomics.store(this.control, RING.TAIL, (tail + 1) | 0);
+		return tail & this.mask;
+	}
+
+	/**
+	 * Returns the packet stored in a slot. The view is valid until a verdict is given.
+	 * @param {number} slot - Slot id
+	 * @returns {Buffer} Packet data
+	 */
+	packet(slot) {
+		return Buffer.from(this.buffer, this.layout.dataOffset + slot * this.slotSize, this.lengths[slot]);
+	}
+
+	/**
+	 * Returns the WINDIVERT_ADDRESS stored in a slot
+	 * @param {number} slot - Slot id
+	 * @returns {Buffer} Address data
+	 */
+	addr(slot) {
+		return Buffer.from(this.buffer, this.layout.addrsOffset + slot * RING.ADDRESS_SIZE, RING.ADDRESS_SIZE);
+	}
+
+	/**
+	 * Reinjects the packet in a slot, including any in-place modification that keeps checksums valid
+	 * @param {number} slot - Slot id
+	 */
+	pass(slot) {
+		this.verdict(slot, VERDICT.PASS);
+	}
+
+	/**
+	 * Reinjects a packet modified in place after recalculating its checksums
+	 * @param {number} slot - Slot id
+	 * @param {number} [newLength=0] - New packet length, at most slotSize; 0 keeps the received length
+	 */
+	passModified(slot, newLength = 0) {
+		this.verdict(slot, VERDICT.PASS_CHECKSUM, newLength);
+	}
+
+	/**
+	 * Drops the packet in a slot
+	 * @param {number} slot - Slot id
+	 */
+	drop(slot) {
+		this.verdict(slot, VERDICT.DROP);
+	}
+
+	/**
+	 * Appends an entry to the verdict ring. The slot must not be touched afterwards.
+	 * @param {number} slot - Slot id
+	 * @param {number} action - One of VERDICT
+	 * @param {number} [newLength=0] - New packet length, 0 keeps the received length
+	 */
+	verdict(slot, action, newLength = 0) {
+		const head = Atomics.load(this.control, RING.VERDICT_HEAD);
+		const index = (head & this.mask) * RING.VERDICT_WORDS;
+		this.verdicts[index] = slot | (action << RING.ACTION_SHIFT);
+		this.verdicts[index + 1] = newLength;
+		Atomics.store(this.control, RING.VERDICT_HEAD, (head + 1) | 0);
+	}
+
+	/**
+	 * Number of packets too large for a slot that were reinjected natively
+	 * @returns {number}
+	 */
+	get oversize() {
+		return Atomics.load(this.control, RING.OVERSIZE);
+	}
+}
+
+/**
+ * A set of lanes backed by SharedArrayBuffers. Create it on the main thread, attach it to a
+ * handle with handle.attachRing(ring) and pass ring.shared to each worker through workerData.
+ */
+class PacketRing {
+	/**
+	 * Creates a new PacketRing
+	 * @param {Object} [options]
+	 * @param {number} [options.lanes=1] - Number of lanes, one per consumer (1-32)
+	 * @param {number} [options.slots=1024] - Slots per lane, a power of two
+	 * @param {number} [options.slotSize=2048] - Bytes of packet data per slot
+	 * @param {SharedArrayBuffer[]} [options.buffers] - Existing lane memory, see PacketRing.fromShared
+	 */
+	constructor({ lanes = 1, slots = 1024, slotSize = 2048, buffers } = {}) {
+		if (!Number.isInteger(slots) || slots < 2 || (slots & (slots - 1)) !== 0) {
+			throw new RangeError('slots must be a power of two');
+		}
+		const layout = ringLayout(slots, slotSize);
+		this.slots = slots;
+		this.slotSize = slotSize;
+		this.buffers = buffers || Array.from({ length: lanes }, () => new SharedArrayBuffer(layout.byteLength));
+		this.lanes = this.buffers.map((buffer) => new RingLane(buffer, slots, slotSize));
+	}
+
+	/**
+	 * Description of the ring that can be posted to workers; the buffers are shared, not copied
+	 * @returns {{buffers: SharedArrayBuffer[], slots: number, slotSize: number}}
+	 */
+	get shared() {
+		return { buffers: this.buffers, slots: this.slots, slotSize: this.slotSize };
+	}
+
+	/**
+	 * Recreates a ring from its shared description inside a worker
+	 * @param {Object} shared - Value of ring.shared
+	 * @returns {PacketRing}
+	 */
+	static fromShared(shared) {
+		return new PacketRing(shared);
+	}
+
+	/**
+	 * Returns one lane
+	 * @param {number} index - Lane index
+	 * @returns {RingLane}
+	 */
+	lane(index) {
+		return this.lanes[index];
+	}
+
+	/**
+	 * Wakes the consumers of the given lanes
+	 * @param {number} mask - Bit mask of lane indices
+	 */
+	notify(mask) {
+		for (let i = 0; i < this.lanes.length; i++) {
+			if (mask & (1 << i)) {
+				Atomics.notify(this.lanes[i].control, RING.HEAD);
+			}
+		}
+	}
+}
+
+/**
+ * @function attachRing
+ * @description Starts delivering a handle's packets into the lanes of a ring
+ * @param {Object} handle - Opened WinDivert handle
+ * @param {PacketRing} ring - Ring created on this thread
+ * @param {Object} [options]
+ * @param {number} [options.affinity=AFFINITY.FLOW] - Lane selection policy
+ */
+function attachRing(handle, ring, { affinity = AFFINITY.FLOW } = {}) {
+	handle.recvRing(
+		(mask) => ring.notify(mask),
+		ring.buffers.map((buffer) => new Uint8Array(buffer)),
+		ring.slots,
+		ring.slotSize,
+		affinity
+	);
+}
+
+module.exports = { RING, VERDICT, AFFINITY, ringLayout, RingLane, PacketRing, attachRing };
@@ -0,0 +1,155 @@
+/**
+ * @file sampler.cc
+ * @brief Sampling stage that keeps monitoring handles from delivering every packet to JavaScript
+ */
+
+#include <cstring>
+#include "sampler.h"
+
+#define SAMPLER_HASH_RANGE (1ULL << 32)
+
+/**
+ * @brief 64-bit finalizer spreading a seeded value over all bits
+ */
+static UINT64 Mix(UINT64 value)
+{
+	value ^= value >> 33;
+	value *= 0xFF51AFD7ED558CCDULL;
+	value ^= value >> 33;
+	value *= 0xC4CEB9FE1A85EC53ULL;
+	value ^= value >> 33;
+	return value;
+}
+
+SamplerStage::SamplerStage(const SamplerConfig &config)
+	: config_(config), sequence_(0), bytes_(0), sampled_(0), sampledBytes_(0), untracked_(0), intervalStart_(0),
+	  intervalSeen_(0), intervalTaken_(0), threshold_(SAMPLER_HASH_RANGE), flows_(config.maxFlows), lastSweep_(0)
+{
+}
+
+StageVerdict SamplerStage::Process(PacketContext &ctx)
+{
+	const UINT64 sequence = this->sequence_.fetch_add(1, std::memory_order_relaxed);
+	this->bytes_.fetch_add(ctx.length, std::memory_order_relaxed);
+	FlowKey key;
+	if (ctx.parsed)
+	{
+		// Packets without ports still hash on their addresses and protocol.
+		FlowKeyFromPacket(ctx.data, ctx.info, ctx.addr->Outbound != 0, &key);
+	}
+	else
+	{
+		std::memset(&key, 0, sizeof(key));
+	}
+
+	bool sampled;
+	switch (this->config_.policy)
+	{
+		case SAMPLER_RESERVOIR:
+			sampled = this->SampleReservoir(ctx, key, sequence);
+			break;
+		case SAMPLER_FIRST:
+			sampled = this->SampleFirst(ctx, key);
+			break;
+		default:
+			sampled = this->SampleRate(key, sequence);
+			break;
+	}
+	if (!sampled)
+	{
+		return ctx.reinject ? STAGE_PASS : STAGE_DROP;
+	}
+	this->sampled_.fetch_add(1, std::memory_order_relaxed);
+	this->sampledBytes_.fetch_add(ctx.length, std::memory_order_relaxed);
+	return STAGE_CONTINUE;
+}
+
+UINT32 SamplerStage::Hash(const FlowKey &key, UINT64 sequence)
+{
+	const UINT64 value = this->config_.key == SAMPLER_BY_FLOW ? FlowHash(key) : sequence;
+	return static_cast<UINT32>(Mix(value ^ this->config_.seed) >> 32);
+}
+
+bool SamplerStage::SampleRate(const FlowKey &key, UINT64 sequence)
+{
+	if (this->config_.key == SAMPLER_BY_PACKET)
+	{
+		return sequence % this->config_.rate == 0;
+	}
+	return this->Hash(key, sequence) < SAMPLER_HASH_RANGE / this->config_.rate;
+}
+
+bool SamplerStage::SampleReservoir(const PacketContext &ctx, const FlowKey &key, UINT64 sequence)
+{
+	UINT64 start = this->intervalStart_.load(std::memory_order_relaxed);
+	// Another thread may have started the interval after ctx.now was read.
+	if (ctx.now > start && ctx.now - start >= this->config_.interval &&
+		this->intervalStart_.compare_exchange_strong(start, ctx.now, std::memory_order_relaxed))
+	{
+		// Admit the share of the next interval that would have filled this one exactly.
+		const UINT64 seen = this->intervalSeen_.exchange(0, std::memory_order_relaxed);
+		this->intervalTaken_.store(0, std::memory_order_relaxed);
+		this->threshold_.store(seen <= this->config_.size ? SAMPLER_HASH_RANGE : SAMPLER_HASH_RANGE * this->config_.size / seen,
+							   std::memory_order_relaxed);
+	}
+	this->intervalSeen_.fetch_add(1, std::memory_order_relaxed);
+	if (this->Hash(key, sequence) >= this->threshold_.load(std::memory_order_relaxed))
+	{
+		return false;
+	}
+	return this->intervalTaken_.fetch_add(1, std::memory_order_relaxed) < this->config_.size;
+}
+
+bool SamplerStage::SampleFirst(const PacketContext &ctx, const FlowKey &key)
+{
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	FlowCount *flow = this->flows_.Find(key);
+	if (flow == nullptr)
+	{
+		flow = this->flows_.Insert(key, FlowCount{0, ctx.now});
+		if (flow == nullptr)
+		{
+			this->untracked_.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+	}
+	flow->last = ctx.now;
+	if (flow->packets >= this->config_.count)
+	{
+		return false;
+	}
+	flow->packets++;
+	return true;
+}
+
+void SamplerStage::Tick(UINT64 now)
+{
+	if (this->config_.policy != SAMPLER_FIRST)
+	{
+		return;
+	}
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	// Threads of other handles may have stamped a later time, so only sweep forward.
+	if (now <= this->lastSweep_ || now - this->lastSweep_ < SAMPLER_SWEEP_INTERVAL)
+	{
+		return;
+	}
+	this->lastSweep_ = now;
+	const UINT64 idle = this->config_.idleTimeout;
+	this->flows_.EraseIf([now, idle](const FlowKey &, const FlowCount &flow)
+	{
+		return now > flow.last && now - flow.last >= idle;
+	});
+}
+
+void SamplerStage::GetStats(SamplerStats *stats)
+{
+	stats->packets = this->sequence_.load(std::memory_order_relaxed);
+	stats->bytes = this->bytes_.load(std::memory_order_relaxed);
+	stats->sampled = this->sampled_.load(std::memory_order_relaxed);
+	stats->sampledBytes = this->sampledBytes_.load(std::memory_order_relaxed);
+	stats->untracked = this->untracked_.load(std::memory_order_relaxed);
+	stats->probability = static_cast<double>(this->threshold_.load(std::memory_order_relaxed)) / SAMPLER_HASH_RANGE;
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	stats->flows = this->flows_.Size();
+}
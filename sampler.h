@@ -0,0 +1,133 @@
+/**
+ * @file sampler.h
+ * @brief Sampling stage that keeps monitoring handles from delivering every packet to JavaScript
+ *
+ * Packets the policy selects continue down the chain and reach JavaScript; the others only
+ * update counters and are dropped, or passed natively on handles that can reinject. Hash
+ * based decisions use the flow key mixed with a seed, so the same flows are picked on every
+ * handle sharing the seed and for as long as the policy keeps its threshold.
+ */
+
+#ifndef SAMPLER_H_
+#define SAMPLER_H_
+
+#include <atomic>
+#include <mutex>
+#include "windivert.h"
+#include "packet.h"
+#include "flow-table.h"
+#include "packet-stage.h"
+
+#define SAMPLER_DEFAULT_MAX_FLOWS (1 << 16)
+#define SAMPLER_DEFAULT_INTERVAL  1000     ///< Milliseconds of a reservoir interval
+#define SAMPLER_DEFAULT_IDLE      30000    ///< Milliseconds after which a first-K flow is forgotten
+#define SAMPLER_SWEEP_INTERVAL    1000     ///< Milliseconds between sweeps of idle flows
+
+/**
+ * @enum SamplerPolicy
+ * @brief How packets are selected
+ */
+enum SamplerPolicy {
+	SAMPLER_RATE = 0,          ///< One in rate packets, or flows
+	SAMPLER_RESERVOIR = 1,     ///< At most size packets per interval, spread over the interval
+	SAMPLER_FIRST = 2          ///< The first count packets of every flow
+};
+
+/**
+ * @enum SamplerKey
+ * @brief What the hash of RATE and RESERVOIR decisions is computed over
+ */
+enum SamplerKey {
+	SAMPLER_BY_FLOW = 0,       ///< Whole flows are sampled or not
+	SAMPLER_BY_PACKET = 1      ///< Each packet is decided on its own
+};
+
+/**
+ * @struct SamplerConfig
+ * @brief Policy and its parameters
+ */
+struct SamplerConfig {
+	SamplerPolicy policy;
+	SamplerKey key;
+	UINT32 rate;               ///< RATE: one in rate
+	UINT32 size;               ///< RESERVOIR: packets per interval
+	UINT32 interval;           ///< RESERVOIR: milliseconds
+	UINT32 count;              ///< FIRST: packets per flow
+	UINT32 idleTimeout;        ///< FIRST: milliseconds
+	size_t maxFlows;           ///< FIRST: flows tracked; packets of further flows are not sampled
+	UINT64 seed;               ///< Mixed into every hash
+};
+
+/**
+ * @struct SamplerStats
+ * @brief Counters since the sampler was created
+ */
+struct SamplerStats {
+	UINT64 packets;            ///< Packets seen
+	UINT64 bytes;
+	UINT64 sampled;            ///< Packets let through to JavaScript
+	UINT64 sampledBytes;
+	UINT64 flows;              ///< FIRST: flows tracked
+	UINT64 untracked;          ///< FIRST: packets not sampled because the flow table was full
+	double probability;        ///< RESERVOIR: admission probability of the current interval
+};
+
+/**
+ * @class SamplerStage
+ * @brief PacketStage letting a sample of the packets through
+ */
+class SamplerStage : public PacketStage {
+	public:
+		explicit SamplerStage(const SamplerConfig &config);
+
+		/**
+		 * @brief Decides whether a packet is sampled
+		 * @return STAGE_CONTINUE if sampled, otherwise STAGE_DROP, or STAGE_PASS if the
+		 *         handle can reinject
+		 */
+		StageVerdict Process(PacketContext &ctx) override;
+
+		/**
+		 * @brief Forgets idle FIRST flows at most once per SAMPLER_SWEEP_INTERVAL
+		 */
+		void Tick(UINT64 now) override;
+
+		void GetStats(SamplerStats *stats);
+
+	private:
+		/**
+		 * @struct FlowCount
+		 * @brief Packets seen of a FIRST flow
+		 */
+		struct FlowCount {
+			UINT32 packets;
+			UINT64 last;       ///< GetTickCount64 of the last packet
+		};
+
+		/**
+		 * @brief 32-bit decision hash of the packet's flow, or of its sequence number
+		 */
+		UINT32 Hash(const FlowKey &key, UINT64 sequence);
+
+		bool SampleRate(const FlowKey &key, UINT64 sequence);
+		bool SampleReservoir(const PacketContext &ctx, const FlowKey &key, UINT64 sequence);
+		bool SampleFirst(const PacketContext &ctx, const FlowKey &key);
+
+		SamplerConfig config_;
+		std::atomic<UINT64> sequence_;         ///< Packets seen, numbers them for per-packet decisions
+		std::atomic<UINT64> bytes_;
+		std::atomic<UINT64> sampled_;
+		std::atomic<UINT64> sampledBytes_;
+		std::atomic<UINT64> untracked_;
+
+		std::atomic<UINT64> intervalStart_;    ///< RESERVOIR: GetTickCount64 the interval began
+		std::atomic<UINT64> intervalSeen_;     ///< RESERVOIR: packets seen in the interval
+		std::atomic<UINT64> intervalTaken_;    ///< RESERVOIR: admissions in the interval, may overshoot size
+		std::atomic<UINT64> threshold_;        ///< RESERVOIR: hashes below are admitted, 2^32 admits all
+
+		std::mutex mutex_;                     ///< Guards flows_ and lastSweep_
+		FlowTable<FlowCount> flows_;           ///< FIRST: per-flow counts
+		UINT64 lastSweep_;
+};
+
+#endif
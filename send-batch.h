@@ -0,0 +1,145 @@
+/**
+ * @file send-batch.h
+ * @brief Accumulates packets and injects them with as few WinDivertSendEx calls as possible
+ */
+
+#ifndef SEND_BATCH_H_
+#define SEND_BATCH_H_
+
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include "windivert.h"
+
+#define SEND_BATCH_BYTES (256 * 1024)
+
+/**
+ * @class SendBatch
+ * @brief Packets stored back to back with one WINDIVERT_ADDRESS each, as WinDivertSendEx expects
+ *
+ * Not thread safe; each sending thread owns its own batch.
+ */
+class SendBatch {
+	public:
+		/**
+		 * @brief Creates an empty batch for a handle
+		 * @param handle Opened WinDivert handle
+		 */
+		explicit SendBatch(HANDLE handle) : handle_(handle), sent_(0), failed_(0)
+		{
+			data_.reserve(SEND_BATCH_BYTES);
+			addrs_.reserve(WINDIVERT_BATCH_MAX);
+		}
+
+		~SendBatch()
+		{
+			Flush();
+		}
+
+		/**
+		 * @brief Appends a packet, flushing first if the batch is full
+		 * @param packet Packet data
+		 * @param length Packet length
+		 * @param addr Address to inject the packet with
+		 */
+		void Add(const void *packet, UINT length, const WINDIVERT_ADDRESS &addr)
+		{
+			std::memcpy(Reserve(length, addr), packet, length);
+		}
+
+		/**
+		 * @brief Appends room for a packet that the caller builds in place
+		 * @param length Packet length
+		 * @param addr Address to inject the packet with
+		 * @return Pointer to length bytes, valid until the next call on the batch
+		 */
+		UINT8 *Reserve(UINT length, const WINDIVERT_ADDRESS &addr)
+		{
+			if (addrs_.size() >= WINDIVERT_BATCH_MAX || (!addrs_.empty() && data_.size() + length > SEND_BATCH_BYTES))
+			{
+				Flush();
+			}
+			size_t offset = data_.size();
+			data_.resize(offset + length);
+			addrs_.push_back(addr);
+			return data_.data() + offset;
+		}
+
+		/**
+		 * @brief Injects all pending packets with one WinDivertSendEx call
+		 * @return false if the driver rejected the batch
+		 */
+		bool Flush()
+		{
+			if (addrs_.empty())
+			{
+				return true;
+			}
+			UINT sendLen = 0;
+			BOOL ok = WinDivertSendEx(handle_, data_.data(), static_cast<UINT>(data_.size()), &sendLen, 0,
+									  addrs_.data(), static_cast<UINT>(addrs_.size() * sizeof(WINDIVERT_ADDRESS)), NULL);
+			if (ok)
+			{
+				sent_ += addrs_.size();
+			}
+			else
+			{
+				failed_ += addrs_.size();
+				std::cerr << "Warning: Failed to send packet batch. Error code: " << GetLastError() << std::endl;
+			}
+			data_.clear();
+			addrs_.clear();
+			return ok != 0;
+		}
+
+		/**
+		 * @brief Handle the batch injects on
+		 */
+		HANDLE Handle() const
+		{
+			return handle_;
+		}
+
+		/**
+		 * @brief Flushes the pending packets, then injects on another handle
+		 * @param handle Opened WinDivert handle
+		 */
+		void SetHandle(HANDLE handle)
+		{
+			Flush();
+			handle_ = handle;
+		}
+
+		/**
+		 * @brief Packets added but not yet flushed
+		 */
+		size_t Pending() const
+		{
+			return addrs_.size();
+		}
+
+		/**
+		 * @brief Packets accepted by the driver so far
+		 */
+		UINT64 Sent() const
+		{
+			return sent_;
+		}
+
+		/**
+		 * @brief Packets in batches the driver rejected
+		 */
+		UINT64 Failed() const
+		{
+			return failed_;
+		}
+
+	private:
+		HANDLE handle_;                          ///< Handle to inject on
+		std::vector<UINT8> data_;                ///< Concatenated packets
+		std::vector<WINDIVERT_ADDRESS> addrs_;   ///< One address per packet
+		UINT64 sent_;                            ///< Packets sent
+		UINT64 failed_;                          ///< Packets in failed batches
+};
+
+#endif
@@ -0,0 +1,241 @@
+/**
+ * @file seq-tracker.cc
+ * @brief Per-flow TCP sequence offsets for rewrites that resize payloads
+ */
+
+#include <cstring>
+#include "checksum.h"
+#include "seq-tracker.h"
+
+SeqTrackerStage::SeqTrackerStage(size_t maxFlows, UINT64 idleTimeout)
+	: idleTimeout_(idleTimeout), table_(maxFlows), lastSweep_(0), flows_(0), untracked_(0), expired_(0),
+	  recorded_(0), shifted_(0), sackBlocks_(0)
+{
+}
+
+INT32 SeqTrackerStage::OriginalDelta(const FlowShifts &flow, UINT32 seq)
+{
+	INT32 delta = 0;
+	for (UINT32 i = 0; i < flow.count && static_cast<INT32>(seq - flow.shifts[i].seq) >= 0; i++)
+	{
+		delta = flow.shifts[i].delta;
+	}
+	return delta;
+}
+
+INT32 SeqTrackerStage::RewrittenDelta(const FlowShifts &flow, UINT32 seq)
+{
+	INT32 delta = 0;
+	for (UINT32 i = 0; i < flow.count; i++)
+	{
+		const UINT32 rewritten = flow.shifts[i].seq + static_cast<UINT32>(flow.shifts[i].delta);
+		if (static_cast<INT32>(seq - rewritten) < 0)
+		{
+			break;
+		}
+		delta = flow.shifts[i].delta;
+	}
+	return delta;
+}
+
+bool SeqTrackerStage::Record(const FlowKey &key, UINT32 seq, UINT32 length, INT32 growth, bool shifted, UINT64 now)
+{
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	FlowShifts *flow = this->table_.Find(key);
+	if (flow == nullptr)
+	{
+		FlowShifts empty;
+		empty.count = 0;
+		empty.lastSeen = now;
+		flow = this->table_.Insert(key, empty);
+		if (flow == nullptr)
+		{
+			this->untracked_++;
+			return false;
+		}
+		this->flows_.store(this->table_.Size(), std::memory_order_relaxed);
+	}
+	flow->lastSeen = now;
+	if (shifted)
+	{
+		seq -= static_cast<UINT32>(RewrittenDelta(*flow, seq));
+	}
+	const UINT32 end = seq + length;
+	if (flow->count > 0)
+	{
+		const SeqShift &last = flow->shifts[flow->count - 1];
+		if (last.seq == end)
+		{
+			// Retransmission of the resized segment: it is resized the same way again.
+			return true;
+		}
+		if (static_cast<INT32>(end - last.seq) < 0)
+		{
+			this->untracked_++;
+			return false;
+		}
+	}
+	if (flow->count == SEQ_TRACKER_MAX_SHIFTS)
+	{
+		// Only retransmissions of data before the oldest shift are affected.
+		std::memmove(flow->shifts, flow->shifts + 1, sizeof(SeqShift) * (SEQ_TRACKER_MAX_SHIFTS - 1));
+		flow->count--;
+	}
+	SeqShift &shift = flow->shifts[flow->count];
+	shift.seq = end;
+	shift.delta = (flow->count > 0 ? flow->shifts[flow->count - 1].delta : 0) + growth;
+	flow->count++;
+	this->recorded_.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+UINT32 SeqTrackerStage::ShiftSack(UINT8 *tcp, UINT32 headerLength, const FlowShifts &flow, bool checksum)
+{
+	// Options start on an even offset and are a multiple of four bytes long, so the checksum
+	// delta can be taken over the whole option area at once.
+	UINT8 before[40];
+	UINT8 *options = tcp + PACKET_TCP_HDR_MIN;
+	const UINT32 length = headerLength - PACKET_TCP_HDR_MIN;
+	std::memcpy(before, options, length);
+	UINT32 blocks = 0;
+	for (UINT32 i = 0; i < length;)
+	{
+		const UINT8 kind = options[i];
+		if (kind == PACKET_TCP_OPT_EOL)
+		{
+			break;
+		}
+		if (kind == PACKET_TCP_OPT_NOP)
+		{
+			i++;
+			continue;
+		}
+		if (i + 1 >= length || options[i + 1] < 2 || i + options[i + 1] > length)
+		{
+			break;
+		}
+		if (kind == PACKET_TCP_OPT_SACK)
+		{
+			for (UINT32 edge = i + 2; edge + 8 <= i + options[i + 1]; edge += 8)
+			{
+				const UINT32 left = ReadBE32(options + edge);
+				const UINT32 right = ReadBE32(options + edge + 4);
+				WriteBE32(options + edge, left - static_cast<UINT32>(RewrittenDelta(flow, left)));
+				WriteBE32(options + edge + 4, right - static_cast<UINT32>(RewrittenDelta(flow, right)));
+				blocks++;
+			}
+		}
+		i += options[i + 1];
+	}
+	if (blocks > 0 && checksum)
+	{
+		ChecksumUpdate(tcp + 16, ChecksumDelta(0, before, options, length));
+	}
+	return blocks;
+}
+
+bool SeqTrackerStage::Shift(PacketContext &ctx, FlowKey *key, bool *keyed)
+{
+	*keyed = false;
+	if (this->flows_.load(std::memory_order_relaxed) == 0 || !ctx.parsed || ctx.info.fragment ||
+		ctx.info.protocol != PACKET_PROTO_TCP || ctx.info.transportLength < PACKET_TCP_HDR_MIN)
+	{
+		return false;
+	}
+	const bool outbound = ctx.addr->Outbound != 0;
+	*keyed = FlowKeyFromPacket(ctx.data, ctx.info, outbound, key);
+	if (!*keyed)
+	{
+		return false;
+	}
+	UINT8 *tcp = ctx.data + ctx.info.transportOffset;
+	FlowShifts flow;
+	{
+		std::lock_guard<std::mutex> lock(this->mutex_);
+		FlowShifts *found = this->table_.Find(*key);
+		if (found == nullptr)
+		{
+			return false;
+		}
+		found->lastSeen = ctx.now;
+		flow = *found;
+		if ((tcp[13] & PACKET_TCP_RST) != 0)
+		{
+			// The RST itself is still shifted.
+			this->table_.Erase(*key);
+			this->flows_.store(this->table_.Size(), std::memory_order_relaxed);
+		}
+	}
+
+	bool changed = false;
+	INT32 delta = 0;
+	if (outbound)
+	{
+		delta = OriginalDelta(flow, ReadBE32(tcp + 4));
+	}
+	else if ((tcp[13] & PACKET_TCP_ACK) != 0)
+	{
+		delta = -RewrittenDelta(flow, ReadBE32(tcp + 8));
+	}
+	if (delta != 0)
+	{
+		UINT8 *field = tcp + (outbound ? 4 : 8);
+		UINT8 before[4];
+		std::memcpy(before, field, sizeof(before));
+		WriteBE32(field, ReadBE32(field) + static_cast<UINT32>(delta));
+		if (ctx.addr->TCPChecksum)
+		{
+			ChecksumUpdate(tcp + 16, ChecksumDelta(0, before, field, sizeof(before)));
+		}
+		changed = true;
+	}
+	if (!outbound && ctx.info.transportLength > PACKET_TCP_HDR_MIN)
+	{
+		const UINT32 blocks = ShiftSack(tcp, ctx.info.transportLength, flow, ctx.addr->TCPChecksum != 0);
+		if (blocks > 0)
+		{
+			this->sackBlocks_.fetch_add(blocks, std::memory_order_relaxed);
+			changed = true;
+		}
+	}
+	if (changed)
+	{
+		this->shifted_.fetch_add(1, std::memory_order_relaxed);
+	}
+	return changed;
+}
+
+StageVerdict SeqTrackerStage::Process(PacketContext &ctx)
+{
+	FlowKey key;
+	bool keyed;
+	Shift(ctx, &key, &keyed);
+	return STAGE_CONTINUE;
+}
+
+void SeqTrackerStage::Tick(UINT64 now)
+{
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	if (now - this->lastSweep_ < SEQ_TRACKER_SWEEP_INTERVAL)
+	{
+		return;
+	}
+	this->lastSweep_ = now;
+	const UINT64 idle = this->idleTimeout_;
+	this->expired_ += this->table_.EraseIf([now, idle](const FlowKey &, const FlowShifts &flow)
+	{
+		return now > flow.lastSeen && now - flow.lastSeen > idle;
+	});
+	this->flows_.store(this->table_.Size(), std::memory_order_relaxed);
+}
+
+void SeqTrackerStage::GetStats(SeqTrackerStats *stats)
+{
+	stats->recorded = this->recorded_.load(std::memory_order_relaxed);
+	stats->shifted = this->shifted_.load(std::memory_order_relaxed);
+	stats->sackBlocks = this->sackBlocks_.load(std::memory_order_relaxed);
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	stats->untracked = this->untracked_;
+	stats->expired = this->expired_;
+	stats->flows = this->table_.Size();
+}
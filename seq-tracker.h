@@ -0,0 +1,135 @@
+/**
+ * @file seq-tracker.h
+ * @brief Per-flow TCP sequence offsets for rewrites that resize payloads
+ *
+ * A stage that adds or removes payload bytes records the change here. The outbound
+ * stream then has two numberings: the original one the local stack uses and the
+ * rewritten one the peer sees. From the recorded position on, outbound sequence numbers
+ * are moved forward by the cumulative change, and inbound acknowledgement numbers and
+ * SACK block edges are moved back, with the TCP checksum fixed incrementally.
+ */
+
+#ifndef SEQ_TRACKER_H_
+#define SEQ_TRACKER_H_
+
+#include <atomic>
+#include <mutex>
+#include "windivert.h"
+#include "packet.h"
+#include "flow-table.h"
+#include "packet-stage.h"
+
+#define SEQ_TRACKER_DEFAULT_MAX_FLOWS (1 << 16)
+#define SEQ_TRACKER_DEFAULT_IDLE      300000   ///< Idle milliseconds before a shifted flow is forgotten
+#define SEQ_TRACKER_SWEEP_INTERVAL    1000     ///< Milliseconds between expiry sweeps
+#define SEQ_TRACKER_MAX_SHIFTS        8        ///< Resizes remembered per flow
+
+/**
+ * @struct SeqTrackerStats
+ * @brief Counters since the tracker was created
+ */
+struct SeqTrackerStats {
+	UINT64 recorded;          ///< Resizes recorded
+	UINT64 shifted;           ///< Packets whose sequence or acknowledgement number was moved
+	UINT64 sackBlocks;        ///< SACK blocks moved
+	UINT64 untracked;         ///< Resizes refused because the table was full or out of order
+	UINT64 expired;           ///< Flows forgotten after the idle timeout
+	UINT64 flows;             ///< Flows with a shift
+};
+
+/**
+ * @class SeqTrackerStage
+ * @brief PacketStage keeping both ends of resized TCP streams in agreement
+ */
+class SeqTrackerStage : public PacketStage {
+	public:
+		/**
+		 * @param maxFlows Flows with a shift tracked at once
+		 * @param idleTimeout Idle milliseconds before a shifted flow is forgotten
+		 */
+		SeqTrackerStage(size_t maxFlows, UINT64 idleTimeout);
+
+		/**
+		 * @brief Records that an outbound segment was resized before being sent
+		 * @param key Flow of the segment
+		 * @param seq Sequence number of the segment, in the rewritten stream if shifted is true
+		 * @param length Original payload length
+		 * @param growth Bytes added, negative if removed
+		 * @param shifted seq was already moved by Shift
+		 * @param now GetTickCount64
+		 * @return false if the table is full or the segment precedes the last recorded resize;
+		 *         a retransmitted segment that was already recorded returns true
+		 */
+		bool Record(const FlowKey &key, UINT32 seq, UINT32 length, INT32 growth, bool shifted, UINT64 now);
+
+		/**
+		 * @brief Moves the sequence, acknowledgement and SACK numbers of a packet of a shifted flow
+		 * @param ctx Parsed packet
+		 * @param key Receives the flow key if the packet is TCP with ports
+		 * @param keyed Receives whether key was set
+		 * @return true if the packet was changed
+		 */
+		bool Shift(PacketContext &ctx, FlowKey *key, bool *keyed);
+
+		/**
+		 * @brief Shifts the packet
+		 * @return STAGE_CONTINUE
+		 */
+		StageVerdict Process(PacketContext &ctx) override;
+
+		/**
+		 * @brief Expires idle flows at most once per SEQ_TRACKER_SWEEP_INTERVAL
+		 */
+		void Tick(UINT64 now) override;
+
+		void GetStats(SeqTrackerStats *stats);
+
+	private:
+		/**
+		 * @struct SeqShift
+		 * @brief Sequence numbers from seq on, in the original stream, move by delta
+		 */
+		struct SeqShift {
+			UINT32 seq;
+			INT32 delta;          ///< Cumulative, includes earlier shifts
+		};
+
+		/**
+		 * @struct FlowShifts
+		 * @brief Shifts of one flow in stream order
+		 */
+		struct FlowShifts {
+			UINT32 count;
+			SeqShift shifts[SEQ_TRACKER_MAX_SHIFTS];
+			UINT64 lastSeen;
+		};
+
+		/**
+		 * @brief Returns the delta of an original sequence number
+		 */
+		static INT32 OriginalDelta(const FlowShifts &flow, UINT32 seq);
+
+		/**
+		 * @brief Returns the delta of a sequence number of the rewritten stream
+		 */
+		static INT32 RewrittenDelta(const FlowShifts &flow, UINT32 seq);
+
+		/**
+		 * @brief Moves the edges of the SACK blocks of an inbound packet back
+		 * @return Number of blocks moved
+		 */
+		static UINT32 ShiftSack(UINT8 *tcp, UINT32 headerLength, const FlowShifts &flow, bool checksum);
+
+		UINT64 idleTimeout_;
+		std::mutex mutex_;                ///< Guards table_, lastSweep_, untracked_ and expired_
+		FlowTable<FlowShifts> table_;
+		UINT64 lastSweep_;
+		std::atomic<size_t> flows_;       ///< table_.Size(), read without the lock to skip packets quickly
+		UINT64 untracked_;
+		UINT64 expired_;
+		std::atomic<UINT64> recorded_;
+		std::atomic<UINT64> shifted_;
+		std::atomic<UINT64> sackBlocks_;
+};
+
+#endif
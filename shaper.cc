@@ -0,0 +1,162 @@
+/**
+ * @file shaper.cc
+ * @brief Delay, jitter and rate shaping stage backed by a PacketScheduler
+ */
+
+#include "shaper.h"
+
+ShaperStage::ShaperStage(size_t maxBytes, UINT32 resolution, size_t maxFlows)
+	: scheduler_(std::make_shared<PacketScheduler>(maxBytes, resolution)), maxFlows_(maxFlows), lastSweep_(0),
+	  random_(PacketScheduler::Now() | 1)
+{
+}
+
+void ShaperStage::SetClasses(const std::vector<ShaperClass> &classes)
+{
+	const UINT64 now = PacketScheduler::Now();
+	std::vector<ClassState> states(classes.size());
+	for (size_t i = 0; i < classes.size(); i++)
+	{
+		states[i].config = classes[i];
+		states[i].bucket = TokenBucket{classes[i].burst, now};
+		if (classes[i].perFlow && classes[i].rate > 0)
+		{
+			states[i].flows.reset(new FlowTable<TokenBucket>(this->maxFlows_));
+		}
+		std::memset(&states[i].stats, 0, sizeof(ShaperClassStats));
+	}
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	this->classes_ = std::move(states);
+}
+
+UINT64 ShaperStage::Take(TokenBucket *bucket, const ShaperClass &config, UINT length, UINT64 now)
+{
+	if (now > bucket->last)
+	{
+		bucket->tokens += static_cast<double>(now - bucket->last) * config.rate / 1e6;
+		if (bucket->tokens > config.burst)
+		{
+			bucket->tokens = config.burst;
+		}
+		bucket->last = now;
+	}
+	bucket->tokens -= length;
+	return bucket->tokens < 0 ? static_cast<UINT64>(-bucket->tokens * 1e6 / config.rate) : 0;
+}
+
+UINT64 ShaperStage::Random()
+{
+	this->random_ ^= this->random_ << 13;
+	this->random_ ^= this->random_ >> 7;
+	this->random_ ^= this->random_ << 17;
+	return this->random_;
+}
+
+StageVerdict ShaperStage::Process(PacketContext &ctx)
+{
+	// Sniffed copies cannot be reinjected, so there is nothing to hold back.
+	if (!ctx.parsed || !ctx.reinject)
+	{
+		return STAGE_CONTINUE;
+	}
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	ClassState *state = nullptr;
+	for (ClassState &candidate : this->classes_)
+	{
+		if (MatchPacket(candidate.config.match, ctx.data, ctx.info, *ctx.addr))
+		{
+			state = &candidate;
+			break;
+		}
+	}
+	if (state == nullptr)
+	{
+		return STAGE_CONTINUE;
+	}
+	const ShaperClass &config = state->config;
+	state->stats.packets++;
+	state->stats.bytes += ctx.length;
+
+	const UINT64 now = PacketScheduler::Now();
+	UINT64 deadline = now + config.delay;
+	TokenBucket *bucket = nullptr;
+	if (config.rate > 0)
+	{
+		FlowKey key;
+		if (state->flows && FlowKeyFromPacket(ctx.data, ctx.info, ctx.addr->Outbound != 0, &key))
+		{
+			bucket = state->flows->Find(key);
+			if (bucket == nullptr)
+			{
+				bucket = state->flows->Insert(key, TokenBucket{config.burst, now});
+			}
+		}
+		if (bucket == nullptr)
+		{
+			bucket = &state->bucket;
+		}
+		deadline += Take(bucket, config, ctx.length, now);
+	}
+	if (config.jitter > 0)
+	{
+		deadline += Random() % (config.jitter + 1);
+	}
+	if (deadline <= now)
+	{
+		return STAGE_PASS;
+	}
+	if (!this->scheduler_->Schedule(ctx.handle, ctx.data, ctx.length, *ctx.addr, deadline))
+	{
+		// The packet never departs, so it must not use up the bucket either.
+		if (bucket != nullptr)
+		{
+			bucket->tokens += ctx.length;
+		}
+		state->stats.dropped++;
+		return STAGE_DROP;
+	}
+	state->stats.delayed++;
+	return STAGE_HOLD;
+}
+
+void ShaperStage::Tick(UINT64 now)
+{
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	if (now - this->lastSweep_ < SHAPER_SWEEP_INTERVAL)
+	{
+		return;
+	}
+	this->lastSweep_ = now;
+	const UINT64 time = PacketScheduler::Now();
+	for (ClassState &state : this->classes_)
+	{
+		if (!state.flows)
+		{
+			continue;
+		}
+		// A bucket that has refilled completely is indistinguishable from a new one.
+		const ShaperClass &config = state.config;
+		state.flows->EraseIf([&config, time](const FlowKey &, const TokenBucket &bucket)
+		{
+			return bucket.tokens + static_cast<double>(time - bucket.last) * config.rate / 1e6 >= config.burst;
+		});
+	}
+}
+
+void ShaperStage::Detach(HANDLE handle)
+{
+	this->scheduler_->Detach(handle);
+}
+
+void ShaperStage::GetStats(SchedulerStats *scheduler, std::vector<ShaperClassStats> *classes)
+{
+	this->scheduler_->GetStats(scheduler);
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	classes->clear();
+	for (const ClassState &state : this->classes_)
+	{
+		ShaperClassStats stats = state.stats;
+		stats.flows = state.flows ? state.flows->Size() : 0;
+		classes->push_back(stats);
+	}
+}
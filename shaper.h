@@ -0,0 +1,130 @@
+/**
+ * @file shaper.h
+ * @brief Delay, jitter and rate shaping stage backed by a PacketScheduler
+ *
+ * Packets are classified by the first matching class. A class may add a fixed delay, a
+ * uniform random jitter and a token bucket rate limit, either shared by the class or kept
+ * per flow. Buckets may run negative: the deficit of a packet becomes its queueing delay,
+ * so a backlogged flow departs at exactly the configured rate. Packets that end up with
+ * a deadline in the future are held by the scheduler and reinjected without a trip
+ * through JavaScript; the others pass immediately. Unmatched packets are left alone.
+ *
+ * Held packets skip the stages attached after the shaper, so it is normally attached last.
+ */
+
+#ifndef SHAPER_H_
+#define SHAPER_H_
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "windivert.h"
+#include "packet.h"
+#include "flow-table.h"
+#include "packet-match.h"
+#include "packet-stage.h"
+#include "packet-scheduler.h"
+
+#define SHAPER_DEFAULT_MAX_FLOWS (1 << 16)
+#define SHAPER_SWEEP_INTERVAL    1000     ///< Milliseconds between sweeps of idle flow buckets
+
+/**
+ * @struct ShaperClass
+ * @brief Match and treatment of a traffic class
+ */
+struct ShaperClass {
+	PacketMatch match;    ///< Packets of the class
+	UINT64 delay;         ///< Fixed delay in microseconds
+	UINT64 jitter;        ///< Random extra delay of up to this many microseconds
+	double rate;          ///< Bytes per second, 0 for no rate limit
+	double burst;         ///< Bucket depth in bytes
+	bool perFlow;         ///< One bucket per flow instead of one for the class
+};
+
+/**
+ * @struct TokenBucket
+ * @brief Bucket state, tokens are bytes and go negative while packets are queued
+ */
+struct TokenBucket {
+	double tokens;
+	UINT64 last;          ///< PacketScheduler::Now() of the last refill
+};
+
+/**
+ * @struct ShaperClassStats
+ * @brief Counters of one class since the classes were set
+ */
+struct ShaperClassStats {
+	UINT64 packets;       ///< Matched packets
+	UINT64 bytes;         ///< Matched bytes
+	UINT64 delayed;       ///< Packets handed to the scheduler
+	UINT64 dropped;       ///< Packets dropped because the scheduler was full
+	UINT64 flows;         ///< Flow buckets in use
+};
+
+/**
+ * @class ShaperStage
+ * @brief PacketStage holding packets back according to their class
+ */
+class ShaperStage : public PacketStage {
+	public:
+		/**
+		 * @param maxBytes Cap on held packet bytes
+		 * @param resolution Microseconds per scheduler tick
+		 * @param maxFlows Flow buckets per class; flows beyond share the class bucket
+		 */
+		ShaperStage(size_t maxBytes, UINT32 resolution, size_t maxFlows);
+
+		/**
+		 * @brief Replaces the classes, evaluated in order; buckets and class counters restart
+		 */
+		void SetClasses(const std::vector<ShaperClass> &classes);
+
+		/**
+		 * @brief Classifies a packet and holds it if it has to wait
+		 * @return STAGE_HOLD if held, STAGE_PASS if its class lets it go now, STAGE_DROP
+		 *         if it had to wait but the scheduler is full, STAGE_CONTINUE if unmatched
+		 */
+		StageVerdict Process(PacketContext &ctx) override;
+
+		/**
+		 * @brief Forgets idle flow buckets at most once per SHAPER_SWEEP_INTERVAL
+		 */
+		void Tick(UINT64 now) override;
+
+		/**
+		 * @brief Sends the packets still held for a closing handle
+		 */
+		void Detach(HANDLE handle) override;
+
+		void GetStats(SchedulerStats *scheduler, std::vector<ShaperClassStats> *classes);
+
+	private:
+		/**
+		 * @struct ClassState
+		 * @brief A class with its buckets and counters
+		 */
+		struct ClassState {
+			ShaperClass config;
+			TokenBucket bucket;                               ///< Class bucket, also used when flows_ is full
+			std::unique_ptr<FlowTable<TokenBucket>> flows;    ///< Per-flow buckets if config.perFlow
+			ShaperClassStats stats;
+		};
+
+		/**
+		 * @brief Refills a bucket and takes a packet from it
+		 * @return Microseconds the packet has to wait
+		 */
+		static UINT64 Take(TokenBucket *bucket, const ShaperClass &config, UINT length, UINT64 now);
+
+		UINT64 Random();
+
+		std::shared_ptr<PacketScheduler> scheduler_;   ///< Holds delayed packets on this stage's own scheduler thread
+		size_t maxFlows_;
+		std::mutex mutex_;                ///< Guards everything below
+		std::vector<ClassState> classes_;
+		UINT64 lastSweep_;                ///< Time of the last idle sweep
+		UINT64 random_;                   ///< xorshift64 state for jitter
+};
+
+#endif
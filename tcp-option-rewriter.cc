@@ -0,0 +1,207 @@
+/**
+ * @file tcp-option-rewriter.cc
+ * @brief Rule based stage rewriting the window and options of TCP segments
+ */
+
+#include <cstring>
+#include "checksum.h"
+#include "tcp-option-rewriter.h"
+
+int BuildTcpOptions(const UINT8 *options, UINT32 length, bool syn, const TcpOptionRule &rule, UINT8 *out,
+					TcpOptionEdits *edits)
+{
+	UINT32 written = 0;
+	bool hasMss = false;
+	bool hasWscale = false;
+	bool hasSackPerm = false;
+	UINT32 i = 0;
+	while (i < length && options[i] != PACKET_TCP_OPT_EOL)
+	{
+		const UINT8 kind = options[i];
+		if (kind == PACKET_TCP_OPT_NOP)
+		{
+			out[written++] = kind;
+			i++;
+			continue;
+		}
+		if (i + 1 >= length || options[i + 1] < 2 || i + options[i + 1] > length)
+		{
+			return -1;
+		}
+		const UINT32 optionLength = options[i + 1];
+		hasMss = hasMss || kind == TCP_OPT_MSS;
+		hasWscale = hasWscale || kind == TCP_OPT_WSCALE;
+		hasSackPerm = hasSackPerm || kind == TCP_OPT_SACK_PERM;
+		if (TcpOptionStripped(rule, kind) && (syn || !TcpOptionNegotiated(kind)))
+		{
+			edits->stripped++;
+			i += optionLength;
+			continue;
+		}
+		UINT8 *option = out + written;
+		std::memcpy(option, options + i, optionLength);
+		if (syn && kind == TCP_OPT_MSS && optionLength == 4 && rule.mss != 0 && ReadBE16(option + 2) > rule.mss)
+		{
+			WriteBE16(option + 2, rule.mss);
+			edits->clamped++;
+		}
+		else if (syn && kind == TCP_OPT_WSCALE && optionLength == 3 && rule.windowScale >= 0)
+		{
+			option[2] = static_cast<UINT8>(rule.windowScale);
+		}
+		written += optionLength;
+		i += optionLength;
+	}
+
+	if (!syn)
+	{
+		return static_cast<int>(written);
+	}
+	if ((rule.insert & TCP_OPTION_INSERT_MSS) && !hasMss && rule.mss != 0 && written + 4 <= TCP_OPTION_SPACE)
+	{
+		out[written] = TCP_OPT_MSS;
+		out[written + 1] = 4;
+		WriteBE16(out + written + 2, rule.mss);
+		written += 4;
+		edits->inserted++;
+	}
+	if ((rule.insert & TCP_OPTION_INSERT_WSCALE) && !hasWscale && rule.windowScale >= 0 && written + 3 <= TCP_OPTION_SPACE)
+	{
+		out[written] = TCP_OPT_WSCALE;
+		out[written + 1] = 3;
+		out[written + 2] = static_cast<UINT8>(rule.windowScale);
+		written += 3;
+		edits->inserted++;
+	}
+	if ((rule.insert & TCP_OPTION_INSERT_SACK_PERM) && !hasSackPerm && written + 2 <= TCP_OPTION_SPACE)
+	{
+		out[written] = TCP_OPT_SACK_PERM;
+		out[written + 1] = 2;
+		written += 2;
+		edits->inserted++;
+	}
+	return static_cast<int>(written);
+}
+
+TcpOptionRewriterStage::TcpOptionRewriterStage()
+	: rules_(std::make_shared<const std::vector<TcpOptionRule>>()), matched_(0), rewritten_(0), resized_(0),
+	  clamped_(0), stripped_(0), inserted_(0), malformed_(0)
+{
+}
+
+void TcpOptionRewriterStage::SetRules(std::vector<TcpOptionRule> rules)
+{
+	std::atomic_store(&this->rules_, std::shared_ptr<const std::vector<TcpOptionRule>>(
+		std::make_shared<const std::vector<TcpOptionRule>>(std::move(rules))));
+}
+
+StageVerdict TcpOptionRewriterStage::Process(PacketContext &ctx)
+{
+	if (!ctx.parsed || ctx.info.fragment || ctx.info.protocol != PACKET_PROTO_TCP || ctx.info.transportLength < PACKET_TCP_HDR_MIN)
+	{
+		return STAGE_CONTINUE;
+	}
+	std::shared_ptr<const std::vector<TcpOptionRule>> rules = std::atomic_load(&this->rules_);
+	const TcpOptionRule *rule = nullptr;
+	for (const TcpOptionRule &candidate : *rules)
+	{
+		if (MatchPacket(candidate.match, ctx.data, ctx.info, *ctx.addr))
+		{
+			rule = &candidate;
+			break;
+		}
+	}
+	if (rule == nullptr)
+	{
+		return STAGE_CONTINUE;
+	}
+	this->matched_.fetch_add(1, std::memory_order_relaxed);
+
+	UINT8 *tcp = ctx.data + ctx.info.transportOffset;
+	bool changed = false;
+	if (rule->hasWindow && ReadBE16(tcp + 14) != rule->window)
+	{
+		UINT8 window[2];
+		WriteBE16(window, rule->window);
+		if (ctx.addr->TCPChecksum)
+		{
+			ChecksumUpdate(tcp + 16, ChecksumDelta(0, tcp + 14, window, 2));
+		}
+		std::memcpy(tcp + 14, window, 2);
+		changed = true;
+	}
+
+	const UINT32 optionLength = ctx.info.transportLength - PACKET_TCP_HDR_MIN;
+	UINT8 options[TCP_OPTION_SPACE + 3];
+	TcpOptionEdits edits = {};
+	const int built = BuildTcpOptions(tcp + PACKET_TCP_HDR_MIN, optionLength, (tcp[13] & PACKET_TCP_SYN) != 0, *rule,
+									  options, &edits);
+	if (built < 0)
+	{
+		this->malformed_.fetch_add(1, std::memory_order_relaxed);
+	}
+	else if (static_cast<UINT32>(built) <= optionLength)
+	{
+		// Removed options leave end-of-list padding, so the header keeps its length.
+		std::memset(options + built, PACKET_TCP_OPT_EOL, optionLength - built);
+		if (std::memcmp(options, tcp + PACKET_TCP_HDR_MIN, optionLength) != 0)
+		{
+			if (ctx.addr->TCPChecksum)
+			{
+				ChecksumUpdate(tcp + 16, ChecksumDelta(0, tcp + PACKET_TCP_HDR_MIN, options, optionLength));
+			}
+			std::memcpy(tcp + PACKET_TCP_HDR_MIN, options, optionLength);
+			changed = true;
+		}
+	}
+	else
+	{
+		const UINT32 padded = (static_cast<UINT32>(built) + 3) & ~3u;
+		const UINT32 length = ctx.info.length + padded - optionLength;
+		const UINT32 ipLength = ctx.info.version == 6 ? length - PACKET_IPV6_HDR_LEN : length;
+		if (ctx.reinject && ctx.send != nullptr && ipLength <= 0xFFFF)
+		{
+			std::memset(options + built, PACKET_TCP_OPT_EOL, padded - built);
+			WINDIVERT_ADDRESS addr = *ctx.addr;
+			addr.IPChecksum = 1;
+			addr.TCPChecksum = 1;
+			UINT8 *out = ctx.send->Reserve(length, addr);
+			const UINT32 fixed = ctx.info.transportOffset + PACKET_TCP_HDR_MIN;
+			std::memcpy(out, ctx.data, fixed);
+			std::memcpy(out + fixed, options, padded);
+			std::memcpy(out + fixed + padded, ctx.data + ctx.info.payloadOffset, ctx.info.payloadLength);
+			UINT8 *outTcp = out + ctx.info.transportOffset;
+			outTcp[12] = static_cast<UINT8>((((PACKET_TCP_HDR_MIN + padded) / 4) << 4) | (outTcp[12] & 0x0F));
+			SetPacketLength(out, length);
+			CalcPacketChecksums(out, length);
+			this->resized_.fetch_add(1, std::memory_order_relaxed);
+			this->clamped_.fetch_add(edits.clamped, std::memory_order_relaxed);
+			this->stripped_.fetch_add(edits.stripped, std::memory_order_relaxed);
+			this->inserted_.fetch_add(edits.inserted, std::memory_order_relaxed);
+			return STAGE_HOLD;
+		}
+	}
+
+	if (changed)
+	{
+		this->rewritten_.fetch_add(1, std::memory_order_relaxed);
+		if (built >= 0 && static_cast<UINT32>(built) <= optionLength)
+		{
+			this->clamped_.fetch_add(edits.clamped, std::memory_order_relaxed);
+			this->stripped_.fetch_add(edits.stripped, std::memory_order_relaxed);
+			this->inserted_.fetch_add(edits.inserted, std::memory_order_relaxed);
+		}
+	}
+	return STAGE_PASS;
+}
+
+void TcpOptionRewriterStage::GetStats(TcpOptionStats *stats)
+{
+	stats->matched = this->matched_.load(std::memory_order_relaxed);
+	stats->rewritten = this->rewritten_.load(std::memory_order_relaxed);
+	stats->resized = this->resized_.load(std::memory_order_relaxed);
+	stats->clamped = this->clamped_.load(std::memory_order_relaxed);
+	stats->stripped = this->stripped_.load(std::memory_order_relaxed);
+	stats->inserted = this->inserted_.load(std::memory_order_relaxed);
+	stats->malformed = this->malformed_.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,142 @@
+/**
+ * @file tcp-option-rewriter.h
+ * @brief Rule based stage rewriting the window and options of TCP segments
+ *
+ * The first rule matching a segment may clamp the MSS and set the window scale of SYN and
+ * SYN-ACK segments, set the window field, remove options of given kinds and add the MSS,
+ * window scale or SACK-permitted options a SYN lacks. Options are walked with bounds
+ * checks and a malformed option area is left alone. Segments whose header keeps its
+ * length are rewritten in place with incremental checksum updates; a header that grows is
+ * rebuilt into the receive thread's send batch.
+ */
+
+#ifndef TCP_OPTION_REWRITER_H_
+#define TCP_OPTION_REWRITER_H_
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "windivert.h"
+#include "packet.h"
+#include "packet-match.h"
+#include "packet-stage.h"
+
+#define TCP_OPTION_SPACE    40   ///< Largest TCP option area
+#define TCP_OPT_MSS         2
+#define TCP_OPT_WSCALE      3
+#define TCP_OPT_SACK_PERM   4
+#define TCP_OPT_TIMESTAMPS  8
+
+#define TCP_OPTION_INSERT_MSS       0x01   ///< Add an MSS option of the rule's mss to SYNs without one
+#define TCP_OPTION_INSERT_WSCALE    0x02   ///< Add a window scale option of the rule's windowScale
+#define TCP_OPTION_INSERT_SACK_PERM 0x04   ///< Add a SACK-permitted option
+
+/**
+ * @struct TcpOptionRule
+ * @brief Match and rewrite of a rule
+ */
+struct TcpOptionRule {
+	PacketMatch match;        ///< Segments the rule applies to, protocol is always TCP
+	UINT16 mss;               ///< MSS of SYNs is lowered to this, 0 to keep it
+	bool hasWindow;
+	UINT16 window;            ///< Window field of every matched segment
+	INT8 windowScale;         ///< Shift count written to the window scale option of SYNs, -1 to keep it
+	UINT8 strip[32];          ///< Bit set of the option kinds removed
+	UINT8 insert;             ///< TCP_OPTION_INSERT_* flags, SYNs only
+};
+
+/**
+ * @struct TcpOptionEdits
+ * @brief What a rewrite changed
+ */
+struct TcpOptionEdits {
+	UINT32 clamped;           ///< MSS options lowered
+	UINT32 stripped;          ///< Options removed
+	UINT32 inserted;          ///< Options added
+};
+
+/**
+ * @struct TcpOptionStats
+ * @brief Counters since the stage was created
+ */
+struct TcpOptionStats {
+	UINT64 matched;           ///< Segments matching a rule
+	UINT64 rewritten;         ///< Segments changed in place
+	UINT64 resized;           ///< Segments rebuilt with a longer header
+	UINT64 clamped;
+	UINT64 stripped;
+	UINT64 inserted;
+	UINT64 malformed;         ///< Option areas left alone because an option overran it
+};
+
+/**
+ * @brief Tests whether a rule removes an option kind
+ */
+inline bool TcpOptionStripped(const TcpOptionRule &rule, UINT8 kind)
+{
+	return (rule.strip[kind >> 3] & (1 << (kind & 7))) != 0;
+}
+
+/**
+ * @brief Tests whether an option is negotiated on the SYN
+ *
+ * Once a connection has agreed on timestamps, every later segment must carry them, so
+ * negotiated options are only removed from SYNs, which keeps the connection from agreeing on them.
+ */
+inline bool TcpOptionNegotiated(UINT8 kind)
+{
+	return kind == TCP_OPT_MSS || kind == TCP_OPT_WSCALE || kind == TCP_OPT_SACK_PERM || kind == TCP_OPT_TIMESTAMPS;
+}
+
+/**
+ * @brief Builds the option area a rule turns a segment's options into
+ * @param options Option area of the segment
+ * @param length Its length, at most TCP_OPTION_SPACE
+ * @param syn The segment has SYN set
+ * @param rule Rule to apply
+ * @param out Receives up to TCP_OPTION_SPACE bytes, without padding
+ * @param edits Receives what changed
+ * @return Length written to out, or -1 if an option overruns the area
+ *
+ * NOP options are kept so the remaining options stay aligned; an insertion that does not
+ * fit is left out. Negotiated options are only stripped when syn is set.
+ */
+int BuildTcpOptions(const UINT8 *options, UINT32 length, bool syn, const TcpOptionRule &rule, UINT8 *out,
+					TcpOptionEdits *edits);
+
+/**
+ * @class TcpOptionRewriterStage
+ * @brief PacketStage applying TcpOptionRules
+ *
+ * Rules are replaced as a whole and read without locking.
+ */
+class TcpOptionRewriterStage : public PacketStage {
+	public:
+		TcpOptionRewriterStage();
+
+		/**
+		 * @brief Replaces the rules, evaluated in order
+		 */
+		void SetRules(std::vector<TcpOptionRule> rules);
+
+		/**
+		 * @brief Rewrites a matching segment
+		 * @return STAGE_PASS if a rule matched, STAGE_HOLD if the segment was rebuilt into
+		 *         the send batch, STAGE_CONTINUE otherwise
+		 */
+		StageVerdict Process(PacketContext &ctx) override;
+
+		void GetStats(TcpOptionStats *stats);
+
+	private:
+		std::shared_ptr<const std::vector<TcpOptionRule>> rules_;   ///< Accessed with std::atomic_load/store
+		std::atomic<UINT64> matched_;
+		std::atomic<UINT64> rewritten_;
+		std::atomic<UINT64> resized_;
+		std::atomic<UINT64> clamped_;
+		std::atomic<UINT64> stripped_;
+		std::atomic<UINT64> inserted_;
+		std::atomic<UINT64> malformed_;
+};
+
+#endif
@@ -0,0 +1,24 @@
+/**
+ * @description Checks that the clauses the FilterNarrower generates compile for the NETWORK layer.
+ * Run with `node --test test/`; off Windows the mock binding checks the fields against the layer.
+ */
+
+const test = require('node:test');
+const assert = require('node:assert');
+const { CompiledFilter } = require('bindings')('windivert');
+const { flowClause } = require('../filter-narrower.js');
+
+const LAYER_NETWORK = 0;
+
+test('an IPv4 TCP flow clause compiles on the NETWORK layer', () => {
+	const clause = flowClause({ protocol: 6, localAddr: '10.0.0.1', localPort: 50000, remoteAddr: '93.184.216.34', remotePort: 443 });
+	const filter = `(outbound and tcp.DstPort == 443) and not (${clause})`;
+	assert.doesNotThrow(() => new CompiledFilter(filter, LAYER_NETWORK));
+});
+
+test('an IPv6 UDP flow clause compiles on the NETWORK layer', () => {
+	const clause = flowClause({ protocol: 17, localAddr: 'fe80:0:0:0:0:0:0:1', localPort: 5353, remoteAddr: '2001:db8:0:0:0:0:0:2', remotePort: 443 });
+	assert.match(clause, /ipv6\.SrcAddr/);
+	assert.match(clause, /udp\.DstPort/);
+	assert.doesNotThrow(() => new CompiledFilter(`true and not (${clause})`, LAYER_NETWORK));
+});
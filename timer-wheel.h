@@ -0,0 +1,188 @@
+/**
+ * @file timer-wheel.h
+ * @brief Hierarchical timer wheel keyed by caller supplied ids
+ *
+ * Four levels of 64 slots; level L slots are 64^L ticks wide, so timers up to 2^24 ticks
+ * ahead are held with O(1) insertion. When the low bits of the current tick wrap, the
+ * due slot of the next level is cascaded into the finer levels. Timers are singly linked
+ * through per-id arrays, so the wheel allocates nothing once ids have been seen.
+ * Not thread safe; owners add their own locking.
+ */
+
+#ifndef TIMER_WHEEL_H_
+#define TIMER_WHEEL_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#define TIMER_WHEEL_BITS   6
+#define TIMER_WHEEL_SLOTS  (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_NONE   0xFFFFFFFFu
+
+class TimerWheel {
+	public:
+		/**
+		 * @brief Creates an empty wheel
+		 * @param now Current tick
+		 */
+		explicit TimerWheel(uint64_t now = 0) : now_(now), count_(0)
+		{
+			for (auto &level : heads_)
+			{
+				for (uint32_t &head : level)
+				{
+					head = TIMER_WHEEL_NONE;
+				}
+			}
+		}
+
+		/**
+		 * @brief Longest delay in ticks, later deadlines are clamped
+		 */
+		static uint64_t MaxDelay()
+		{
+			return (1ULL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1;
+		}
+
+		uint64_t Now() const
+		{
+			return now_;
+		}
+
+		size_t Size() const
+		{
+			return count_;
+		}
+
+		/**
+		 * @brief Schedules a timer
+		 * @param id Caller id, must not be scheduled already
+		 * @param deadline Tick to fire at; past deadlines fire on the next tick
+		 */
+		void Schedule(uint32_t id, uint64_t deadline)
+		{
+			if (id >= next_.size())
+			{
+				next_.resize(id + 1, TIMER_WHEEL_NONE);
+				deadlines_.resize(id + 1, 0);
+			}
+			if (deadline <= now_)
+			{
+				deadline = now_ + 1;
+			}
+			else if (deadline - now_ > MaxDelay())
+			{
+				deadline = now_ + MaxDelay();
+			}
+			deadlines_[id] = deadline;
+			Insert(id);
+			count_++;
+		}
+
+		/**
+		 * @brief Advances to a tick and fires every timer due by then, in deadline order
+		 * @param now New current tick
+		 * @param expire Called with the id of each fired timer; it may schedule new timers
+		 */
+		template <typename F>
+		void Advance(uint64_t now, F expire)
+		{
+			while (now_ < now)
+			{
+				if (count_ == 0)
+				{
+					now_ = now;
+					return;
+				}
+				now_++;
+				for (int level = TIMER_WHEEL_LEVELS - 1; level > 0; level--)
+				{
+					const uint64_t mask = (1ULL << (TIMER_WHEEL_BITS * level)) - 1;
+					if ((now_ & mask) == 0)
+					{
+						Cascade(level);
+					}
+				}
+				uint32_t &head = heads_[0][now_ & (TIMER_WHEEL_SLOTS - 1)];
+				uint32_t id = head;
+				head = TIMER_WHEEL_NONE;
+				while (id != TIMER_WHEEL_NONE)
+				{
+					const uint32_t next = next_[id];
+					next_[id] = TIMER_WHEEL_NONE;
+					count_--;
+					expire(id);
+					id = next;
+				}
+			}
+		}
+
+		/**
+		 * @brief Returns a tick at or before the next timer fires
+		 * @return Exact deadline if it lies within the finest level, otherwise the next
+		 *         cascade; UINT64_MAX if the wheel is empty
+		 */
+		uint64_t NextExpiry() const
+		{
+			if (count_ == 0)
+			{
+				return UINT64_MAX;
+			}
+			for (uint64_t tick = now_ + 1; tick <= now_ + TIMER_WHEEL_SLOTS; tick++)
+			{
+				if ((tick & (TIMER_WHEEL_SLOTS - 1)) == 0)
+				{
+					return tick;
+				}
+				if (heads_[0][tick & (TIMER_WHEEL_SLOTS - 1)] != TIMER_WHEEL_NONE)
+				{
+					return tick;
+				}
+			}
+			return now_ + TIMER_WHEEL_SLOTS;
+		}
+
+	private:
+		/**
+		 * @brief Links a timer into the level whose span covers its distance
+		 */
+		void Insert(uint32_t id)
+		{
+			const uint64_t deadline = deadlines_[id];
+			const uint64_t delta = deadline - now_;
+			int level = 0;
+			while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1ULL << (TIMER_WHEEL_BITS * (level + 1))))
+			{
+				level++;
+			}
+			uint32_t &head = heads_[level][(deadline >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1)];
+			next_[id] = head;
+			head = id;
+		}
+
+		/**
+		 * @brief Moves the due slot of a level into the finer levels
+		 */
+		void Cascade(int level)
+		{
+			uint32_t &head = heads_[level][(now_ >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1)];
+			uint32_t id = head;
+			head = TIMER_WHEEL_NONE;
+			while (id != TIMER_WHEEL_NONE)
+			{
+				const uint32_t next = next_[id];
+				Insert(id);
+				id = next;
+			}
+		}
+
+		uint64_t now_;                                                ///< Current tick
+		size_t count_;                                                ///< Scheduled timers
+		uint32_t heads_[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];       ///< First id per slot
+		std::vector<uint32_t> next_;                                  ///< Next id in the same slot
+		std::vector<uint64_t> deadlines_;                             ///< Deadline per id
+};
+
+#endif
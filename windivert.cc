@@ -8,6 +8,15 @@
 
 #include "node-windivert.h"
 
+/**
+ * @brief Steady clock time in microseconds, used for the replaceFilter metrics
+ */
+static UINT64 SteadyMicros()
+{
+	return static_cast<UINT64>(std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
 /**
  * @brief Initializes the WinDivert module and exports its functionality.
  * @param env The Node.js environment.
@@ -17,7 +26,7 @@
 Napi::Object WinDivert::Init(Napi::Env env, Napi::Object exports)
 {
 	Napi::HandleScope scope(env);
-	Napi::Function func = DefineClass(env, "WinDivert", {InstanceMethod("open", &WinDivert::open), InstanceMethod("HelperCalcChecksums", &WinDivert::HelperCalcChecksums), InstanceMethod("recv", &WinDivert::recv), InstanceMethod("send", &WinDivert::send), InstanceMethod("close", &WinDivert::close)});
+	Napi::Function func = DefineClass(env, "WinDivert", {InstanceMethod("open", &WinDivert::open), InstanceMethod("HelperCalcChecksums", &WinDivert::HelperCalcChecksums), InstanceMethod("recv", &WinDivert::recv), InstanceMethod("recvBatch", &WinDivert::recvBatch), InstanceMethod("recvRing", &WinDivert::recvRing), InstanceMethod("recvSink", &WinDivert::recvSink), InstanceMethod("sinkStats", &WinDivert::sinkStats), InstanceMethod("credit", &WinDivert::credit), InstanceMethod("attachFlowIndex", &WinDivert::attachFlowIndex), InstanceMethod("attachStage", &WinDivert::attachStage), InstanceMethod("send", &WinDivert::send), InstanceMethod("close", &WinDivert::close), InstanceMethod("replaceFilter", &WinDivert::replaceFilter)});
 
 	Napi::FunctionReference constructor = Napi::Persistent(func);
 	constructor.SuppressDestruct();
@@ -29,9 +38,10 @@ Napi::Object WinDivert::Init(Napi::Env env, Napi::Object exports)
 /**
  * @brief Constructor for the WinDivert class.
  * @param info Contains the construction parameters:
- *             - filter: String containing the WinDivert filter expression
- *             - layer: (Optional) The WinDivert layer to operate on
+ *             - filter: String containing the WinDivert filter expression, or a CompiledFilter
+ *             - layer: (Optional) The WinDivert layer to operate on, must match a CompiledFilter's layer
  *             - flags: (Optional) Additional flags for WinDivert operation
+ *             - priority: (Optional) Handle priority, WINDIVERT_PRIORITY_LOWEST..WINDIVERT_PRIORITY_HIGHEST (default 0)
  */
 WinDivert::WinDivert(const Napi::CallbackInfo &info) : Napi::ObjectWrap<WinDivert>(info)
 {
@@ -39,22 +49,63 @@ WinDivert::WinDivert(const Napi::CallbackInfo &info) : Napi::ObjectWrap<WinDiver
 	Napi::Env env = info.Env();
 	Napi::HandleScope scope(env);
 	int argc = info.Length();
-	if (argc < 1 || !info[0].IsString())
+	UINT32 compiledLayer = 0;
+	const bool compiled = argc > 0 && CompiledFilterWrap::FromValue(info[0], &this->filter_, &compiledLayer);
+	if (!compiled && (argc < 1 || !info[0].IsString()))
 	{
-		Napi::TypeError::New(env, "String filter expected").ThrowAsJavaScriptException();
+		Napi::TypeError::New(env, "String filter or CompiledFilter expected").ThrowAsJavaScriptException();
 		return;
 	}
-	this->filter_ = info[0].As<Napi::String>().Utf8Value();
+	if (!compiled)
+	{
+		this->filter_ = info[0].As<Napi::String>().Utf8Value();
+	}
+	this->layer_ = compiledLayer;
+	this->flags_ = 0;
+	this->priority_ = 0;
+	this->basePriority_ = 0;
+	this->pendingHandle_ = INVALID_HANDLE_VALUE;
+	this->retiredHandle_ = INVALID_HANDLE_VALUE;
+	this->handleGeneration_ = 0;
+	this->verdictGeneration_ = 0;
+	this->drainedAt_ = 0;
+	this->drained_ = 0;
+	this->replaceStart_ = 0;
+	this->recvMode_ = RECV_PACKETS;
+	this->batchSize_ = 0;
+	this->credits = 0;
+	this->closeFlag = 0;
+	this->ringAffinity_ = RING_AFFINITY_FLOW;
+	this->ringNext_ = 0;
+	this->doorbellMask = std::make_shared<std::atomic<UINT32>>(0);
 
 	if (argc > 1 && info[1].IsNumber())
 	{
 		this->layer_ = info[1].As<Napi::Number>().Uint32Value();
+		if (compiled && this->layer_ != compiledLayer)
+		{
+			Napi::TypeError::New(env, "CompiledFilter was compiled for layer " + std::to_string(compiledLayer)).ThrowAsJavaScriptException();
+			return;
+		}
 	}
 
 	if (argc > 2 && info[2].IsNumber())
 	{
 		this->flags_ = info[2].As<Napi::Number>().Uint32Value();
 	}
+
+	if (argc > 3 && info[3].IsNumber())
+	{
+		const int priority = info[3].As<Napi::Number>().Int32Value();
+		if (priority < WINDIVERT_PRIORITY_LOWEST || priority > WINDIVERT_PRIORITY_HIGHEST)
+		{
+			Napi::RangeError::New(env, "Priority must be between " + std::to_string(WINDIVERT_PRIORITY_LOWEST) +
+										   " and " + std::to_string(WINDIVERT_PRIORITY_HIGHEST)).ThrowAsJavaScriptException();
+			return;
+		}
+		this->priority_ = static_cast<INT16>(priority);
+		this->basePriority_ = this->priority_;
+	}
 	this->handle_ = INVALID_HANDLE_VALUE;
 }
 
@@ -67,8 +118,10 @@ WinDivert::~WinDivert()
 {
 	std::cout << "WinDivert destructor called" << std::endl;
 	this->StopThread();
+	this->CloseReplaceHandles();
 	if (this->handle_ != INVALID_HANDLE_VALUE)
 	{
+		this->stages_.Detach(this->handle_);
 		WinDivertClose(this->handle_);
 		CloseHandle(this->handle_);
 		this->handle_ = INVALID_HANDLE_VALUE;
@@ -112,6 +165,406 @@ Napi::Value WinDivert::recv(const Napi::CallbackInfo &info)
 	return Napi::String::New(env, "Recv method executed");
 }
 
+/**
+ * @brief Starts receiving packets in batches, paced by read credits.
+ * @param info Contains:
+ *             - callback: Called as (data, addrs, offsets, columns) per batch and once with null at end of stream
+ *             - batchSize: (Optional) Maximum packets per batch, 1..WINDIVERT_BATCH_MAX (default 64)
+ *             - credits: (Optional) Batches that may be delivered before credit() is called (default 0)
+ * @return Undefined.
+ * @throws Error if filter is not opened or reception already started.
+ *
+ * One credit allows one batch to be read from the driver. While no credit is available
+ * the receive thread does not call WinDivertRecvEx, so a slow consumer leaves packets
+ * queued in the driver instead of in the thread-safe function queue.
+ */
+Napi::Value WinDivert::recvBatch(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	if (this->handle_ == INVALID_HANDLE_VALUE)
+	{
+		Napi::Error::New(env, "Filter not opened. Use open method first.").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	if (info.Length() < 1 || !info[0].IsFunction())
+	{
+		Napi::TypeError::New(env, "Function expected as argument").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	if (this->recvThread.joinable())
+	{
+		Napi::Error::New(env, "Receive already started on this handle").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	UINT32 batchSize = 64;
+	if (info.Length() > 1 && info[1].IsNumber())
+	{
+		batchSize = info[1].As<Napi::Number>().Uint32Value();
+	}
+	if (batchSize < 1 || batchSize > WINDIVERT_BATCH_MAX)
+	{
+		Napi::RangeError::New(env, "batchSize must be between 1 and " + std::to_string(WINDIVERT_BATCH_MAX)).ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	int credits = 0;
+	if (info.Length() > 2 && info[2].IsNumber())
+	{
+		credits = info[2].As<Napi::Number>().Int32Value();
+	}
+
+	this->recvMode_ = RECV_BATCHES;
+	this->batchSize_ = batchSize;
+	this->credits = credits > 0 ? credits : 0;
+	this->tsfn = Napi::ThreadSafeFunction::New(
+		env,
+		info[0].As<Napi::Function>(),
+		"Recv Batch Callback",
+		0,
+		1
+	);
+	this->StartThread();
+	return env.Undefined();
+}
+
+/**
+ * @brief Joins the handle to a FlowIndex.
+ * @param info Contains the FlowIndex object.
+ * @return Undefined.
+ * @throws Error if reception already started on this handle.
+ *
+ * FLOW and SOCKET layer handles add and remove flows from their receive thread; NETWORK
+ * layer handles fill the processId column of received batches from the index.
+ */
+Napi::Value WinDivert::attachFlowIndex(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	std::shared_ptr<FlowIndex> index = info.Length() > 0 ? FlowIndexWrap::FromValue(info[0]) : std::shared_ptr<FlowIndex>();
+	if (!index)
+	{
+		Napi::TypeError::New(env, "FlowIndex expected as argument").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	if (this->recvThread.joinable())
+	{
+		Napi::Error::New(env, "attachFlowIndex must be called before receiving").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	this->flowIndex_ = index;
+	return env.Undefined();
+}
+
+/**
+ * @brief Appends a native stage to the handle.
+ * @param info Contains the stage object: a Nat, Shaper, Policer, Sampler, FlowCache, HttpRewriter,
+ *             SeqTracker, FakeInjector, HopEstimator, Fragmenter, Disorder or
+ *             TcpOptionRewriter.
+ * @return Undefined.
+ * @throws Error if the handle is not a NETWORK layer handle or reception already started.
+ *
+ * Stages run in the receive thread in attach order, before packets reach JavaScript in
+ * any delivery mode. A stage object can be attached to several handles.
+ */
+Napi::Value WinDivert::attachStage(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	std::shared_ptr<PacketStage> stage = info.Length() > 0 ? StageFromValue(info[0]) : std::shared_ptr<PacketStage>();
+	if (!stage)
+	{
+		Napi::TypeError::New(env, "Stage object expected as argument").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	if (this->layer_ != WINDIVERT_LAYER_NETWORK && this->layer_ != WINDIVERT_LAYER_NETWORK_FORWARD)
+	{
+		Napi::Error::New(env, "Stages can only be attached to NETWORK layer handles").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	if (this->recvThread.joinable())
+	{
+		Napi::Error::New(env, "attachStage must be called before receiving").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	this->stages_.Add(stage);
+	return env.Undefined();
+}
+
+/**
+ * @brief Starts delivering packets into SharedArrayBuffer lanes for worker_threads.
+ * @param info Contains:
+ *             - doorbell: Called on the main thread with a bit mask of lanes whose sleeping
+ *               consumer should be woken with Atomics.notify
+ *             - lanes: Array of Uint8Array views, one per lane, laid out as in packet-ring.h
+ *             - slots: Slots per lane, a power of two
+ *             - slotSize: Bytes of packet data per slot
+ *             - affinity: (Optional) RingAffinity, default RING_AFFINITY_FLOW
+ * @return Undefined.
+ * @throws Error if filter is not opened, reception already started or a lane is too small.
+ *
+ * Packets stay in their slot until the lane consumer returns a verdict for it; the verdict
+ * thread then reinjects or drops the slot without the packet crossing back into JavaScript.
+ */
+Napi::Value WinDivert::recvRing(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	if (this->handle_ == INVALID_HANDLE_VALUE)
+	{
+		Napi::Error::New(env, "Filter not opened. Use open method first.").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	if (info.Length() < 4 || !info[0].IsFunction() || !info[1].IsArray() || !info[2].IsNumber() || !info[3].IsNumber())
+	{
+		Napi::TypeError::New(env, "Invalid arguments.  Expected usage: recvRing(doorbell, lanes, slots, slotSize[, affinity])").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	if (this->recvThread.joinable())
+	{
+		Napi::Error::New(env, "Receive already started on this handle").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	Napi::Array lanes = info[1].As<Napi::Array>();
+	UINT32 slots = info[2].As<Napi::Number>().Uint32Value();
+	UINT32 slotSize = info[3].As<Napi::Number>().Uint32Value();
+	UINT32 affinity = RING_AFFINITY_FLOW;
+	if (info.Length() > 4 && info[4].IsNumber())
+	{
+		affinity = info[4].As<Napi::Number>().Uint32Value();
+	}
+	if (lanes.Length() < 1 || lanes.Length() > RING_LANES_MAX)
+	{
+		Napi::RangeError::New(env, "Lane count must be between 1 and " + std::to_string(RING_LANES_MAX)).ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	if (slots < 2 || slots > RING_SLOT_MASK + 1 || (slots & (slots - 1)) != 0)
+	{
+		Napi::RangeError::New(env, "slots must be a power of two").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	if (slotSize < PACKET_IPV6_HDR_LEN || slotSize > MAXBUF)
+	{
+		Napi::RangeError::New(env, "slotSize must be between 40 and " + std::to_string(MAXBUF)).ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+
+	RingLayout layout(slots, slotSize);
+	std::vector<std::unique_ptr<PacketRingLane>> ringLanes;
+	std::vector<Napi::Reference<Napi::Uint8Array>> ringRefs;
+	for (UINT32 i = 0; i < lanes.Length(); i++)
+	{
+		Napi::Value lane = lanes.Get(i);
+		if (!lane.IsTypedArray() || lane.As<Napi::TypedArray>().TypedArrayType() != napi_uint8_array)
+		{
+			Napi::TypeError::New(env, "Lanes must be Uint8Array views").ThrowAsJavaScriptException();
+			return env.Undefined();
+		}
+		Napi::Uint8Array view = lane.As<Napi::Uint8Array>();
+		if (view.ByteLength() < layout.byteLength || (reinterpret_cast<uintptr_t>(view.Data()) & 7) != 0)
+		{
+			Napi::RangeError::New(env, "Lane " + std::to_string(i) + " must be 8 byte aligned and hold " +
+										   std::to_string(layout.byteLength) + " bytes").ThrowAsJavaScriptException();
+			return env.Undefined();
+		}
+		ringLanes.emplace_back(new PacketRingLane(view.Data(), layout));
+		ringRefs.emplace_back(Napi::Persistent(view));
+	}
+
+	this->ringLanes = std::move(ringLanes);
+	this->ringRefs = std::move(ringRefs);
+	this->ringAffinity_ = affinity;
+	this->ringNext_ = 0;
+	this->recvMode_ = RECV_RING;
+	this->doorbellMask->store(0);
+	this->tsfn = Napi::ThreadSafeFunction::New(
+		env,
+		info[0].As<Napi::Function>(),
+		"Ring Doorbell",
+		0,
+		1
+	);
+	this->StartThread();
+	return env.Undefined();
+}
+
+/**
+ * @brief Starts consuming packets in the receive thread without calling JavaScript.
+ * @param info Contains the optional options object:
+ *             - reinject: Send packets back after counting them instead of dropping them (default false)
+ *             - capture: { path, sampleRate = 1, snapLength = 256 } writes one packet in sampleRate to a pcap file
+ *             - patterns: Strings or Buffers; packets whose transport payload contains one are counted per pattern
+ * @return Undefined.
+ * @throws Error if filter is not opened, reception already started or the capture file cannot be created.
+ *
+ * Attached stages still run first, so a sink can be the last step of a native policy. The
+ * counters are read with sinkStats(), which stays usable after close().
+ */
+Napi::Value WinDivert::recvSink(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	if (this->handle_ == INVALID_HANDLE_VALUE)
+	{
+		Napi::Error::New(env, "Filter not opened. Use open method first.").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	if (this->recvThread.joinable())
+	{
+		Napi::Error::New(env, "Receive already started on this handle").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	SinkConfig config;
+	config.reinject = false;
+	config.sampleRate = 0;
+	config.snapLength = SINK_DEFAULT_SNAPLEN;
+	if (info.Length() > 0 && info[0].IsObject())
+	{
+		Napi::Object options = info[0].As<Napi::Object>();
+		config.reinject = options.Get("reinject").ToBoolean().Value();
+		Napi::Value capture = options.Get("capture");
+		if (capture.IsObject())
+		{
+			Napi::Object captureOptions = capture.As<Napi::Object>();
+			if (!captureOptions.Get("path").IsString())
+			{
+				Napi::TypeError::New(env, "capture.path must be a string").ThrowAsJavaScriptException();
+				return env.Undefined();
+			}
+			config.capturePath = captureOptions.Get("path").As<Napi::String>().Utf8Value();
+			const double sampleRate = NumberOption(captureOptions, "sampleRate", 1);
+			const double snapLength = NumberOption(captureOptions, "snapLength", SINK_DEFAULT_SNAPLEN);
+			if (!(sampleRate >= 1 && sampleRate <= UINT32_MAX) || !(snapLength >= 1 && snapLength <= MAXBUF))
+			{
+				Napi::RangeError::New(env, "capture.sampleRate must be at least 1 and capture.snapLength between 1 and " +
+											   std::to_string(MAXBUF)).ThrowAsJavaScriptException();
+				return env.Undefined();
+			}
+			config.sampleRate = static_cast<UINT32>(sampleRate);
+			config.snapLength = static_cast<UINT32>(snapLength);
+		}
+		Napi::Value patterns = options.Get("patterns");
+		if (patterns.IsArray())
+		{
+			Napi::Array list = patterns.As<Napi::Array>();
+			if (list.Length() > SINK_MAX_PATTERNS)
+			{
+				Napi::RangeError::New(env, "At most " + std::to_string(SINK_MAX_PATTERNS) + " patterns are supported").ThrowAsJavaScriptException();
+				return env.Undefined();
+			}
+			for (UINT32 i = 0; i < list.Length(); i++)
+			{
+				Napi::Value pattern = list.Get(i);
+				std::string bytes;
+				if (pattern.IsString())
+				{
+					bytes = pattern.As<Napi::String>().Utf8Value();
+				}
+				else if (pattern.IsBuffer())
+				{
+					Napi::Buffer<char> buffer = pattern.As<Napi::Buffer<char>>();
+					bytes.assign(buffer.Data(), buffer.Length());
+				}
+				if (bytes.empty())
+				{
+					Napi::TypeError::New(env, "Patterns must be non-empty strings or Buffers").ThrowAsJavaScriptException();
+					return env.Undefined();
+				}
+				config.patterns.push_back(bytes);
+			}
+		}
+	}
+
+	std::unique_ptr<PacketSink> sink(new PacketSink(config));
+	const std::string error = sink->Open();
+	if (!error.empty())
+	{
+		Napi::Error::New(env, error).ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	this->sink_ = std::move(sink);
+	this->recvMode_ = RECV_SINK;
+	// Never called per packet; replaceFilter completes through it.
+	this->tsfn = Napi::ThreadSafeFunction::New(
+		env,
+		Napi::Function::New(env, [](const Napi::CallbackInfo &) {}),
+		"Sink Control",
+		0,
+		1
+	);
+	this->StartThread();
+	return env.Undefined();
+}
+
+/**
+ * @brief Reads the counters of the sink started by recvSink.
+ * @param info Not used.
+ * @return Object with packets, bytes, ipv4, ipv6, tcp, udp, icmp, other, inbound, outbound, reinjected,
+ *         sampled, captureBytes, captureErrors and patterns (one count per pattern), or undefined.
+ */
+Napi::Value WinDivert::sinkStats(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	if (!this->sink_)
+	{
+		return env.Undefined();
+	}
+	SinkStats stats;
+	this->sink_->GetStats(&stats);
+	Napi::Object result = Napi::Object::New(env);
+	result.Set("packets", Napi::Number::New(env, static_cast<double>(stats.packets)));
+	result.Set("bytes", Napi::Number::New(env, static_cast<double>(stats.bytes)));
+	result.Set("ipv4", Napi::Number::New(env, static_cast<double>(stats.ipv4)));
+	result.Set("ipv6", Napi::Number::New(env, static_cast<double>(stats.ipv6)));
+	result.Set("tcp", Napi::Number::New(env, static_cast<double>(stats.tcp)));
+	result.Set("udp", Napi::Number::New(env, static_cast<double>(stats.udp)));
+	result.Set("icmp", Napi::Number::New(env, static_cast<double>(stats.icmp)));
+	result.Set("other", Napi::Number::New(env, static_cast<double>(stats.other)));
+	result.Set("inbound", Napi::Number::New(env, static_cast<double>(stats.inbound)));
+	result.Set("outbound", Napi::Number::New(env, static_cast<double>(stats.outbound)));
+	result.Set("reinjected", Napi::Number::New(env, static_cast<double>(stats.reinjected)));
+	result.Set("sampled", Napi::Number::New(env, static_cast<double>(stats.sampled)));
+	result.Set("captureBytes", Napi::Number::New(env, static_cast<double>(stats.captureBytes)));
+	result.Set("captureErrors", Napi::Number::New(env, static_cast<double>(stats.captureErrors)));
+	Napi::Array patterns = Napi::Array::New(env, stats.patterns.size());
+	for (size_t i = 0; i < stats.patterns.size(); i++)
+	{
+		patterns.Set(static_cast<uint32_t>(i), Napi::Number::New(env, static_cast<double>(stats.patterns[i])));
+	}
+	result.Set("patterns", patterns);
+	return result;
+}
+
+/**
+ * @brief Grants read credits to the batched receiver.
+ * @param info Contains the number of additional batches the consumer can accept (default 1).
+ *             A negative count takes back up to that many unused credits.
+ * @return Number of credits now available.
+ */
+Napi::Value WinDivert::credit(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	int count = 1;
+	if (info.Length() > 0)
+	{
+		if (!info[0].IsNumber())
+		{
+			Napi::TypeError::New(env, "Number expected as argument").ThrowAsJavaScriptException();
+			return env.Undefined();
+		}
+		count = info[0].As<Napi::Number>().Int32Value();
+	}
+	int available;
+	{
+		std::lock_guard<std::mutex> lock(this->creditMutex);
+		if (count > 0)
+		{
+			this->credits += count;
+		}
+		else if (count < 0)
+		{
+			this->credits = std::max(0, this->credits + count);
+		}
+		available = this->credits;
+	}
+	this->creditCond.notify_one();
+	return Napi::Number::New(env, available);
+}
+
 /**
  * @brief Opens the WinDivert handle with specified parameters.
  * @param info Not used.
@@ -127,7 +580,7 @@ Napi::Value WinDivert::open(const Napi::CallbackInfo &info)
 		return env.Undefined();
 	}
 
-	this->handle_ = WinDivertOpen(filter_.c_str(), (WINDIVERT_LAYER)layer_, 0, flags_);
+	this->handle_ = WinDivertOpen(filter_.c_str(), (WINDIVERT_LAYER)layer_, priority_, flags_);
 
 	if (this->handle_ == INVALID_HANDLE_VALUE)
 	{
@@ -290,6 +743,18 @@ Napi::Value WinDivert::close(const Napi::CallbackInfo &info)
 		return env.Undefined();
 	}
 	this->StopThread();
+	this->CloseReplaceHandles();
+	if (this->sink_)
+	{
+		// Counters stay readable, but the capture file is complete once the handle is closed.
+		this->sink_->Close();
+	}
+	if (this->replaceDeferred_)
+	{
+		this->replaceDeferred_->Reject(Napi::Error::New(env, "Handle closed during filter replacement").Value());
+		this->replaceDeferred_.reset();
+	}
+	this->stages_.Detach(this->handle_);
 
 	BOOL close = WinDivertClose(this->handle_);
 	if (close != 1)
@@ -304,9 +769,150 @@ Napi::Value WinDivert::close(const Napi::CallbackInfo &info)
 		CloseHandle(this->handle_);
 		this->handle_ = INVALID_HANDLE_VALUE; 
 	}
+	this->ringLanes.clear();
+	this->ringRefs.clear();
 	return Napi::Boolean::New(env, close);
 }
 
+/**
+ * @brief Replaces the filter without losing the packets already queued on the handle.
+ * The new handle is opened one priority above the one the handle was created with, or below it at
+ * the highest priority, and the next replacement returns to the original priority, so swaps never
+ * climb. The new handle takes every packet its filter matches from now on, while
+ * WinDivertShutdown(RECV) stops the old handle from queueing more and lets packets past it. The
+ * receive thread reads the old handle until it is dry and only then moves to the new one, so the
+ * callback never sees a packet of the new handle before the last one of the old handle.
+ * @param info Contains:
+ *             - filter: String filter or CompiledFilter for the handle's layer
+ * @return Promise resolved, after the old handle is closed, with:
+ *         - drained: Packets read from the old handle after the call
+ *         - gapMs: Time until the old handle ran dry; packets of the new handle wait in its queue meanwhile
+ *         - totalMs: Time until the old handle was closed
+ *         - priority: Priority of the new handle
+ * @throws Error if the handle is not opened, a replacement is in progress or the new handle cannot be opened.
+ */
+Napi::Value WinDivert::replaceFilter(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	if (this->handle_ == INVALID_HANDLE_VALUE)
+	{
+		Napi::Error::New(env, "Filter not opened. Use open method first.").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	if (this->replaceDeferred_)
+	{
+		Napi::Error::New(env, "A filter replacement is already in progress").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	string filter;
+	UINT32 layer = this->layer_;
+	const bool compiled = info.Length() > 0 && CompiledFilterWrap::FromValue(info[0], &filter, &layer);
+	if (!compiled && (info.Length() < 1 || !info[0].IsString()))
+	{
+		Napi::TypeError::New(env, "String filter or CompiledFilter expected").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	if (!compiled)
+	{
+		filter = info[0].As<Napi::String>().Utf8Value();
+	}
+	if (layer != this->layer_)
+	{
+		Napi::TypeError::New(env, "CompiledFilter was compiled for layer " + std::to_string(layer)).ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+
+	const INT16 neighbour = static_cast<INT16>(this->basePriority_ < WINDIVERT_PRIORITY_HIGHEST
+		? this->basePriority_ + 1 : this->basePriority_ - 1);
+	const INT16 priority = this->priority_ == this->basePriority_ ? neighbour : this->basePriority_;
+	HANDLE handle = WinDivertOpen(filter.c_str(), (WINDIVERT_LAYER)this->layer_, priority, this->flags_);
+	if (handle == INVALID_HANDLE_VALUE)
+	{
+		std::string errorMsg = "Error opening filter: [" + std::to_string(GetLastError()) + "]";
+		Napi::Error::New(env, errorMsg).ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	HANDLE old = this->handle_;
+	for (UINT32 param = WINDIVERT_PARAM_QUEUE_LENGTH; param <= WINDIVERT_PARAM_QUEUE_SIZE; param++)
+	{
+		UINT64 value;
+		if (WinDivertGetParam(old, (WINDIVERT_PARAM)param, &value))
+		{
+			WinDivertSetParam(handle, (WINDIVERT_PARAM)param, value);
+		}
+	}
+
+	this->filter_ = filter;
+	this->priority_ = priority;
+	this->drained_ = 0;
+	this->replaceStart_ = SteadyMicros();
+	Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(env);
+	this->replaceDeferred_ = std::make_unique<Napi::Promise::Deferred>(deferred);
+
+	if (!this->recvThread.joinable())
+	{
+		this->retiredHandle_ = old;
+		this->handle_ = handle;
+		this->handleGeneration_++;
+		this->FinishReplace(env, this->replaceStart_);
+		return deferred.Promise();
+	}
+	// The receive thread moves to the pending handle when the old one reports ERROR_NO_DATA.
+	this->pendingHandle_ = handle;
+	WinDivertShutdown(old, WINDIVERT_SHUTDOWN_RECV);
+	return deferred.Promise();
+}
+
+/**
+ * @brief Closes the retired handle and resolves the replaceFilter promise.
+ * Runs on the JavaScript thread after every packet of the old handle has been delivered, and in
+ * ring mode after the verdict thread has stopped injecting on the old handle.
+ */
+void WinDivert::FinishReplace(Napi::Env env, UINT64 drainedAt)
+{
+	if (this->retiredHandle_ == INVALID_HANDLE_VALUE)
+	{
+		return;
+	}
+	HANDLE retired = this->retiredHandle_;
+	this->retiredHandle_ = INVALID_HANDLE_VALUE;
+	this->stages_.Detach(retired);
+	WinDivertClose(retired);
+	CloseHandle(retired);
+
+	if (!this->replaceDeferred_)
+	{
+		return;
+	}
+	const UINT64 now = SteadyMicros();
+	Napi::Object result = Napi::Object::New(env);
+	result.Set("drained", Napi::Number::New(env, static_cast<double>(this->drained_.load())));
+	result.Set("gapMs", Napi::Number::New(env, (drainedAt - this->replaceStart_) / 1000.0));
+	result.Set("totalMs", Napi::Number::New(env, (now - this->replaceStart_) / 1000.0));
+	result.Set("priority", Napi::Number::New(env, this->priority_));
+	this->replaceDeferred_->Resolve(result);
+	this->replaceDeferred_.reset();
+}
+
+/**
+ * @brief Closes the new handle of a replacement the receive thread never switched to,
+ * and the old handle of one whose promise has not been resolved yet.
+ */
+void WinDivert::CloseReplaceHandles()
+{
+	const HANDLE handles[] = {this->pendingHandle_.exchange(INVALID_HANDLE_VALUE), this->retiredHandle_};
+	for (HANDLE handle : handles)
+	{
+		if (handle != INVALID_HANDLE_VALUE)
+		{
+			this->stages_.Detach(handle);
+			WinDivertClose(handle);
+			CloseHandle(handle);
+		}
+	}
+	this->retiredHandle_ = INVALID_HANDLE_VALUE;
+}
+
 /**
  * @brief Stops the packet receiving thread.
  */
@@ -314,12 +920,19 @@ void WinDivert::StopThread()
 {
 	if (this->recvThread.joinable())
 	{
-		this->closeFlag = 1;
-		recvThread.join();	
-		if (this->tsfn)
 		{
-			this->tsfn.Release();
+			std::lock_guard<std::mutex> lock(this->creditMutex);
+			this->closeFlag = 1;
 		}
+		this->creditCond.notify_all();
+		// Wake a thread blocked in WinDivertRecv; it then fails with ERROR_NO_DATA.
+		WinDivertShutdown(this->handle_, WINDIVERT_SHUTDOWN_RECV);
+		recvThread.join();	
+	}
+	if (this->verdictThread.joinable())
+	{
+		this->ringCond.notify_all();
+		this->verdictThread.join();
 	}
 }
 
@@ -336,9 +949,16 @@ void WinDivert::StartThread()
 	}
 
 	this->closeFlag = 0;
+	this->verdictGeneration_ = this->handleGeneration_.load();
 	try
 	{
 		this->recvThread = std::thread(&WinDivert::ThreadFunction, this);
+		if (this->recvMode_ == RECV_RING)
+		{
+			// Released by the verdict thread, which finishes replacements through the callback.
+			this->tsfn.Acquire();
+			this->verdictThread = std::thread(&WinDivert::VerdictThreadFunction, this);
+		}
 	}
 	catch (const std::system_error &e)
 	{
@@ -349,12 +969,43 @@ void WinDivert::StartThread()
 
 /**
  * @brief Main thread function for receiving packets.
- * Continuously receives packets and calls the JavaScript callback.
+ * Runs the per-packet or batched receive loop, then releases the callback.
  */
 void WinDivert::ThreadFunction()
+{
+	switch (this->recvMode_)
+	{
+		case RECV_BATCHES:
+			this->ReceiveBatches();
+			break;
+		case RECV_RING:
+			this->ReceiveToRing();
+			break;
+		case RECV_SINK:
+			this->ReceiveToSink();
+			break;
+		default:
+			this->ReceivePackets();
+			break;
+	}
+
+	if (this->tsfn)
+	{
+		tsfn.Release(); 
+	}
+}
+
+/**
+ * @brief Continuously receives packets and calls the JavaScript callback for each one.
+ * Events of the flow, socket and reflect layers carry no packet, so they are read in batches
+ * and applied to the flow index once per batch, still with one callback per event.
+ */
+void WinDivert::ReceivePackets()
 {
 	char packet[MAXBUF];
-	WINDIVERT_ADDRESS addr;
+	const bool network = this->layer_ == WINDIVERT_LAYER_NETWORK || this->layer_ == WINDIVERT_LAYER_NETWORK_FORWARD;
+	std::vector<WINDIVERT_ADDRESS> addrs(network ? 1 : WINDIVERT_BATCH_MAX);
+	SendBatch direct(this->handle_);
 
 	while (true)
 	{
@@ -369,11 +1020,20 @@ void WinDivert::ThreadFunction()
 			break;
 		}
 		UINT packetLen;
-		BOOL recv = WinDivertRecv(this->handle_, packet, sizeof(packet), &packetLen, &addr);
+		UINT addrLen = static_cast<UINT>(addrs.size() * sizeof(WINDIVERT_ADDRESS));
+		BOOL recv = WinDivertRecvEx(this->handle_, packet, sizeof(packet), &packetLen, 0, addrs.data(), &addrLen, NULL);
 
 		if (recv != 1)
 		{
 			DWORD error = GetLastError();
+			if (error == ERROR_NO_DATA)
+			{
+				if (this->SwitchHandle(direct))
+				{
+					continue;
+				}
+				break;
+			}
 
 			std::string errorMsg = "Warning: Failed to read packet. Error code: " + std::to_string(error);
 
@@ -381,30 +1041,628 @@ void WinDivert::ThreadFunction()
 
 			continue;
 		}
-		auto callback = [packet, packetLen, addr](Napi::Env env, Napi::Function jsCallback)
+		const UINT count = addrLen / sizeof(WINDIVERT_ADDRESS);
+		if (this->pendingHandle_ != INVALID_HANDLE_VALUE)
+		{
+			this->drained_ += count;
+		}
+		if (this->flowIndex_ && !network)
+		{
+			ApplyFlowEvents(*this->flowIndex_, addrs.data(), count);
+		}
+		const UINT64 now = this->stages_.Empty() ? 0 : GetTickCount64();
+		for (UINT i = 0; i < count; i++)
+		{
+			WINDIVERT_ADDRESS addr = addrs[i];
+			if (!this->stages_.Empty())
+			{
+				const bool deliver = this->ProcessStages(reinterpret_cast<UINT8 *>(packet), packetLen, &addr, now, direct);
+				direct.Flush();
+				if (!deliver)
+				{
+					continue;
+				}
+			}
+			auto callback = [packet, packetLen, addr](Napi::Env env, Napi::Function jsCallback)
+			{
+				Napi::Buffer<char> packetBuffer = Napi::Buffer<char>::Copy(env, packet, packetLen);
+				Napi::Buffer<char> addrBuffer = Napi::Buffer<char>::Copy(
+					env, reinterpret_cast<const char *>(&addr), sizeof(WINDIVERT_ADDRESS));
+
+				jsCallback.Call({packetBuffer, addrBuffer});
+			};
+			napi_status status = tsfn.BlockingCall(callback);
+			if (status != napi_ok)
+			{
+				std::cerr << "Warning: Failed to call JavaScript callback. NAPI status: " << status << std::endl;
+				return;
+			}
+		}
+		if (!this->stages_.Empty())
+		{
+			this->stages_.Tick(now);
+		}
+	}
+}
+
+/**
+ * @brief Moves the receive thread from a drained handle to the one opened by replaceFilter.
+ * The switch is refused once the handle is closing, so StopThread always shuts down the handle
+ * the thread is reading.
+ */
+bool WinDivert::SwitchHandle(SendBatch &direct)
+{
+	const UINT64 drainedAt = SteadyMicros();
+	{
+		std::lock_guard<std::mutex> lock(this->creditMutex);
+		if (this->closeFlag == 1 || this->pendingHandle_ == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+		this->retiredHandle_ = this->handle_.exchange(this->pendingHandle_.exchange(INVALID_HANDLE_VALUE));
+		this->drainedAt_ = drainedAt;
+		this->handleGeneration_++;
+	}
+	direct.SetHandle(this->handle_);
+	if (this->recvMode_ == RECV_RING)
+	{
+		// The verdict thread may still be injecting on the old handle; it finishes the replacement once it has moved.
+		return true;
+	}
+	// Queued behind the callbacks of the old handle's packets.
+	napi_status status = tsfn.BlockingCall([this, drainedAt](Napi::Env env, Napi::Function jsCallback)
+	{
+		this->FinishReplace(env, drainedAt);
+	});
+	if (status != napi_ok)
+	{
+		std::cerr << "Warning: Failed to call JavaScript callback. NAPI status: " << status << std::endl;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Waits for a read credit and takes it.
+ * @return false if the handle is closing.
+ */
+bool WinDivert::AcquireCredit()
+{
+	std::unique_lock<std::mutex> lock(this->creditMutex);
+	this->creditCond.wait(lock, [this] { return this->credits > 0 || this->closeFlag == 1; });
+	if (this->closeFlag == 1)
+	{
+		return false;
+	}
+	this->credits--;
+	return true;
+}
+
+/**
+ * @brief Computes packet boundaries of a batch returned by WinDivertRecvEx.
+ * Packets are stored back to back, so each one ends where WinDivertHelperParsePacket
+ * reports the next packet to begin. FLOW, SOCKET and REFLECT events carry no packet
+ * data and get empty ranges.
+ * @param batch Batch whose data and addrs are already filled.
+ */
+void WinDivert::SplitBatch(PacketBatch *batch)
+{
+	const UINT size = static_cast<UINT>(batch->data.size());
+	UINT offset = 0;
+	batch->offsets.resize(batch->addrs.size() + 1);
+	batch->offsets[0] = 0;
+	for (size_t i = 0; i < batch->addrs.size(); i++)
+	{
+		if (offset < size)
+		{
+			PVOID next = NULL;
+			UINT nextLen = 0;
+			if (WinDivertHelperParsePacket(batch->data.data() + offset, size - offset, NULL, NULL, NULL,
+										   NULL, NULL, NULL, NULL, NULL, NULL, &next, &nextLen) && next != NULL)
+			{
+				offset = size - nextLen;
+			}
+			else
+			{
+				offset = size;
+			}
+		}
+		batch->offsets[i + 1] = offset;
+	}
+}
+
+/**
+ * @brief Connects a received batch with the joined flow index.
+ * Event layers update the index; packet layers look every packet up under a single
+ * shared lock and store the owning ProcessId in the processId column.
+ */
+void WinDivert::IndexBatch(PacketBatch *batch)
+{
+	const size_t count = batch->addrs.size();
+	if (this->layer_ != WINDIVERT_LAYER_NETWORK && this->layer_ != WINDIVERT_LAYER_NETWORK_FORWARD)
+	{
+		ApplyFlowEvents(*this->flowIndex_, batch->addrs.data(), count);
+		return;
+	}
+
+	std::vector<FlowKey> keys(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		const UINT8 *packet = reinterpret_cast<const UINT8 *>(batch->data.data()) + batch->offsets[i];
+		PacketInfo info;
+		if (!ParsePacket(packet, batch->offsets[i + 1] - batch->offsets[i], &info) ||
+			!FlowKeyFromPacket(packet, info, batch->addrs[i].Outbound != 0, &keys[i]))
+		{
+			keys[i].protocol = 0;
+		}
+	}
+	AddressColumnsLayout layout(static_cast<UINT32>(count), ADDR_KIND_NETWORK);
+	UINT32 *processIds = reinterpret_cast<UINT32 *>(reinterpret_cast<UINT8 *>(batch->columns.data()) + layout.offsets[ADDR_COL_PROCESS_ID]);
+	this->flowIndex_->LookupProcesses(keys.data(), count, processIds);
+}
+
+/**
+ * @brief Runs a received packet through the attached stages.
+ * Passed packets, and the replies to rejected ones, are added to the send batch unless the
+ * handle cannot reinject; a handle that cannot send drops rejected packets silently.
+ */
+bool WinDivert::ProcessStages(UINT8 *packet, UINT length, WINDIVERT_ADDRESS *addr, UINT64 now, SendBatch &send)
+{
+	PacketContext ctx;
+	ctx.data = packet;
+	ctx.length = length;
+	ctx.addr = addr;
+	ctx.now = now;
+	ctx.send = &send;
+	ctx.handle = this->handle_;
+	ctx.reinject = (this->flags_ & (WINDIVERT_FLAG_SNIFF | WINDIVERT_FLAG_RECV_ONLY)) == 0;
+	const StageVerdict verdict = this->stages_.Run(ctx);
+	if (verdict == STAGE_PASS && ctx.reinject)
+	{
+		send.Add(ctx.data, ctx.length, *ctx.addr);
+	}
+	else if (verdict == STAGE_REJECT && ctx.reinject && ctx.parsed)
+	{
+		UINT8 reply[REJECT_MAX_LENGTH];
+		const UINT32 length = BuildReject(ctx.data, ctx.info, reply);
+		if (length != 0)
+		{
+			WINDIVERT_ADDRESS addr;
+			RejectAddress(*ctx.addr, &addr);
+			send.Add(reply, length, addr);
+		}
+	}
+	return verdict == STAGE_CONTINUE;
+}
+
+/**
+ * @brief Runs every packet of a split batch through the stages.
+ * Packets still to be delivered are moved down in place, so data, addrs and offsets
+ * describe only them afterwards.
+ */
+bool WinDivert::FilterBatch(PacketBatch *batch, SendBatch &send)
+{
+	const UINT64 now = GetTickCount64();
+	UINT8 *data = reinterpret_cast<UINT8 *>(batch->data.data());
+	const size_t count = batch->addrs.size();
+	size_t kept = 0;
+	UINT32 end = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		const UINT32 start = batch->offsets[i];
+		const UINT32 length = batch->offsets[i + 1] - start;
+		if (!this->ProcessStages(data + start, length, &batch->addrs[i], now, send))
+		{
+			continue;
+		}
+		if (end != start)
 		{
-			Napi::Buffer<char> packetBuffer = Napi::Buffer<char>::Copy(env, packet, packetLen);
+			std::memmove(data + end, data + start, length);
+		}
+		batch->addrs[kept++] = batch->addrs[i];
+		end += length;
+		batch->offsets[kept] = end;
+	}
+	batch->data.resize(end);
+	batch->addrs.resize(kept);
+	batch->offsets.resize(kept + 1);
+	send.Flush();
+	this->stages_.Tick(now);
+	return kept > 0;
+}
+
+/**
+ * @brief Receives packets in batches of up to batchSize_ and delivers each batch with one callback.
+ * A batch is only read from the driver once the consumer has granted a credit for it.
+ */
+void WinDivert::ReceiveBatches()
+{
+	const UINT batchBytes = std::max<UINT>(MAXBUF, this->batchSize_ * BATCH_PACKET_RESERVE);
+	SendBatch direct(this->handle_);
+
+	while (this->AcquireCredit())
+	{
+		PacketBatch *batch = new PacketBatch();
+		batch->data.resize(batchBytes);
+		batch->addrs.resize(this->batchSize_);
+		UINT recvLen = 0;
+		UINT addrLen = static_cast<UINT>(this->batchSize_ * sizeof(WINDIVERT_ADDRESS));
+		BOOL recv = WinDivertRecvEx(this->handle_, batch->data.data(), batchBytes, &recvLen, 0,
+									batch->addrs.data(), &addrLen, NULL);
+		if (recv != 1)
+		{
+			DWORD error = GetLastError();
+			delete batch;
+			{
+				std::lock_guard<std::mutex> lock(this->creditMutex);
+				this->credits++;
+			}
+			if (error == ERROR_NO_DATA)
+			{
+				if (this->SwitchHandle(direct))
+				{
+					continue;
+				}
+				break;
+			}
+			std::cerr << "Warning: Failed to read packet batch. Error code: " << error << std::endl;
+			continue;
+		}
+		batch->data.resize(recvLen);
+		batch->addrs.resize(addrLen / sizeof(WINDIVERT_ADDRESS));
+		if (this->pendingHandle_ != INVALID_HANDLE_VALUE)
+		{
+			this->drained_ += batch->addrs.size();
+		}
+		SplitBatch(batch);
+		if (!this->stages_.Empty() && !this->FilterBatch(batch, direct))
+		{
+			// Every packet was handled natively; keep the credit for the next batch.
+			delete batch;
+			std::lock_guard<std::mutex> lock(this->creditMutex);
+			this->credits++;
+			continue;
+		}
+		AddressColumnsLayout columnsLayout(static_cast<UINT32>(batch->addrs.size()),
+										   AddressKindForLayer(static_cast<WINDIVERT_LAYER>(this->layer_)));
+		batch->columns.resize(columnsLayout.byteLength / sizeof(UINT64));
+		DecodeAddressColumns(batch->addrs.data(), columnsLayout, reinterpret_cast<UINT8 *>(batch->columns.data()));
+		if (this->flowIndex_)
+		{
+			this->IndexBatch(batch);
+		}
+
+		auto callback = [](Napi::Env env, Napi::Function jsCallback, PacketBatch *batch)
+		{
+			Napi::Buffer<char> dataBuffer = Napi::Buffer<char>::Copy(env, batch->data.data(), batch->data.size());
 			Napi::Buffer<char> addrBuffer = Napi::Buffer<char>::Copy(
-				env, reinterpret_cast<const char *>(&addr), sizeof(WINDIVERT_ADDRESS));
+				env, reinterpret_cast<const char *>(batch->addrs.data()), batch->addrs.size() * sizeof(WINDIVERT_ADDRESS));
+			Napi::Uint32Array offsets = Napi::Uint32Array::New(env, batch->offsets.size());
+			std::copy(batch->offsets.begin(), batch->offsets.end(), offsets.Data());
+			const size_t columnsBytes = batch->columns.size() * sizeof(UINT64);
+			Napi::ArrayBuffer columns = Napi::ArrayBuffer::New(env, columnsBytes);
+			std::memcpy(columns.Data(), batch->columns.data(), columnsBytes);
+			delete batch;
 
-			jsCallback.Call({packetBuffer, addrBuffer});
+			jsCallback.Call({dataBuffer, addrBuffer, offsets, columns});
 		};
-		napi_status status = tsfn.BlockingCall(callback);
+		napi_status status = tsfn.BlockingCall(batch, callback);
 		if (status != napi_ok)
 		{
+			delete batch;
 			std::cerr << "Warning: Failed to call JavaScript callback. NAPI status: " << status << std::endl;
-			break;
+			return;
 		}
 	}
-	
-	if (this->tsfn)
+
+	// Signal end of stream so iterators and streams can finish.
+	tsfn.BlockingCall([](Napi::Env env, Napi::Function jsCallback)
 	{
-		tsfn.Release(); 
+		jsCallback.Call({env.Null()});
+	});
+}
+
+/**
+ * @brief Picks the lane for a packet.
+ * With flow affinity both directions of a connection hash to the same lane, so a worker
+ * sees every packet of the flows it owns.
+ */
+UINT32 WinDivert::SelectLane(const UINT8 *packet, UINT length, const WINDIVERT_ADDRESS &addr)
+{
+	const UINT32 count = static_cast<UINT32>(this->ringLanes.size());
+	if (count == 1)
+	{
+		return 0;
+	}
+	if (this->ringAffinity_ == RING_AFFINITY_ROUND_ROBIN)
+	{
+		return this->ringNext_++ % count;
 	}
-	if (recvThread.joinable())
+	PacketInfo info;
+	FlowKey key;
+	if (!ParsePacket(packet, length, &info))
 	{
-		recvThread.join();
+		return 0;
+	}
+	FlowKeyFromPacket(packet, info, addr.Outbound != 0, &key);
+	return static_cast<UINT32>(FlowHash(key) % count);
+}
+
+/**
+ * @brief Schedules one doorbell call for lanes whose consumer is sleeping.
+ * Calls are coalesced: while one is pending, further lanes are only added to the mask.
+ */
+void WinDivert::RingDoorbell(UINT32 lanes)
+{
+	UINT32 sleeping = 0;
+	for (UINT32 i = 0; i < this->ringLanes.size(); i++)
+	{
+		if ((lanes & (1u << i)) != 0 && this->ringLanes[i]->ConsumerWaiting())
+		{
+			sleeping |= 1u << i;
+		}
+	}
+	if (sleeping == 0 || this->doorbellMask->fetch_or(sleeping) != 0)
+	{
+		return;
+	}
+	std::shared_ptr<std::atomic<UINT32>> mask = this->doorbellMask;
+	tsfn.NonBlockingCall([mask](Napi::Env env, Napi::Function jsCallback)
+	{
+		jsCallback.Call({Napi::Number::New(env, mask->exchange(0))});
+	});
+}
+
+/**
+ * @brief Waits until the next slot of a lane has been released by the verdict thread.
+ */
+bool WinDivert::AcquireSlot(PacketRingLane *lane)
+{
+	std::unique_lock<std::mutex> lock(this->ringMutex);
+	while (!lane->CanPublish())
+	{
+		if (this->closeFlag == 1)
+		{
+			return false;
+		}
+		this->ringCond.wait_for(lock, std::chrono::milliseconds(1));
+	}
+	return true;
+}
+
+/**
+ * @brief Receives packet batches and distributes them over the ring lanes.
+ * Packets larger than a slot are reinjected unchanged and counted in RING_OVERSIZE.
+ */
+void WinDivert::ReceiveToRing()
+{
+	const UINT batchBytes = std::max<UINT>(MAXBUF, RING_RECV_BATCH * BATCH_PACKET_RESERVE);
+	const bool reinject = (this->flags_ & (WINDIVERT_FLAG_SNIFF | WINDIVERT_FLAG_RECV_ONLY)) == 0;
+	std::vector<UINT8> data(batchBytes);
+	std::vector<WINDIVERT_ADDRESS> addrs(RING_RECV_BATCH);
+	SendBatch direct(this->handle_);
+
+	while (this->closeFlag == 0)
+	{
+		UINT recvLen = 0;
+		UINT addrLen = static_cast<UINT>(addrs.size() * sizeof(WINDIVERT_ADDRESS));
+		BOOL recv = WinDivertRecvEx(this->handle_, data.data(), batchBytes, &recvLen, 0, addrs.data(), &addrLen, NULL);
+		if (recv != 1)
+		{
+			DWORD error = GetLastError();
+			if (error == ERROR_NO_DATA)
+			{
+				if (this->SwitchHandle(direct))
+				{
+					continue;
+				}
+				break;
+			}
+			std::cerr << "Warning: Failed to read packet batch. Error code: " << error << std::endl;
+			continue;
+		}
+
+		const UINT count = addrLen / sizeof(WINDIVERT_ADDRESS);
+		if (this->pendingHandle_ != INVALID_HANDLE_VALUE)
+		{
+			this->drained_ += count;
+		}
+		const UINT64 now = this->stages_.Empty() ? 0 : GetTickCount64();
+		UINT32 published = 0;
+		UINT offset = 0;
+		for (UINT i = 0; i < count && offset < recvLen; i++)
+		{
+			UINT8 *packet = data.data() + offset;
+			const UINT length = PacketLength(packet, recvLen - offset);
+			offset += length;
+			if (!this->stages_.Empty() && !this->ProcessStages(packet, length, &addrs[i], now, direct))
+			{
+				continue;
+			}
+
+			const UINT32 index = this->SelectLane(packet, length, addrs[i]);
+			PacketRingLane *lane = this->ringLanes[index].get();
+			if (length > lane->Layout().slotSize)
+			{
+				if (reinject)
+				{
+					direct.Add(packet, length, addrs[i]);
+				}
+				lane->Count(RING_OVERSIZE, 1);
+				continue;
+			}
+			if (!lane->CanPublish())
+			{
+				// Let consumers see what is already published before blocking on them.
+				this->RingDoorbell(published);
+				published = 0;
+				if (!this->AcquireSlot(lane))
+				{
+					// Closing: still send what the stages already queued, closeFlag ends the outer loop.
+					break;
+				}
+			}
+			lane->Publish(packet, length, &addrs[i]);
+			published |= 1u << index;
+		}
+		direct.Flush();
+		if (!this->stages_.Empty())
+		{
+			this->stages_.Tick(now);
+		}
+		this->RingDoorbell(published);
+	}
+}
+
+/**
+ * @brief Receives packet batches and hands every packet to the sink.
+ * Nothing is queued for JavaScript: packets are counted, sampled and then either dropped or
+ * reinjected with one WinDivertSendEx per batch.
+ */
+void WinDivert::ReceiveToSink()
+{
+	const UINT batchBytes = std::max<UINT>(MAXBUF, WINDIVERT_BATCH_MAX * BATCH_PACKET_RESERVE);
+	const bool canReinject = (this->flags_ & (WINDIVERT_FLAG_SNIFF | WINDIVERT_FLAG_RECV_ONLY)) == 0;
+	const bool network = this->layer_ == WINDIVERT_LAYER_NETWORK || this->layer_ == WINDIVERT_LAYER_NETWORK_FORWARD;
+	std::vector<UINT8> data(batchBytes);
+	std::vector<WINDIVERT_ADDRESS> addrs(WINDIVERT_BATCH_MAX);
+	SendBatch direct(this->handle_);
+
+	while (this->closeFlag == 0)
+	{
+		UINT recvLen = 0;
+		UINT addrLen = static_cast<UINT>(addrs.size() * sizeof(WINDIVERT_ADDRESS));
+		BOOL recv = WinDivertRecvEx(this->handle_, data.data(), batchBytes, &recvLen, 0, addrs.data(), &addrLen, NULL);
+		if (recv != 1)
+		{
+			DWORD error = GetLastError();
+			if (error == ERROR_NO_DATA)
+			{
+				if (this->SwitchHandle(direct))
+				{
+					continue;
+				}
+				break;
+			}
+			std::cerr << "Warning: Failed to read packet batch. Error code: " << error << std::endl;
+			continue;
+		}
+
+		const UINT count = addrLen / sizeof(WINDIVERT_ADDRESS);
+		if (this->pendingHandle_ != INVALID_HANDLE_VALUE)
+		{
+			this->drained_ += count;
+		}
+		if (!network)
+		{
+			if (this->flowIndex_)
+			{
+				ApplyFlowEvents(*this->flowIndex_, addrs.data(), count);
+			}
+			for (UINT i = 0; i < count; i++)
+			{
+				this->sink_->Consume(data.data(), 0, addrs[i]);
+			}
+			continue;
+		}
+
+		const UINT64 now = this->stages_.Empty() ? 0 : GetTickCount64();
+		UINT offset = 0;
+		for (UINT i = 0; i < count && offset < recvLen; i++)
+		{
+			UINT8 *packet = data.data() + offset;
+			const UINT length = PacketLength(packet, recvLen - offset);
+			offset += length;
+			if (!this->stages_.Empty() && !this->ProcessStages(packet, length, &addrs[i], now, direct))
+			{
+				continue;
+			}
+			if (this->sink_->Consume(packet, length, addrs[i]) && canReinject)
+			{
+				direct.Add(packet, length, addrs[i]);
+			}
+		}
+		direct.Flush();
+		if (!this->stages_.Empty())
+		{
+			this->stages_.Tick(now);
+		}
+	}
+	this->sink_->Flush();
+}
+
+/**
+ * @brief Applies verdicts returned by lane consumers.
+ * Passed slots are taken straight from shared memory and injected in bulk with
+ * WinDivertSendEx, then released to the producer. The thread polls the lanes,
+ * yielding and then sleeping briefly while they are idle.
+ */
+void WinDivert::VerdictThreadFunction()
+{
+	const bool reinject = (this->flags_ & (WINDIVERT_FLAG_SNIFF | WINDIVERT_FLAG_RECV_ONLY)) == 0;
+	SendBatch batch(this->handle_);
+	UINT32 idle = 0;
+
+	while (this->closeFlag == 0)
+	{
+		const UINT32 generation = this->handleGeneration_;
+		if (generation != this->verdictGeneration_)
+		{
+			// The receive thread switched handles; stop injecting on the retired one, then let it be closed.
+			batch.SetHandle(this->handle_);
+			this->verdictGeneration_ = generation;
+			const UINT64 drainedAt = this->drainedAt_;
+			napi_status status = this->tsfn.BlockingCall([this, drainedAt](Napi::Env env, Napi::Function jsCallback)
+			{
+				this->FinishReplace(env, drainedAt);
+			});
+			if (status != napi_ok)
+			{
+				std::cerr << "Warning: Failed to call JavaScript callback. NAPI status: " << status << std::endl;
+			}
+		}
+		size_t applied = 0;
+		for (auto &lane : this->ringLanes)
+		{
+			PacketRingLane *current = lane.get();
+			applied += current->DrainVerdicts([&batch, current, reinject](UINT32 slot, UINT32 action, UINT32 newLength)
+			{
+				if (reinject && action != RING_ACTION_DROP)
+				{
+					UINT8 *packet = current->SlotData(slot);
+					WINDIVERT_ADDRESS *addr = reinterpret_cast<WINDIVERT_ADDRESS *>(current->SlotAddr(slot));
+					UINT length = current->SlotLength(slot);
+					if (newLength != 0 && newLength != length)
+					{
+						length = newLength;
+						SetPacketLength(packet, length);
+						action = RING_ACTION_PASS_CHECKSUM;
+					}
+					if (action == RING_ACTION_PASS_CHECKSUM)
+					{
+						WinDivertHelperCalcChecksums(packet, length, addr, 0);
+					}
+					batch.Add(packet, length, *addr);
+				}
+				current->Release(slot);
+			});
+		}
+		batch.Flush();
+		if (applied > 0)
+		{
+			idle = 0;
+			this->ringCond.notify_one();
+		}
+		else if (++idle < 64)
+		{
+			std::this_thread::yield();
+		}
+		else
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(idle < 1024 ? 50 : 1000));
+		}
 	}
+	this->tsfn.Release();
 }
 
 /**
@@ -415,6 +1673,24 @@ void WinDivert::ThreadFunction()
  */
 Napi::Object InitAll(Napi::Env env, Napi::Object exports)
 {
+	FlowIndexWrap::Init(env, exports);
+	NatWrap::Init(env, exports);
+	ShaperWrap::Init(env, exports);
+	PolicerWrap::Init(env, exports);
+	SamplerWrap::Init(env, exports);
+	FlowCacheWrap::Init(env, exports);
+	HttpRewriterWrap::Init(env, exports);
+	SeqTrackerWrap::Init(env, exports);
+	FakeInjectorWrap::Init(env, exports);
+	HopEstimatorWrap::Init(env, exports);
+	FragmenterWrap::Init(env, exports);
+	DisorderWrap::Init(env, exports);
+	TcpOptionRewriterWrap::Init(env, exports);
+	CompiledFilterWrap::Init(env, exports);
+	PipelineWrap::Init(env, exports);
+#ifdef WINDIVERT_MOCK
+	InitMock(env, exports);
+#endif
 	return WinDivert::Init(env, exports);
 }
 NODE_API_MODULE(addon, InitAll)
\ No newline at end of file
@@ -3,8 +3,13 @@
  * @description A Node.js binding for WinDivert driver to capture and modify network packets
  */
 
-const wd = require('bindings')('WinDivert');
-const { HeaderReader, BYTESWAP16 } = require('./decoders.js');
+const wd = require('bindings')('windivert');
+const { HeaderReader, BYTESWAP16, AddressColumns, ADDRESS_FLAGS, ADDRESS_KIND } = require('./decoders.js');
+const { ADDRESS_SIZE, PacketBatch, packets, createPacketStream } = require('./batch.js');
+const { RING, VERDICT, AFFINITY, PacketRing, attachRing } = require('./ring.js');
+const { FilterCache } = require('./filter-cache.js');
+const { FilterNarrower, flowOf } = require('./filter-narrower.js');
+const { PipelineBatch, createPipelineStream, reinject } = require('./pipeline.js');
 
 /**
  * @constant {Object} FLAGS
@@ -82,33 +87,112 @@ async function checkAdmin() {
  * @async
  * @function createWindivert
  * @description Creates a new WinDivert handle
- * @param {string} filter - WinDivert filter string
+ * @param {string|CompiledFilter} filter - WinDivert filter string, or a filter compiled ahead of time
  * @param {number} layer - WinDivert layer
  * @param {number} flag - WinDivert flags
+ * @param {number} [priority=0] - Handle priority, -30000..30000; replaceFilter() raises it by one each time
  * @returns {Promise<Object>} WinDivert handle
  * @throws {Error} Throws an error if not running as administrator
  */
-async function createWindivert(filter, layer, flag) {
+async function createWindivert(filter, layer, flag, priority) {
 	await checkAdmin();
-	return new wd.WinDivert(filter, layer, flag);
+	return new wd.WinDivert(filter, layer, flag, priority);
 };
 
 /**
  * @function addReceiveListener
- * @description Adds a packet receive listener to a WinDivert handle
+ * @description Adds a packet receive listener to a WinDivert handle.
+ * By default the listener gets its own packet and addr Buffers and each decision is sent with one
+ * send() call. With verdictRing, packets are delivered through a single-lane PacketRing consumed on
+ * the main thread and the decisions are written to the lane's verdict ring, which the native side
+ * applies in bulk; the packet and addr views are then only valid until the listener returns.
  * @param {Object} handle - WinDivert handle
  * @param {Function} callback - Callback function to process packets
  * @param {Buffer} callback.packet - The received packet
  * @param {Object} callback.addr - The packet address information
+ * @param {Object} [options]
+ * @param {boolean} [options.verdictRing=false] - Use the verdict ring instead of one send() per packet
+ * @param {number} [options.slots=1024] - Ring slots, a power of two
+ * @param {number} [options.slotSize=2048] - Bytes per slot, larger packets are reinjected natively
  * @returns {Buffer|undefined} Modified packet or undefined to use original packet
  */
-function addReceiveListener(handle, callback) {
+function addReceiveListener(handle, callback, { verdictRing = false, slots = 1024, slotSize = 2048 } = {}) {
+	if (!verdictRing) {
+		addSendListener(handle, callback);
+		return;
+	}
+	try {
+		const ring = new PacketRing({ lanes: 1, slots, slotSize });
+		const lane = ring.lane(0);
+		// The consumer never sleeps in Atomics.wait, so keep WAITING set and let every batch ring the doorbell.
+		Atomics.store(lane.control, RING.WAITING, 1);
+		handle.recvRing(
+			() => drainVerdictLane(handle, lane, callback),
+			[new Uint8Array(ring.buffers[0])],
+			slots,
+			slotSize,
+			AFFINITY.ROUND_ROBIN
+		);
+	} catch (error) {
+		console.error(error);
+	}
+};
+
+/**
+ * @function drainVerdictLane
+ * @description Runs the listener for every published slot and writes its verdict
+ * @private
+ * @param {Object} handle - WinDivert handle
+ * @param {RingLane} lane - Lane consumed on this thread
+ * @param {Function} callback - Listener given to addReceiveListener
+ */
+function drainVerdictLane(handle, lane, callback) {
+	for (let slot = lane.next(0); slot !== -1; slot = lane.next(0)) {
+		const packet = lane.packet(slot);
+		const addr = lane.addr(slot);
+		let newPacket;
+		try {
+			newPacket = callback(packet, addr);
+		} catch (error) {
+			console.error("Recv Error:", error);
+			lane.drop(slot);
+			continue;
+		}
+		if (newPacket === undefined) {
+			lane.pass(slot);
+		} else if (newPacket === packet) {
+			lane.passModified(slot);
+		} else if (Buffer.isBuffer(newPacket) && newPacket.length <= lane.slotSize) {
+			newPacket.copy(Buffer.from(lane.buffer, lane.layout.dataOffset + slot * lane.slotSize, lane.slotSize));
+			lane.passModified(slot, newPacket.length);
+		} else {
+			if (Buffer.isBuffer(newPacket)) {
+				try {
+					handle.HelperCalcChecksums({ packet: newPacket }, 0);
+					handle.send({ packet: newPacket, addr: Buffer.from(addr) });
+				} catch (error) {
+					console.error("Recv Error:", error);
+				}
+			}
+			lane.drop(slot);
+		}
+	}
+}
+
+/**
+ * @function addSendListener
+ * @description Default listener that reinjects each packet with its own send() call
+ * @private
+ * @param {Object} handle - WinDivert handle
+ * @param {Function} callback - Listener given to addReceiveListener
+ */
+function addSendListener(handle, callback) {
 	try {
 		handle.recv(function (packet, addr) {
 			const newPacket = callback(packet, addr);
 			if (Buffer.isBuffer(newPacket)) {
 				try {
-					handle.HelperCalcChecksums(newPacket, 0);
+					handle.HelperCalcChecksums({ packet: newPacket }, 0);
 					handle.send({ packet: newPacket, addr })
 				} catch (error) {
 					console.error("Recv Error:", error);
@@ -120,8 +204,80 @@ function addReceiveListener(handle, callback) {
 	} catch (error) {
 		console.error(error);
 	}
+}
+
+/**
+ * @method packets
+ * @memberof WinDivert
+ * @description Returns an async iterator of PacketBatch objects, see batch.js
+ * @param {Object} [options] - { batchSize, highWaterMark }
+ * @returns {AsyncIterableIterator<PacketBatch>}
+ */
+wd.WinDivert.prototype.packets = function (options) {
+	return packets(this, options);
+};
+
+/**
+ * @method createReadStream
+ * @memberof WinDivert
+ * @description Returns an object mode Readable of PacketBatch objects, see batch.js
+ * @param {Object} [options] - { batchSize, highWaterMark }
+ * @returns {Readable}
+ */
+wd.WinDivert.prototype.createReadStream = function (options) {
+	return createPacketStream(this, options);
+};
+
+/**
+ * @method attachRing
+ * @memberof WinDivert
+ * @description Delivers packets into the SharedArrayBuffer lanes of a PacketRing, see ring.js
+ * @param {PacketRing} ring - Ring whose lanes are consumed by worker_threads
+ * @param {Object} [options] - { affinity }
+ */
+wd.WinDivert.prototype.attachRing = function (ring, options) {
+	attachRing(this, ring, options);
 };
 
+/**
+ * @method createReadStream
+ * @memberof Pipeline
+ * @description Starts the pipeline and returns an object mode Readable of PipelineBatch objects, see pipeline.js
+ * @param {Object} [options] - { highWaterMark }
+ * @returns {Readable}
+ */
+wd.Pipeline.prototype.createReadStream = function (options) {
+	return createPipelineStream(this, options);
+};
+
+/**
+ * @method reinject
+ * @memberof Pipeline
+ * @description Sends every packet of a PipelineBatch back through the handle it was read from
+ * @param {PipelineBatch} batch
+ * @returns {number} Packets accepted by the driver
+ */
+wd.Pipeline.prototype.reinject = function (batch) {
+	return reinject(this, batch);
+};
+
+/**
+ * @function trackFlows
+ * @description Keeps a FlowIndex up to date from a FLOW or SOCKET layer handle.
+ * Events are received in batches and applied to the index natively; the returned stream
+ * still yields the PacketBatch of every event batch (see batch.columns) and is drained
+ * automatically unless the caller consumes it.
+ * @param {Object} handle - Opened FLOW or SOCKET layer handle (SNIFF | RECV_ONLY)
+ * @param {FlowIndex} index - Index shared with NETWORK layer handles
+ * @param {Object} [options]
+ * @param {number} [options.batchSize=255] - Maximum events per batch
+ * @returns {Readable} Stream of event batches
+ */
+function trackFlows(handle, index, { batchSize = 255 } = {}) {
+	handle.attachFlowIndex(index);
+	return handle.createReadStream({ batchSize }).resume();
+}
+
 /**
  * @exports windivert
  */
@@ -131,6 +287,35 @@ module.exports = {
 	PROTOCOLS,
 	createWindivert,
 	addReceiveListener,
+	trackFlows,
+	FlowIndex: wd.FlowIndex,
+	Nat: wd.Nat,
+	Shaper: wd.Shaper,
+	Policer: wd.Policer,
+	Sampler: wd.Sampler,
+	FlowCache: wd.FlowCache,
+	HttpRewriter: wd.HttpRewriter,
+	SeqTracker: wd.SeqTracker,
+	FakeInjector: wd.FakeInjector,
+	HopEstimator: wd.HopEstimator,
+	Fragmenter: wd.Fragmenter,
+	Disorder: wd.Disorder,
+	TcpOptionRewriter: wd.TcpOptionRewriter,
+	CompiledFilter: wd.CompiledFilter,
+	FilterCache,
+	FilterNarrower,
+	flowOf,
+	Pipeline: wd.Pipeline,
+	PipelineBatch,
+	ADDRESS_SIZE,
+	PacketBatch,
+	RING,
+	VERDICT,
+	AFFINITY,
+	PacketRing,
 	HeaderReader,
-	BYTESWAP16
+	BYTESWAP16,
+	AddressColumns,
+	ADDRESS_FLAGS,
+	ADDRESS_KIND
 };